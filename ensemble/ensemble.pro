@@ -1,3 +1,41 @@
 #TEMPLATE = lib
 #CONFIG = dll
 #VERSION = 0.0.1
+TEMPLATE = lib
+CONFIG += staticlib debug
+CONFIG -= qt
+CONFIG += c++11
+
+INCLUDEPATH += ../tree
+
+SOURCES += gradientboosting.cpp \
+    hyperparametersearch.cpp \
+    ../tree/criterion.cpp \
+    ../tree/splitter.cpp \
+    ../tree/treebuilder.cpp \
+    ../tree/basetree.cpp \
+    ../tree/tree.cpp \
+    ../tree/util.cpp \
+    ../tree/binnedmatrix.cpp \
+    ../tree/arena.cpp \
+    ../tree/crossvalidation.cpp \
+    ../tree/transport.cpp \
+    ../tree/hoeffdingtree.cpp \
+    ../tree/numa.cpp \
+    ../tree/compressedtree.cpp \
+    ../tree/treedag.cpp
+
+HEADERS += gradientboosting.h \
+    hyperparametersearch.h
+
+LIBS += -L/usr/local/lib
+LIBS += -lopencv_core
+
+# parallel_for runs on std::thread
+QMAKE_CXXFLAGS += -pthread
+LIBS += -pthread
+
+# shm_open of SharedMemoryTransport
+LIBS += -lrt
+
+TARGET = ensemble
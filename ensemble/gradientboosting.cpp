@@ -0,0 +1,516 @@
+#include "gradientboosting.h"
+#include "basetree.h"
+#include "util.h"
+#include "treedag.h"
+#include <cmath>
+
+GradientBoostingRegressor::GradientBoostingRegressor(int n_estimators,
+                                                     double learning_rate,
+                                                     int max_depth,
+                                                     int min_samples_split,
+                                                     int min_samples_leaf,
+                                                     int max_features,
+                                                     int random_state,
+                                                     bool warm_start)
+    : _n_estimators(n_estimators),
+      _learning_rate(learning_rate),
+      _max_depth(max_depth),
+      _min_samples_split(min_samples_split),
+      _min_samples_leaf(min_samples_leaf),
+      _max_features(max_features),
+      _random_state(random_state),
+      _warm_start(warm_start),
+      _init(0.0),
+      _dag(NULL)
+{
+
+}
+
+GradientBoostingRegressor::~GradientBoostingRegressor()
+{
+    clear();
+}
+
+void GradientBoostingRegressor::clear()
+{
+    for (size_t i = 0; i < _estimators.size(); i++)
+        delete _estimators[i];
+    _estimators.clear();
+    delete _dag;
+    _dag = NULL;
+    _train_score.clear();
+    _raw_predictions = Mat();
+    _init = 0.0;
+}
+
+int GradientBoostingRegressor::fit(Mat X,
+                                   Mat y,
+                                   Mat sample_weight,
+                                   bool same_training_set)
+{
+    // Validation
+    if (X.rows == 0 || X.cols == 0)
+        return 1;
+    if (static_cast<int>(y.total()) != X.rows)
+        return 2;
+    if (sample_weight.total() != 0 && static_cast<int>(sample_weight.total()) != X.rows)
+        return 2;
+    if (_n_estimators < 1 || _learning_rate <= 0.0)
+        return 3;
+
+    to_target(y);
+    to_target(sample_weight);
+
+    if (X.depth() != CV_32F && X.depth() != CV_64F)
+        X.convertTo(X, CV_64F);
+
+    int n_samples = X.rows;
+    bool empty_weight = (sample_weight.total() == 0);
+
+    if (!_warm_start || _estimators.empty())
+    {
+        clear();
+
+        // The first prediction is the weighted mean
+        double weight_sum = 0.0;
+        for (int i = 0; i < n_samples; i++)
+        {
+            double w = empty_weight ? 1.0 : sample_weight.at<double>(i);
+            _init += w * y.at<double>(i);
+            weight_sum += w;
+        }
+        _init /= weight_sum;
+
+        _raw_predictions = Mat(n_samples, 1, CV_64F);
+        for (int i = 0; i < n_samples; i++)
+            _raw_predictions.at<double>(i) = _init;
+    }
+    else
+    {
+        // Warm start
+        if (_n_estimators < static_cast<int>(_estimators.size()))
+            return 3;
+
+        // Unless the caller vouches for the rows of the previous fit, X goes
+        // through the fitted stages once
+        if (!same_training_set || _raw_predictions.rows != X.rows)
+            _raw_predictions = _raw_predict(X);
+    }
+
+    Mat residual(n_samples, 1, CV_64F);
+    for (int stage = static_cast<int>(_estimators.size()); stage < _n_estimators; stage++)
+    {
+        // The negative gradient of the squared error
+        for (int i = 0; i < n_samples; i++)
+            residual.at<double>(i) = y.at<double>(i) - _raw_predictions.at<double>(i);
+
+        DecisionTreeRegressor* tree = new DecisionTreeRegressor((char*)"FriedmanMSE",
+                                                                (char*)"Best",
+                                                                _max_depth,
+                                                                _min_samples_split,
+                                                                _min_samples_leaf,
+                                                                0.0,
+                                                                _max_features,
+                                                                0,
+                                                                _random_state + stage,
+                                                                Mat());
+        tree->_arena = &_arena;
+        int error = tree->fit(X, residual, sample_weight);
+        if (error != 0)
+        {
+            delete tree;
+            return error;
+        }
+        _estimators.push_back(tree);
+
+        // Update the raw predictions and the training score
+        Mat stage_prediction = tree->predict(X);
+        double loss = 0.0;
+        double weight_sum = 0.0;
+        for (int i = 0; i < n_samples; i++)
+        {
+            double w = empty_weight ? 1.0 : sample_weight.at<double>(i);
+            double& raw = _raw_predictions.at<double>(i);
+            raw += _learning_rate * stage_prediction.at<double>(i);
+            loss += w * (y.at<double>(i) - raw) * (y.at<double>(i) - raw);
+            weight_sum += w;
+        }
+        _train_score.push_back(loss / weight_sum);
+    }
+
+    // Keep a compacted model whole: the new stages join the DAG
+    if (_dag != NULL && _dag->_roots.size() < _estimators.size())
+    {
+        bool is_released = (_estimators[0]->_tree == NULL);
+        vector<const Tree*> trees;
+        for (size_t s = _dag->_roots.size(); s < _estimators.size(); s++)
+            trees.push_back(_estimators[s]->_tree);
+        _dag->add_trees(trees);
+        for (size_t s = _estimators.size() - trees.size(); is_released && s < _estimators.size(); s++)
+        {
+            delete _estimators[s]->_tree;
+            _estimators[s]->_tree = NULL;
+        }
+    }
+    return 0;
+}
+
+Mat GradientBoostingRegressor::_raw_predict(Mat X)
+{
+    if (_dag != NULL)
+    {
+        int dtype = _estimators[0]->_dtype;
+        if (X.depth() != dtype)
+            X.convertTo(X, dtype);
+        if (dtype == CV_32F)
+            return _dag->predict_sum(as_view<float>(X), _init, _learning_rate);
+        return _dag->predict_sum(as_view<double>(X), _init, _learning_rate);
+    }
+
+    Mat raw(X.rows, 1, CV_64F);
+    for (int i = 0; i < X.rows; i++)
+        raw.at<double>(i) = _init;
+
+    for (size_t s = 0; s < _estimators.size(); s++)
+    {
+        Mat stage_prediction = _estimators[s]->predict(X);
+        for (int i = 0; i < X.rows; i++)
+            raw.at<double>(i) += _learning_rate * stage_prediction.at<double>(i);
+    }
+    return raw;
+}
+
+Mat GradientBoostingRegressor::predict(Mat X)
+{
+    return _raw_predict(X);
+}
+
+Mat GradientBoostingRegressor::partial_dependence(const vector<int>& features,
+                                                  Mat grid,
+                                                  int n_threads)
+{
+    if (_estimators.empty())
+        return Mat();
+
+    // The raw prediction is linear in the stages, so is its average
+    Mat pd(grid.rows, 1, CV_64F);
+    for (int g = 0; g < grid.rows; g++)
+        pd.at<double>(g) = _init;
+    for (size_t s = 0; s < _estimators.size(); s++)
+    {
+        Mat stage_pd = _estimators[s]->partial_dependence(features, grid, n_threads);
+        if (stage_pd.empty())
+            return Mat();
+        for (int g = 0; g < grid.rows; g++)
+            pd.at<double>(g) += _learning_rate * stage_pd.at<double>(g);
+    }
+    return pd;
+}
+
+int GradientBoostingRegressor::compact(bool release_stages)
+{
+    if (_estimators.empty())
+        return 1;
+    if (!_has_trees())
+        return 2;
+
+    vector<const Tree*> trees(_estimators.size());
+    for (size_t s = 0; s < _estimators.size(); s++)
+        trees[s] = _estimators[s]->_tree;
+    TreeDag* dag = new TreeDag();
+    int error_code = dag->add_trees(trees);
+    if (error_code != 0)
+    {
+        delete dag;
+        return 2;
+    }
+    delete _dag;
+    _dag = dag;
+
+    if (release_stages)
+    {
+        for (size_t s = 0; s < _estimators.size(); s++)
+        {
+            delete _estimators[s]->_tree;
+            _estimators[s]->_tree = NULL;
+        }
+    }
+    return 0;
+}
+
+bool GradientBoostingRegressor::_has_trees() const
+{
+    for (size_t s = 0; s < _estimators.size(); s++)
+    {
+        if (_estimators[s]->_tree == NULL)
+            return false;
+    }
+    return true;
+}
+
+int GradientBoostingRegressor::compress(ThresholdCoding coding,
+                                        CompressionReport& report,
+                                        Mat X_check,
+                                        bool release_stages)
+{
+    report = CompressionReport();
+    if (_estimators.empty())
+        return 1;
+
+    Mat original;
+    if (!X_check.empty())
+        original = _raw_predict(X_check);
+
+    for (size_t s = 0; s < _estimators.size(); s++)
+    {
+        CompressionReport stage_report;
+        if (_estimators[s]->compress(coding, stage_report) != 0)
+            return 2;
+        report.original_bytes += stage_report.original_bytes;
+        report.compressed_bytes += stage_report.compressed_bytes;
+        report.max_threshold_shift = std::max(report.max_threshold_shift, stage_report.max_threshold_shift);
+        report.value_error_bound += _learning_rate * stage_report.value_error_bound;
+    }
+
+    if (release_stages)
+    {
+        for (size_t s = 0; s < _estimators.size(); s++)
+        {
+            delete _estimators[s]->_tree;
+            _estimators[s]->_tree = NULL;
+        }
+    }
+
+    // The stages predict with their compressed tree once released
+    if (!X_check.empty())
+    {
+        Mat raw(X_check.rows, 1, CV_64F);
+        for (int i = 0; i < X_check.rows; i++)
+            raw.at<double>(i) = _init;
+        for (size_t s = 0; s < _estimators.size(); s++)
+        {
+            DecisionTreeRegressor* stage = _estimators[s];
+            Mat X = X_check;
+            if (X.depth() != stage->_dtype)
+                X.convertTo(X, stage->_dtype);
+            Mat stage_prediction = (stage->_dtype == CV_32F) ? stage->_compressed->predict(as_view<float>(X))
+                                                             : stage->_compressed->predict(as_view<double>(X));
+            for (int i = 0; i < X_check.rows; i++)
+                raw.at<double>(i) += _learning_rate * stage_prediction.at<double>(i);
+        }
+        for (int i = 0; i < X_check.rows; i++)
+            report.max_error = std::max(report.max_error, std::fabs(raw.at<double>(i) - original.at<double>(i)));
+        report.n_checked = X_check.rows;
+    }
+    return 0;
+}
+
+int GradientBoostingRegressor::bin_thresholds(const BinnedMatrix& quantizer)
+{
+    if (_estimators.empty())
+        return 1;
+
+    for (size_t s = 0; s < _estimators.size(); s++)
+    {
+        int error_code = _estimators[s]->bin_thresholds(quantizer);
+        if (error_code != 0)
+            return error_code;
+    }
+    return 0;
+}
+
+/**
+ * @brief init + learning_rate * the sum of the stages' predictions of the codes
+ */
+template <typename CODE>
+static Mat predict_binned_stages(const vector<DecisionTreeRegressor*>& estimators,
+                                 double init,
+                                 double learning_rate,
+                                 DataView<CODE> codes,
+                                 int n_threads)
+{
+    if (estimators.empty())
+        return Mat();
+
+    Mat raw(codes.rows, 1, CV_64F);
+    for (int i = 0; i < codes.rows; i++)
+        raw.at<double>(i) = init;
+    for (size_t s = 0; s < estimators.size(); s++)
+    {
+        Mat stage_prediction = estimators[s]->predict_binned(codes, n_threads);
+        if (stage_prediction.empty())
+            return Mat();
+        for (int i = 0; i < codes.rows; i++)
+            raw.at<double>(i) += learning_rate * stage_prediction.at<double>(i);
+    }
+    return raw;
+}
+
+Mat GradientBoostingRegressor::predict_binned(DataView<uint8_t> codes,
+                                              int n_threads)
+{
+    return predict_binned_stages(_estimators, _init, _learning_rate, codes, n_threads);
+}
+
+Mat GradientBoostingRegressor::predict_binned(DataView<uint16_t> codes,
+                                              int n_threads)
+{
+    return predict_binned_stages(_estimators, _init, _learning_rate, codes, n_threads);
+}
+
+/**
+ * @brief Leaf of every row of X in every stage, shape = [n_samples, n_stages]
+ */
+template <typename DTYPE>
+static Mat apply_stages(const vector<DecisionTreeRegressor*>& estimators,
+                        DataView<DTYPE> X,
+                        int n_threads)
+{
+    int n_stages = static_cast<int>(estimators.size());
+    Mat leaves(X.rows, n_stages, CV_32S);
+    parallel_for(X.rows, n_threads, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+        {
+            int* row = leaves.ptr<int>(i);
+            for (int s = 0; s < n_stages; s++)
+                row[s] = estimators[s]->_tree->_find_leaf(X, i);
+        }
+    });
+    return leaves;
+}
+
+/**
+ * @brief Decision path of every row of X through all the stages, in two
+ * passes: the path lengths, then the node ids
+ */
+template <typename DTYPE>
+static CsrMatrix decision_path_stages(const vector<DecisionTreeRegressor*>& estimators,
+                                      DataView<DTYPE> X,
+                                      const vector<int>& n_nodes_ptr,
+                                      int n_threads)
+{
+    int n_samples = X.rows;
+    int n_stages = static_cast<int>(estimators.size());
+    CsrMatrix path;
+    path.rows = n_samples;
+    path.cols = n_nodes_ptr[n_stages];
+    path.indptr.assign(n_samples + 1, 0);
+
+    parallel_for(n_samples, n_threads, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+        {
+            long long length = 0;
+            for (int s = 0; s < n_stages; s++)
+                length += estimators[s]->_tree->path_length(X, i);
+            path.indptr[i + 1] = length;
+        }
+    });
+    for (int i = 0; i < n_samples; i++)
+        path.indptr[i + 1] += path.indptr[i];
+    path.indices.resize(path.indptr[n_samples]);
+    parallel_for(n_samples, n_threads, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+        {
+            int* row = &path.indices[path.indptr[i]];
+            for (int s = 0; s < n_stages; s++)
+                row += estimators[s]->_tree->write_path(X, i, n_nodes_ptr[s], row);
+        }
+    });
+    return path;
+}
+
+/**
+ * @brief One-hot leaf embedding of X, n_stages columns per row
+ */
+template <typename DTYPE>
+static CsrMatrix leaf_embedding_stages(const vector<DecisionTreeRegressor*>& estimators,
+                                       DataView<DTYPE> X,
+                                       int n_threads)
+{
+    int n_samples = X.rows;
+    int n_stages = static_cast<int>(estimators.size());
+
+    // Leaf numbers of every stage, offset by the leaves of the stages before
+    vector<vector<int> > ordinal(n_stages);
+    vector<int> leaf_offset(n_stages + 1, 0);
+    for (int s = 0; s < n_stages; s++)
+        leaf_offset[s + 1] = leaf_offset[s] + estimators[s]->_tree->leaf_ordinals(ordinal[s]);
+
+    CsrMatrix embedding;
+    embedding.rows = n_samples;
+    embedding.cols = leaf_offset[n_stages];
+    embedding.indptr.resize(n_samples + 1);
+    for (int i = 0; i <= n_samples; i++)
+        embedding.indptr[i] = static_cast<long long>(i) * n_stages;
+    embedding.indices.resize(embedding.indptr[n_samples]);
+    parallel_for(n_samples, n_threads, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+        {
+            int* row = &embedding.indices[embedding.indptr[i]];
+            for (int s = 0; s < n_stages; s++)
+                row[s] = leaf_offset[s] + ordinal[s][estimators[s]->_tree->_find_leaf(X, i)];
+        }
+    });
+    return embedding;
+}
+
+Mat GradientBoostingRegressor::apply(Mat X,
+                                     int n_threads)
+{
+    if (_estimators.empty() || !_has_trees())
+        return Mat();
+
+    // The stages share the feature type of the training set
+    int dtype = _estimators[0]->_dtype;
+    if (X.depth() != dtype)
+        X.convertTo(X, dtype);
+    if (dtype == CV_32F)
+        return apply_stages(_estimators, as_view<float>(X), n_threads);
+    return apply_stages(_estimators, as_view<double>(X), n_threads);
+}
+
+CsrMatrix GradientBoostingRegressor::decision_path(Mat X,
+                                                   vector<int>& n_nodes_ptr,
+                                                   int n_threads)
+{
+    if (!_has_trees())
+    {
+        n_nodes_ptr.assign(1, 0);
+        CsrMatrix path;
+        path.rows = X.rows;
+        path.cols = 0;
+        path.indptr.assign(X.rows + 1, 0);
+        return path;
+    }
+
+    n_nodes_ptr.assign(_estimators.size() + 1, 0);
+    for (size_t s = 0; s < _estimators.size(); s++)
+        n_nodes_ptr[s + 1] = n_nodes_ptr[s] + _estimators[s]->_tree->_node_count;
+
+    int dtype = _estimators.empty() ? CV_64F : _estimators[0]->_dtype;
+    if (X.depth() != dtype)
+        X.convertTo(X, dtype);
+    if (dtype == CV_32F)
+        return decision_path_stages(_estimators, as_view<float>(X), n_nodes_ptr, n_threads);
+    return decision_path_stages(_estimators, as_view<double>(X), n_nodes_ptr, n_threads);
+}
+
+CsrMatrix GradientBoostingRegressor::leaf_embedding(Mat X,
+                                                    int n_threads)
+{
+    if (!_has_trees())
+    {
+        CsrMatrix embedding;
+        embedding.rows = X.rows;
+        embedding.cols = 0;
+        embedding.indptr.assign(X.rows + 1, 0);
+        return embedding;
+    }
+
+    int dtype = _estimators.empty() ? CV_64F : _estimators[0]->_dtype;
+    if (X.depth() != dtype)
+        X.convertTo(X, dtype);
+    if (dtype == CV_32F)
+        return leaf_embedding_stages(_estimators, as_view<float>(X), n_threads);
+    return leaf_embedding_stages(_estimators, as_view<double>(X), n_threads);
+}
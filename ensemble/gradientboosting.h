@@ -0,0 +1,202 @@
+#ifndef GRADIENTBOOSTING_H
+#define GRADIENTBOOSTING_H
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "tree.h"
+#include "arena.h"
+
+using std::vector;
+using cv::Mat;
+
+class TreeDag;
+
+class GradientBoostingRegressor
+{
+public:
+    /**
+     * @brief Gradient boosting for least squares regression. Each stage fits
+     * a FriedmanMSE regression tree on the residuals of the previous stages.
+     * @param n_estimators Number of boosting stages
+     * @param learning_rate Shrinkage of the contribution of each tree
+     * @param max_depth
+     * @param min_samples_split
+     * @param min_samples_leaf
+     * @param max_features
+     * @param random_state Stage i uses random_state + i
+     * @param warm_start Let fit append stages to the fitted ones, until
+     * n_estimators, instead of starting over
+     */
+    GradientBoostingRegressor(int n_estimators,
+                              double learning_rate,
+                              int max_depth,
+                              int min_samples_split,
+                              int min_samples_leaf,
+                              int max_features,
+                              int random_state,
+                              bool warm_start);
+    ~GradientBoostingRegressor();
+
+    /**
+     * @brief Fit the stages on the training set (X, y).
+     * With warm_start, the stages already fitted are kept and only the
+     * missing ones are fitted, on the raw predictions of X by the fitted
+     * stages.
+     * @param X The training input samples, shape = [n_samples, n_features]
+     * @param y The target values, shape = [n_samples]
+     * @param sample_weight Sample weights. If total size equals to zero, then samples are equally weighted.
+     * @param same_training_set With warm_start, the caller guarantees that X
+     * holds the same rows as in the previous fit, so that their raw
+     * predictions are reused instead of running the earlier stages again.
+     * @return error_code, 3 if warm_start asks for fewer stages than fitted
+     */
+    int fit(Mat X,
+            Mat y,
+            Mat sample_weight,
+            bool same_training_set=false);
+
+    /**
+     * @brief Predict regression values of X.
+     * @param X The input samples, shape = [n_samples, n_features]
+     * @return The predicted values, shape = [n_samples, 1]
+     */
+    Mat predict(Mat X);
+
+    /**
+     * @brief Partial dependence of the predictions on the target features:
+     * init + learning_rate * the sum of the partial dependences of the
+     * stages, each one computed by the weighted tree recursion.
+     * @param features Target features, one or two for a plot
+     * @param grid Values of the target features, shape = [n_grid, n_target_features]
+     * @param n_threads Number of threads, 0 for all the cores
+     * @return shape = [n_grid, 1], empty if not fitted or the features do not match the grid
+     */
+    Mat partial_dependence(const vector<int>& features,
+                           Mat grid,
+                           int n_threads=1);
+
+    /**
+     * @brief Share the identical subtrees of the stages in a TreeDag, which
+     * predict then walks instead of the stages. Stages fitted later by a
+     * warm start join it.
+     * @param release_stages Free the trees of the stages, leaving the DAG
+     * the only copy of the model; apply, decision_path and leaf_embedding
+     * then see no stage
+     * @return error_code, 1 if not fitted, 2 if a stage has no tree, e.g. released by compress
+     */
+    int compact(bool release_stages=false);
+
+    /**
+     * @brief Compress every stage for serving, see CompressedTree. The leaf
+     * errors of the stages add up: the error bound is learning_rate times
+     * the sum of the bounds of the stages.
+     * @param coding THRESHOLD_FLOAT32 or THRESHOLD_INDEX
+     * @param report Sizes, threshold shift and error bound of the compression
+     * @param X_check Samples the error is measured on, none if empty
+     * @param release_stages Free the trees of the stages, predict then reading
+     * the compressed ones
+     * @return error_code, 1 if not fitted, 2 if a stage cannot be compressed
+     */
+    int compress(ThresholdCoding coding,
+                 CompressionReport& report,
+                 Mat X_check=Mat(),
+                 bool release_stages=false);
+
+    /**
+     * @brief Prepare predict_binned for the codes of quantizer in every stage.
+     * @param quantizer Bin edges of every feature, e.g. the BinnedMatrix of
+     * the training set, or one built by BinnedMatrix::set_edges from the
+     * thresholds of all the stages
+     * @return error_code, 1 if not fitted, else that of the first stage failing
+     */
+    int bin_thresholds(const BinnedMatrix& quantizer);
+
+    /**
+     * @brief Predict regression target of pre-binned X with integer
+     * comparisons only, equal to predict on the values the codes stand for.
+     * @param codes Bin codes given by the quantizer of bin_thresholds,
+     * shape = [n_samples, n_features]
+     * @param n_threads Number of threads, 0 for all the cores
+     * @return The predicted values, shape = [n_samples, 1]. Empty before bin_thresholds.
+     */
+    Mat predict_binned(DataView<uint8_t> codes,
+                       int n_threads=1);
+
+    /**
+     * @brief Predict regression target of pre-binned X, up to 65536 bins.
+     */
+    Mat predict_binned(DataView<uint16_t> codes,
+                       int n_threads=1);
+
+    /**
+     * @brief Leaf of every sample of X in every stage.
+     * @param X The input samples, shape = [n_samples, n_features]
+     * @param n_threads Number of threads, 0 for all the cores
+     * @return Node ids, shape = [n_samples, n_stages], CV_32S. Empty if not fitted.
+     */
+    Mat apply(Mat X,
+              int n_threads=1);
+
+    /**
+     * @brief Nodes every sample of X goes through in every stage, as a
+     * sparse indicator matrix, the nodes of stage s being the columns
+     * [n_nodes_ptr[s], n_nodes_ptr[s+1]).
+     * @param X The input samples, shape = [n_samples, n_features]
+     * @param n_nodes_ptr shape = [n_stages + 1]
+     * @param n_threads Number of threads, 0 for all the cores
+     * @return shape = [n_samples, n_nodes_ptr[n_stages]]
+     */
+    CsrMatrix decision_path(Mat X,
+                            vector<int>& n_nodes_ptr,
+                            int n_threads=1);
+
+    /**
+     * @brief One-hot embedding of the leaves of X, e.g. for a downstream
+     * linear model: row i has a 1 in the column of its leaf in every stage,
+     * the leaves of stage s being numbered from the number of leaves of the
+     * stages before it. Written row by row, without a dense matrix.
+     * @param X The input samples, shape = [n_samples, n_features]
+     * @param n_threads Number of threads, 0 for all the cores
+     * @return shape = [n_samples, total number of leaves], n_stages nonzeros per row
+     */
+    CsrMatrix leaf_embedding(Mat X,
+                             int n_threads=1);
+
+    /**
+     * @brief Release the fitted stages
+     */
+    void clear();
+
+private:
+    /**
+     * @brief init + learning_rate * the sum of the stages' predictions
+     */
+    Mat _raw_predict(Mat X);
+
+    /**
+     * @brief Whether every stage still holds its tree, see compact and compress
+     */
+    bool _has_trees() const;
+
+public:
+    int _n_estimators;
+    double _learning_rate;
+    int _max_depth;
+    int _min_samples_split;
+    int _min_samples_leaf;
+    int _max_features;
+    int _random_state;
+    bool _warm_start;
+
+    double _init;                               // Weighted mean of y, the prediction of no stage
+    vector<DecisionTreeRegressor*> _estimators; // The fitted stages
+    vector<double> _train_score;                // Weighted mean squared error after each stage
+
+    Mat _raw_predictions;                       // Raw predictions of the training set after the last stage
+
+    Arena _arena;                               // Scratch memory of the stages' fits
+
+    TreeDag* _dag;                              // Stages sharing their subtrees, NULL if not compacted
+};
+
+#endif // GRADIENTBOOSTING_H
@@ -0,0 +1,362 @@
+#include "hyperparametersearch.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+#include "tree.h"
+#include "basetree.h"
+#include "binnedmatrix.h"
+#include "crossvalidation.h"
+#include "gradientboosting.h"
+#include "util.h"
+
+SearchTrial::SearchTrial(char* criterion_name,
+                         char* splitter_name,
+                         int max_depth,
+                         int min_samples_split,
+                         int min_samples_leaf,
+                         double min_weight_fraction_leaf,
+                         int max_features,
+                         int max_leaf_nodes,
+                         int random_state,
+                         int is_classification,
+                         int n_estimators,
+                         double learning_rate)
+    : criterion_name(criterion_name),
+      splitter_name(splitter_name),
+      max_depth(max_depth),
+      min_samples_split(min_samples_split),
+      min_samples_leaf(min_samples_leaf),
+      min_weight_fraction_leaf(min_weight_fraction_leaf),
+      max_features(max_features),
+      max_leaf_nodes(max_leaf_nodes),
+      random_state(random_state),
+      is_classification(is_classification),
+      n_estimators(n_estimators),
+      learning_rate(learning_rate),
+      error(0),
+      score(0.0),
+      n_stages(0),
+      stopped(false),
+      memory_estimate(0)
+{
+
+}
+
+HyperparameterSearch::HyperparameterSearch(int n_threads,
+                                           size_t memory_budget,
+                                           int halving_factor)
+    : _n_threads(n_threads),
+      _memory_budget(memory_budget),
+      _halving_factor(halving_factor),
+      _peak_memory(0),
+      _numa_placement(NUMA_NONE)
+{
+
+}
+
+/**
+ * @brief Upper estimate of the memory of a trial beside the training set,
+ * which the trials share: the fit of its tree, or for a booster the fitted
+ * trees of all its stages, the scratch of the stage being fitted, which is
+ * freed once the stage is fitted, and the predictions and residuals kept
+ * between stages
+ * @param dtype Feature type, CV_32F or CV_64F
+ * @return Bytes
+ */
+static size_t trial_memory(const SearchTrial& trial,
+                           int n_samples,
+                           int n_features,
+                           int n_outputs,
+                           int n_classes,
+                           int dtype)
+{
+    if (trial.n_estimators <= 0)
+    {
+        BaseDecisionTree tree(trial.criterion_name,
+                              trial.splitter_name,
+                              trial.max_depth,
+                              trial.min_samples_split,
+                              trial.min_samples_leaf,
+                              trial.min_weight_fraction_leaf,
+                              trial.max_features,
+                              trial.max_leaf_nodes,
+                              trial.random_state,
+                              Mat(),
+                              trial.is_classification);
+        MemoryUsage usage = tree.estimate_fit_memory(n_samples, n_features, n_outputs, n_classes, dtype);
+        return usage.total() - usage.bytes("dataset");
+    }
+
+    // A stage as GradientBoostingRegressor::fit grows it
+    DecisionTreeRegressor stage((char*)"FriedmanMSE",
+                                (char*)"Best",
+                                trial.max_depth,
+                                trial.min_samples_split,
+                                trial.min_samples_leaf,
+                                0.0,
+                                trial.max_features,
+                                0,
+                                trial.random_state,
+                                Mat());
+    MemoryUsage usage = stage.estimate_fit_memory(n_samples, n_features, 1, n_classes, dtype);
+    size_t kept = usage.bytes("tree") + usage.bytes("sample_weight");
+    size_t scratch = usage.total() - usage.bytes("dataset") - kept;
+    return static_cast<size_t>(trial.n_estimators) * kept + scratch +
+           3 * static_cast<size_t>(n_samples) * sizeof(double);
+}
+
+/**
+ * @brief Run task(t) for every t of order on n_workers threads. The next
+ * trial of order starts once its memory fits in the budget left by the
+ * running ones, or when nothing runs.
+ * @param placement NUMA nodes of the workers
+ * @return The highest memory of the trials running together
+ */
+static size_t run_admitted(const vector<int>& order,
+                           const vector<SearchTrial>& trials,
+                           size_t memory_budget,
+                           int n_workers,
+                           NumaPlacement placement,
+                           const std::function<void(int)>& task)
+{
+    std::mutex lock;
+    std::condition_variable released;
+    size_t next = 0;
+    size_t in_use = 0;
+    size_t peak = 0;
+    int running = 0;
+
+    parallel_for(n_workers, n_workers, [&](int /*begin*/, int /*end*/) {
+        while (true)
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            released.wait(guard, [&]{
+                return next >= order.size() || running == 0 || memory_budget == 0 ||
+                       in_use + trials[order[next]].memory_estimate <= memory_budget;
+            });
+            if (next >= order.size())
+                return;
+            int t = order[next++];
+            in_use += trials[t].memory_estimate;
+            running += 1;
+            peak = std::max(peak, in_use);
+            guard.unlock();
+
+            task(t);
+
+            guard.lock();
+            in_use -= trials[t].memory_estimate;
+            running -= 1;
+            released.notify_all();
+        }
+    }, placement);
+    return peak;
+}
+
+/**
+ * @brief HyperparameterSearch::run on DTYPE features
+ */
+template <typename DTYPE>
+static int run_trials(HyperparameterSearch& search,
+                      vector<SearchTrial>& trials,
+                      const Mat& X,
+                      const Mat& y,
+                      const Mat& sample_weight,
+                      const Mat& X_valid,
+                      const Mat& y_valid)
+{
+    DataView<DTYPE> X_view = as_view<DTYPE>(X);
+    DataView<DTYPE> X_valid_view = as_view<DTYPE>(X_valid);
+    DataView<double> y_view = as_view<double>(y);
+    DataView<double> weight_view = as_view<double>(sample_weight);
+    DataView<double> y_valid_view = as_view<double>(y_valid);
+    int n_samples = X.rows;
+    int n_features = X.cols;
+
+    // Size of a node value
+    std::set<double> classes;
+    for (int i = 0; i < n_samples; i++)
+        classes.insert(y_view.at(i));
+    int n_classes = static_cast<int>(classes.size());
+
+    // The binned features are shared by the "Binned" trials
+    BinnedMatrix binned;
+    bool need_bins = false;
+    vector<int> single;
+    vector<int> boosted;
+    for (size_t t = 0; t < trials.size(); t++)
+    {
+        SearchTrial& trial = trials[t];
+        trial.error = 0;
+        trial.score = 0.0;
+        trial.n_stages = 0;
+        trial.stopped = false;
+        trial.memory_estimate = trial_memory(trial, n_samples, n_features, y.cols, n_classes, X.depth());
+        if (trial.n_estimators > 0)
+            boosted.push_back(t);
+        else
+        {
+            single.push_back(t);
+            if (strcmp(trial.splitter_name, "Binned") == 0)
+                need_bins = true;
+        }
+    }
+    int n_workers = search._n_threads;
+    if (n_workers <= 0)
+        n_workers = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+    // Every trial scans all the columns: spread them over the nodes
+    NumaPlacement bin_placement = (search._numa_placement == NUMA_NONE) ? NUMA_NONE
+                                                                        : NUMA_INTERLEAVED;
+    if (need_bins && binned.fit(X_view, 256, n_workers, bin_placement) != 0)
+        return 3;
+
+    // Successive halving: round r of R fits the boosting trials to
+    // max_stages / halving_factor ** (R - r) stages
+    int n_rounds = 0;
+    int max_stages = 0;
+    for (size_t b = 0; b < boosted.size(); b++)
+        max_stages = std::max(max_stages, trials[boosted[b]].n_estimators);
+    if (search._halving_factor >= 2)
+    {
+        long long survivors = search._halving_factor;
+        while (survivors <= static_cast<long long>(boosted.size()))
+        {
+            n_rounds += 1;
+            survivors *= search._halving_factor;
+        }
+    }
+    vector<GradientBoostingRegressor*> boosters(trials.size(), NULL);
+
+    int stage_limit = INT_MAX;
+    std::function<void(int)> task = [&](int t) {
+        SearchTrial& trial = trials[t];
+        Mat prediction;
+        if (trial.n_estimators <= 0)
+        {
+            BaseDecisionTree tree(trial.criterion_name,
+                                  trial.splitter_name,
+                                  trial.max_depth,
+                                  trial.min_samples_split,
+                                  trial.min_samples_leaf,
+                                  trial.min_weight_fraction_leaf,
+                                  trial.max_features,
+                                  trial.max_leaf_nodes,
+                                  trial.random_state,
+                                  Mat(),
+                                  trial.is_classification);
+            if (strcmp(trial.splitter_name, "Binned") == 0)
+                trial.error = tree.fit(binned, y_view, weight_view);
+            else
+                trial.error = tree.fit(X_view, y_view, weight_view);
+            if (trial.error != 0)
+                return;
+            prediction = tree.predict(X_valid_view);
+        }
+        else
+        {
+            // Gradient boosting only handles least squares regression
+            if (trial.is_classification == 0)
+            {
+                trial.error = 3;
+                return;
+            }
+            if (boosters[t] == NULL)
+                boosters[t] = new GradientBoostingRegressor(trial.n_estimators,
+                                                            trial.learning_rate,
+                                                            trial.max_depth,
+                                                            trial.min_samples_split,
+                                                            trial.min_samples_leaf,
+                                                            trial.max_features,
+                                                            trial.random_state,
+                                                            true);
+            GradientBoostingRegressor* booster = boosters[t];
+            booster->_n_estimators = std::min(trial.n_estimators, stage_limit);
+            // Every round resumes on the same training set
+            trial.error = booster->fit(X, y, sample_weight, true);
+            trial.n_stages = static_cast<int>(booster->_estimators.size());
+            if (trial.error != 0)
+                return;
+            prediction = booster->predict(X_valid);
+        }
+        trial.score = prediction_score(prediction, y_valid_view, DataView<double>(),
+                                       0, X_valid.rows, trial.is_classification);
+    };
+
+    vector<int> alive = boosted;
+    search._peak_memory = 0;
+    for (int round = 0; round <= n_rounds; round++)
+    {
+        stage_limit = INT_MAX;
+        if (round < n_rounds)
+            stage_limit = std::max(1, static_cast<int>(std::ceil(
+                              max_stages / std::pow(static_cast<double>(search._halving_factor),
+                                                    n_rounds - round))));
+
+        // The single trees run with the first round
+        vector<int> order = alive;
+        if (round == 0)
+            order.insert(order.begin(), single.begin(), single.end());
+        search._peak_memory = std::max(search._peak_memory,
+                                       run_admitted(order, trials, search._memory_budget,
+                                                    n_workers, search._numa_placement, task));
+        if (round == n_rounds)
+            break;
+
+        // Keep the best 1 / halving_factor, the failed trials last
+        std::stable_sort(alive.begin(), alive.end(), [&](int a, int b) {
+            if ((trials[a].error == 0) != (trials[b].error == 0))
+                return trials[a].error == 0;
+            return trials[a].score > trials[b].score;
+        });
+        size_t n_kept = (alive.size() + search._halving_factor - 1) / search._halving_factor;
+        for (size_t i = n_kept; i < alive.size(); i++)
+        {
+            trials[alive[i]].stopped = true;
+            delete boosters[alive[i]];
+            boosters[alive[i]] = NULL;
+        }
+        alive.resize(n_kept);
+    }
+
+    for (size_t t = 0; t < boosters.size(); t++)
+        delete boosters[t];
+    return 0;
+}
+
+int HyperparameterSearch::run(vector<SearchTrial>& trials,
+                              Mat X,
+                              Mat y,
+                              Mat sample_weight,
+                              Mat X_valid,
+                              Mat y_valid)
+{
+    // Validation
+    if (X.rows == 0 || X.cols == 0 || X_valid.rows == 0)
+        return 1;
+
+    // Converted once, then shared read-only by all the trials
+    if (X.depth() != CV_32F && X.depth() != CV_64F)
+        X.convertTo(X, CV_64F);
+    if (!X.isContinuous())
+        X = X.clone();
+    if (X_valid.depth() != X.depth())
+        X_valid.convertTo(X_valid, X.depth());
+    to_target(y);
+    to_target(sample_weight);
+    to_target(y_valid);
+    if (y.rows != X.rows || X_valid.cols != X.cols || y_valid.rows != X_valid.rows)
+        return 2;
+    if (sample_weight.total() != 0 && sample_weight.rows != X.rows)
+        return 2;
+
+    if (X.depth() == CV_32F)
+        return run_trials<float>(*this, trials, X, y, sample_weight, X_valid, y_valid);
+    return run_trials<double>(*this, trials, X, y, sample_weight, X_valid, y_valid);
+}
@@ -0,0 +1,118 @@
+#ifndef HYPERPARAMETERSEARCH_H
+#define HYPERPARAMETERSEARCH_H
+
+#include <cstddef>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "numa.h"
+
+using std::vector;
+using cv::Mat;
+
+/**
+ * @brief A configuration tried by HyperparameterSearch, and its result
+ */
+struct SearchTrial
+{
+    /**
+     * @brief A trial of a decision tree, or of a gradient boosting regressor
+     * when n_estimators > 0. The tree parameters are the ones of the
+     * BaseDecisionTree constructor.
+     * @param criterion_name
+     * @param splitter_name
+     * @param max_depth
+     * @param min_samples_split
+     * @param min_samples_leaf
+     * @param min_weight_fraction_leaf
+     * @param max_features
+     * @param max_leaf_nodes
+     * @param random_state
+     * @param is_classification 0 for classification, 1 for regression
+     * @param n_estimators Boosting stages, 0 for a single tree
+     * @param learning_rate
+     */
+    SearchTrial(char* criterion_name,
+                char* splitter_name,
+                int max_depth,
+                int min_samples_split,
+                int min_samples_leaf,
+                double min_weight_fraction_leaf,
+                int max_features,
+                int max_leaf_nodes,
+                int random_state,
+                int is_classification,
+                int n_estimators=0,
+                double learning_rate=0.1);
+
+    // Parameters
+    char* criterion_name;
+    char* splitter_name;
+    int max_depth;
+    int min_samples_split;
+    int min_samples_leaf;
+    double min_weight_fraction_leaf;
+    int max_features;
+    int max_leaf_nodes;
+    int random_state;
+    int is_classification;
+    int n_estimators;
+    double learning_rate;
+
+    // Results
+    int error;                  // error_code of the fit
+    double score;               // Validation score, see prediction_score
+    int n_stages;               // Boosting stages fitted, fewer than n_estimators when stopped
+    bool stopped;               // Dropped by successive halving
+    size_t memory_estimate;     // Bytes reserved for the trial while it runs
+};
+
+class HyperparameterSearch
+{
+public:
+    /**
+     * @brief Run trials concurrently on one shared copy of the training set.
+     * A trial starts when its memory estimate, from
+     * BaseDecisionTree::estimate_fit_memory for its tree or each stage of
+     * its booster, fits in what the running trials leave of memory_budget,
+     * in the order of the trials.
+     * Boosting trials go through successive halving: every round fits the
+     * remaining ones up to a fraction of their stages, by warm start, and
+     * keeps the best 1 / halving_factor of them.
+     * @param n_threads Trials run at the same time, 0 for the number of cores
+     * @param memory_budget Bytes, 0 for no limit
+     * @param halving_factor Successive halving reduction, < 2 to fit every
+     * boosting trial to its end
+     */
+    HyperparameterSearch(int n_threads,
+                         size_t memory_budget,
+                         int halving_factor);
+
+    /**
+     * @brief Fit the trials on (X, y) and score them on (X_valid, y_valid).
+     * X is converted, and binned for the "Binned" trials, once.
+     * @param trials The configurations, their results are filled in
+     * @param X The training input samples, shape = [n_samples, n_features]
+     * @param y The target values, shape = [n_samples]
+     * @param sample_weight Sample weights. If total size equals to zero, then samples are equally weighted.
+     * @param X_valid The validation samples, shape = [n_valid, n_features]
+     * @param y_valid The validation target values, shape = [n_valid]
+     * @return error_code of the data validation; the errors of the trials
+     * are in SearchTrial::error
+     */
+    int run(vector<SearchTrial>& trials,
+            Mat X,
+            Mat y,
+            Mat sample_weight,
+            Mat X_valid,
+            Mat y_valid);
+
+public:
+    int _n_threads;
+    size_t _memory_budget;
+    int _halving_factor;
+    size_t _peak_memory;        // Highest sum of the estimates of the trials running together
+    NumaPlacement _numa_placement;  // NUMA nodes of the workers, NUMA_NONE not to pin them.
+                                    // The shared bins are then interleaved over the nodes.
+};
+
+#endif // HYPERPARAMETERSEARCH_H
@@ -0,0 +1,176 @@
+#include "gradientboosting_test.h"
+#include <QtCore>
+#include <utility>
+#include <opencv2/opencv.hpp>
+#include "gradientboosting.h"
+#include "basetree.h"
+#include "treedag.h"
+#include "util.h"
+#include "tools.h"
+using std::pair;
+using cv::Mat;
+
+int GradientBoostingRegression_test(QString filename)
+{
+    QString fn = QString("../test_data/Regression/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_regression(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat sample_weight = Mat::ones(200, 1, CV_64F);
+
+    GradientBoostingRegressor r(50, 0.1, 3, 2, 1, 0, 0, false);
+    r.fit(X, y, sample_weight);
+    for (size_t i = 0; i < r._train_score.size(); i += 10)
+        cout << "stage: " << i << "\t" << "train_score: " << r._train_score[i] << endl;
+    return 0;
+}
+
+int GradientBoostingWarmStart_test(QString filename)
+{
+    QString fn = QString("../test_data/Regression/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_regression(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat sample_weight = Mat::ones(200, 1, CV_64F);
+
+    // 20 stages then 30 more give the model of 50 stages at once
+    GradientBoostingRegressor once(50, 0.1, 3, 2, 1, 0, 0, false);
+    once.fit(X, y, sample_weight);
+
+    GradientBoostingRegressor warm(20, 0.1, 3, 2, 1, 0, 0, true);
+    warm.fit(X, y, sample_weight);
+    warm._n_estimators = 50;
+    warm.fit(X, y, sample_weight);
+
+    Mat a = once.predict(X);
+    Mat b = warm.predict(X);
+    for (int i = 0; i < 10; i++)
+        cout << "once: " << a.at<double>(i) << "\t"
+             << "warm start: " << b.at<double>(i) << endl;
+
+    // Other rows loaded into the buffer of the training set are another
+    // training set, whose raw predictions are recomputed
+    Mat X_reused = X.rowRange(0, 100).clone();
+    Mat y_reused = y.rowRange(0, 100).clone();
+    GradientBoostingRegressor reused(20, 0.1, 3, 2, 1, 0, 0, true);
+    reused.fit(X_reused, y_reused, Mat());
+    X.rowRange(100, 200).copyTo(X_reused);
+    y.rowRange(100, 200).copyTo(y_reused);
+    reused._n_estimators = 40;
+    reused.fit(X_reused, y_reused, Mat());
+
+    GradientBoostingRegressor fresh(20, 0.1, 3, 2, 1, 0, 0, true);
+    fresh.fit(X.rowRange(0, 100).clone(), y.rowRange(0, 100).clone(), Mat());
+    fresh._n_estimators = 40;
+    fresh.fit(X.rowRange(100, 200).clone(), y.rowRange(100, 200).clone(), Mat());
+
+    a = fresh.predict(X);
+    b = reused.predict(X);
+    double max_diff = 0.0;
+    for (int i = 0; i < X.rows; i++)
+        max_diff = std::max(max_diff, std::abs(a.at<double>(i) - b.at<double>(i)));
+    cout << "reused buffer: max difference " << max_diff << "\t"
+         << "train_score: " << reused._train_score.back() << " / " << fresh._train_score.back() << endl;
+    return 0;
+}
+
+int GradientBoostingPartialDependence_test(QString filename)
+{
+    QString fn = QString("../test_data/Regression/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_regression(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat sample_weight = Mat::ones(200, 1, CV_64F);
+
+    GradientBoostingRegressor r(50, 0.1, 3, 2, 1, 0, 0, false);
+    r.fit(X, y, sample_weight);
+
+    vector<int> features(1, 0);
+    Mat grid = partial_dependence_grid(X, features, 10);
+    Mat pd = r.partial_dependence(features, grid);
+    for (int g = 0; g < grid.rows; g++)
+        cout << "x0: " << grid.at<double>(g, 0) << "\t" << "partial dependence: " << pd.at<double>(g) << endl;
+    return 0;
+}
+
+int GradientBoostingLeafEmbedding_test(QString filename)
+{
+    QString fn = QString("../test_data/Regression/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_regression(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat sample_weight = Mat::ones(200, 1, CV_64F);
+
+    GradientBoostingRegressor r(50, 0.1, 3, 2, 1, 0, 0, false);
+    r.fit(X, y, sample_weight);
+
+    Mat leaves = r.apply(X, 4);
+    CsrMatrix embedding = r.leaf_embedding(X, 4);
+    vector<int> n_nodes_ptr;
+    CsrMatrix path = r.decision_path(X, n_nodes_ptr, 4);
+    cout << "leaves: " << leaves.rows << "x" << leaves.cols << "\t"
+         << "embedding columns: " << embedding.cols << "\t"
+         << "path nonzeros: " << path.indptr[X.rows] << endl;
+    for (int s = 0; s < 5; s++)
+        cout << "row 0, stage: " << s << "\t" << "embedding column: " << embedding.indices[s] << endl;
+    return 0;
+}
+
+int GradientBoostingCompress_test(QString filename)
+{
+    QString fn = QString("../test_data/Regression/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_regression(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat sample_weight = Mat::ones(200, 1, CV_64F);
+
+    GradientBoostingRegressor r(50, 0.1, 3, 2, 1, 0, 0, false);
+    r.fit(X, y, sample_weight);
+    Mat result = r.predict(X);
+
+    // The stages are freed, predict reads the compressed trees
+    CompressionReport report;
+    int error_code = r.compress(THRESHOLD_INDEX, report, X, true);
+    Mat compressed_result = r.predict(X);
+    cout << "error_code: " << error_code << "\t"
+         << "bytes: " << report.original_bytes << " -> " << report.compressed_bytes << "\t"
+         << "error bound: " << report.value_error_bound << "\t"
+         << "max error: " << report.max_error << endl;
+    for (int i = 0; i < 5; i++)
+        cout << "predict: " << result.at<double>(i) << "\t"
+             << "compressed: " << compressed_result.at<double>(i) << endl;
+    return 0;
+}
+
+int GradientBoostingCompact_test(QString filename)
+{
+    QString fn = QString("../test_data/Regression/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_regression(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat sample_weight = Mat::ones(200, 1, CV_64F);
+
+    GradientBoostingRegressor r(50, 0.1, 3, 2, 1, 0, 0, true);
+    r.fit(X, y, sample_weight);
+    Mat result = r.predict(X);
+
+    // The DAG is the only copy of the model, the next stages join it
+    int error_code = r.compact(true);
+    Mat compact_result = r.predict(X);
+    r._n_estimators = 60;
+    r.fit(X, y, sample_weight);
+    int n_equal = 0;
+    for (int i = 0; i < X.rows; i++)
+        n_equal += (result.at<double>(i) == compact_result.at<double>(i));
+    cout << "error_code: " << error_code << "\t"
+         << "nodes: " << r._dag->_n_tree_nodes << " -> " << r._dag->_nodes.size() << "\t"
+         << "trees: " << r._dag->_roots.size() << "\t"
+         << "equal predictions: " << n_equal << "/" << X.rows << endl;
+    return 0;
+}
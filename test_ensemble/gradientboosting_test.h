@@ -0,0 +1,12 @@
+#ifndef GRADIENTBOOSTING_TEST_H
+#define GRADIENTBOOSTING_TEST_H
+#include <QtCore>
+
+int GradientBoostingRegression_test(QString);
+int GradientBoostingWarmStart_test(QString);
+int GradientBoostingPartialDependence_test(QString);
+int GradientBoostingLeafEmbedding_test(QString);
+int GradientBoostingCompress_test(QString);
+int GradientBoostingCompact_test(QString);
+
+#endif // GRADIENTBOOSTING_TEST_H
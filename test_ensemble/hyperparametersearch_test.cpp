@@ -0,0 +1,46 @@
+#include "hyperparametersearch_test.h"
+#include <QtCore>
+#include <utility>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "hyperparametersearch.h"
+#include "tools.h"
+using std::pair;
+using std::vector;
+using cv::Mat;
+
+int HyperparameterSearch_test(QString filename)
+{
+    QString fn = QString("../test_data/Regression/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_regression(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    // Train on the first 150 rows, validate on the others
+    Mat X_train = X.rowRange(0, 150);
+    Mat y_train = y.rowRange(0, 150);
+    Mat X_valid = X.rowRange(150, 200);
+    Mat y_valid = y.rowRange(150, 200);
+
+    vector<SearchTrial> trials;
+    for (int max_depth = 2; max_depth <= 8; max_depth += 2)
+    {
+        for (int min_samples_leaf = 1; min_samples_leaf <= 4; min_samples_leaf *= 2)
+        {
+            trials.push_back(SearchTrial("MSE", "Best", max_depth, 2, min_samples_leaf, 0.0, 0, 0, 0, 1));
+            trials.push_back(SearchTrial("FriedmanMSE", "Best", max_depth, 2, min_samples_leaf, 0.0, 0, 0, 0, 1,
+                                         40, 0.1));
+        }
+    }
+
+    // 4 trials at a time within 64 MB, halving the boosting trials by 3
+    HyperparameterSearch search(4, 64 << 20, 3);
+    search.run(trials, X_train, y_train, Mat(), X_valid, y_valid);
+    for (size_t i = 0; i < trials.size(); i++)
+        cout << "max_depth: " << trials[i].max_depth << "\t"
+             << "min_samples_leaf: " << trials[i].min_samples_leaf << "\t"
+             << "n_stages: " << trials[i].n_stages << "\t"
+             << "score: " << trials[i].score << endl;
+    cout << "peak memory: " << search._peak_memory << endl;
+    return 0;
+}
@@ -0,0 +1,7 @@
+#ifndef HYPERPARAMETERSEARCH_TEST_H
+#define HYPERPARAMETERSEARCH_TEST_H
+#include <QtCore>
+
+int HyperparameterSearch_test(QString);
+
+#endif // HYPERPARAMETERSEARCH_TEST_H
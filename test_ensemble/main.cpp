@@ -0,0 +1,23 @@
+#include <opencv2/opencv.hpp>
+#include <QtCore>
+#include <iostream>
+#include "gradientboosting.h"
+#include "gradientboosting_test.h"
+#include "hyperparametersearch_test.h"
+#include "tools.h"
+using namespace cv;
+using namespace std;
+
+int main()
+{
+    // GradientBoosting_test
+    GradientBoostingRegression_test("test3.txt");
+//    GradientBoostingWarmStart_test("test3.txt");
+//    GradientBoostingPartialDependence_test("test3.txt");
+//    GradientBoostingLeafEmbedding_test("test3.txt");
+//    GradientBoostingCompress_test("test3.txt");
+//    GradientBoostingCompact_test("test3.txt");
+
+    // HyperparameterSearch_test
+//    HyperparameterSearch_test("test3.txt");
+}
@@ -0,0 +1,64 @@
+TEMPLATE = app
+CONFIG += console debug
+CONFIG -= app_bundle
+#CONFIG -= qt
+CONFIG += c++11
+
+INCLUDEPATH += ../tree \
+               ../ensemble \
+               ../test_tree
+
+HEADERS += gradientboosting_test.h \
+           hyperparametersearch_test.h \
+           ../test_tree/tools.h \
+           ../ensemble/gradientboosting.h \
+           ../ensemble/hyperparametersearch.h \
+           ../tree/criterion.h \
+           ../tree/splitter.h \
+           ../tree/basetree.h \
+           ../tree/tree.h \
+           ../tree/treebuilder.h \
+           ../tree/util.h \
+           ../tree/dataview.h \
+           ../tree/binnedmatrix.h \
+           ../tree/arena.h \
+           ../tree/crossvalidation.h \
+           ../tree/transport.h \
+           ../tree/hoeffdingtree.h \
+           ../tree/numa.h \
+           ../tree/compressedtree.h \
+           ../tree/treedag.h \
+           ../tree/memoryusage.h
+
+SOURCES += main.cpp \
+           gradientboosting_test.cpp \
+           hyperparametersearch_test.cpp \
+           ../test_tree/tools.cpp \
+           ../ensemble/gradientboosting.cpp \
+           ../ensemble/hyperparametersearch.cpp \
+           ../tree/criterion.cpp \
+           ../tree/splitter.cpp \
+           ../tree/basetree.cpp \
+           ../tree/tree.cpp \
+           ../tree/treebuilder.cpp \
+           ../tree/util.cpp \
+           ../tree/binnedmatrix.cpp \
+           ../tree/arena.cpp \
+           ../tree/crossvalidation.cpp \
+           ../tree/transport.cpp \
+           ../tree/hoeffdingtree.cpp \
+           ../tree/numa.cpp \
+           ../tree/compressedtree.cpp \
+           ../tree/treedag.cpp
+
+LIBS += -L/usr/local/lib
+LIBS += -lopencv_core
+
+# parallel_for runs on std::thread
+QMAKE_CXXFLAGS += -pthread
+LIBS += -pthread
+
+# shm_open of SharedMemoryTransport
+LIBS += -lrt
+
+TARGET = test_ensemble
@@ -5,6 +5,7 @@
 #include <iostream>
 #include <opencv2/opencv.hpp>
 #include "criterion.h"
+#include "util.h"
 using namespace cv;
 using namespace std;
 
@@ -27,7 +28,7 @@ int Gini_test()
     int end = 10;
 
     Gini g = Gini();
-    g.init(y, sample_weight, _weight_n_samples, vec, start, end);
+    g.init(as_view<double>(y), as_view<double>(sample_weight), _weight_n_samples, &vec[0], start, end);
 
     for (int i = 0; i < 11; i++)
     {
@@ -61,7 +62,7 @@ int Entropy_test()
     int end = 10;
 
     Entropy g = Entropy();
-    g.init(y, sample_weight, _weight_n_samples, vec, start, end);
+    g.init(as_view<double>(y), as_view<double>(sample_weight), _weight_n_samples, &vec[0], start, end);
 
     for (int i = 0; i < 11; i++)
     {
@@ -96,7 +97,7 @@ int MSE_test()
 
     Criterion* g = new MSE();
 //    MSE g = MSE();
-    g->init(y, sample_weight, _weight_n_samples, vec, start, end);
+    g->init(as_view<double>(y), as_view<double>(sample_weight), _weight_n_samples, &vec[0], start, end);
 
     for (int i = 0; i < 11; i++)
     {
@@ -130,7 +131,43 @@ int FriedmanMSE_test()
     int end = 10;
 
     FriedmanMSE g = FriedmanMSE();
-    g.init(y, sample_weight, _weight_n_samples, vec, start, end);
+    g.init(as_view<double>(y), as_view<double>(sample_weight), _weight_n_samples, &vec[0], start, end);
+
+    for (int i = 0; i < 11; i++)
+    {
+        g.update(i);
+        double impurity = g.node_impurity();
+        double d = g.impurity_improvement(impurity);
+        pair<double, double> p = g.children_impurity();
+        cout << "impurity_improvement: " << d << "\t";
+        cout << "left_impurity: " << p.first << "\t" \
+             << "right_impurity: " << p.second << endl;
+    }
+    return 0;
+}
+
+int MAE_test()
+{
+    Mat y = Mat(10, 1, CV_64F);
+    for (int i = 0; i < 5; i++)
+        y.at<double>(i) = 0.;
+    for (int i = 5; i < 9; i++)
+        y.at<double>(i) = 1.;
+    y.at<double>(9) = 100.;    // An outlier moves the mean, not the median
+
+    Mat sample_weight = Mat::ones(10, 1, CV_64F);
+
+    double _weight_n_samples = 10;
+    vector<int> vec;
+    for (int i = 0; i < 10; i++)
+        vec.push_back(i);
+
+    int start = 0;
+    int end = 10;
+
+    MAE g = MAE();
+    g.init(as_view<double>(y), as_view<double>(sample_weight), _weight_n_samples, &vec[0], start, end);
+    cout << "median: " << g.node_value()[0] << endl;
 
     for (int i = 0; i < 11; i++)
     {
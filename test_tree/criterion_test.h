@@ -5,5 +5,6 @@ int Gini_test();
 int Entropy_test();
 int MSE_test();
 int FriedmanMSE_test();
+int MAE_test();
 
 #endif // CRITERION_TEST_H
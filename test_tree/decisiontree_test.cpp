@@ -3,7 +3,16 @@
 #include <utility>
 #include <opencv2/opencv.hpp>
 #include "tree.h"
+#include "basetree.h"
+#include "crossvalidation.h"
+#include "binnedmatrix.h"
+#include "transport.h"
+#include "hoeffdingtree.h"
+#include "treedag.h"
+#include "util.h"
 #include "tools.h"
+#include <unistd.h>
+#include <sys/wait.h>
 using std::pair;
 using cv::Mat;
 
@@ -27,6 +36,7 @@ int DecisionTreeClassification_test(QString filename)
         else
             cout << "Wrong" << " " << result.at<double>(i) << " " << y.at<double>(i) << endl;
     }
+    return 0;
 }
 
 int DecisionTreeRegression_test(QString filename)
@@ -49,4 +59,909 @@ int DecisionTreeRegression_test(QString filename)
         else
             cout << "Wrong" << " " << result.at<double>(i) << " " << y.at<double>(i) << endl;
     }
+    return 0;
+}
+
+int DecisionTreeRegressionFloat_test(QString filename)
+{
+    QString fn = QString("../test_data/Regression/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_regression(fn);
+    Mat X;
+    pMat.first.convertTo(X, CV_32F);
+    Mat y = pMat.second;
+
+    Mat sample_weight = Mat::ones(200, 1, CV_64F);
+    Mat class_weight = Mat::ones(0, 0, CV_64F);
+
+    // A CV_32F X trains and predicts in single precision
+    DecisionTreeRegressor r("MSE", "Best", 100, 2, 1, 0.0, 0, 0, 0, class_weight);
+    r.fit(X, y, sample_weight);
+    Mat result = r.predict(X);
+    Mat result_double = r.predict(pMat.first);
+    for (int i = 0; i < result.total(); i++)
+    {
+        if (result.at<double>(i) != result_double.at<double>(i))
+            cout << "Inconsistent" << " " << result.at<double>(i) << " " << result_double.at<double>(i) << endl;
+        else if (result.at<double>(i) == y.at<double>(i))
+            cout << "Correct" << endl;
+        else
+            cout << "Wrong" << " " << result.at<double>(i) << " " << y.at<double>(i) << endl;
+    }
+    return 0;
+}
+
+int DecisionTreeBinned_test(QString filename, int max_bins)
+{
+    QString fn = QString("../test_data/Classification/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_classification(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat sample_weight = Mat::ones(200, 1, CV_64F);
+    Mat class_weight = Mat::ones(0, 0, CV_64F);
+
+    // Train on bin codes, predict on the raw values with the bin edges
+    DecisionTreeClassifier c("Gini", "Binned", 10, 2, 1, 0.0, 0, 0, 0, class_weight);
+    c._max_bins = max_bins;
+    c.fit(X, y, sample_weight);
+    Mat result = c.predict(X);
+    for (int i = 0; i < result.total(); i++)
+    {
+        if (result.at<double>(i) == y.at<double>(i))
+            cout << "Correct" << endl;
+        else
+            cout << "Wrong" << " " << result.at<double>(i) << " " << y.at<double>(i) << endl;
+    }
+    return 0;
+}
+
+int DecisionTreeMultiOutput_test(QString filename)
+{
+    QString fn = QString("../test_data/Regression/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_regression(fn);
+    Mat X = pMat.first;
+
+    // Three outputs derived from the target, fitted by one tree
+    Mat y = Mat(X.rows, 3, CV_64F);
+    for (int i = 0; i < X.rows; i++)
+    {
+        double v = pMat.second.at<double>(i);
+        y.at<double>(i, 0) = v;
+        y.at<double>(i, 1) = 2 * v + 1;
+        y.at<double>(i, 2) = -v;
+    }
+
+    Mat sample_weight = Mat::ones(200, 1, CV_64F);
+    Mat class_weight = Mat::ones(0, 0, CV_64F);
+
+    DecisionTreeRegressor r("MSE", "Best", 100, 2, 1, 0.0, 0, 0, 0, class_weight);
+    r.fit(X, y, sample_weight);
+    Mat result = r.predict(X);
+    for (int i = 0; i < result.rows; i++)
+    {
+        for (int k = 0; k < result.cols; k++)
+        {
+            if (result.at<double>(i, k) == y.at<double>(i, k))
+                cout << "Correct" << endl;
+            else
+                cout << "Wrong" << " " << result.at<double>(i, k) << " " << y.at<double>(i, k) << endl;
+        }
+    }
+    return 0;
+}
+
+int DecisionTreeBoundedSearch_test(QString filename)
+{
+    QString fn = QString("../test_data/Regression/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_regression(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat sample_weight = Mat::ones(200, 1, CV_64F);
+    Mat class_weight = Mat::ones(0, 0, CV_64F);
+
+    // The bounded search must grow the tree of the exhaustive search
+    DecisionTreeRegressor r("MSE", "Best", 100, 2, 1, 0.0, 0, 0, 0, class_weight);
+    DecisionTreeRegressor b("MSE", "Best", 100, 2, 1, 0.0, 0, 0, 0, class_weight);
+    b._bounded_search = true;
+    r.fit(X, y, sample_weight);
+    b.fit(X, y, sample_weight);
+    Mat result = r.predict(X);
+    Mat result_bounded = b.predict(X);
+    for (int i = 0; i < result.total(); i++)
+    {
+        if (result.at<double>(i) == result_bounded.at<double>(i))
+            cout << "Correct" << endl;
+        else
+            cout << "Wrong" << " " << result_bounded.at<double>(i) << " " << result.at<double>(i) << endl;
+    }
+    return 0;
+}
+
+int DecisionTreePruning_test(QString filename)
+{
+    QString fn = QString("../test_data/Regression/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_regression(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat sample_weight = Mat::ones(200, 1, CV_64F);
+    Mat class_weight = Mat::ones(0, 0, CV_64F);
+
+    DecisionTreeRegressor r("MSE", "Best", 100, 2, 1, 0.0, 0, 0, 0, class_weight);
+    r.fit(X, y, sample_weight);
+
+    // Prune the grown tree at every alpha of its path
+    Mat ccp_alphas, impurities;
+    r.cost_complexity_pruning_path(ccp_alphas, impurities);
+    for (int i = ccp_alphas.rows - 1; i >= 0; i--)
+    {
+        DecisionTreeRegressor p("MSE", "Best", 100, 2, 1, 0.0, 0, 0, 0, class_weight);
+        p.fit(X, y, sample_weight);
+        p.prune(ccp_alphas.at<double>(i));
+        cout << "ccp_alpha: " << ccp_alphas.at<double>(i) << "\t"
+             << "impurity: " << impurities.at<double>(i) << "\t"
+             << "node_count: " << p._tree->_node_count << endl;
+    }
+    return 0;
+}
+
+int DecisionTreeShap_test(QString filename)
+{
+    QString fn = QString("../test_data/Regression/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_regression(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat sample_weight = Mat::ones(200, 1, CV_64F);
+    Mat class_weight = Mat::ones(0, 0, CV_64F);
+
+    DecisionTreeRegressor r("MSE", "Best", 8, 2, 1, 0.0, 0, 0, 0, class_weight);
+    r.fit(X, y, sample_weight);
+
+    // Every row of SHAP values sums to the prediction of the sample
+    Mat pred = r.predict(X);
+    Mat phi = r.shap_values(X, Mat(), 0, 0);
+    Mat phi_background = r.shap_values(X, X.rowRange(0, 20), 0, 0);
+    for (int i = 0; i < 10; i++)
+    {
+        double sum = 0.0;
+        double sum_background = 0.0;
+        for (int j = 0; j < phi.cols; j++)
+        {
+            sum += phi.at<double>(i, j);
+            sum_background += phi_background.at<double>(i, j);
+        }
+        cout << "prediction: " << pred.at<double>(i) << "\t"
+             << "path-dependent: " << sum << "\t"
+             << "interventional: " << sum_background << endl;
+    }
+    return 0;
+}
+
+int DecisionTreeRefitLeaves_test(QString filename)
+{
+    QString fn = QString("../test_data/Regression/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_regression(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat sample_weight = Mat::ones(200, 1, CV_64F);
+    Mat class_weight = Mat::ones(0, 0, CV_64F);
+
+    DecisionTreeRegressor r("MSE", "Best", 4, 2, 1, 0.0, 0, 0, 0, class_weight);
+    r.fit(X, y, sample_weight);
+
+    // Shifted labels move every leaf value by the same amount
+    Mat y_shifted = y.clone();
+    for (int i = 0; i < y_shifted.total(); i++)
+        y_shifted.at<double>(i) += 1.0;
+    Mat before = r.predict(X);
+    r.refit_leaves(X, y_shifted, sample_weight, 0);
+    Mat after = r.predict(X);
+    for (int i = 0; i < 10; i++)
+        cout << "before: " << before.at<double>(i) << "\t"
+             << "after: " << after.at<double>(i) << endl;
+    return 0;
+}
+
+int DecisionTreeCrossValidation_test(QString filename)
+{
+    QString fn = QString("../test_data/Regression/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_regression(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat sample_weight = Mat::ones(200, 1, CV_64F);
+    Mat class_weight = Mat::ones(0, 0, CV_64F);
+
+    // The 5 folds share X and train on 4 threads
+    DecisionTreeRegressor r("MSE", "Best", 6, 2, 1, 0.0, 0, 0, 0, class_weight);
+    Mat test_scores;
+    cross_validate(r, X, y, sample_weight, 5, test_scores, 4);
+    for (int i = 0; i < test_scores.rows; i++)
+        cout << "fold: " << i << "\t" << "R^2: " << test_scores.at<double>(i) << endl;
+
+    // Fitting an estimator leaves its parameters as constructed: it can be
+    // refitted, and cross-validated after a fit as before
+    DecisionTreeRegressor fitted("MSE", "Best", 0, 2, 1, 0.05, 0, 0, 0, class_weight);
+    Mat fresh_scores;
+    int fresh_error = cross_validate(fitted, X, y, sample_weight, 5, fresh_scores, 4);
+    int error_code = fitted.fit(X, y, sample_weight);
+    Mat first = fitted.predict(X);
+    int refit_error = fitted.fit(X, y, sample_weight);
+    Mat second = fitted.predict(X);
+    int n_equal = 0;
+    for (int i = 0; i < X.rows; i++)
+        n_equal += (first.at<double>(i) == second.at<double>(i));
+    cout << "fit: error_code " << error_code << "\t"
+         << "refit: error_code " << refit_error << "\t"
+         << "equal predictions: " << n_equal << "/" << X.rows << endl;
+
+    Mat fitted_scores;
+    int fitted_error = cross_validate(fitted, X, y, sample_weight, 5, fitted_scores, 4);
+    n_equal = 0;
+    for (int i = 0; fresh_error == 0 && fitted_error == 0 && i < fresh_scores.rows; i++)
+        n_equal += (fresh_scores.at<double>(i) == fitted_scores.at<double>(i));
+    cout << "cross_validate before fit: error_code " << fresh_error << "\t"
+         << "after fit: error_code " << fitted_error << "\t"
+         << "equal scores: " << n_equal << "/" << fresh_scores.rows << endl;
+    return 0;
+}
+
+int DecisionTreeDataParallel_test(QString filename, int n_workers)
+{
+    QString fn = QString("../test_data/Classification/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_classification(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat class_weight = Mat::ones(0, 0, CV_64F);
+
+    // Edges shared by all the workers
+    BinnedMatrix reference;
+    reference.fit(as_view<double>(X), 32);
+
+    DecisionTreeClassifier single("Gini", "Binned", 10, 2, 1, 0.0, 0, 0, 0, class_weight);
+    single.fit(reference, as_view<double>(y), DataView<double>());
+    Mat expected = single.predict(X);
+
+    SharedMemoryTransport transport;
+    if (transport.create("/decisiontree_test", n_workers, 4096) != 0)
+        return 1;
+
+    cout.flush();
+    for (int rank = 0; rank < n_workers; rank++)
+    {
+        if (fork() != 0)
+            continue;
+
+        // Worker rank trains on the rows rank, rank + n_workers, ...
+        int n_rows = (X.rows - rank + n_workers - 1) / n_workers;
+        Mat X_shard(n_rows, X.cols, CV_64F);
+        Mat y_shard(n_rows, 1, CV_64F);
+        for (int r = 0; r < n_rows; r++)
+        {
+            X.row(rank + r * n_workers).copyTo(X_shard.row(r));
+            y_shard.at<double>(r) = y.at<double>(rank + r * n_workers);
+        }
+        BinnedMatrix shard;
+        shard.transform(as_view<double>(X_shard), reference);
+
+        SharedMemoryTransport worker;
+        worker.attach("/decisiontree_test", rank);
+        DecisionTreeClassifier c("Gini", "Binned", 10, 2, 1, 0.0, 0, 0, 0, class_weight);
+        c._transport = &worker;
+        c.fit(shard, as_view<double>(y_shard), DataView<double>());
+
+        Mat result = c.predict(X);
+        int n_same = 0;
+        for (int i = 0; i < result.total(); i++)
+            n_same += (result.at<double>(i) == expected.at<double>(i));
+        cout << "worker: " << rank << "\t" << "same as single process: "
+             << n_same << "/" << result.total() << endl;
+        _exit(0);
+    }
+    for (int rank = 0; rank < n_workers; rank++)
+        wait(NULL);
+    return 0;
+}
+
+int DecisionTreeDataParallelShards_test(QString filename, int n_workers)
+{
+    QString fn = QString("../test_data/Classification/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_classification(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat class_weight = Mat::ones(0, 0, CV_64F);
+
+    // Edges shared by all the workers
+    BinnedMatrix reference;
+    reference.fit(as_view<double>(X), 32);
+
+    DecisionTreeClassifier single("Gini", "Binned", 10, 2, 1, 0.0, 0, 0, 0, class_weight);
+    single.fit(reference, as_view<double>(y), DataView<double>());
+    Mat expected = single.predict(X);
+
+    SharedMemoryTransport transport;
+    if (n_workers < 2 || transport.create("/decisiontree_test", n_workers, 4096) != 0)
+        return 1;
+
+    cout.flush();
+    for (int rank = 0; rank < n_workers; rank++)
+    {
+        if (fork() != 0)
+            continue;
+
+        // The last worker has an empty shard, worker rank < n_workers - 1
+        // trains on the rows rank, rank + n_workers - 1, ...
+        int n_rows = 0;
+        if (rank < n_workers - 1)
+            n_rows = (X.rows - rank + n_workers - 2) / (n_workers - 1);
+        Mat X_shard(n_rows, X.cols, CV_64F);
+        Mat y_shard(n_rows, 1, CV_64F);
+        for (int r = 0; r < n_rows; r++)
+        {
+            X.row(rank + r * (n_workers - 1)).copyTo(X_shard.row(r));
+            y_shard.at<double>(r) = y.at<double>(rank + r * (n_workers - 1));
+        }
+        BinnedMatrix shard;
+        shard.transform(as_view<double>(X_shard), reference);
+
+        SharedMemoryTransport worker;
+        worker.attach("/decisiontree_test", rank);
+        DecisionTreeClassifier c("Gini", "Binned", 10, 2, 1, 0.0, 0, 0, 0, class_weight);
+        c._transport = &worker;
+        int error_code = c.fit(shard, as_view<double>(y_shard), DataView<double>());
+
+        Mat result = c.predict(X);
+        int n_same = 0;
+        for (int i = 0; i < result.total(); i++)
+            n_same += (result.at<double>(i) == expected.at<double>(i));
+
+        // Worker 0 has a sample weight too many, every worker returns its
+        // error code instead of waiting for it
+        Mat sample_weight = Mat::ones(n_rows + (rank == 0), 1, CV_64F);
+        int invalid_error_code = c.fit(shard, as_view<double>(y_shard), as_view<double>(sample_weight));
+        cout << "worker: " << rank << "\t" << "rows: " << n_rows << "\t"
+             << "error_code: " << error_code << "\t" << "same as single process: "
+             << n_same << "/" << result.total() << "\t"
+             << "invalid shard error_code: " << invalid_error_code << endl;
+        _exit(0);
+    }
+    for (int rank = 0; rank < n_workers; rank++)
+        wait(NULL);
+    return 0;
+}
+
+int DecisionTreeFeatureParallel_test(QString filename, int n_workers)
+{
+    QString fn = QString("../test_data/Regression/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_regression(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat sample_weight = Mat::ones(200, 1, CV_64F);
+    Mat class_weight = Mat::ones(0, 0, CV_64F);
+
+    DecisionTreeRegressor single("MSE", "Best", 6, 2, 1, 0.0, 0, 0, 0, class_weight);
+    single.fit(X, y, sample_weight);
+    Mat expected = single.predict(X);
+
+    SharedMemoryTransport transport;
+    if (transport.create("/decisiontree_test", n_workers, 4096) != 0)
+        return 1;
+
+    cout.flush();
+    for (int rank = 0; rank < n_workers; rank++)
+    {
+        if (fork() != 0)
+            continue;
+
+        // Worker rank holds all the rows of the columns rank, rank + n_workers, ...
+        vector<int> columns;
+        for (int j = rank; j < X.cols; j += n_workers)
+            columns.push_back(j);
+        Mat X_columns(X.rows, columns.size(), CV_64F);
+        for (int c = 0; c < columns.size(); c++)
+            X.col(columns[c]).copyTo(X_columns.col(c));
+
+        SharedMemoryTransport worker;
+        worker.attach("/decisiontree_test", rank);
+        DecisionTreeRegressor r("MSE", "Best", 6, 2, 1, 0.0, 0, 0, 0, class_weight);
+        r._transport = &worker;
+        r._feature_indices = DataView<int>(&columns[0], columns.size(), 1);
+        r.fit(X_columns, y, sample_weight);
+
+        // The tree splits on the global features, node for node as the
+        // single process, with the same sums
+        Tree* a = single._tree;
+        Tree* b = r._tree;
+        int n_same_nodes = 0;
+        for (int i = 0; i < std::min(a->_node_count, b->_node_count); i++)
+            n_same_nodes += (a->_nodes[i] == b->_nodes[i] && a->_value[i] == b->_value[i]);
+        Mat result = r.predict(X);
+        int n_same = 0;
+        for (int i = 0; i < result.total(); i++)
+            n_same += (result.at<double>(i) == expected.at<double>(i));
+        cout << "worker: " << rank << "\t" << "nodes: " << b->_node_count << "/" << a->_node_count << "\t"
+             << "same nodes: " << n_same_nodes << "/" << a->_node_count << "\t"
+             << "same as single process: " << n_same << "/" << result.total() << endl;
+        _exit(0);
+    }
+    for (int rank = 0; rank < n_workers; rank++)
+        wait(NULL);
+    return 0;
+}
+
+int HoeffdingTree_test(QString filename, int window)
+{
+    QString fn = QString("../test_data/Classification/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_classification(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    // The rows come as a stream of batches of 10, read again at every epoch.
+    // epsilon falls below the tie threshold of 0.1 from a leaf weight of
+    // 231, so the leaves of a window of 1000 events can split
+    HoeffdingTree h("Gini", 2, 32, 50, 1e-2, 0.1, 0, 64, 0);
+    HoeffdingTree windowed("Gini", 2, 32, 50, 1e-2, 0.1, 0, 64, window);
+    for (int epoch = 1; epoch <= 50; epoch++)
+    {
+        for (int start = 0; start < X.rows; start += 10)
+        {
+            Mat X_batch(10, X.cols, CV_64F, X.ptr<double>(start), X.step);
+            Mat y_batch(10, 1, CV_64F, y.ptr<double>(start), y.step);
+            h.partial_fit(X_batch, y_batch);
+            windowed.partial_fit(X_batch, y_batch);
+        }
+        if (epoch % 10 != 0)
+            continue;
+
+        Mat result = h.predict(X);
+        Mat windowed_result = windowed.predict(X);
+        int n_correct = 0;
+        int n_windowed_correct = 0;
+        for (int i = 0; i < result.total(); i++)
+        {
+            n_correct += (result.at<double>(i) == y.at<double>(i));
+            n_windowed_correct += (windowed_result.at<double>(i) == y.at<double>(i));
+        }
+        cout << "events: " << h._n_events << "\t"
+             << "nodes: " << h._tree->_node_count << "\t"
+             << "correct: " << n_correct << "/" << result.total() << "\t"
+             << "windowed nodes: " << windowed._tree->_node_count << "\t"
+             << "windowed correct: " << n_windowed_correct << "/" << result.total() << endl;
+    }
+
+    // Drift: the labels flip, only the windowed tree forgets the old ones.
+    // Once a window of flipped events is read, its leaves hold only those
+    Mat flipped = y.clone();
+    for (int i = 0; i < flipped.total(); i++)
+        flipped.at<double>(i) = 1.0 - y.at<double>(i);
+    for (int epoch = 1; epoch <= 10; epoch++)
+    {
+        h.partial_fit(X, flipped);
+        windowed.partial_fit(X, flipped);
+        if (epoch % 5 != 0)
+            continue;
+
+        Mat result = h.predict(X);
+        Mat windowed_result = windowed.predict(X);
+        int n_correct = 0;
+        int n_windowed_correct = 0;
+        for (int i = 0; i < result.total(); i++)
+        {
+            n_correct += (result.at<double>(i) == flipped.at<double>(i));
+            n_windowed_correct += (windowed_result.at<double>(i) == flipped.at<double>(i));
+        }
+        cout << "after drift, events: " << epoch * X.rows << "\t"
+             << "correct: " << n_correct << "/" << result.total() << "\t"
+             << "windowed correct: " << n_windowed_correct << "/" << result.total() << endl;
+    }
+    return 0;
+}
+
+int DecisionTreeBundled_test(QString filename, double max_conflict_rate)
+{
+    QString fn = QString("../test_data/Classification/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_classification(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    // One-hot encode every feature cut in 8 ranges: the 8 columns of a
+    // feature are mutually exclusive
+    int n_ranges = 8;
+    Mat one_hot = Mat::zeros(X.rows, X.cols * n_ranges, CV_64F);
+    for (int i = 0; i < X.rows; i++)
+    {
+        for (int j = 0; j < X.cols; j++)
+        {
+            int range = static_cast<int>(X.at<double>(i, j) + 4.0);
+            range = std::min(std::max(range, 0), n_ranges - 1);
+            one_hot.at<double>(i, j * n_ranges + range) = 1.0;
+        }
+    }
+
+    Mat sample_weight = Mat::ones(200, 1, CV_64F);
+    Mat class_weight = Mat::ones(0, 0, CV_64F);
+
+    BinnedMatrix binned;
+    binned.fit(as_view<double>(one_hot), 256);
+    DecisionTreeClassifier c("Gini", "Binned", 10, 2, 1, 0.0, 0, 0, 0, class_weight);
+    c.fit(binned, as_view<double>(y), as_view<double>(sample_weight));
+    Mat expected = c.predict(one_hot);
+
+    BinnedMatrix bundled;
+    bundled.fit(as_view<double>(one_hot), 256);
+    bundled.bundle(max_conflict_rate);
+    DecisionTreeClassifier b("Gini", "Binned", 10, 2, 1, 0.0, 0, 0, 0, class_weight);
+    b.fit(bundled, as_view<double>(y), as_view<double>(sample_weight));
+    Mat result = b.predict(one_hot);
+
+    // The splits are on the original columns
+    int n_same = 0;
+    for (int i = 0; i < result.total(); i++)
+        n_same += (result.at<double>(i) == expected.at<double>(i));
+    cout << "columns: " << one_hot.cols << "\t"
+         << "bundles: " << bundled.bundles.size() << "\t"
+         << "same as unbundled: " << n_same << "/" << result.total() << endl;
+    return 0;
+}
+
+int DecisionTreeNuma_test(QString filename, int placement)
+{
+    QString fn = QString("../test_data/Classification/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_classification(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat sample_weight = Mat::ones(200, 1, CV_64F);
+    Mat class_weight = Mat::ones(0, 0, CV_64F);
+
+    // The columns binned by pinned threads get the same codes
+    BinnedMatrix serial;
+    serial.fit(as_view<double>(X), 256);
+    BinnedMatrix pinned;
+    pinned.fit(as_view<double>(X), 256, 0, static_cast<NumaPlacement>(placement));
+    int n_same = 0;
+    for (int i = 0; i < X.rows; i++)
+    {
+        for (int j = 0; j < X.cols; j++)
+            n_same += (serial.code(i, j) == pinned.code(i, j));
+    }
+
+    DecisionTreeClassifier c("Gini", "Binned", 10, 2, 1, 0.0, 0, 0, 0, class_weight);
+    c._numa_placement = static_cast<NumaPlacement>(placement);
+    Mat test_scores;
+    cross_validate(c, X, y, sample_weight, 5, test_scores, 0);
+    cout << "nodes: " << numa_node_count() << "\t"
+         << "same codes: " << n_same << "/" << X.total() << endl;
+    for (int i = 0; i < test_scores.rows; i++)
+        cout << "fold: " << i << "\t" << "accuracy: " << test_scores.at<double>(i) << endl;
+    return 0;
+}
+
+int DecisionTreePermutationImportance_test(QString filename)
+{
+    QString fn = QString("../test_data/Classification/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_classification(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat sample_weight = Mat::ones(200, 1, CV_64F);
+    Mat class_weight = Mat::ones(0, 0, CV_64F);
+
+    DecisionTreeClassifier c("Gini", "Best", 10, 2, 1, 0.0, 0, 0, 0, class_weight);
+    c.fit(X, y, sample_weight);
+    Mat importances = c.permutation_importance(X, y, sample_weight, 10, 0, 4);
+    Mat impurity = c.feature_importances();
+    for (int j = 0; j < importances.rows; j++)
+    {
+        double mean = 0.0;
+        for (int r = 0; r < importances.cols; r++)
+            mean += importances.at<double>(j, r) / importances.cols;
+        cout << "feature: " << j << "\t" << "permutation: " << mean << "\t"
+             << "impurity: " << impurity.at<double>(j) << endl;
+    }
+    return 0;
+}
+
+int DecisionTreePartialDependence_test(QString filename)
+{
+    QString fn = QString("../test_data/Classification/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_classification(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat sample_weight = Mat::ones(200, 1, CV_64F);
+    Mat class_weight = Mat::ones(0, 0, CV_64F);
+
+    DecisionTreeClassifier c("Gini", "Best", 10, 2, 1, 0.0, 0, 0, 0, class_weight);
+    c.fit(X, y, sample_weight);
+
+    // Two-feature grid on the two most important features, the fraction of
+    // every class at each point
+    Mat importances = c.feature_importances();
+    vector<int> features;
+    for (int j = 0; j < importances.total(); j++)
+        features.push_back(j);
+    std::sort(features.begin(), features.end(), [&](int a, int b) {
+        return importances.at<double>(a) > importances.at<double>(b);
+    });
+    features.resize(2);
+    Mat grid = partial_dependence_grid(X, features, 5);
+    Mat pd = c.partial_dependence(features, grid, 4);
+    for (int g = 0; g < grid.rows; g++)
+    {
+        cout << "x" << features[0] << ": " << grid.at<double>(g, 0) << "\t"
+             << "x" << features[1] << ": " << grid.at<double>(g, 1);
+        for (int k = 0; k < pd.cols; k++)
+            cout << "\t" << pd.at<double>(g, k);
+        cout << endl;
+    }
+
+    // The recursion gives the mean prediction over X with the target
+    // features set to the grid values when no split on another feature lies
+    // below a split on a target feature, e.g. when the target features are
+    // those split at depth 1 of a tree of depth 2
+    DecisionTreeClassifier stump("Gini", "Best", 2, 2, 1, 0.0, 0, 0, 0, class_weight);
+    stump.fit(X, y, sample_weight);
+    Tree* tree = stump._tree;
+    vector<int> stump_features;
+    int children[2] = {tree->_nodes[0].left_child, tree->_nodes[0].right_child};
+    for (int side = 0; side < 2; side++)
+    {
+        int feature = tree->_nodes[children[side]].feature;
+        if (tree->_nodes[children[side]].left_child != TREE_LEAF &&
+            std::find(stump_features.begin(), stump_features.end(), feature) == stump_features.end())
+            stump_features.push_back(feature);
+    }
+    grid = partial_dependence_grid(X, stump_features, 5);
+    pd = stump.partial_dependence(stump_features, grid);
+    double max_diff = 0.0;
+    for (int g = 0; g < grid.rows; g++)
+    {
+        Mat X_grid = X.clone();
+        for (int i = 0; i < X.rows; i++)
+            for (int t = 0; t < stump_features.size(); t++)
+                X_grid.at<double>(i, stump_features[t]) = grid.at<double>(g, t);
+        Mat proba = stump.predict_proba(X_grid);
+        for (int k = 0; k < pd.cols; k++)
+        {
+            double mean = 0.0;
+            for (int i = 0; i < X.rows; i++)
+                mean += proba.at<double>(i, k);
+            max_diff = std::max(max_diff, std::abs(mean / X.rows - pd.at<double>(g, k)));
+        }
+    }
+    cout << "depth 2, target features: " << stump_features.size() << "\t"
+         << "grid points: " << grid.rows << "\t"
+         << "max difference to the mean prediction: " << max_diff << endl;
+    return 0;
+}
+
+int DecisionTreeApply_test(QString filename)
+{
+    QString fn = QString("../test_data/Classification/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_classification(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat sample_weight = Mat::ones(200, 1, CV_64F);
+    Mat class_weight = Mat::ones(0, 0, CV_64F);
+
+    DecisionTreeClassifier c("Gini", "Best", 10, 2, 1, 0.0, 0, 0, 0, class_weight);
+    c.fit(X, y, sample_weight);
+    Mat leaves = c.apply(X, 4);
+    CsrMatrix path = c.decision_path(X, 4);
+
+    // A path runs from the root to the leaf
+    int n_consistent = 0;
+    for (int i = 0; i < X.rows; i++)
+        n_consistent += (path.indices[path.indptr[i]] == 0 &&
+                         path.indices[path.indptr[i + 1] - 1] == leaves.at<int>(i));
+    cout << "nodes: " << path.cols << "\t" << "nonzeros: " << path.indptr[X.rows] << "\t"
+         << "paths ending at their leaf: " << n_consistent << "/" << X.rows << endl;
+    return 0;
+}
+
+int DecisionTreePredictProba_test(QString filename)
+{
+    QString fn = QString("../test_data/Classification/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_classification(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat sample_weight = Mat::ones(200, 1, CV_64F);
+    Mat class_weight = Mat::ones(0, 0, CV_64F);
+
+    DecisionTreeClassifier c("Gini", "Best", 3, 2, 1, 0.0, 0, 0, 0, class_weight);
+    c.fit(X, y, sample_weight);
+
+    // The second call writes into the buffer of the first one
+    Mat proba;
+    c.predict_proba(X, proba, 4);
+    const uchar* buffer = proba.data;
+    c.predict_proba(X, proba, 4);
+    Mat log_proba = c.predict_log_proba(X);
+    Mat result = c.predict(X);
+    for (int i = 0; i < 10; i++)
+    {
+        cout << "predict: " << result.at<double>(i);
+        for (int k = 0; k < proba.cols; k++)
+            cout << "\t" << proba.at<double>(i, k) << " (" << log_proba.at<double>(i, k) << ")";
+        cout << endl;
+    }
+    cout << "buffer reused: " << (proba.data == buffer) << endl;
+    return 0;
+}
+
+int DecisionTreePredictBinned_test(QString filename)
+{
+    QString fn = QString("../test_data/Regression/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_regression(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat class_weight = Mat::ones(0, 0, CV_64F);
+
+    // The binned splitter splits on the edges of the training codes
+    BinnedMatrix binned;
+    binned.fit(as_view<double>(X), 256);
+    DecisionTreeRegressor r("MSE", "Binned", 10, 2, 1, 0.0, 0, 0, 0, class_weight);
+    r.fit(binned, as_view<double>(y), DataView<double>());
+    int error_code = r.bin_thresholds(binned);
+    Mat result = r.predict(X);
+    Mat binned_result = r.predict_binned(binned.view8(), 4);
+    int n_equal = 0;
+    for (int i = 0; i < X.rows; i++)
+        n_equal += (result.at<double>(i) == binned_result.at<double>(i));
+    cout << "binned splitter: error_code " << error_code << "\t"
+         << "equal predictions: " << n_equal << "/" << X.rows << endl;
+
+    // Any other tree is binned on its own thresholds
+    DecisionTreeRegressor best("MSE", "Best", 10, 2, 1, 0.0, 0, 0, 0, class_weight);
+    best.fit(X, y, Mat());
+    vector<vector<double> > edges;
+    best._tree->split_thresholds(edges);
+    BinnedMatrix quantizer;
+    quantizer.set_edges(edges);
+    error_code = best.bin_thresholds(quantizer);
+    BinnedMatrix codes;
+    codes.transform(as_view<double>(X), quantizer);
+    result = best.predict(X);
+    binned_result = codes.is_wide ? best.predict_binned(codes.view16(), 4)
+                                  : best.predict_binned(codes.view8(), 4);
+    n_equal = 0;
+    for (int i = 0; i < X.rows; i++)
+        n_equal += (result.at<double>(i) == binned_result.at<double>(i));
+    cout << "best splitter: error_code " << error_code << "\t"
+         << "equal predictions: " << n_equal << "/" << X.rows << endl;
+    return 0;
+}
+
+int DecisionTreeCompress_test(QString filename)
+{
+    QString fn = QString("../test_data/Regression/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_regression(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat class_weight = Mat::ones(0, 0, CV_64F);
+
+    const char* codings[] = {"float32", "index"};
+    for (int coding = THRESHOLD_FLOAT32; coding <= THRESHOLD_INDEX; coding++)
+    {
+        DecisionTreeRegressor r("MSE", "Best", 0, 2, 1, 0.0, 0, 0, 0, class_weight);
+        r.fit(X, y, Mat());
+        CompressionReport report;
+        int error_code = r.compress(static_cast<ThresholdCoding>(coding), report, X, true);
+        Mat result = r.predict(X);
+        cout << codings[coding] << ": error_code " << error_code << "\t"
+             << "bytes: " << report.original_bytes << " -> " << report.compressed_bytes << "\t"
+             << "threshold shift: " << report.max_threshold_shift << "\t"
+             << "error bound: " << report.value_error_bound << "\t"
+             << "max error: " << report.max_error << "\t"
+             << "predict[0]: " << result.at<double>(0) << endl;
+    }
+    return 0;
+}
+
+int DecisionTreeDag_test(QString filename)
+{
+    QString fn = QString("../test_data/Classification/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_classification(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat sample_weight = Mat::ones(200, 1, CV_64F);
+    Mat class_weight = Mat::ones(0, 0, CV_64F);
+
+    // Trees of different depths share their lower subtrees
+    vector<DecisionTreeClassifier*> trees;
+    vector<const Tree*> fitted;
+    for (int max_depth = 4; max_depth <= 8; max_depth++)
+    {
+        DecisionTreeClassifier* c = new DecisionTreeClassifier("Gini", "Best", max_depth, 2, 1, 0.0, 0, 0, 0, class_weight);
+        c->fit(X, y, sample_weight);
+        trees.push_back(c);
+        fitted.push_back(c->_tree);
+    }
+    TreeDag dag;
+    int error_code = dag.add_trees(fitted);
+    Mat result = dag.predict(as_view<double>(X), 4);
+    int n_equal = 0;
+    for (size_t t = 0; t < trees.size(); t++)
+    {
+        Mat tree_result = trees[t]->predict(X);
+        for (int i = 0; i < X.rows; i++)
+            n_equal += (tree_result.at<double>(i) == result.at<double>(i, static_cast<int>(t)));
+    }
+    cout << "error_code: " << error_code << "\t"
+         << "nodes: " << dag._n_tree_nodes << " -> " << dag._nodes.size() << "\t"
+         << "equal predictions: " << n_equal << "/" << X.rows * trees.size() << endl;
+    for (size_t t = 0; t < trees.size(); t++)
+        delete trees[t];
+    return 0;
+}
+
+int DecisionTreeMemoryUsage_test(QString filename)
+{
+    QString fn = QString("../test_data/Regression/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_regression(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat class_weight = Mat::ones(0, 0, CV_64F);
+
+    char splitters[2][8] = {"Best", "Binned"};
+    for (int s = 0; s < 2; s++)
+    {
+        DecisionTreeRegressor r("MSE", splitters[s], 0, 2, 1, 0.0, 0, 0, 0, class_weight);
+        MemoryUsage estimate = r.estimate_fit_memory(X.rows, X.cols);
+        r.fit(X, y, Mat());
+        cout << splitters[s] << endl;
+        for (size_t p = 0; p < r._fit_memory.parts.size(); p++)
+            cout << "  " << r._fit_memory.parts[p].first << ": " << r._fit_memory.parts[p].second << endl;
+        cout << "peak: " << r._fit_memory.total() << "\t"
+             << "estimate: " << estimate.total() << "\t"
+             << "model: " << r.memory_usage().total() << endl;
+    }
+    return 0;
+}
+
+int DecisionTreeRandomSplitter_test(QString filename)
+{
+    QString fn = QString("../test_data/Classification/").append(filename);
+    pair<Mat, Mat> pMat = read_data_from_txt_classification(fn);
+    Mat X = pMat.first;
+    Mat y = pMat.second;
+
+    Mat class_weight = Mat::ones(0, 0, CV_64F);
+
+    // Fully grown, the random thresholds still separate every sample, and
+    // the children of every split must cover the samples of their parent
+    DecisionTreeClassifier c("Gini", "Random", 0, 2, 1, 0.0, 0, 0, 0, class_weight);
+    c.fit(X, y, Mat());
+    Mat result = c.predict(X);
+    int n_correct = 0;
+    for (int i = 0; i < result.total(); i++)
+        if (result.at<double>(i) == y.at<double>(i))
+            n_correct++;
+    cout << "Correct: " << n_correct << "/" << result.total() << endl;
+
+    const vector<Node>& nodes = c._tree->_nodes;
+    for (int i = 0; i < c._tree->_node_count; i++)
+    {
+        if (nodes[i].left_child == TREE_LEAF)
+            continue;
+        const Node& left = nodes[nodes[i].left_child];
+        const Node& right = nodes[nodes[i].right_child];
+        if (left.n_node_samples < 1 || right.n_node_samples < 1 ||
+            left.n_node_samples + right.n_node_samples != nodes[i].n_node_samples)
+            cout << "Wrong split at node " << i << endl;
+    }
+    return 0;
 }
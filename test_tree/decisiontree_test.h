@@ -4,5 +4,28 @@
 
 int DecisionTreeClassification_test(QString);
 int DecisionTreeRegression_test(QString);
+int DecisionTreeRegressionFloat_test(QString);
+int DecisionTreeBinned_test(QString, int);
+int DecisionTreeMultiOutput_test(QString);
+int DecisionTreeBoundedSearch_test(QString);
+int DecisionTreePruning_test(QString);
+int DecisionTreeShap_test(QString);
+int DecisionTreeRefitLeaves_test(QString);
+int DecisionTreeCrossValidation_test(QString);
+int DecisionTreeDataParallel_test(QString, int);
+int DecisionTreeDataParallelShards_test(QString, int);
+int DecisionTreeFeatureParallel_test(QString, int);
+int HoeffdingTree_test(QString, int);
+int DecisionTreeBundled_test(QString, double);
+int DecisionTreeNuma_test(QString, int);
+int DecisionTreePermutationImportance_test(QString);
+int DecisionTreePartialDependence_test(QString);
+int DecisionTreeApply_test(QString);
+int DecisionTreePredictProba_test(QString);
+int DecisionTreePredictBinned_test(QString);
+int DecisionTreeCompress_test(QString);
+int DecisionTreeDag_test(QString);
+int DecisionTreeMemoryUsage_test(QString);
+int DecisionTreeRandomSplitter_test(QString);
 
 #endif // DECISIONTREE_TEST_H
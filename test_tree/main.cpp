@@ -28,12 +28,14 @@ int main()
 //    Entropy_test();
 //    MSE_test();
 //    FriedmanMSE_test();
+//    MAE_test();
 
     // Splitter_test
 //    BestSplitter_classification_test("Gini", "test4.txt");
 //    BestSplitter_classification_test("Entropy", "test4.txt");
 //    BestSplitter_regression_test("MSE", "test4.txt");
 //    BestSplitter_regression_test("FriedmanMSE", "test1.txt");
+//    BestSplitter_regression_test("MAE", "test3.txt");
 //    RandomSplitter_test();
 
     // Util_test
@@ -43,6 +45,30 @@ int main()
 //    DecisionTreeClassification_test("test3.txt");
     DecisionTreeRegression_test("test3.txt");
     DecisionTreeRegression_test("test2.txt");
+//    DecisionTreeRegressionFloat_test("test1.txt");
+//    DecisionTreeBinned_test("test3.txt", 32);
+//    DecisionTreeMultiOutput_test("test3.txt");
+//    DecisionTreeBoundedSearch_test("test3.txt");
+//    DecisionTreePruning_test("test3.txt");
+//    DecisionTreeShap_test("test3.txt");
+//    DecisionTreeRefitLeaves_test("test3.txt");
+//    DecisionTreeCrossValidation_test("test3.txt");
+//    DecisionTreeDataParallel_test("test3.txt", 4);
+//    DecisionTreeDataParallelShards_test("test3.txt", 4);
+//    DecisionTreeFeatureParallel_test("test3.txt", 1);
+//    DecisionTreeFeatureParallel_test("test3.txt", 4);
+//    HoeffdingTree_test("test3.txt", 1000);
+//    DecisionTreeBundled_test("test3.txt", 0.0);
+//    DecisionTreeNuma_test("test3.txt", 2);
+//    DecisionTreePermutationImportance_test("test3.txt");
+//    DecisionTreePartialDependence_test("test3.txt");
+//    DecisionTreeApply_test("test3.txt");
+//    DecisionTreePredictProba_test("test3.txt");
+//    DecisionTreePredictBinned_test("test3.txt");
+//    DecisionTreeCompress_test("test3.txt");
+//    DecisionTreeDag_test("test3.txt");
+//    DecisionTreeMemoryUsage_test("test3.txt");
+//    DecisionTreeRandomSplitter_test("test3.txt");
 
     // Tools
 }
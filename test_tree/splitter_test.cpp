@@ -28,11 +28,13 @@ int BestSplitter_classification_test(char* criterion_name, QString filename)
         g = new MSE();
     else if (strcmp(criterion_name, "FriedmanMSE") == 0)
         g = new FriedmanMSE();
+    else if (strcmp(criterion_name, "MAE") == 0)
+        g = new MAE();
 
     SplitRecord split;
     int const_feature = 0;
-    BestSplitter bs(g, 20, 2, 1., 0);
-    bs.init(X, y, sample_weight);
+    BestSplitter<double> bs(g, 20, 2, 1., 0);
+    bs.init(as_view<double>(X), as_view<double>(y), as_view<double>(sample_weight));
     double weighted_n_samples = bs.node_reset(0, 200);
     double impurity = bs.node_impurity();
     bs.node_split(impurity, &split, &const_feature);
@@ -56,11 +58,13 @@ int BestSplitter_regression_test(char* criterion_name, QString filename)
         g = new MSE();
     else if (strcmp(criterion_name, "FriedmanMSE") == 0)
         g = new FriedmanMSE();
+    else if (strcmp(criterion_name, "MAE") == 0)
+        g = new MAE();
 
     SplitRecord split;
     int const_feature = 0;
-    BestSplitter bs(g, 20, 2, 1., 0);
-    bs.init(X, y, sample_weight);
+    BestSplitter<double> bs(g, 20, 2, 1., 0);
+    bs.init(as_view<double>(X), as_view<double>(y), as_view<double>(sample_weight));
     double weighted_n_samples = bs.node_reset(0, 200);
     double impurity = bs.node_impurity();
     bs.node_split(impurity, &split, &const_feature);
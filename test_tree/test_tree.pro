@@ -19,6 +19,16 @@ HEADERS += criterion_test.h \
            ../tree/tree.h \
            ../tree/treebuilder.h \
            ../tree/util.h \
+           ../tree/dataview.h \
+           ../tree/binnedmatrix.h \
+           ../tree/arena.h \
+           ../tree/crossvalidation.h \
+           ../tree/transport.h \
+           ../tree/hoeffdingtree.h \
+           ../tree/numa.h \
+           ../tree/compressedtree.h \
+           ../tree/treedag.h \
+           ../tree/memoryusage.h \
     decisiontree_test.h
 
 SOURCES += main.cpp \
@@ -32,9 +42,24 @@ SOURCES += main.cpp \
            ../tree/tree.cpp \
            ../tree/treebuilder.cpp \
            ../tree/util.cpp \
+           ../tree/binnedmatrix.cpp \
+           ../tree/arena.cpp \
+           ../tree/crossvalidation.cpp \
+           ../tree/transport.cpp \
+           ../tree/hoeffdingtree.cpp \
+           ../tree/numa.cpp \
+           ../tree/compressedtree.cpp \
+           ../tree/treedag.cpp \
     decisiontree_test.cpp
 
 LIBS += -L/usr/local/lib
 LIBS += -lopencv_core
 
+# parallel_for runs on std::thread
+QMAKE_CXXFLAGS += -pthread
+LIBS += -pthread
+
+# shm_open of SharedMemoryTransport
+LIBS += -lrt
+
 TARGET = test_tree
@@ -0,0 +1,135 @@
+#include "arena.h"
+#include <cstdlib>
+
+Arena::Arena(size_t _block_size)
+    : block_size(_block_size),
+      current(0),
+      used(0),
+      peak(0)
+{
+
+}
+
+Arena::~Arena()
+{
+    release();
+}
+
+void* Arena::allocate(size_t n_bytes,
+                      size_t alignment)
+{
+    if (n_bytes == 0)
+        n_bytes = 1;
+
+    // Bump in the current block, or the next kept block large enough
+    for (; current < blocks.size(); current++)
+    {
+        Block& block = blocks[current];
+        size_t address = reinterpret_cast<size_t>(block.data) + block.used;
+        size_t padding = (alignment - address % alignment) % alignment;
+
+        if (block.used + padding + n_bytes <= block.size)
+        {
+            block.used += padding + n_bytes;
+            used += padding + n_bytes;
+            peak = (used > peak) ? used : peak;
+            return block.data + block.used - n_bytes;
+        }
+    }
+
+    // Request a new block, large allocations get a block of their own
+    Block block;
+    block.size = n_bytes + alignment > block_size ? n_bytes + alignment : block_size;
+    block.data = static_cast<char*>(std::malloc(block.size));
+    if (block.data == NULL)
+        throw std::bad_alloc();
+
+    size_t address = reinterpret_cast<size_t>(block.data);
+    size_t padding = (alignment - address % alignment) % alignment;
+    block.used = padding + n_bytes;
+    used += padding + n_bytes;
+    peak = (used > peak) ? used : peak;
+
+    blocks.push_back(block);
+    current = blocks.size() - 1;
+    return block.data + padding;
+}
+
+void Arena::reset()
+{
+    for (size_t i = 0; i < blocks.size(); i++)
+        blocks[i].used = 0;
+    current = 0;
+    used = 0;
+}
+
+void Arena::release()
+{
+    for (size_t i = 0; i < blocks.size(); i++)
+        std::free(blocks[i].data);
+    blocks.clear();
+    current = 0;
+    used = 0;
+}
+
+size_t Arena::bytes_reserved() const
+{
+    size_t total = 0;
+    for (size_t i = 0; i < blocks.size(); i++)
+        total += blocks[i].size;
+    return total;
+}
+
+size_t Arena::high_water_mark() const
+{
+    return peak;
+}
+
+void Arena::reset_high_water_mark()
+{
+    peak = used;
+}
+
+NodePool::NodePool()
+    : arena(NULL),
+      node_size(0),
+      free_list(NULL),
+      n_bytes_allocated(0)
+{
+
+}
+
+void* NodePool::allocate(size_t n_bytes,
+                         size_t alignment)
+{
+    if (n_bytes == node_size && free_list != NULL)
+    {
+        void* node = free_list;
+        free_list = *static_cast<void**>(node);
+        return node;
+    }
+
+    // The first node fixes the size of the nodes recycled
+    if (node_size == 0 && n_bytes >= sizeof(void*) && alignment >= alignof(void*))
+        node_size = n_bytes;
+
+    n_bytes_allocated += n_bytes;
+    Arena* from = (arena != NULL) ? arena : &own_arena;
+    return from->allocate(n_bytes, alignment);
+}
+
+void NodePool::deallocate(void* p,
+                          size_t n_bytes)
+{
+    // Other sizes stay in the arena until it is reset
+    if (n_bytes != node_size)
+        return;
+
+    *static_cast<void**>(p) = free_list;
+    free_list = p;
+}
+
+size_t NodePool::bytes_allocated() const
+{
+    return n_bytes_allocated;
+}
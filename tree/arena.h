@@ -0,0 +1,251 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+//========================================
+// Arena
+// Bump allocator for the scratch memory of a fit
+//========================================
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <vector>
+using std::vector;
+
+/**
+ * @brief Memory arena handing out scratch memory by bumping a pointer in
+ * large blocks.
+ *
+ * Individual allocations are never freed. reset() rewinds every block in
+ * one step and keeps them for the next fit, release() gives the blocks
+ * back to the system. An Arena is not thread safe: use one per fit.
+ */
+class Arena
+{
+public:
+    /**
+     * @param block_size Size in bytes of the blocks requested from the system
+     */
+    Arena(size_t block_size=1 << 20);
+    ~Arena();
+
+    /**
+     * @brief Allocate n_bytes of uninitialized memory.
+     * @param n_bytes
+     * @param alignment A power of two
+     * @return address of the memory
+     */
+    void* allocate(size_t n_bytes,
+                   size_t alignment);
+
+    /**
+     * @brief Rewind all the blocks, every allocation becomes invalid.
+     * The blocks are kept and reused by the next allocations.
+     */
+    void reset();
+
+    /**
+     * @brief Free all the blocks.
+     */
+    void release();
+
+    /**
+     * @brief Number of bytes requested from the system
+     */
+    size_t bytes_reserved() const;
+
+    /**
+     * @brief Largest number of bytes handed out at once, alignment padding
+     * included, since the arena was created or reset_high_water_mark
+     */
+    size_t high_water_mark() const;
+
+    /**
+     * @brief Restart the high-water mark from the bytes handed out now,
+     * e.g. at the start of a fit on a shared arena
+     */
+    void reset_high_water_mark();
+
+private:
+    struct Block
+    {
+        char* data;
+        size_t size;
+        size_t used;
+    };
+
+    Arena(const Arena&);
+    Arena& operator= (const Arena&);
+
+public:
+    size_t block_size;
+    vector<Block> blocks;
+    size_t current;                 // Index of the block allocations are made in
+    size_t used;                    // Bytes handed out since the last reset
+    size_t peak;                    // Largest value of used, see high_water_mark
+};
+
+/**
+ * @brief STL allocator drawing from an Arena, or from the heap when the
+ * arena is NULL. deallocate() is a no-op on arena memory.
+ */
+template <typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    ArenaAllocator(Arena* _arena=NULL)
+        : arena(_arena)
+    {
+
+    }
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other)
+        : arena(other.arena)
+    {
+
+    }
+
+    T* allocate(size_t n)
+    {
+        if (arena == NULL)
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t /*n*/)
+    {
+        if (arena == NULL)
+            ::operator delete(p);
+    }
+
+public:
+    Arena* arena;
+};
+
+template <typename T, typename U>
+inline bool operator== (const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+    return a.arena == b.arena;
+}
+
+template <typename T, typename U>
+inline bool operator!= (const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+    return a.arena != b.arena;
+}
+
+/**
+ * @brief vector whose storage comes from an Arena
+ */
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+/**
+ * @brief Free list of the fixed size nodes of node based containers
+ * (multiset, map), carved from an Arena.
+ *
+ * The containers insert and erase all along a fit: the nodes given back are
+ * reused, so the arena only grows to the largest number of nodes alive at
+ * once. Without an arena the nodes are carved from an arena of the pool.
+ * The pool must outlive the containers using it.
+ */
+class NodePool
+{
+public:
+    NodePool();
+
+    /**
+     * @brief A node from the free list when n_bytes is the node size,
+     * carved from the arena otherwise
+     * @param n_bytes
+     * @param alignment A power of two
+     * @return address of the memory
+     */
+    void* allocate(size_t n_bytes,
+                   size_t alignment);
+
+    /**
+     * @brief Give a node back to the free list
+     * @param p
+     * @param n_bytes As passed to allocate
+     */
+    void deallocate(void* p,
+                    size_t n_bytes);
+
+    /**
+     * @brief Bytes carved from the arena, the free nodes included
+     */
+    size_t bytes_allocated() const;
+
+private:
+    NodePool(const NodePool&);
+    NodePool& operator= (const NodePool&);
+
+public:
+    Arena* arena;                   // Scratch memory of the fit, NULL for own_arena
+    Arena own_arena;
+    size_t node_size;               // Bytes of the nodes recycled, 0 before the first one
+    void* free_list;                // Next free node in the first bytes of each
+    size_t n_bytes_allocated;
+};
+
+/**
+ * @brief STL allocator drawing from a NodePool, or from the heap when the
+ * pool is NULL
+ */
+template <typename T>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+
+    PoolAllocator(NodePool* _pool=NULL)
+        : pool(_pool)
+    {
+
+    }
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other)
+        : pool(other.pool)
+    {
+
+    }
+
+    T* allocate(size_t n)
+    {
+        if (pool == NULL)
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        return static_cast<T*>(pool->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        if (pool == NULL)
+            ::operator delete(p);
+        else
+            pool->deallocate(p, n * sizeof(T));
+    }
+
+public:
+    NodePool* pool;
+};
+
+template <typename T, typename U>
+inline bool operator== (const PoolAllocator<T>& a, const PoolAllocator<U>& b)
+{
+    return a.pool == b.pool;
+}
+
+template <typename T, typename U>
+inline bool operator!= (const PoolAllocator<T>& a, const PoolAllocator<U>& b)
+{
+    return a.pool != b.pool;
+}
+
+#endif // ARENA_H
@@ -1,14 +1,25 @@
 #include "basetree.h"
 #include "criterion.h"
 #include "splitter.h"
+#include "util.h"
+#include "binnedmatrix.h"
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <functional>
+#include <mutex>
+#include <random>
 
 Tree::Tree(int n_features,
-           int n_classes)
+           int n_classes,
+           int n_outputs)
     : _n_features(n_features),  // Input/Output layout
-      _n_classes(n_classes),    // Inner structures
+      _n_classes(n_classes),
+      _n_outputs(n_outputs),    // Inner structures
       _max_depth(0),
       _node_count(0),
-      _capacity(0)
+      _capacity(0),
+      _n_values(0)
 {
 
 }
@@ -68,18 +79,21 @@ int Tree::_add_node(int parent,
     return node_id;
 }
 
-Mat Tree::predict(Mat _X)
+template <typename DTYPE>
+Mat Tree::predict(DataView<DTYPE> _X)
 {
     // TODO: sparse matrix
     return _apply_dense(_X);
 }
 
-Mat Tree::_apply_dense(Mat _X)
+template <typename DTYPE>
+Mat Tree::_apply_dense(DataView<DTYPE> _X)
 {
     Node* node;
     int drop = 0;
     int n_samples = _X.rows;
-    Mat_<double> result(n_samples, 1);
+    Mat_<double> result(n_samples, _n_outputs);
+    bool has_tables = (_leaf_prediction.size() == static_cast<size_t>(_node_count) * _n_outputs);
 
     for (int i = 0; i < n_samples; i++)
     {
@@ -91,7 +105,7 @@ Mat Tree::_apply_dense(Mat _X)
         while (node->left_child != TREE_LEAF)
         {
             // and node.right_child != TreeType::TREE_LEAF
-            if (_X.at<double>(i, node->feature) <= node->threshold)
+            if (_X.at(i, node->feature) <= node->threshold)
             {
                 drop = node->left_child;
                 node = &(_nodes.at(node->left_child));
@@ -103,18 +117,1067 @@ Mat Tree::_apply_dense(Mat _X)
             }
         }
 
-        // Get the iterator of droped node
-        vector<double>::iterator c = max_element(_value.at(drop).begin(), _value.at(drop).end());
+        // The leaf tables, when normalize_leaves is up to date
+        if (has_tables)
+            std::memcpy(result.ptr<double>(i), &_leaf_prediction[static_cast<size_t>(drop) * _n_outputs],
+                        sizeof(double) * _n_outputs);
+        else
+            _node_prediction(drop, result.ptr<double>(i));
+    }
+    return result;
+}
+
+void Tree::_node_prediction(int node_id,
+                            double* prediction) const
+{
+    const vector<double>& value = _value.at(node_id);
+
+    // A multi-output regression leaf holds one value per output
+    if (_n_outputs > 1)
+    {
+        for (int k = 0; k < _n_outputs; k++)
+            prediction[k] = value.at(k);
+        return;
+    }
+
+    // Get the iterator of droped node
+    vector<double>::const_iterator c = max_element(value.begin(), value.end());
+
+    // If _value.size > 1, means this is a classification
+    if (value.size() > 1)
+        prediction[0] = static_cast<double>(distance(value.begin(), c));
+    else
+        prediction[0] = *c;
+}
+
+template <typename DTYPE>
+Mat Tree::apply(DataView<DTYPE> X,
+                int n_threads)
+{
+    int n_samples = X.rows;
+    if (_node_count == 0)
+        return Mat();
+
+    Mat result(n_samples, 1, CV_32S);
+    parallel_for(n_samples, n_threads, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            result.at<int>(i) = _find_leaf(X, i);
+    });
+    return result;
+}
+
+template <typename DTYPE>
+CsrMatrix Tree::decision_path(DataView<DTYPE> X,
+                              int n_threads)
+{
+    int n_samples = X.rows;
+    CsrMatrix path;
+    path.rows = n_samples;
+    path.cols = _node_count;
+    path.indptr.assign(n_samples + 1, 0);
+    if (_node_count == 0)
+        return path;
+
+    // Count, then fill
+    parallel_for(n_samples, n_threads, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            path.indptr[i + 1] = path_length(X, i);
+    });
+    for (int i = 0; i < n_samples; i++)
+        path.indptr[i + 1] += path.indptr[i];
+    path.indices.resize(path.indptr[n_samples]);
+    parallel_for(n_samples, n_threads, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            write_path(X, i, 0, &path.indices[path.indptr[i]]);
+    });
+    return path;
+}
+
+template <typename DTYPE>
+int Tree::path_length(const DataView<DTYPE>& X,
+                      int i) const
+{
+    int length = 1;
+    int node_id = 0;
+    while (_nodes[node_id].left_child != TREE_LEAF)
+    {
+        const Node& node = _nodes[node_id];
+        node_id = (X.at(i, node.feature) <= node.threshold) ? node.left_child : node.right_child;
+        length += 1;
+    }
+    return length;
+}
+
+template <typename DTYPE>
+int Tree::write_path(const DataView<DTYPE>& X,
+                     int i,
+                     int offset,
+                     int* path) const
+{
+    int length = 0;
+    int node_id = 0;
+    path[length++] = offset;
+    while (_nodes[node_id].left_child != TREE_LEAF)
+    {
+        const Node& node = _nodes[node_id];
+        node_id = (X.at(i, node.feature) <= node.threshold) ? node.left_child : node.right_child;
+        path[length++] = offset + node_id;
+    }
+    return length;
+}
+
+int Tree::leaf_ordinals(vector<int>& ordinal) const
+{
+    ordinal.assign(_node_count, -1);
+    int n_leaves = 0;
+    for (int n = 0; n < _node_count; n++)
+    {
+        if (_nodes[n].left_child == TREE_LEAF)
+            ordinal[n] = n_leaves++;
+    }
+    return n_leaves;
+}
+
+void Tree::normalize_leaves()
+{
+    int n_values = _value.empty() ? 0 : static_cast<int>(_value[0].size());
+    _n_values = n_values;
+    _leaf_prediction.resize(static_cast<size_t>(_node_count) * _n_outputs);
+    for (int n = 0; n < _node_count; n++)
+        _node_prediction(n, &_leaf_prediction[static_cast<size_t>(n) * _n_outputs]);
 
-        // If _value.size > 1, means this is a classification
-        if (_value.at(drop).size() > 1)
-            result.at<double>(i, 0) = static_cast<double>(distance(_value.at(drop).begin(), c));
+    // Class fractions of the leaves of a classification tree, a regression
+    // value is no probability
+    _leaf_row.clear();
+    _leaf_proba.clear();
+    _leaf_log_proba.clear();
+    if (_n_outputs > 1 || n_values < 2)
+        return;
+
+    int n_leaves = leaf_ordinals(_leaf_row);
+    _leaf_proba.resize(static_cast<size_t>(n_leaves) * n_values);
+    _leaf_log_proba.resize(static_cast<size_t>(n_leaves) * n_values);
+    for (int n = 0; n < _node_count; n++)
+    {
+        if (_leaf_row[n] < 0)
+            continue;
+
+        double* proba = &_leaf_proba[static_cast<size_t>(_leaf_row[n]) * n_values];
+        double* log_proba = &_leaf_log_proba[static_cast<size_t>(_leaf_row[n]) * n_values];
+        for (int k = 0; k < n_values; k++)
+        {
+            proba[k] = _node_output(n, k);
+            log_proba[k] = std::log(proba[k]);
+        }
+    }
+}
+
+template <typename DTYPE>
+void Tree::predict_proba(DataView<DTYPE> X,
+                         double* proba,
+                         bool log,
+                         int n_threads) const
+{
+    // A single class has no table, every sample is of that class
+    if (_leaf_proba.empty())
+    {
+        std::fill(proba, proba + static_cast<size_t>(X.rows) * _n_values, log ? 0.0 : 1.0);
+        return;
+    }
+
+    const vector<double>& table = log ? _leaf_log_proba : _leaf_proba;
+    size_t row_size = sizeof(double) * _n_values;
+    parallel_for(X.rows, n_threads, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            std::memcpy(proba + static_cast<size_t>(i) * _n_values,
+                        &table[static_cast<size_t>(_leaf_row[_find_leaf(X, i)]) * _n_values],
+                        row_size);
+    });
+}
+
+int Tree::bin_thresholds(const BinnedMatrix& quantizer)
+{
+    // A failed conversion leaves none, not that of an earlier quantizer
+    _bin_threshold.clear();
+    vector<uint16_t> bin_threshold(_node_count, 0);
+    for (int n = 0; n < _node_count; n++)
+    {
+        const Node& node = _nodes[n];
+        if (node.left_child == TREE_LEAF)
+            continue;
+        if (node.feature >= quantizer.cols)
+            return 1;
+
+        // x <= edges[k]  <=>  bin_value(x) <= k
+        const vector<double>& edges = quantizer.bin_edges[node.feature];
+        vector<double>::const_iterator edge = std::lower_bound(edges.begin(), edges.end(),
+                                                               node.threshold);
+        if (edge == edges.end() || *edge != node.threshold)
+            return 2;
+        bin_threshold[n] = static_cast<uint16_t>(edge - edges.begin());
+    }
+    _bin_threshold.swap(bin_threshold);
+    return 0;
+}
+
+void Tree::split_thresholds(vector<vector<double> >& edges) const
+{
+    edges.assign(_n_features, vector<double>());
+    for (int n = 0; n < _node_count; n++)
+    {
+        if (_nodes[n].left_child != TREE_LEAF)
+            edges[_nodes[n].feature].push_back(_nodes[n].threshold);
+    }
+    for (int j = 0; j < _n_features; j++)
+    {
+        std::sort(edges[j].begin(), edges[j].end());
+        edges[j].erase(std::unique(edges[j].begin(), edges[j].end()), edges[j].end());
+    }
+}
+
+MemoryUsage Tree::memory_usage() const
+{
+    size_t value_bytes = vector_bytes(_value);
+    for (size_t n = 0; n < _value.size(); n++)
+        value_bytes += vector_bytes(_value[n]);
+
+    MemoryUsage usage;
+    usage.add("nodes", vector_bytes(_nodes));
+    usage.add("values", value_bytes);
+    usage.add("leaf_tables", vector_bytes(_leaf_prediction) + vector_bytes(_leaf_row) +
+                             vector_bytes(_leaf_proba) + vector_bytes(_leaf_log_proba));
+    usage.add("bin_thresholds", vector_bytes(_bin_threshold));
+    return usage;
+}
+
+template <typename CODE>
+Mat Tree::predict_binned(DataView<CODE> codes,
+                         int n_threads)
+{
+    if (_node_count == 0 || _bin_threshold.size() != static_cast<size_t>(_node_count))
+        return Mat();
+
+    int n_samples = codes.rows;
+    Mat_<double> result(n_samples, _n_outputs);
+    bool has_tables = (_leaf_prediction.size() == static_cast<size_t>(_node_count) * _n_outputs);
+    parallel_for(n_samples, n_threads, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+        {
+            int node_id = 0;
+            while (_nodes[node_id].left_child != TREE_LEAF)
+            {
+                const Node& node = _nodes[node_id];
+                node_id = (codes.at(i, node.feature) <= _bin_threshold[node_id]) ? node.left_child
+                                                                                  : node.right_child;
+            }
+            if (has_tables)
+                std::memcpy(result.ptr<double>(i), &_leaf_prediction[static_cast<size_t>(node_id) * _n_outputs],
+                            sizeof(double) * _n_outputs);
+            else
+                _node_prediction(node_id, result.ptr<double>(i));
+        }
+    });
+    return result;
+}
+
+template <typename DTYPE>
+int Tree::_find_leaf(const DataView<DTYPE>& X,
+                     int i) const
+{
+    int node_id = 0;
+    while (_nodes[node_id].left_child != TREE_LEAF)
+    {
+        const Node& node = _nodes[node_id];
+        node_id = (X.at(i, node.feature) <= node.threshold) ? node.left_child : node.right_child;
+    }
+    return node_id;
+}
+
+template <typename DTYPE>
+int Tree::refit_leaves(DataView<DTYPE> X,
+                       DataView<double> y,
+                       DataView<double> sample_weight,
+                       int statistic,
+                       int n_threads)
+{
+    int n_samples = X.rows;
+
+    // Validation
+    if (_node_count == 0)
+        return 1;
+    if (X.cols != _n_features || y.rows != n_samples)
+        return 2;
+    if (!sample_weight.empty() && sample_weight.rows != n_samples)
+        return 2;
+    if (statistic == LEAF_CLASS_COUNT)
+    {
+        if (y.cols != 1)
+            return 2;
+        for (int i = 0; i < n_samples; i++)
+        {
+            if (y.at(i) < 0 || y.at(i) >= _n_classes)
+                return 2;
+        }
+    }
+    else if (y.cols != _n_outputs)
+        return 2;
+
+    if (statistic == LEAF_MEDIAN)
+    {
+        // Route the rows, then group them by leaf with a counting pass
+        vector<int> leaf(n_samples);
+        parallel_for(n_samples, n_threads, [&](int begin, int end) {
+            for (int i = begin; i < end; i++)
+                leaf[i] = _find_leaf(X, i);
+        });
+
+        vector<int> offset(_node_count + 1, 0);
+        for (int i = 0; i < n_samples; i++)
+            offset[leaf[i] + 1]++;
+        for (int i = 0; i < _node_count; i++)
+            offset[i + 1] += offset[i];
+        vector<int> rows(n_samples);
+        vector<int> next(offset.begin(), offset.end() - 1);
+        for (int i = 0; i < n_samples; i++)
+            rows[next[leaf[i]]++] = i;
+
+        parallel_for(_node_count, n_threads, [&](int begin, int end) {
+            WeightedMedianCalculator median;
+            for (int node_id = begin; node_id < end; node_id++)
+            {
+                if (offset[node_id] == offset[node_id + 1])
+                    continue;
+                for (int k = 0; k < _n_outputs; k++)
+                {
+                    median.clear();
+                    for (int p = offset[node_id]; p < offset[node_id + 1]; p++)
+                        median.push(y.at(rows[p], k),
+                                    sample_weight.empty() ? 1.0 : sample_weight.at(rows[p]));
+                    _value[node_id][k] = median.median();
+                }
+            }
+        });
+        normalize_leaves();
+        return 0;
+    }
+
+    // Weighted sums per node, accumulated by each thread then merged
+    int width = (statistic == LEAF_CLASS_COUNT) ? _n_classes : _n_outputs;
+    vector<double> sum(static_cast<size_t>(_node_count) * width, 0.0);
+    vector<double> weight(_node_count, 0.0);
+    std::mutex merge;
+    parallel_for(n_samples, n_threads, [&](int begin, int end) {
+        vector<double> local_sum(sum.size(), 0.0);
+        vector<double> local_weight(weight.size(), 0.0);
+        for (int i = begin; i < end; i++)
+        {
+            int node_id = _find_leaf(X, i);
+            double w = sample_weight.empty() ? 1.0 : sample_weight.at(i);
+            double* node_sum = &local_sum[static_cast<size_t>(node_id) * width];
+            if (statistic == LEAF_CLASS_COUNT)
+                node_sum[static_cast<int>(y.at(i))] += w;
+            else
+            {
+                for (int k = 0; k < width; k++)
+                    node_sum[k] += w * y.at(i, k);
+            }
+            local_weight[node_id] += w;
+        }
+
+        std::lock_guard<std::mutex> lock(merge);
+        for (size_t j = 0; j < sum.size(); j++)
+            sum[j] += local_sum[j];
+        for (size_t j = 0; j < weight.size(); j++)
+            weight[j] += local_weight[j];
+    });
+
+    for (int node_id = 0; node_id < _node_count; node_id++)
+    {
+        if (weight[node_id] <= 0.0)
+            continue;
+        const double* node_sum = &sum[static_cast<size_t>(node_id) * width];
+        vector<double>& value = _value[node_id];
+        value.resize(width);
+        for (int k = 0; k < width; k++)
+            value[k] = (statistic == LEAF_CLASS_COUNT) ? node_sum[k] : node_sum[k] / weight[node_id];
+    }
+    normalize_leaves();
+    return 0;
+}
+
+double Tree::_node_output(int node_id,
+                         int output) const
+{
+    const vector<double>& value = _value.at(node_id);
+    if (_n_outputs > 1 || value.size() == 1)
+        return value.at(output);
+
+    // Class weights of a classification leaf
+    double total = 0.0;
+    for (size_t c = 0; c < value.size(); c++)
+        total += value[c];
+    return (total > 0.0) ? value.at(output) / total : 0.0;
+}
+
+int Tree::_depth() const
+{
+    vector<int> depth(_node_count, 0);
+    int max_depth = 0;
+    for (int i = 0; i < _node_count; i++)
+    {
+        if (_nodes[i].left_child != TREE_LEAF)
+        {
+            depth[_nodes[i].left_child] = depth[i] + 1;
+            depth[_nodes[i].right_child] = depth[i] + 1;
+        }
+        max_depth = std::max(max_depth, depth[i]);
+    }
+    return max_depth;
+}
+
+/**
+ * @brief Element of the path of unique features of TreeSHAP
+ */
+struct PathElement
+{
+    int feature;            // Feature split on, -1 for the root
+    double zero_fraction;   // Fraction of the zero paths (feature absent) flowing through
+    double one_fraction;    // Fraction of the one paths (feature present) flowing through
+    double weight;          // Proportion of the subsets of a given cardinality
+};
+
+/**
+ * @brief Add a feature to the path of unique_depth + 1 elements.
+ */
+static void extend_path(PathElement* path,
+                        int unique_depth,
+                        double zero_fraction,
+                        double one_fraction,
+                        int feature)
+{
+    path[unique_depth].feature = feature;
+    path[unique_depth].zero_fraction = zero_fraction;
+    path[unique_depth].one_fraction = one_fraction;
+    path[unique_depth].weight = (unique_depth == 0) ? 1.0 : 0.0;
+
+    for (int i = unique_depth - 1; i >= 0; i--)
+    {
+        path[i+1].weight += one_fraction * path[i].weight * (i + 1) /
+                            static_cast<double>(unique_depth + 1);
+        path[i].weight = zero_fraction * path[i].weight * (unique_depth - i) /
+                         static_cast<double>(unique_depth + 1);
+    }
+}
+
+/**
+ * @brief Undo extend_path of the element path_index.
+ */
+static void unwind_path(PathElement* path,
+                        int unique_depth,
+                        int path_index)
+{
+    double one_fraction = path[path_index].one_fraction;
+    double zero_fraction = path[path_index].zero_fraction;
+    double next_one_portion = path[unique_depth].weight;
+    double tmp;
+
+    for (int i = unique_depth - 1; i >= 0; i--)
+    {
+        if (one_fraction != 0.0)
+        {
+            tmp = path[i].weight;
+            path[i].weight = next_one_portion * (unique_depth + 1) /
+                             static_cast<double>((i + 1) * one_fraction);
+            next_one_portion = tmp - path[i].weight * zero_fraction * (unique_depth - i) /
+                                     static_cast<double>(unique_depth + 1);
+        }
         else
-            result.at<double>(i, 0) = *c;
+            path[i].weight = path[i].weight * (unique_depth + 1) /
+                             static_cast<double>(zero_fraction * (unique_depth - i));
+    }
+
+    for (int i = path_index; i < unique_depth; i++)
+    {
+        path[i].feature = path[i+1].feature;
+        path[i].zero_fraction = path[i+1].zero_fraction;
+        path[i].one_fraction = path[i+1].one_fraction;
+    }
+}
+
+/**
+ * @brief Total weight of the path once the element path_index is unwound,
+ * without modifying the path.
+ */
+static double unwound_path_sum(const PathElement* path,
+                               int unique_depth,
+                               int path_index)
+{
+    double one_fraction = path[path_index].one_fraction;
+    double zero_fraction = path[path_index].zero_fraction;
+    double next_one_portion = path[unique_depth].weight;
+    double total = 0.0;
+    double tmp;
+
+    for (int i = unique_depth - 1; i >= 0; i--)
+    {
+        if (one_fraction != 0.0)
+        {
+            tmp = next_one_portion * (unique_depth + 1) /
+                  static_cast<double>((i + 1) * one_fraction);
+            total += tmp;
+            next_one_portion = path[i].weight - tmp * zero_fraction * (unique_depth - i) /
+                                                static_cast<double>(unique_depth + 1);
+        }
+        else if (zero_fraction != 0.0)
+            total += path[i].weight / zero_fraction /
+                     ((unique_depth - i) / static_cast<double>(unique_depth + 1));
+    }
+    return total;
+}
+
+/**
+ * @brief TreeSHAP recursion, algorithm 2 of Lundberg et al., "Consistent
+ * Individualized Feature Attribution for Tree Ensembles".
+ * The path of a node is stored right after the one of its parent in path.
+ */
+template <typename DTYPE>
+static void tree_shap_recurse(const Tree& tree,
+                              const DataView<DTYPE>& X,
+                              int row,
+                              const vector<double>& leaf_output,
+                              double* phi,
+                              int node_id,
+                              int unique_depth,
+                              PathElement* parent_path,
+                              double parent_zero_fraction,
+                              double parent_one_fraction,
+                              int parent_feature)
+{
+    PathElement* path = parent_path + unique_depth + 1;
+    std::copy(parent_path, parent_path + unique_depth + 1, path);
+    extend_path(path, unique_depth, parent_zero_fraction,
+                parent_one_fraction, parent_feature);
+
+    const Node& node = tree._nodes[node_id];
+    if (node.left_child == TREE_LEAF)
+    {
+        double w;
+        for (int i = 1; i <= unique_depth; i++)
+        {
+            w = unwound_path_sum(path, unique_depth, i);
+            phi[path[i].feature] += w * (path[i].one_fraction - path[i].zero_fraction) *
+                                    leaf_output[node_id];
+        }
+        return;
+    }
+
+    // The hot child is the one x follows
+    int hot = node.right_child;
+    int cold = node.left_child;
+    if (X.at(row, node.feature) <= node.threshold)
+    {
+        hot = node.left_child;
+        cold = node.right_child;
+    }
+    double w = node.weighted_n_node_samples;
+    double hot_zero_fraction = tree._nodes[hot].weighted_n_node_samples / w;
+    double cold_zero_fraction = tree._nodes[cold].weighted_n_node_samples / w;
+    double incoming_zero_fraction = 1.0;
+    double incoming_one_fraction = 1.0;
+
+    // A feature already on the path is unwound, to be split on again here
+    int path_index = 0;
+    for (; path_index <= unique_depth; path_index++)
+    {
+        if (path[path_index].feature == node.feature)
+            break;
+    }
+    if (path_index != unique_depth + 1)
+    {
+        incoming_zero_fraction = path[path_index].zero_fraction;
+        incoming_one_fraction = path[path_index].one_fraction;
+        unwind_path(path, unique_depth, path_index);
+        unique_depth -= 1;
+    }
+
+    tree_shap_recurse(tree, X, row, leaf_output, phi, hot, unique_depth + 1, path,
+                      hot_zero_fraction * incoming_zero_fraction,
+                      incoming_one_fraction, node.feature);
+    tree_shap_recurse(tree, X, row, leaf_output, phi, cold, unique_depth + 1, path,
+                      cold_zero_fraction * incoming_zero_fraction,
+                      0.0, node.feature);
+}
+
+template <typename DTYPE>
+Mat Tree::shap_values(DataView<DTYPE> X,
+                      int output,
+                      int n_threads)
+{
+    int n_samples = X.rows;
+    Mat_<double> result = Mat::zeros(n_samples, _n_features + 1, CV_64F);
+    if (_node_count == 0)
+        return result;
+
+    // Explained value of the nodes, and the expected value: the leaves
+    // weighted by their cover
+    vector<double> leaf_output(_node_count);
+    double expected_value = 0.0;
+    for (int i = 0; i < _node_count; i++)
+    {
+        leaf_output[i] = _node_output(i, output);
+        if (_nodes[i].left_child == TREE_LEAF)
+            expected_value += leaf_output[i] * _nodes[i].weighted_n_node_samples;
     }
+    expected_value /= _nodes[0].weighted_n_node_samples;
+
+    // A path per depth, each one element longer than its parent's
+    int max_depth = _depth();
+    size_t path_size = static_cast<size_t>(max_depth + 2) * (max_depth + 3) / 2;
+
+    parallel_for(n_samples, n_threads, [&](int begin, int end) {
+        vector<PathElement> path(path_size);
+        for (int i = begin; i < end; i++)
+        {
+            double* phi = result.ptr<double>(i);
+            tree_shap_recurse(*this, X, i, leaf_output, phi, 0, 0,
+                              &path[0], 1.0, 1.0, -1);
+            phi[_n_features] = expected_value;
+        }
+    });
     return result;
 }
 
+/**
+ * @brief Interventional SHAP of one sample against one background row.
+ * Along a path, a feature on which x and the background row split apart is
+ * taken from x (counted in n_x) or from the row (counted in n_r). A leaf
+ * reached with n_x and n_r such features gives each feature from x
+ * value * (n_x - 1)! n_r! / (n_x + n_r)!, and removes from each feature from
+ * the row value * n_x! (n_r - 1)! / (n_x + n_r)!.
+ * @param from 0 for a feature not split on yet, 1 from x, 2 from the row
+ */
+template <typename DTYPE>
+static void interventional_recurse(const Tree& tree,
+                                   const DataView<DTYPE>& X,
+                                   int row,
+                                   const DataView<DTYPE>& background,
+                                   int ref,
+                                   const vector<double>& leaf_output,
+                                   const vector<double>& factorial,
+                                   double* phi,
+                                   int node_id,
+                                   vector<char>& from,
+                                   vector<int>& features,
+                                   int n_x,
+                                   int n_r)
+{
+    const Node& node = tree._nodes[node_id];
+    if (node.left_child == TREE_LEAF)
+    {
+        double v = leaf_output[node_id];
+        double pos = (n_x > 0) ? v * factorial[n_x - 1] * factorial[n_r] / factorial[n_x + n_r] : 0.0;
+        double neg = (n_r > 0) ? v * factorial[n_x] * factorial[n_r - 1] / factorial[n_x + n_r] : 0.0;
+        for (size_t i = 0; i < features.size(); i++)
+        {
+            if (from[features[i]] == 1)
+                phi[features[i]] += pos;
+            else
+                phi[features[i]] -= neg;
+        }
+        return;
+    }
+
+    int f = node.feature;
+    int x_child = (X.at(row, f) <= node.threshold) ? node.left_child : node.right_child;
+    int r_child = (background.at(ref, f) <= node.threshold) ? node.left_child : node.right_child;
+
+    if (from[f] == 1 || x_child == r_child)
+    {
+        interventional_recurse(tree, X, row, background, ref, leaf_output, factorial,
+                               phi, from[f] == 2 ? r_child : x_child,
+                               from, features, n_x, n_r);
+        return;
+    }
+    if (from[f] == 2)
+    {
+        interventional_recurse(tree, X, row, background, ref, leaf_output, factorial,
+                               phi, r_child, from, features, n_x, n_r);
+        return;
+    }
+
+    // x and the row part ways on a new feature
+    features.push_back(f);
+    from[f] = 1;
+    interventional_recurse(tree, X, row, background, ref, leaf_output, factorial,
+                           phi, x_child, from, features, n_x + 1, n_r);
+    from[f] = 2;
+    interventional_recurse(tree, X, row, background, ref, leaf_output, factorial,
+                           phi, r_child, from, features, n_x, n_r + 1);
+    from[f] = 0;
+    features.pop_back();
+}
+
+template <typename DTYPE>
+Mat Tree::interventional_shap_values(DataView<DTYPE> X,
+                                     DataView<DTYPE> background,
+                                     int output,
+                                     int n_threads)
+{
+    int n_samples = X.rows;
+    int n_background = background.rows;
+    Mat_<double> result = Mat::zeros(n_samples, _n_features + 1, CV_64F);
+    if (_node_count == 0 || n_background == 0)
+        return result;
+
+    vector<double> leaf_output(_node_count);
+    for (int i = 0; i < _node_count; i++)
+        leaf_output[i] = _node_output(i, output);
+
+    // At most one feature per level of a path
+    int max_depth = _depth();
+    vector<double> factorial(max_depth + 2, 1.0);
+    for (size_t i = 1; i < factorial.size(); i++)
+        factorial[i] = factorial[i-1] * i;
+
+    // Expected value: the mean prediction of the background
+    double expected_value = 0.0;
+    for (int r = 0; r < n_background; r++)
+    {
+        int node_id = 0;
+        while (_nodes[node_id].left_child != TREE_LEAF)
+            node_id = (background.at(r, _nodes[node_id].feature) <= _nodes[node_id].threshold) ?
+                      _nodes[node_id].left_child : _nodes[node_id].right_child;
+        expected_value += leaf_output[node_id];
+    }
+    expected_value /= n_background;
+
+    parallel_for(n_samples, n_threads, [&](int begin, int end) {
+        vector<char> from(_n_features, 0);
+        vector<int> features;
+        features.reserve(max_depth);
+        for (int i = begin; i < end; i++)
+        {
+            double* phi = result.ptr<double>(i);
+            for (int r = 0; r < n_background; r++)
+                interventional_recurse(*this, X, i, background, r, leaf_output, factorial,
+                                       phi, 0, from, features, 0, 0);
+            for (int j = 0; j < _n_features; j++)
+                phi[j] /= n_background;
+            phi[_n_features] = expected_value;
+        }
+    });
+    return result;
+}
+
+/**
+ * @brief Score of permutation_importance from its totals, as prediction_score:
+ * the accuracy for a classification, the R^2 averaged over the outputs for a
+ * regression
+ * @param totals Weighted count of the correct predictions, or the weighted
+ * SSE of every output
+ * @param sst Weighted SST of every output
+ */
+static double importance_score(const vector<double>& totals,
+                               const vector<double>& sst,
+                               double weight_sum,
+                               int is_classification)
+{
+    if (is_classification == 0)
+        return (weight_sum > 0.0) ? totals[0] / weight_sum : 0.0;
+
+    double score = 0.0;
+    for (size_t k = 0; k < totals.size(); k++)
+        score += (sst[k] > 0.0) ? 1.0 - totals[k] / sst[k] : (totals[k] == 0.0 ? 1.0 : 0.0);
+    return score / totals.size();
+}
+
+template <typename DTYPE>
+Mat Tree::permutation_importance(DataView<DTYPE> X,
+                                 DataView<double> y,
+                                 DataView<double> sample_weight,
+                                 int is_classification,
+                                 int n_repeats,
+                                 int random_state,
+                                 int n_threads)
+{
+    int n_samples = X.rows;
+    Mat_<double> result = Mat::zeros(_n_features, std::max(n_repeats, 0), CV_64F);
+    if (_node_count == 0 || n_samples == 0 || n_repeats <= 0)
+        return result;
+
+    // Accuracy counts one term per row, R^2 one per output
+    int n_terms = (is_classification == 0) ? 1 : _n_outputs;
+    vector<double> node_prediction(static_cast<size_t>(_node_count) * _n_outputs);
+    for (int n = 0; n < _node_count; n++)
+        _node_prediction(n, &node_prediction[static_cast<size_t>(n) * _n_outputs]);
+    auto row_loss = [&](int i, int node_id, double* loss) {
+        double w = sample_weight.empty() ? 1.0 : sample_weight.at(i);
+        const double* prediction = &node_prediction[static_cast<size_t>(node_id) * _n_outputs];
+        if (is_classification == 0)
+        {
+            loss[0] = (prediction[0] == y.at(i)) ? w : 0.0;
+            return;
+        }
+        for (int k = 0; k < n_terms; k++)
+        {
+            double error = y.at(i, k) - prediction[k];
+            loss[k] = w * error * error;
+        }
+    };
+
+    // Preorder of the nodes: the leaves below a node are the preorder range
+    // [pre[n], pre_end[n]), children having larger ids than their parent
+    vector<int> pre(_node_count);
+    vector<int> pre_end(_node_count);
+    vector<int> by_pre(_node_count);
+    vector<int> stack(1, 0);
+    for (int position = 0; !stack.empty(); position++)
+    {
+        int n = stack.back();
+        stack.pop_back();
+        pre[n] = position;
+        by_pre[position] = n;
+        if (_nodes[n].left_child != TREE_LEAF)
+        {
+            stack.push_back(_nodes[n].right_child);
+            stack.push_back(_nodes[n].left_child);
+        }
+    }
+    for (int n = _node_count - 1; n >= 0; n--)
+        pre_end[n] = (_nodes[n].left_child == TREE_LEAF) ? pre[n] + 1 : pre_end[_nodes[n].right_child];
+
+    // Rows sorted by the preorder of their leaf: the rows reaching node n
+    // are rows[offset[pre[n]], offset[pre_end[n]])
+    vector<int> leaf(n_samples);
+    parallel_for(n_samples, n_threads, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            leaf[i] = _find_leaf(X, i);
+    });
+    vector<int> offset(_node_count + 1, 0);
+    for (int i = 0; i < n_samples; i++)
+        offset[pre[leaf[i]] + 1] += 1;
+    for (int p = 0; p < _node_count; p++)
+        offset[p + 1] += offset[p];
+    vector<int> rows(n_samples);
+    vector<int> next(offset.begin(), offset.end() - 1);
+    for (int i = 0; i < n_samples; i++)
+        rows[next[pre[leaf[i]]]++] = i;
+
+    // Feature-to-node index: the top-most nodes testing each feature. The
+    // rows below them are the only ones a permutation of the feature moves.
+    vector<vector<int> > feature_nodes(_n_features);
+    vector<int> covered(_n_features, 0);
+    for (int p = 0; p < _node_count; p++)
+    {
+        int n = by_pre[p];
+        int j = _nodes[n].feature;
+        if (_nodes[n].left_child == TREE_LEAF || p < covered[j])
+            continue;
+        feature_nodes[j].push_back(n);
+        covered[j] = pre_end[n];
+    }
+
+    // Baseline, and the loss of every row in the order of rows
+    vector<double> base_loss(static_cast<size_t>(n_samples) * n_terms);
+    vector<double> totals(n_terms, 0.0);
+    vector<double> mean(n_terms, 0.0);
+    vector<double> sst(n_terms, 0.0);
+    double weight_sum = 0.0;
+    for (int p = 0; p < n_samples; p++)
+    {
+        int i = rows[p];
+        double* loss = &base_loss[static_cast<size_t>(p) * n_terms];
+        row_loss(i, leaf[i], loss);
+        double w = sample_weight.empty() ? 1.0 : sample_weight.at(i);
+        weight_sum += w;
+        for (int k = 0; k < n_terms; k++)
+        {
+            totals[k] += loss[k];
+            if (is_classification != 0)
+                mean[k] += w * y.at(i, k);
+        }
+    }
+    if (is_classification != 0)
+    {
+        for (int k = 0; k < n_terms; k++)
+            mean[k] /= weight_sum;
+        for (int i = 0; i < n_samples; i++)
+        {
+            double w = sample_weight.empty() ? 1.0 : sample_weight.at(i);
+            for (int k = 0; k < n_terms; k++)
+                sst[k] += w * (y.at(i, k) - mean[k]) * (y.at(i, k) - mean[k]);
+        }
+    }
+    double base_score = importance_score(totals, sst, weight_sum, is_classification);
+
+    // One task per feature and repeat, each re-scoring only the rows below
+    // the nodes of its feature, routed from these nodes
+    parallel_for(_n_features * n_repeats, n_threads, [&](int begin, int end) {
+        vector<int> donors(n_samples);
+        for (int i = 0; i < n_samples; i++)
+            donors[i] = i;
+        vector<int> swaps;
+        vector<double> permuted(n_terms);
+        vector<double> loss(n_terms);
+        for (int task = begin; task < end; task++)
+        {
+            int j = task / n_repeats;
+            if (feature_nodes[j].empty())
+                continue;
+
+            // The t-th moved row takes the value of donors[t], drawn by a
+            // partial Fisher-Yates shuffle of all the rows
+            std::seed_seq seeds{random_state, task};
+            std::mt19937 generator(seeds);
+            permuted = totals;
+            int t = 0;
+            for (size_t m = 0; m < feature_nodes[j].size(); m++)
+            {
+                int top = feature_nodes[j][m];
+                for (int p = offset[pre[top]]; p < offset[pre_end[top]]; p++, t++)
+                {
+                    int swap = t + static_cast<int>(generator() % (n_samples - t));
+                    std::swap(donors[t], donors[swap]);
+                    swaps.push_back(swap);
+
+                    // The nodes above top do not test j
+                    int i = rows[p];
+                    DTYPE value = X.at(donors[t], j);
+                    int node_id = top;
+                    while (_nodes[node_id].left_child != TREE_LEAF)
+                    {
+                        const Node& node = _nodes[node_id];
+                        DTYPE x = (node.feature == j) ? value : X.at(i, node.feature);
+                        node_id = (x <= node.threshold) ? node.left_child : node.right_child;
+                    }
+                    if (node_id == leaf[i])
+                        continue;
+
+                    row_loss(i, node_id, &loss[0]);
+                    const double* old_loss = &base_loss[static_cast<size_t>(p) * n_terms];
+                    for (int k = 0; k < n_terms; k++)
+                        permuted[k] += loss[k] - old_loss[k];
+                }
+            }
+            result.at<double>(j, task % n_repeats) =
+                    base_score - importance_score(permuted, sst, weight_sum, is_classification);
+
+            // Back to the identity, so that the draws do not depend on the
+            // tasks run before by the thread
+            for (int s = static_cast<int>(swaps.size()) - 1; s >= 0; s--)
+                std::swap(donors[s], donors[swaps[s]]);
+            swaps.clear();
+        }
+    });
+    return result;
+}
+
+Mat Tree::partial_dependence(const vector<int>& features,
+                             DataView<double> grid,
+                             int n_threads)
+{
+    int n_grid = grid.rows;
+    int n_values = _value.empty() ? 0 : static_cast<int>(_value[0].size());
+    Mat_<double> result = Mat::zeros(n_grid, n_values, CV_64F);
+    if (_node_count == 0 || n_grid == 0)
+        return result;
+
+    // Grid column of every feature, -1 for the features integrated out
+    vector<int> column(_n_features, -1);
+    for (size_t c = 0; c < features.size(); c++)
+        column[features[c]] = static_cast<int>(c);
+
+    vector<double> node_output(static_cast<size_t>(_node_count) * n_values);
+    for (int n = 0; n < _node_count; n++)
+    {
+        if (_nodes[n].left_child == TREE_LEAF)
+            for (int k = 0; k < n_values; k++)
+                node_output[static_cast<size_t>(n) * n_values + k] = _node_output(n, k);
+    }
+
+    parallel_for(n_grid, n_threads, [&](int begin, int end) {
+        vector<std::pair<int, double> > stack;
+        for (int g = begin; g < end; g++)
+        {
+            double* pd = result.ptr<double>(g);
+            stack.push_back(std::make_pair(0, 1.0));
+            while (!stack.empty())
+            {
+                int node_id = stack.back().first;
+                double weight = stack.back().second;
+                stack.pop_back();
+
+                const Node& node = _nodes[node_id];
+                if (node.left_child == TREE_LEAF)
+                {
+                    const double* output = &node_output[static_cast<size_t>(node_id) * n_values];
+                    for (int k = 0; k < n_values; k++)
+                        pd[k] += weight * output[k];
+                    continue;
+                }
+                if (column[node.feature] >= 0)
+                {
+                    double x = grid.at(g, column[node.feature]);
+                    stack.push_back(std::make_pair((x <= node.threshold) ? node.left_child
+                                                                         : node.right_child,
+                                                   weight));
+                    continue;
+                }
+
+                // Both children, as the training samples split
+                double left = _nodes[node.left_child].weighted_n_node_samples;
+                double right = _nodes[node.right_child].weighted_n_node_samples;
+                double total = left + right;
+                if (total <= 0.0)
+                {
+                    left = 1.0;
+                    right = 1.0;
+                    total = 2.0;
+                }
+                stack.push_back(std::make_pair(node.left_child, weight * left / total));
+                stack.push_back(std::make_pair(node.right_child, weight * right / total));
+            }
+        }
+    });
+    return result;
+}
+
+// Explicit instantiations for the supported feature types
+template Mat Tree::predict<float>(DataView<float> X);
+template Mat Tree::predict<double>(DataView<double> X);
+template Mat Tree::_apply_dense<float>(DataView<float> X);
+template Mat Tree::_apply_dense<double>(DataView<double> X);
+template Mat Tree::apply<float>(DataView<float> X, int n_threads);
+template Mat Tree::apply<double>(DataView<double> X, int n_threads);
+template CsrMatrix Tree::decision_path<float>(DataView<float> X, int n_threads);
+template CsrMatrix Tree::decision_path<double>(DataView<double> X, int n_threads);
+template void Tree::predict_proba<float>(DataView<float> X, double* proba, bool log, int n_threads) const;
+template void Tree::predict_proba<double>(DataView<double> X, double* proba, bool log, int n_threads) const;
+template Mat Tree::predict_binned<uint8_t>(DataView<uint8_t> codes, int n_threads);
+template Mat Tree::predict_binned<uint16_t>(DataView<uint16_t> codes, int n_threads);
+template int Tree::_find_leaf<float>(const DataView<float>& X, int i) const;
+template int Tree::_find_leaf<double>(const DataView<double>& X, int i) const;
+template int Tree::path_length<float>(const DataView<float>& X, int i) const;
+template int Tree::path_length<double>(const DataView<double>& X, int i) const;
+template int Tree::write_path<float>(const DataView<float>& X, int i, int offset, int* path) const;
+template int Tree::write_path<double>(const DataView<double>& X, int i, int offset, int* path) const;
+template int Tree::refit_leaves<float>(DataView<float> X, DataView<double> y,
+                                      DataView<double> sample_weight, int statistic, int n_threads);
+template int Tree::refit_leaves<double>(DataView<double> X, DataView<double> y,
+                                       DataView<double> sample_weight, int statistic, int n_threads);
+template Mat Tree::shap_values<float>(DataView<float> X, int output, int n_threads);
+template Mat Tree::shap_values<double>(DataView<double> X, int output, int n_threads);
+template Mat Tree::interventional_shap_values<float>(DataView<float> X, DataView<float> background,
+                                                     int output, int n_threads);
+template Mat Tree::interventional_shap_values<double>(DataView<double> X, DataView<double> background,
+                                                      int output, int n_threads);
+template Mat Tree::permutation_importance<float>(DataView<float> X, DataView<double> y,
+                                                 DataView<double> sample_weight, int is_classification,
+                                                 int n_repeats, int random_state, int n_threads);
+template Mat Tree::permutation_importance<double>(DataView<double> X, DataView<double> y,
+                                                  DataView<double> sample_weight, int is_classification,
+                                                  int n_repeats, int random_state, int n_threads);
+
 Mat Tree::compute_feature_importances(bool normalize)
 {
     // TODO
@@ -147,3 +1210,199 @@ Mat Tree::compute_feature_importances(bool normalize)
     }
     return result;
 }
+
+/**
+ * @brief Weakest link candidate of the pruning queue. An entry is stale when
+ * the node was removed or its alpha recomputed since it was pushed.
+ */
+struct PruneCandidate
+{
+    double alpha;
+    int node_id;
+    int version;
+
+    PruneCandidate(double _alpha, int _node_id, int _version)
+        : alpha(_alpha),
+          node_id(_node_id),
+          version(_version){
+    }
+
+    // Smallest alpha first, then smallest node id
+    bool operator> (const PruneCandidate& c) const {
+        if (alpha != c.alpha)
+            return alpha > c.alpha;
+        return node_id > c.node_id;
+    }
+};
+
+void Tree::_weakest_link_prune(double ccp_alpha,
+                               vector<bool>& is_removed,
+                               vector<bool>& is_pruned,
+                               vector<double>* ccp_alphas,
+                               vector<double>* impurities)
+{
+    int n_nodes = _node_count;
+    is_removed.assign(n_nodes, false);
+    is_pruned.assign(n_nodes, false);
+    if (n_nodes == 0)
+        return;
+
+    double weighted_n_root = _nodes.at(0).weighted_n_node_samples;
+    vector<int> parent(n_nodes, TREE_UNDEFINED);
+    vector<double> r_node(n_nodes);        // R(t)
+    vector<double> r_branch(n_nodes);      // R(T_t)
+    vector<int> n_leaves(n_nodes);         // |leaves(T_t)|
+    vector<int> version(n_nodes, 0);
+
+    // Children have larger ids than their parent: one pass down for the
+    // parents, one pass up for the subtree statistics
+    for (int i = 0; i < n_nodes; i++)
+    {
+        if (_nodes[i].left_child != TREE_LEAF)
+        {
+            parent[_nodes[i].left_child] = i;
+            parent[_nodes[i].right_child] = i;
+        }
+    }
+
+    for (int i = n_nodes - 1; i >= 0; i--)
+    {
+        const Node& node = _nodes[i];
+        r_node[i] = node.impurity * node.weighted_n_node_samples / weighted_n_root;
+        if (node.left_child == TREE_LEAF)
+        {
+            r_branch[i] = r_node[i];
+            n_leaves[i] = 1;
+        }
+        else
+        {
+            r_branch[i] = r_branch[node.left_child] + r_branch[node.right_child];
+            n_leaves[i] = n_leaves[node.left_child] + n_leaves[node.right_child];
+        }
+    }
+
+    std::priority_queue<PruneCandidate,
+                        vector<PruneCandidate>,
+                        std::greater<PruneCandidate> > pq;
+    for (int i = 0; i < n_nodes; i++)
+    {
+        if (_nodes[i].left_child != TREE_LEAF)
+            pq.push(PruneCandidate((r_node[i] - r_branch[i]) / (n_leaves[i] - 1), i, 0));
+    }
+
+    if (ccp_alphas != NULL)
+        ccp_alphas->assign(1, 0.0);
+    if (impurities != NULL)
+        impurities->assign(1, r_branch[0]);
+
+    vector<int> stk;
+    while (!pq.empty())
+    {
+        PruneCandidate c = pq.top();
+        pq.pop();
+
+        // Lazy invalidation of the stale entries
+        if (is_removed[c.node_id] || is_pruned[c.node_id] ||
+            c.version != version[c.node_id])
+            continue;
+        if (c.alpha > ccp_alpha)
+            break;
+
+        // Prune the branch: its internal nodes leave the queue
+        int t = c.node_id;
+        is_pruned[t] = true;
+        stk.push_back(_nodes[t].left_child);
+        stk.push_back(_nodes[t].right_child);
+        while (!stk.empty())
+        {
+            int i = stk.back();
+            stk.pop_back();
+            is_removed[i] = true;
+            if (_nodes[i].left_child != TREE_LEAF)
+            {
+                stk.push_back(_nodes[i].left_child);
+                stk.push_back(_nodes[i].right_child);
+            }
+        }
+
+        // Update the branches of the ancestors
+        double diff_r = r_branch[t] - r_node[t];
+        int diff_leaves = n_leaves[t] - 1;
+        r_branch[t] = r_node[t];
+        n_leaves[t] = 1;
+        for (int a = parent[t]; a != TREE_UNDEFINED; a = parent[a])
+        {
+            r_branch[a] -= diff_r;
+            n_leaves[a] -= diff_leaves;
+            version[a] += 1;
+            pq.push(PruneCandidate((r_node[a] - r_branch[a]) / (n_leaves[a] - 1),
+                                   a, version[a]));
+        }
+
+        if (ccp_alphas != NULL)
+            ccp_alphas->push_back(c.alpha);
+        if (impurities != NULL)
+            impurities->push_back(r_branch[0]);
+    }
+}
+
+void Tree::cost_complexity_pruning_path(vector<double>& ccp_alphas,
+                                        vector<double>& impurities)
+{
+    vector<bool> is_removed;
+    vector<bool> is_pruned;
+    _weakest_link_prune(INFINITY, is_removed, is_pruned, &ccp_alphas, &impurities);
+}
+
+Tree* Tree::prune(double ccp_alpha)
+{
+    vector<bool> is_removed;
+    vector<bool> is_pruned;
+    _weakest_link_prune(ccp_alpha, is_removed, is_pruned, NULL, NULL);
+
+    Tree* tree = new Tree(_n_features, _n_classes, _n_outputs);
+    if (_node_count == 0)
+        return tree;
+
+    // Copy the kept nodes in depth-first order, pruned nodes become leaves
+    // (node id, parent in the new tree, is_left, depth)
+    struct Item
+    {
+        int node_id;
+        int parent;
+        bool is_left;
+        int depth;
+    };
+    vector<Item> stk;
+    Item root = {0, TREE_UNDEFINED, false, 0};
+    stk.push_back(root);
+    while (!stk.empty())
+    {
+        Item item = stk.back();
+        stk.pop_back();
+
+        const Node& node = _nodes[item.node_id];
+        bool is_leaf = (node.left_child == TREE_LEAF || is_pruned[item.node_id]);
+        int new_id = tree->_add_node(item.parent,
+                                     item.is_left,
+                                     is_leaf,
+                                     node.feature,
+                                     node.threshold,
+                                     node.impurity,
+                                     node.n_node_samples,
+                                     node.weighted_n_node_samples);
+        tree->_value.push_back(_value.at(item.node_id));
+        if (item.depth > tree->_max_depth)
+            tree->_max_depth = item.depth;
+
+        if (!is_leaf)
+        {
+            Item right = {node.right_child, new_id, false, item.depth + 1};
+            Item left = {node.left_child, new_id, true, item.depth + 1};
+            stk.push_back(right);
+            stk.push_back(left);
+        }
+    }
+    tree->normalize_leaves();
+    return tree;
+}
@@ -2,14 +2,19 @@
 #define BASETREE_H
 
 #include <vector>
+#include <stdint.h>
 #include <utility>
 #include <numeric>
 #include <opencv2/opencv.hpp>
+#include "dataview.h"
+#include "numa.h"
+#include "memoryusage.h"
 using std::vector;
 using cv::Mat;
 
 class Criterion;
 class Splitter;
+class BinnedMatrix;
 
 /**
  * @brief Define the TreeType
@@ -20,6 +25,31 @@ enum TreeType
     TREE_LEAF=-1,
 };
 
+/**
+ * @brief Statistic held by the value of a leaf, as given by the node_value
+ * of the criterion that built the tree
+ */
+enum LeafStatistic
+{
+    LEAF_CLASS_COUNT=0,     // Weighted count of every class, Gini and Entropy
+    LEAF_MEAN=1,            // Weighted mean of every output, MSE and FriedmanMSE
+    LEAF_MEDIAN=2,          // Weighted median of every output, MAE
+};
+
+/**
+ * @brief Sparse indicator matrix in compressed sparse row format: the
+ * nonzero columns of row i, all equal to 1, are
+ * indices[indptr[i]], ..., indices[indptr[i+1] - 1], increasing.
+ */
+struct CsrMatrix
+{
+    int rows;
+    int cols;
+    vector<long long> indptr;                       // shape = [rows + 1]
+    vector<int, FirstTouchAllocator<int> > indices; // Left uninitialized on resize,
+                                                    // filled by the threads of their rows
+};
+
 /**
  * @brief Base storage structure for the nodes in a Tree object
  */
@@ -111,7 +141,8 @@ public:
      * # (i.e. through `_resize` or `__setstate__`)
      **/
     Tree(int _n_features,
-         int _n_classes);
+         int _n_classes,
+         int _n_outputs=1);
     ~Tree();
 
     /**
@@ -136,24 +167,133 @@ public:
                   double weighted_n_node_samples);
     /**
      * @brief Predict target for X.
+     * DTYPE is the feature type, float or double. Thresholds of a tree trained
+     * on float features are exact floats, so both give the same decisions.
      * @param X
-     * @return
+     * @return shape [n_samples, 1], or [n_samples, n_outputs] for a
+     * multi-output regression
+     */
+    template <typename DTYPE>
+    Mat predict(DataView<DTYPE> X);
+
+    /**
+     * @brief Class probabilities of X, read from the leaf tables: a
+     * traversal and a row copy per sample, no allocation.
+     * @param X
+     * @param proba Output buffer, shape = [n_samples, n_values], row-major
+     * @param log Write the log-probabilities instead
+     * @param n_threads Rows are split among the threads, 0 for all the cores
+     */
+    template <typename DTYPE>
+    void predict_proba(DataView<DTYPE> X,
+                       double* proba,
+                       bool log=false,
+                       int n_threads=1) const;
+
+    /**
+     * @brief Fill the leaf tables from _value: the prediction of every node,
+     * and for a classification tree the class fractions of every leaf and
+     * their logs. Called once the tree is built, and after any change of
+     * _value, which the predictors read through them.
+     */
+    void normalize_leaves();
+
+    /**
+     * @brief Convert the thresholds to bin indices of quantizer: the split
+     * x <= threshold of feature j becomes code <= k, threshold being
+     * bin_edges[j][k], which gives the same decisions for the codes of
+     * quantizer.
+     * @param quantizer Its bin edges, e.g. the BinnedMatrix the tree was fitted on
+     * @return error_code, 1 if quantizer has fewer features than the tree, 2 if
+     * a threshold is not an edge of its feature, predict_binned then being disabled
      */
-    Mat predict(Mat X);
+    int bin_thresholds(const BinnedMatrix& quantizer);
+
+    /**
+     * @brief Sorted distinct thresholds of every feature, the edges of a
+     * quantizer any tree converts exactly to with bin_thresholds
+     * @param edges shape = [n_features][n_thresholds of the feature]
+     */
+    void split_thresholds(vector<vector<double> >& edges) const;
+
+    /**
+     * @brief Bytes of the nodes, the node values, the leaf tables and the
+     * bin thresholds
+     */
+    MemoryUsage memory_usage() const;
+
+    /**
+     * @brief Predict target for pre-binned X, comparing the codes with the
+     * bin thresholds. Matches predict on the values the codes stand for.
+     * @param codes Bin codes, uint8_t or uint16_t, shape = [n_samples, n_features]
+     * @param n_threads Rows are split among the threads, 0 for all the cores
+     * @return shape [n_samples, n_outputs], empty before bin_thresholds
+     */
+    template <typename CODE>
+    Mat predict_binned(DataView<CODE> codes,
+                       int n_threads=1);
 
     /**
      * @brief Finds the terminal region (=leaf node) for each sample in X.
      * @param X
-     * @return
+     * @param n_threads Rows are split among the threads, 0 for all the cores
+     * @return Node id of the leaf of every sample, shape = [n_samples, 1], CV_32S
+     */
+    template <typename DTYPE>
+    Mat apply(DataView<DTYPE> X,
+              int n_threads=1);
+
+    /**
+     * @brief Nodes every sample of X goes through, built in two passes over
+     * the rows: the path lengths, then the node ids, each row being written
+     * by the thread of its chunk.
+     * @param X
+     * @param n_threads Rows are split among the threads, 0 for all the cores
+     * @return shape = [n_samples, node_count]
+     */
+    template <typename DTYPE>
+    CsrMatrix decision_path(DataView<DTYPE> X,
+                            int n_threads=1);
+
+    /**
+     * @brief Number of nodes row i of X goes through, the root and its leaf included
+     */
+    template <typename DTYPE>
+    int path_length(const DataView<DTYPE>& X,
+                    int i) const;
+
+    /**
+     * @brief Write offset + the id of every node row i of X goes through,
+     * from the root, into path
+     * @return The number of nodes written
+     */
+    template <typename DTYPE>
+    int write_path(const DataView<DTYPE>& X,
+                   int i,
+                   int offset,
+                   int* path) const;
+
+    /**
+     * @brief Id of the leaf row i of X falls in
+     */
+    template <typename DTYPE>
+    int _find_leaf(const DataView<DTYPE>& X,
+                   int i) const;
+
+    /**
+     * @brief Number the leaves in the order of their node ids
+     * @param ordinal The number of every leaf, -1 for the internal nodes, shape = [node_count]
+     * @return The number of leaves
      */
-    Mat apply(Mat X);
+    int leaf_ordinals(vector<int>& ordinal) const;
 
     /**
      * @brief Finds the terminal region (=leaf node) for each sample in X.
      * @param X
      * @return
      */
-    Mat _apply_dense(Mat X);
+    template <typename DTYPE>
+    Mat _apply_dense(DataView<DTYPE> X);
 
     /**
      * @brief Computes the importance of each feature (aka variable).
@@ -162,10 +302,167 @@ public:
      */
     Mat compute_feature_importances(bool normalize);
 
+    /**
+     * @brief SHAP values of the predictions of X, by TreeSHAP (path-dependent):
+     * the features absent from a coalition are integrated out following the
+     * training samples, weighted_n_node_samples being the cover of a node.
+     * O(n_leaves * depth ** 2) per sample.
+     * @param X The input samples, shape = [n_samples, n_features]
+     * @param output Output explained: the regression output, or the class
+     * whose probability is explained for a classification
+     * @param n_threads Rows are split among the threads, 0 for all the cores
+     * @return shape = [n_samples, n_features + 1], the last column holds the
+     * expected value, the row sums to the explained value of the sample
+     */
+    template <typename DTYPE>
+    Mat shap_values(DataView<DTYPE> X,
+                    int output=0,
+                    int n_threads=1);
+
+    /**
+     * @brief Interventional SHAP values of the predictions of X: the features
+     * absent from a coalition take their values from background rows, and
+     * the values are averaged over the background.
+     * O(n_background * n_leaves * depth) per sample.
+     * @param X The input samples, shape = [n_samples, n_features]
+     * @param background Reference samples, shape = [n_background, n_features]
+     * @param output
+     * @param n_threads
+     * @return shape = [n_samples, n_features + 1], the last column holds the
+     * mean explained value of the background
+     */
+    template <typename DTYPE>
+    Mat interventional_shap_values(DataView<DTYPE> X,
+                                   DataView<DTYPE> background,
+                                   int output=0,
+                                   int n_threads=1);
+
+    /**
+     * @brief Permutation importance on held-out (X, y): the drop of the score
+     * when the values of a feature are shuffled among the rows. Only the
+     * rows below the top-most nodes testing the feature, found through a
+     * feature-to-node index, are re-routed, from these nodes; the other rows
+     * keep their leaf and their loss. The tasks (feature, repeat) are split
+     * among the threads.
+     * @param X The input samples, shape = [n_samples, n_features]
+     * @param y The target values, shape = [n_samples, n_outputs], the class
+     * for a classification
+     * @param sample_weight Sample weights. If empty, then samples are equally weighted.
+     * @param is_classification 0 to score the accuracy, else the R^2 averaged over the outputs
+     * @param n_repeats Shuffles per feature
+     * @param random_state Seed of the shuffles, the same ones for any n_threads
+     * @param n_threads
+     * @return shape = [n_features, n_repeats], 0 for a feature the tree does not test
+     */
+    template <typename DTYPE>
+    Mat permutation_importance(DataView<DTYPE> X,
+                               DataView<double> y,
+                               DataView<double> sample_weight,
+                               int is_classification,
+                               int n_repeats,
+                               int random_state,
+                               int n_threads=1);
+
+    /**
+     * @brief Partial dependence of the prediction on the target features, by
+     * the weighted tree recursion: for each grid point, the tree is walked
+     * once from the root, following the grid value at a node splitting on a
+     * target feature, and both children otherwise, weighted by the fraction
+     * of weighted_n_node_samples each received. O(n_grid * n_nodes), without
+     * reading the training samples.
+     * @param features Target features, e.g. one or two
+     * @param grid Values of the target features, shape = [n_grid, n_target_features]
+     * @param n_threads Grid points are split among the threads, 0 for all the cores
+     * @return Average prediction of every grid point, the value of each
+     * regression output or the fraction of each class, shape = [n_grid, n_values]
+     */
+    Mat partial_dependence(const vector<int>& features,
+                           DataView<double> grid,
+                           int n_threads=1);
+
+    /**
+     * @brief Recompute the values of the leaves from (X, y), keeping the
+     * splits. Every row is routed once to its leaf; counts and means are
+     * accumulated on the fly by each thread, medians are taken over the rows
+     * of each leaf. Leaves that no row reaches keep their value, as do the
+     * internal nodes.
+     * @param X The input samples, shape = [n_samples, n_features]
+     * @param y The target values, shape = [n_samples, n_outputs], the class
+     * for a classification
+     * @param sample_weight Sample weights. If empty, then samples are equally weighted.
+     * @param statistic LeafStatistic of the criterion the tree was built with
+     * @param n_threads Rows are split among the threads, 0 for all the cores
+     * @return error_code, 2 if the shapes or the classes do not match the tree
+     */
+    template <typename DTYPE>
+    int refit_leaves(DataView<DTYPE> X,
+                     DataView<double> y,
+                     DataView<double> sample_weight,
+                     int statistic,
+                     int n_threads=1);
+
+    /**
+     * @brief Minimal cost-complexity pruning path of the tree.
+     * Step i prunes the weakest link, the internal node t of smallest
+     *
+     *     alpha(t) = (R(t) - R(T_t)) / (|leaves(T_t)| - 1)
+     *
+     * where R is the impurity weighted by the fraction of samples, and T_t the
+     * subtree rooted at t. Computed in one bottom-up pass and a priority queue.
+     * @param ccp_alphas Effective alphas, 0 then the alpha of each step
+     * @param impurities Sum of the leaf R of the pruned tree at each step
+     */
+    void cost_complexity_pruning_path(vector<double>& ccp_alphas,
+                                      vector<double>& impurities);
+
+    /**
+     * @brief The subtree of minimal cost-complexity for ccp_alpha, i.e. the
+     * tree after every step of the pruning path with an alpha <= ccp_alpha.
+     * @param ccp_alpha
+     * @return A new tree with its nodes renumbered in depth-first order
+     */
+    Tree* prune(double ccp_alpha);
+
+    /**
+     * @brief The prediction of a node: the class of largest weight for a
+     * classification, the value of every output for a regression.
+     * @param prediction shape = [n_outputs]
+     */
+    void _node_prediction(int node_id,
+                          double* prediction) const;
+
+private:
+    /**
+     * @brief The explained value of a node: the value of output for a
+     * regression, the fraction of class output for a classification.
+     */
+    double _node_output(int node_id,
+                        int output) const;
+
+    /**
+     * @brief Depth of the deepest leaf
+     */
+    int _depth() const;
+
+    /**
+     * @brief Prune the weakest links while their alpha is <= ccp_alpha.
+     * @param ccp_alpha
+     * @param is_removed Set for the nodes below a pruned node, shape [node_count]
+     * @param is_pruned Set for the pruned nodes, the new leaves, shape [node_count]
+     * @param ccp_alphas If not NULL, the alpha of each step
+     * @param impurities If not NULL, the total leaf impurity after each step
+     */
+    void _weakest_link_prune(double ccp_alpha,
+                             vector<bool>& is_removed,
+                             vector<bool>& is_pruned,
+                             vector<double>* ccp_alphas,
+                             vector<double>* impurities);
+
 public:
     // Input/Output layout
     int _n_features;             // Number of features in X
     int _n_classes;              // max(n_classes)
+    int _n_outputs;              // Number of regression outputs, the size of a leaf value
 
     // Inner structures: values are stored separately from node structure,
     // since size is determined at runtime.
@@ -173,7 +470,17 @@ public:
     int _node_count;             // Counter for node IDs
     int _capacity;               // Capacity of tree, in terms of nodes
     vector<Node> _nodes;         // Array of nodes
-    vector<vector<double>> _value;       // The value of every node
+    vector<vector<double>> _value;       // The value of every node, internal ones included
+
+    vector<uint16_t> _bin_threshold;     // Threshold of every node as a bin index, see bin_thresholds
+
+    // Leaf tables, see normalize_leaves
+    int _n_values;                       // Size of a node value, n_classes or n_outputs
+    vector<double> _leaf_prediction;     // Class of largest weight, or the values, shape [node_count, n_outputs]
+    vector<int> _leaf_row;               // Row of every leaf in the class tables, -1 for the internal nodes
+    vector<double> _leaf_proba;          // Class fractions of the leaves, shape [n_leaves, n_values],
+                                         // empty for a regression tree
+    vector<double> _leaf_log_proba;      // Their logs, shape [n_leaves, n_values]
 };
 
 #endif // BASETREE_H
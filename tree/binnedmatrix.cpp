@@ -0,0 +1,379 @@
+#include "binnedmatrix.h"
+#include <algorithm>
+#include "splitter.h"
+#include "util.h"
+
+BinnedMatrix::BinnedMatrix()
+    : rows(0),
+      cols(0),
+      max_bins(0),
+      is_wide(false)
+{
+
+}
+
+BinnedMatrix::~BinnedMatrix()
+{
+
+}
+
+template <typename DTYPE>
+int BinnedMatrix::fit(DataView<DTYPE> X,
+                      int _max_bins,
+                      int n_threads,
+                      NumaPlacement placement)
+{
+    // Validation
+    if (X.rows == 0 || X.cols == 0)
+        return 1;
+    if (_max_bins < 2 || _max_bins > 65536)
+        return 2;
+
+    rows = X.rows;
+    cols = X.cols;
+    max_bins = _max_bins;
+    is_wide = max_bins > 256;
+
+    // Released, so that the binning threads touch fresh pages
+    size_t n_codes = static_cast<size_t>(rows) * cols;
+    Codes8().swap(codes8);
+    Codes16().swap(codes16);
+    if (is_wide)
+        codes16.resize(n_codes);
+    else
+        codes8.resize(n_codes);
+
+    bin_edges.clear();
+    bin_edges.resize(cols);
+    bundles.clear();
+    feature_bundle.clear();
+    feature_offset.clear();
+    default_bin.clear();
+    bundle_n_codes.clear();
+    bundle_codes.clear();
+
+    parallel_for(cols, n_threads, [&](int begin, int end) {
+        vector<DTYPE> sorted_values(rows);
+        for (int j = begin; j < end; j++)
+        {
+            _fit_column(X, j, sorted_values);
+            _bin_column(X, j);
+        }
+    }, placement);
+    return 0;
+}
+
+template <typename DTYPE>
+int BinnedMatrix::transform(DataView<DTYPE> X,
+                            const BinnedMatrix& reference,
+                            int n_threads,
+                            NumaPlacement placement)
+{
+    // Validation, the row shard of a worker may be empty
+    if (X.rows > 0 && X.cols == 0)
+        return 1;
+    if (reference.cols == 0 || (X.rows > 0 && X.cols != reference.cols))
+        return 2;
+
+    rows = X.rows;
+    cols = reference.cols;
+    max_bins = reference.max_bins;
+    is_wide = reference.is_wide;
+    bin_edges = reference.bin_edges;
+
+    // Released, so that the binning threads touch fresh pages
+    size_t n_codes = static_cast<size_t>(rows) * cols;
+    Codes8().swap(codes8);
+    Codes16().swap(codes16);
+    if (is_wide)
+        codes16.resize(n_codes);
+    else
+        codes8.resize(n_codes);
+
+    parallel_for(cols, n_threads, [&](int begin, int end) {
+        for (int j = begin; j < end; j++)
+            _bin_column(X, j);
+    }, placement);
+
+    bundles = reference.bundles;
+    feature_bundle = reference.feature_bundle;
+    feature_offset = reference.feature_offset;
+    default_bin = reference.default_bin;
+    bundle_n_codes = reference.bundle_n_codes;
+    bundle_codes.clear();
+    if (is_bundled())
+        _encode_bundles();
+    return 0;
+}
+
+int BinnedMatrix::set_edges(const vector<vector<double> >& edges)
+{
+    // Validation
+    if (edges.empty())
+        return 1;
+    int n_bins_max = 2;
+    for (size_t j = 0; j < edges.size(); j++)
+    {
+        for (size_t b = 1; b < edges[j].size(); b++)
+        {
+            if (!(edges[j][b-1] < edges[j][b]))
+                return 2;
+        }
+        n_bins_max = std::max(n_bins_max, static_cast<int>(edges[j].size()) + 1);
+    }
+    if (n_bins_max > 65536)
+        return 2;
+
+    rows = 0;
+    cols = static_cast<int>(edges.size());
+    max_bins = n_bins_max;
+    is_wide = max_bins > 256;
+    bin_edges = edges;
+    Codes8().swap(codes8);
+    Codes16().swap(codes16);
+    bundles.clear();
+    feature_bundle.clear();
+    feature_offset.clear();
+    default_bin.clear();
+    bundle_n_codes.clear();
+    bundle_codes.clear();
+    return 0;
+}
+
+MemoryUsage BinnedMatrix::memory_usage() const
+{
+    size_t edge_bytes = vector_bytes(bin_edges);
+    for (size_t j = 0; j < bin_edges.size(); j++)
+        edge_bytes += vector_bytes(bin_edges[j]);
+    size_t bundle_bytes = vector_bytes(bundles) + vector_bytes(feature_bundle) + vector_bytes(feature_offset) +
+                          vector_bytes(default_bin) + vector_bytes(bundle_n_codes);
+    for (size_t k = 0; k < bundles.size(); k++)
+        bundle_bytes += vector_bytes(bundles[k]);
+
+    MemoryUsage usage;
+    usage.add("bin_edges", edge_bytes);
+    usage.add("codes", vector_bytes(codes8) + vector_bytes(codes16) + vector_bytes(bundle_codes));
+    usage.add("bundles", bundle_bytes);
+    return usage;
+}
+
+int BinnedMatrix::bundle(double max_conflict_rate)
+{
+    // Validation
+    if (rows == 0 || cols == 0 || is_bundled())
+        return 1;
+    if (max_conflict_rate < 0.0 || max_conflict_rate >= 1.0)
+        return 2;
+
+    // The default bin of a feature is its most frequent one
+    default_bin.assign(cols, 0);
+    vector<int> n_nonzero(cols, 0);
+    vector<int> bin_count;
+    for (int j = 0; j < cols; j++)
+    {
+        bin_count.assign(n_bins(j), 0);
+        for (int i = 0; i < rows; i++)
+            bin_count[code(i, j)] += 1;
+        default_bin[j] = static_cast<int>(std::max_element(bin_count.begin(), bin_count.end()) -
+                                          bin_count.begin());
+        n_nonzero[j] = rows - bin_count[default_bin[j]];
+    }
+
+    // Densest features first, they are the hardest to place
+    vector<int> order(cols);
+    for (int j = 0; j < cols; j++)
+        order[j] = j;
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return n_nonzero[a] > n_nonzero[b];
+    });
+
+    long long max_conflicts = static_cast<long long>(max_conflict_rate * rows);
+    vector<vector<bool> > is_used;      // Rows holding a non-default bin, per bundle
+    vector<int> n_used;
+    vector<long long> n_conflicts;
+    vector<int> nonzero_rows;           // Rows of the feature placed off its default bin
+    bundles.clear();
+    bundle_n_codes.clear();
+
+    for (int o = 0; o < cols; o++)
+    {
+        int j = order[o];
+        int n_codes = n_bins(j) - 1;
+        int found = -1;
+
+        // A conflict is a row of the feature the bundle uses already: only
+        // these rows are tested against each bundle
+        nonzero_rows.clear();
+        for (int i = 0; i < rows; i++)
+        {
+            if (code(i, j) != default_bin[j])
+                nonzero_rows.push_back(i);
+        }
+
+        for (int k = 0; k < static_cast<int>(bundles.size()) && found < 0; k++)
+        {
+            if (bundle_n_codes[k] + n_codes > 65536)
+                continue;
+
+            // At least n_nonzero + n_used - rows rows overlap
+            long long budget = max_conflicts - n_conflicts[k];
+            if (static_cast<long long>(n_nonzero[j]) + n_used[k] - rows > budget)
+                continue;
+
+            long long n_conflict = 0;
+            for (size_t r = 0; r < nonzero_rows.size() && n_conflict <= budget; r++)
+            {
+                if (is_used[k][nonzero_rows[r]])
+                    n_conflict += 1;
+            }
+            if (n_conflict > budget)
+                continue;
+
+            found = k;
+            n_conflicts[k] += n_conflict;
+        }
+        if (found < 0)
+        {
+            found = static_cast<int>(bundles.size());
+            bundles.push_back(vector<int>());
+            bundle_n_codes.push_back(1);
+            is_used.push_back(vector<bool>(rows, false));
+            n_used.push_back(0);
+            n_conflicts.push_back(0);
+        }
+
+        bundles[found].push_back(j);
+        bundle_n_codes[found] += n_codes;
+        for (size_t r = 0; r < nonzero_rows.size(); r++)
+        {
+            if (!is_used[found][nonzero_rows[r]])
+            {
+                is_used[found][nonzero_rows[r]] = true;
+                n_used[found] += 1;
+            }
+        }
+    }
+
+    // Every feature takes the codes after the previous ones of its bundle
+    feature_bundle.assign(cols, 0);
+    feature_offset.assign(cols, 0);
+    for (int k = 0; k < static_cast<int>(bundles.size()); k++)
+    {
+        int offset = 1;
+        for (int m = 0; m < static_cast<int>(bundles[k].size()); m++)
+        {
+            int j = bundles[k][m];
+            feature_bundle[j] = k;
+            feature_offset[j] = offset;
+            offset += n_bins(j) - 1;
+        }
+    }
+
+    _encode_bundles();
+    return 0;
+}
+
+void BinnedMatrix::_encode_bundles()
+{
+    // Read the per-feature codes while feature_bundle is still empty
+    vector<int> bundle_of;
+    bundle_of.swap(feature_bundle);
+
+    int n_bundles = static_cast<int>(bundles.size());
+    vector<uint16_t> encoded(static_cast<size_t>(n_bundles) * rows, 0);
+    for (int k = 0; k < n_bundles; k++)
+    {
+        uint16_t* column = &encoded[static_cast<size_t>(k) * rows];
+        for (int m = 0; m < static_cast<int>(bundles[k].size()); m++)
+        {
+            int j = bundles[k][m];
+            for (int i = 0; i < rows; i++)
+            {
+                int bin = code(i, j);
+                // The first feature of the bundle wins a conflict
+                if (bin != default_bin[j] && column[i] == 0)
+                    column[i] = static_cast<uint16_t>(feature_offset[j] +
+                                                      ((bin < default_bin[j]) ? bin : bin - 1));
+            }
+        }
+    }
+
+    feature_bundle.swap(bundle_of);
+    bundle_codes.swap(encoded);
+    Codes8().swap(codes8);
+    Codes16().swap(codes16);
+}
+
+template <typename DTYPE>
+void BinnedMatrix::_fit_column(DataView<DTYPE> X,
+                               int j,
+                               vector<DTYPE>& sorted_values)
+{
+    for (int i = 0; i < rows; i++)
+        sorted_values[i] = X.at(i, j);
+    std::sort(sorted_values.begin(), sorted_values.end());
+
+    // Cut at the ranks of the max_bins-quantiles, between two distinct
+    // values so that equal values always share a bin. With few distinct
+    // values every value gets its own bin.
+    vector<double>& edges = bin_edges[j];
+    for (int q = 1; q < max_bins; q++)
+    {
+        int rank = static_cast<int>((static_cast<long long>(q) * rows) / max_bins);
+        if (rank >= rows)
+            break;
+
+        DTYPE lower = sorted_values[rank];
+        typename vector<DTYPE>::iterator next = std::upper_bound(sorted_values.begin(),
+                                                                 sorted_values.end(),
+                                                                 lower);
+        if (next == sorted_values.end())
+            break;
+
+        double edge = mid_threshold(lower, *next);
+        if (edges.empty() || edge > edges.back())
+            edges.push_back(edge);
+    }
+
+    // Few distinct values: the quantiles may skip some of them
+    if (static_cast<int>(edges.size()) + 1 < max_bins)
+    {
+        vector<double> distinct_edges;
+        for (int i = 1; i < rows; i++)
+        {
+            if (sorted_values[i] != sorted_values[i-1])
+                distinct_edges.push_back(mid_threshold(sorted_values[i-1], sorted_values[i]));
+        }
+        if (static_cast<int>(distinct_edges.size()) + 1 <= max_bins)
+            edges = distinct_edges;
+    }
+}
+
+template <typename DTYPE>
+void BinnedMatrix::_bin_column(DataView<DTYPE> X,
+                               int j)
+{
+    size_t offset = static_cast<size_t>(j) * rows;
+    for (int i = 0; i < rows; i++)
+    {
+        int bin = bin_value(j, X.at(i, j));
+        if (is_wide)
+            codes16[offset + i] = static_cast<uint16_t>(bin);
+        else
+            codes8[offset + i] = static_cast<uint8_t>(bin);
+    }
+}
+
+int BinnedMatrix::bin_value(int j,
+                            double value) const
+{
+    const vector<double>& edges = bin_edges[j];
+    return static_cast<int>(std::lower_bound(edges.begin(), edges.end(), value) -
+                            edges.begin());
+}
+
+// Explicit instantiations for the supported feature types
+template int BinnedMatrix::fit<float>(DataView<float> X, int max_bins, int n_threads, NumaPlacement placement);
+template int BinnedMatrix::fit<double>(DataView<double> X, int max_bins, int n_threads, NumaPlacement placement);
+template int BinnedMatrix::transform<float>(DataView<float> X, const BinnedMatrix& reference, int n_threads, NumaPlacement placement);
+template int BinnedMatrix::transform<double>(DataView<double> X, const BinnedMatrix& reference, int n_threads, NumaPlacement placement);
@@ -0,0 +1,253 @@
+#ifndef BINNEDMATRIX_H
+#define BINNEDMATRIX_H
+
+//========================================
+// BinnedMatrix
+// Quantized, column-major training representation
+//========================================
+
+#include <vector>
+#include <stdint.h>
+#include "dataview.h"
+#include "numa.h"
+#include "memoryusage.h"
+using std::vector;
+
+/**
+ * @brief Every feature of X quantized into at most max_bins bins.
+ *
+ * Codes are stored column-major (feature by feature), as uint8 when
+ * max_bins <= 256 and as uint16 otherwise. Bin b of feature j holds the
+ * values in (bin_edges[j][b-1], bin_edges[j][b]], the last bin is unbounded,
+ * so for any value x
+ *
+ *     x <= bin_edges[j][b]  <=>  bin_value(j, x) <= b
+ *
+ * and a split found on bin b maps back to the real threshold
+ * bin_edges[j][b] stored in Node::threshold.
+ *
+ * After bundle, mutually exclusive features share a column: a bundle code
+ * of 0 means every feature of the bundle is in its default bin, its most
+ * frequent one, and every other bin of a feature owns a range of codes of
+ * its bundle. code still gives the bin of any feature.
+ *
+ * Columns are binned in parallel, the codes of a column being first
+ * touched, hence placed in memory, by the thread that bins it.
+ */
+class BinnedMatrix
+{
+public:
+    BinnedMatrix();
+    ~BinnedMatrix();
+
+    /**
+     * @brief Compute the bin edges of every feature of X, then bin X.
+     * @param X The input samples, shape = [n_samples, n_features]
+     * @param max_bins Maximal number of bins per feature, in [2, 65536]
+     * @param n_threads Number of threads binning the columns, 0 for the number of cores
+     * @param placement NUMA nodes of the threads, hence of the column blocks
+     * they bin. NUMA_PARTITIONED for blocks scanned by the worker of their
+     * node, NUMA_INTERLEAVED for codes scanned by all the workers.
+     * @return error_code
+     */
+    template <typename DTYPE>
+    int fit(DataView<DTYPE> X,
+            int max_bins,
+            int n_threads=1,
+            NumaPlacement placement=NUMA_NONE);
+
+    /**
+     * @brief Bin X with the bin edges of reference, e.g. the row shard of a
+     * worker with the edges shared by all the workers. X is bundled as
+     * reference is, and may have no rows, e.g. an empty shard.
+     * @param X The input samples, shape = [n_samples, n_features]
+     * @param reference A fitted BinnedMatrix with n_features features
+     * @param n_threads Number of threads binning the columns, 0 for the number of cores
+     * @param placement NUMA nodes of the threads, as in fit
+     * @return error_code
+     */
+    template <typename DTYPE>
+    int transform(DataView<DTYPE> X,
+                  const BinnedMatrix& reference,
+                  int n_threads=1,
+                  NumaPlacement placement=NUMA_NONE);
+
+    /**
+     * @brief Use the given bin edges, e.g. those of an external quantizer or
+     * Tree::split_thresholds, without binning any sample.
+     * @param edges Increasing upper edges of every bin but the last, per feature
+     * @return error_code, 1 for no feature, 2 for edges not increasing or
+     * more than 65536 bins
+     */
+    int set_edges(const vector<vector<double> >& edges);
+
+    /**
+     * @brief Bytes of the bin edges, the codes and the bundles, by part
+     */
+    MemoryUsage memory_usage() const;
+
+    /**
+     * @brief Exclusive feature bundling: greedily merge the features whose
+     * non-default rows rarely overlap into shared columns. Features are taken
+     * from the densest, each joining the first bundle it conflicts with on at
+     * most max_conflict_rate * rows rows. On a conflicting row, the bundle
+     * keeps the feature that joined first and the others read their default
+     * bin. The per-feature codes are released.
+     * @param max_conflict_rate Fraction of the rows, in [0, 1). 0 only
+     * bundles exactly exclusive features.
+     * @return error_code, 1 if not fitted or already bundled, 2 for an invalid rate
+     */
+    int bundle(double max_conflict_rate);
+
+    /**
+     * @brief Find the bin of a value of feature j.
+     * @param j
+     * @param value
+     * @return bin code
+     */
+    int bin_value(int j,
+                  double value) const;
+
+    /**
+     * @brief Bin code of sample i, feature j
+     */
+    inline int code(int i, int j) const
+    {
+        if (!feature_bundle.empty())
+            return bundled_code(i, j);
+        size_t index = static_cast<size_t>(j) * rows + i;
+        return is_wide ? codes16[index] : codes8[index];
+    }
+
+    /**
+     * @brief Bin code of sample i, feature j, decoded from its bundle
+     */
+    inline int bundled_code(int i, int j) const
+    {
+        int local = bundle_codes[static_cast<size_t>(feature_bundle[j]) * rows + i]
+                    - feature_offset[j];
+        if (local < 0 || local >= n_bins(j) - 1)
+            return default_bin[j];
+        return (local < default_bin[j]) ? local : local + 1;
+    }
+
+    /**
+     * @brief Code in its bundle of bin b of feature j, b != default_bin[j]
+     */
+    inline int bundle_code(int j, int b) const
+    {
+        return feature_offset[j] + ((b < default_bin[j]) ? b : b - 1);
+    }
+
+    /**
+     * @brief Whether bundle was called, the features being read through their bundle
+     */
+    inline bool is_bundled() const
+    {
+        return !feature_bundle.empty();
+    }
+
+    /**
+     * @brief Codes of bundle k, shape = [n_samples]
+     */
+    inline const uint16_t* bundle_column(int k) const
+    {
+        return bundle_codes.data() + static_cast<size_t>(k) * rows;
+    }
+
+    /**
+     * @brief Codes of feature j when is_wide is false and not bundled, shape = [n_samples]
+     */
+    inline const uint8_t* column8(int j) const
+    {
+        return codes8.data() + static_cast<size_t>(j) * rows;
+    }
+
+    /**
+     * @brief Codes of feature j when is_wide is true and not bundled, shape = [n_samples]
+     */
+    inline const uint16_t* column16(int j) const
+    {
+        return codes16.data() + static_cast<size_t>(j) * rows;
+    }
+
+    /**
+     * @brief All the codes when is_wide is false and not bundled, e.g. for
+     * predict_binned, shape = [n_samples, n_features]
+     */
+    inline DataView<uint8_t> view8() const
+    {
+        return DataView<uint8_t>(codes8.data(), rows, cols, 1, rows);
+    }
+
+    /**
+     * @brief All the codes when is_wide is true and not bundled, shape = [n_samples, n_features]
+     */
+    inline DataView<uint16_t> view16() const
+    {
+        return DataView<uint16_t>(codes16.data(), rows, cols, 1, rows);
+    }
+
+    /**
+     * @brief Number of bins of feature j
+     */
+    inline int n_bins(int j) const
+    {
+        return static_cast<int>(bin_edges[j].size()) + 1;
+    }
+
+    /**
+     * @brief Real threshold of a split between bin and bin+1 of feature j
+     */
+    inline double threshold(int j, int bin) const
+    {
+        return bin_edges[j][bin];
+    }
+
+private:
+    /**
+     * @brief Compute the bin edges of column j of X
+     * @param sorted_values Buffer, shape = [n_samples]
+     */
+    template <typename DTYPE>
+    void _fit_column(DataView<DTYPE> X,
+                     int j,
+                     vector<DTYPE>& sorted_values);
+
+    /**
+     * @brief Bin column j of X into the codes, with the current bin edges
+     */
+    template <typename DTYPE>
+    void _bin_column(DataView<DTYPE> X,
+                     int j);
+
+    /**
+     * @brief Encode the per-feature codes into the bundle columns of the
+     * current bundles, then release them
+     */
+    void _encode_bundles();
+
+public:
+    // Left uninitialized on resize, for the first touch of the binning threads
+    typedef vector<uint8_t, FirstTouchAllocator<uint8_t> > Codes8;
+    typedef vector<uint16_t, FirstTouchAllocator<uint16_t> > Codes16;
+
+    int rows;                           // Number of samples
+    int cols;                           // Number of features
+    int max_bins;                       // Maximal number of bins per feature
+    bool is_wide;                       // Codes are stored as uint16
+
+    Codes8 codes8;                      // Codes, shape = [n_features, n_samples]
+    Codes16 codes16;                    // Codes, shape = [n_features, n_samples]
+    vector<vector<double> > bin_edges;  // Upper edge of every bin but the last
+
+    // Exclusive feature bundling, empty unless bundled
+    vector<vector<int> > bundles;       // Features of every bundle, by priority on a conflict
+    vector<int> feature_bundle;         // Bundle of every feature
+    vector<int> feature_offset;         // First code of every feature in its bundle
+    vector<int> default_bin;            // Bin of every feature left implicit by its bundle
+    vector<int> bundle_n_codes;         // Number of codes of every bundle
+    vector<uint16_t> bundle_codes;      // Codes, shape = [n_bundles, n_samples]
+};
+
+#endif // BINNEDMATRIX_H
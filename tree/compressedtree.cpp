@@ -0,0 +1,194 @@
+#include "compressedtree.h"
+#include "basetree.h"
+#include "util.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+#include <queue>
+
+CompressedTree::CompressedTree()
+    : _coding(THRESHOLD_FLOAT32),
+      _n_features(0),
+      _n_outputs(1),
+      _value_offset(0.0),
+      _value_scale(0.0)
+{
+
+}
+
+/**
+ * @brief Largest float <= threshold, so that x <= threshold and
+ * x <= the float agree on every float x
+ */
+static float float_below(double threshold)
+{
+    if (threshold >= FLT_MAX)
+        return FLT_MAX;
+    if (threshold < -FLT_MAX)
+        return -std::numeric_limits<float>::infinity();
+    float value = static_cast<float>(threshold);
+    if (value > threshold)
+        value = std::nextafter(value, -std::numeric_limits<float>::infinity());
+    return value;
+}
+
+int CompressedTree::compress(const Tree& tree,
+                             ThresholdCoding coding,
+                             CompressionReport& report)
+{
+    if (tree._node_count == 0)
+        return 1;
+
+    int n_outputs = tree._n_outputs;
+    bool has_tables = (tree._leaf_prediction.size() == static_cast<size_t>(tree._node_count) * n_outputs);
+
+    // Threshold tables, the distinct thresholds of every feature
+    vector<vector<double> > edges;
+    vector<size_t> table_offset;
+    if (coding == THRESHOLD_INDEX)
+    {
+        tree.split_thresholds(edges);
+        table_offset.assign(edges.size() + 1, 0);
+        for (size_t j = 0; j < edges.size(); j++)
+            table_offset[j + 1] = table_offset[j] + edges[j].size();
+        if (table_offset.back() > static_cast<size_t>(std::numeric_limits<uint32_t>::max()))
+            return 2;
+    }
+
+    // Leaf predictions, and their range
+    vector<int> leaves;
+    vector<double> leaf_prediction;
+    vector<double> prediction(n_outputs);
+    for (int n = 0; n < tree._node_count; n++)
+    {
+        if (tree._nodes[n].left_child != TREE_LEAF)
+            continue;
+        leaves.push_back(n);
+        if (has_tables)
+            std::copy(&tree._leaf_prediction[static_cast<size_t>(n) * n_outputs],
+                      &tree._leaf_prediction[static_cast<size_t>(n + 1) * n_outputs],
+                      prediction.begin());
+        else
+            tree._node_prediction(n, &prediction[0]);
+        leaf_prediction.insert(leaf_prediction.end(), prediction.begin(), prediction.end());
+    }
+    double min_value = *std::min_element(leaf_prediction.begin(), leaf_prediction.end());
+    double max_value = *std::max_element(leaf_prediction.begin(), leaf_prediction.end());
+    bool is_integral = (min_value >= -32767.0 && max_value <= 32767.0);
+    for (size_t v = 0; is_integral && v < leaf_prediction.size(); v++)
+        is_integral = (leaf_prediction[v] == std::floor(leaf_prediction[v]));
+
+    // value = offset + code * scale, code in [-32767, 32767]
+    double offset = 0.0;
+    double scale = 1.0;
+    if (!is_integral)
+    {
+        offset = min_value + 0.5 * (max_value - min_value);
+        scale = 0.5 * (max_value - min_value) / 32767.0;
+    }
+    vector<int16_t> leaf_values(leaf_prediction.size());
+    double value_error = 0.0;
+    for (size_t v = 0; v < leaf_prediction.size(); v++)
+    {
+        double code = (scale > 0.0) ? std::floor((leaf_prediction[v] - offset) / scale + 0.5) : 0.0;
+        code = std::min(std::max(code, -32767.0), 32767.0);
+        leaf_values[v] = static_cast<int16_t>(code);
+        value_error = std::max(value_error, std::fabs(offset + leaf_values[v] * scale - leaf_prediction[v]));
+    }
+
+    // Nodes in breadth-first order, siblings next to each other
+    vector<int> leaf_ordinal(tree._node_count, -1);
+    for (size_t l = 0; l < leaves.size(); l++)
+        leaf_ordinal[leaves[l]] = static_cast<int>(l);
+    vector<CompressedNode> nodes(tree._node_count);
+    std::queue<std::pair<int, int> > pending;      // (node id, new id)
+    pending.push(std::make_pair(0, 0));
+    int n_placed = 1;
+    double threshold_shift = 0.0;
+    while (!pending.empty())
+    {
+        const Node& node = tree._nodes[pending.front().first];
+        CompressedNode& compressed = nodes[pending.front().second];
+        int node_id = pending.front().first;
+        pending.pop();
+
+        if (node.left_child == TREE_LEAF)
+        {
+            compressed.child = ~leaf_ordinal[node_id];
+            compressed.feature = 0;
+            compressed.threshold.index = 0;
+            continue;
+        }
+        compressed.child = n_placed;
+        compressed.feature = node.feature;
+        if (coding == THRESHOLD_FLOAT32)
+        {
+            compressed.threshold.value = float_below(node.threshold);
+            threshold_shift = std::max(threshold_shift, node.threshold - compressed.threshold.value);
+        }
+        else
+        {
+            const vector<double>& table = edges[node.feature];
+            size_t k = std::lower_bound(table.begin(), table.end(), node.threshold) - table.begin();
+            compressed.threshold.index = static_cast<uint32_t>(table_offset[node.feature] + k);
+        }
+        pending.push(std::make_pair(node.left_child, n_placed));
+        pending.push(std::make_pair(node.right_child, n_placed + 1));
+        n_placed += 2;
+    }
+
+    _coding = coding;
+    _n_features = tree._n_features;
+    _n_outputs = n_outputs;
+    _nodes.swap(nodes);
+    _thresholds.clear();
+    for (size_t j = 0; j < edges.size(); j++)
+        _thresholds.insert(_thresholds.end(), edges[j].begin(), edges[j].end());
+    vector<double>(_thresholds).swap(_thresholds);
+    _leaf_values.swap(leaf_values);
+    _value_offset = offset;
+    _value_scale = scale;
+
+    // Sizes of what predict reads
+    size_t original_bytes = static_cast<size_t>(tree._node_count) * sizeof(Node);
+    for (int n = 0; n < tree._node_count; n++)
+        original_bytes += tree._value[n].size() * sizeof(double);
+    original_bytes += (tree._leaf_prediction.size() + tree._leaf_proba.size() +
+                       tree._leaf_log_proba.size()) * sizeof(double) + tree._leaf_row.size() * sizeof(int);
+    report.original_bytes += original_bytes;
+    report.compressed_bytes += memory_bytes();
+    report.max_threshold_shift = std::max(report.max_threshold_shift, threshold_shift);
+    report.value_error_bound = std::max(report.value_error_bound, value_error);
+    return 0;
+}
+
+template <typename DTYPE>
+Mat CompressedTree::predict(DataView<DTYPE> X,
+                            int n_threads) const
+{
+    if (_nodes.empty())
+        return Mat();
+
+    Mat_<double> result(X.rows, _n_outputs);
+    parallel_for(X.rows, n_threads, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+        {
+            const int16_t* codes = &_leaf_values[static_cast<size_t>(_find_leaf(X, i)) * _n_outputs];
+            double* row = result.ptr<double>(i);
+            for (int k = 0; k < _n_outputs; k++)
+                row[k] = _value_offset + codes[k] * _value_scale;
+        }
+    });
+    return result;
+}
+
+size_t CompressedTree::memory_bytes() const
+{
+    return _nodes.size() * sizeof(CompressedNode) +
+           _thresholds.size() * sizeof(double) +
+           _leaf_values.size() * sizeof(int16_t);
+}
+
+template Mat CompressedTree::predict<float>(DataView<float> X, int n_threads) const;
+template Mat CompressedTree::predict<double>(DataView<double> X, int n_threads) const;
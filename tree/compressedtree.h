@@ -0,0 +1,146 @@
+#ifndef COMPRESSEDTREE_H
+#define COMPRESSEDTREE_H
+
+//========================================
+// CompressedTree
+// Read-only copy of a Tree for memory-bound serving
+//========================================
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+#include <opencv2/opencv.hpp>
+#include "dataview.h"
+
+using std::vector;
+using cv::Mat;
+
+class Tree;
+
+/**
+ * @brief How the thresholds of a CompressedTree are stored
+ */
+enum ThresholdCoding
+{
+    THRESHOLD_FLOAT32=0,    // Rounded down to a float: the same decisions on float
+                            // features, a shift bounded by max_threshold_shift else
+    THRESHOLD_INDEX=1,      // Index into the sorted distinct thresholds of the
+                            // feature: the same decisions on any feature
+};
+
+/**
+ * @brief What a compression costs and saves
+ */
+struct CompressionReport
+{
+    size_t original_bytes;          // Nodes, values and leaf tables of the original trees
+    size_t compressed_bytes;        // Nodes, threshold tables and leaf values once compressed
+    double max_threshold_shift;     // Largest move of a threshold, 0 with THRESHOLD_INDEX
+    double value_error_bound;       // Largest error of a prediction taking the original
+                                    // decisions, from the int16 leaf values
+    double max_error;               // Largest error measured on the check samples,
+                                    // decisions changed by a threshold shift included
+    int n_checked;                  // Number of check samples, 0 for none
+
+    CompressionReport()
+        : original_bytes(0),
+          compressed_bytes(0),
+          max_threshold_shift(0.0),
+          value_error_bound(0.0),
+          max_error(0.0),
+          n_checked(0)
+    {
+
+    }
+};
+
+/**
+ * @brief Node of a CompressedTree, 12 bytes instead of the 48 of a Node.
+ * Siblings are adjacent, so the right child is child + 1.
+ */
+struct CompressedNode
+{
+    int32_t child;          // Left child, or ~leaf for a leaf
+    int32_t feature;        // Feature used for splitting the node
+    union
+    {
+        float value;        // THRESHOLD_FLOAT32
+        uint32_t index;     // THRESHOLD_INDEX, into the thresholds table
+    } threshold;
+};
+
+class CompressedTree
+{
+public:
+    /**
+     * @brief A fitted Tree stripped to what predict reads: compact nodes,
+     * thresholds as floats or as indices into per-feature sorted tables,
+     * and leaf predictions as int16 codes of value = offset + code * scale.
+     * Leaf values all integers in the int16 range, e.g. classes, are stored
+     * exactly. The predictor reads this format directly.
+     */
+    CompressedTree();
+
+    /**
+     * @brief Compress a fitted tree. The tree is not needed afterwards.
+     * @param tree
+     * @param coding
+     * @param report The shift, bound and sizes of this tree are added to it,
+     * the errors being maximums
+     * @return error_code, 1 if the tree has no node, 2 if a threshold table
+     * would not fit uint32 indices
+     */
+    int compress(const Tree& tree,
+                 ThresholdCoding coding,
+                 CompressionReport& report);
+
+    /**
+     * @brief Predict target for X, with the original decisions up to the
+     * threshold coding.
+     * @param X shape = [n_samples, n_features]
+     * @param n_threads Rows are split among the threads, 0 for all the cores
+     * @return shape [n_samples, n_outputs], empty if not compressed
+     */
+    template <typename DTYPE>
+    Mat predict(DataView<DTYPE> X,
+                int n_threads=1) const;
+
+    /**
+     * @brief Leaf of sample i of X
+     * @return The leaf ordinal
+     */
+    template <typename DTYPE>
+    inline int _find_leaf(const DataView<DTYPE>& X,
+                          int i) const
+    {
+        const CompressedNode* node = &_nodes[0];
+        if (_coding == THRESHOLD_FLOAT32)
+        {
+            while (node->child >= 0)
+                node = &_nodes[node->child + (X.at(i, node->feature) > node->threshold.value)];
+        }
+        else
+        {
+            while (node->child >= 0)
+                node = &_nodes[node->child + (X.at(i, node->feature) > _thresholds[node->threshold.index])];
+        }
+        return ~node->child;
+    }
+
+    /**
+     * @brief Bytes held by the compressed tree
+     */
+    size_t memory_bytes() const;
+
+    ThresholdCoding _coding;
+    int _n_features;
+    int _n_outputs;
+    vector<CompressedNode> _nodes;      // Root first, siblings adjacent
+    vector<double> _thresholds;         // Distinct thresholds, sorted within each feature,
+                                        // the features one after the other
+    vector<int16_t> _leaf_values;       // Codes of the leaf predictions, shape [n_leaves, n_outputs]
+    double _value_offset;
+    double _value_scale;
+};
+
+#endif // COMPRESSEDTREE_H
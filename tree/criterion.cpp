@@ -1,16 +1,18 @@
 #include "criterion.h"
-#include <set>
+#include <algorithm>
 using std::set;
 
 Criterion::Criterion()
-    : start(0),
+    : samples(NULL),
+      start(0),
       pos(0),
       end(0),
       n_node_samples(0),
       weighted_n_samples(0.0),
       weighted_n_node_samples(0.0),
       weighted_n_left(0.0),
-      weighted_n_right(0.0)
+      weighted_n_right(0.0),
+      arena(NULL)
 {
 
 }
@@ -33,6 +35,55 @@ double Criterion::impurity_improvement(double impurity)
                      - weighted_n_left / weighted_n_node_samples * impurity_left);
 }
 
+double Criterion::improvement_upper_bound(const double* /*bin_weight*/,
+                                          const double* /*bin_sum*/,
+                                          const double* /*bin_y_min*/,
+                                          const double* /*bin_y_max*/,
+                                          int /*n_bins*/)
+{
+    return INFINITY;
+}
+
+int Criterion::init_stats(DataView<double> /*_y*/,
+                          double /*_weight_n_samples*/,
+                          int /*_n_classes*/)
+{
+    // Not expressible as a sum over the samples
+    return 0;
+}
+
+int Criterion::n_stats() const
+{
+    return 0;
+}
+
+MemoryUsage Criterion::memory_usage() const
+{
+    MemoryUsage usage;
+    usage.add("label_counts", vector_bytes(label_count_total) + vector_bytes(label_count_left) +
+                              vector_bytes(label_count_right));
+    return usage;
+}
+
+void Criterion::add_stats(int /*i*/,
+                          double /*w*/,
+                          double* /*stats*/) const
+{
+
+}
+
+void Criterion::reset_stats(const double* /*total*/,
+                            double /*weighted_n*/)
+{
+
+}
+
+void Criterion::update_stats(const double* /*left*/,
+                             double /*_weighted_n_left*/)
+{
+
+}
+
 ClassificationCriterion::ClassificationCriterion()
     : Criterion(),
       n_classes(0)
@@ -45,13 +96,18 @@ ClassificationCriterion::~ClassificationCriterion()
 
 }
 
-void ClassificationCriterion::init(Mat _y,
-                                   Mat _sample_weight,
+void ClassificationCriterion::init(DataView<double> _y,
+                                   DataView<double> _sample_weight,
                                    double _weight_n_samples,
-                                   vector<int>& _samples,
+                                   const int* _samples,
                                    int _start,
                                    int _end)
 {
+    // Find how many classes in y, once per training set rather than per node
+    bool new_y = (label_count_total.empty() ||
+                  _y.data != y.data ||
+                  _y.rows != y.rows);
+
     y = _y;
     sample_weight = _sample_weight;
     weighted_n_samples = _weight_n_samples;
@@ -59,37 +115,36 @@ void ClassificationCriterion::init(Mat _y,
     start = _start;
     end = _end;
 
-    // Find how many classes in y
-    set<double> unique;
-    for (int i = 0; i < y.rows; i++)
+    if (new_y)
     {
-        if (unique.find(y.at<double>(i)) == unique.end())
-            unique.insert(y.at<double>(i));
-    }
-    n_classes = unique.size();
-
-    // Clear
-    label_count_total.clear();
-    label_count_left.clear();
-    label_count_right.clear();
+        set<double> unique;
+        for (int i = 0; i < y.rows; i++)
+        {
+            if (unique.find(y.at(i)) == unique.end())
+                unique.insert(y.at(i));
+        }
+        n_classes = unique.size();
 
-    // Initialize
-    label_count_total.resize(n_classes);
-    label_count_left.resize(n_classes);
-    label_count_right.resize(n_classes);
+        // Allocate the statistics from the arena
+        label_count_total = ArenaVector<double>(n_classes, 0.0, ArenaAllocator<double>(arena));
+        label_count_left = ArenaVector<double>(n_classes, 0.0, ArenaAllocator<double>(arena));
+        label_count_right = ArenaVector<double>(n_classes, 0.0, ArenaAllocator<double>(arena));
+    }
+    else
+        std::fill(label_count_total.begin(), label_count_total.end(), 0.0);
 
     weighted_n_node_samples = 0.0;
     double w = 1.0;
     int index;
     for (int i = start; i < end; i++)
     {
-        index = samples.at(i);
+        index = samples[i];
 
-        if (sample_weight.total() == 0)
-            w = sample_weight.at<double>(index);
+        if (!sample_weight.empty())
+            w = sample_weight.at(index);
 
         // Get count of every class
-        int c = (int)y.at<double>(index, 0);
+        int c = (int)y.at(index);
         label_count_total.at(c) += w;
 
         weighted_n_node_samples += w;
@@ -119,12 +174,12 @@ void ClassificationCriterion::update(int new_pos)
     double diff_w = 0.0;
     for (int i = pos; i < new_pos; i++)
     {
-        index = samples.at(i);
+        index = samples[i];
 
-        if (sample_weight.total() != 0)
-            w = sample_weight.at<double>(index);
+        if (!sample_weight.empty())
+            w = sample_weight.at(index);
 
-        int label_index = static_cast<int>(y.at<double>(index));
+        int label_index = static_cast<int>(y.at(index));
         label_count_left.at(label_index) += w;
         label_count_right.at(label_index) -= w;
 
@@ -138,7 +193,59 @@ void ClassificationCriterion::update(int new_pos)
 
 vector<double> ClassificationCriterion::node_value()
 {
-    return label_count_total;
+    return vector<double>(label_count_total.begin(), label_count_total.end());
+}
+
+int ClassificationCriterion::init_stats(DataView<double> _y,
+                                        double _weight_n_samples,
+                                        int _n_classes)
+{
+    y = _y;
+    sample_weight = DataView<double>();
+    weighted_n_samples = _weight_n_samples;
+    samples = NULL;
+    start = 0;
+    end = 0;
+
+    // The classes of all the shards, some may be missing from the local y
+    n_classes = _n_classes;
+    label_count_total = ArenaVector<double>(n_classes, 0.0, ArenaAllocator<double>(arena));
+    label_count_left = ArenaVector<double>(n_classes, 0.0, ArenaAllocator<double>(arena));
+    label_count_right = ArenaVector<double>(n_classes, 0.0, ArenaAllocator<double>(arena));
+    return n_classes;
+}
+
+int ClassificationCriterion::n_stats() const
+{
+    return n_classes;
+}
+
+void ClassificationCriterion::add_stats(int i,
+                                        double w,
+                                        double* stats) const
+{
+    stats[static_cast<int>(y.at(i))] += w;
+}
+
+void ClassificationCriterion::reset_stats(const double* total,
+                                          double weighted_n)
+{
+    std::copy(total, total + n_classes, label_count_total.begin());
+    weighted_n_node_samples = weighted_n;
+
+    reset();
+}
+
+void ClassificationCriterion::update_stats(const double* left,
+                                           double _weighted_n_left)
+{
+    for (int c = 0; c < n_classes; c++)
+    {
+        label_count_left[c] = left[c];
+        label_count_right[c] = label_count_total[c] - left[c];
+    }
+    weighted_n_left = _weighted_n_left;
+    weighted_n_right = weighted_n_node_samples - _weighted_n_left;
 }
 
 Entropy::Entropy()
@@ -249,17 +356,7 @@ pair<double, double> Gini::children_impurity()
 
 RegressionCriterion::RegressionCriterion()
     : Criterion(),
-      mean_left(0.0),
-      mean_right(0.0),
-      mean_total(0.0),
-      sq_sum_left(0.0),
-      sq_sum_right(0.0),
-      sq_sum_total(0.0),
-      var_left(0.0),
-      var_right(0.0),
-      sum_left(0.0),
-      sum_right(0.0),
-      sum_total(0.0)
+      n_outputs(0)
 {
 
 }
@@ -270,10 +367,10 @@ RegressionCriterion::~RegressionCriterion()
 
 }
 
-void RegressionCriterion::init(Mat _y,
-                               Mat _sample_weight,
+void RegressionCriterion::init(DataView<double> _y,
+                               DataView<double> _sample_weight,
                                double _weight_n_samples,
-                               vector<int>& _samples,
+                               const int* _samples,
                                int _start,
                                int _end)
 {
@@ -284,34 +381,48 @@ void RegressionCriterion::init(Mat _y,
     start = _start;
     end = _end;
 
-    sum_total = 0.0;
-    sum_left = 0.0;
-    sum_right = 0.0;
-    sq_sum_total = 0.0;
-    sq_sum_left = 0.0;
-    sq_sum_right = 0.0;
+    // Allocate the per output statistics from the arena
+    if (n_outputs != y.cols)
+    {
+        n_outputs = y.cols;
+        sum_total = ArenaVector<double>(n_outputs, 0.0, ArenaAllocator<double>(arena));
+        sum_left = ArenaVector<double>(n_outputs, 0.0, ArenaAllocator<double>(arena));
+        sum_right = ArenaVector<double>(n_outputs, 0.0, ArenaAllocator<double>(arena));
+        sq_sum_total = ArenaVector<double>(n_outputs, 0.0, ArenaAllocator<double>(arena));
+        sq_sum_left = ArenaVector<double>(n_outputs, 0.0, ArenaAllocator<double>(arena));
+        sq_sum_right = ArenaVector<double>(n_outputs, 0.0, ArenaAllocator<double>(arena));
+    }
+
+    double* sum = sum_total.data();
+    double* sq_sum = sq_sum_total.data();
+    std::fill(sum, sum + n_outputs, 0.0);
+    std::fill(sq_sum, sq_sum + n_outputs, 0.0);
 
     int index;
     double w = 1.0;
-    double y_i = 0.0;
-    double w_y_i = 0.0;
+    double y_ik = 0.0;
+    const double* y_i;
     weighted_n_node_samples = 0.0;
 
     for (int i = start; i < end; i++)
     {
-        index = samples.at(i);
+        index = samples[i];
 
-        if (sample_weight.total() != 0)
-            w = sample_weight.at<double>(index);
+        if (!sample_weight.empty())
+            w = sample_weight.at(index);
 
-        y_i = y.at<double>(index);
-        w_y_i = w * y_i;
-        sum_total += w_y_i;
-        sq_sum_total += w_y_i * y_i;
+        // The outputs of a sample are contiguous in y, so that the loop
+        // over them vectorizes
+        y_i = &y.at(index, 0);
+        for (int k = 0; k < n_outputs; k++)
+        {
+            y_ik = y_i[k * y.col_stride];
+            sum[k] += w * y_ik;
+            sq_sum[k] += w * y_ik * y_ik;
+        }
 
         weighted_n_node_samples += w;
     }
-    mean_total = sum_total / weighted_n_node_samples;
 
     reset();
 }
@@ -320,15 +431,10 @@ void RegressionCriterion::reset()
 {
     pos = 0;
 
-    mean_right = mean_total;
-    mean_left = 0.0;
-    sq_sum_right = sq_sum_total;
-    sq_sum_left = 0.0;
-    var_right = (sq_sum_right / weighted_n_node_samples -
-                 mean_right * mean_right);
-    var_left = 0.0;
-    sum_right = sum_total;
-    sum_left = 0.0;
+    std::fill(sum_left.begin(), sum_left.end(), 0.0);
+    std::fill(sq_sum_left.begin(), sq_sum_left.end(), 0.0);
+    std::copy(sum_total.begin(), sum_total.end(), sum_right.begin());
+    std::copy(sq_sum_total.begin(), sq_sum_total.end(), sq_sum_right.begin());
 
     weighted_n_right = weighted_n_node_samples;
     weighted_n_left = 0;
@@ -337,50 +443,138 @@ void RegressionCriterion::reset()
 void RegressionCriterion::update(int new_pos)
 {
     double w = 1.0;
-    double y_i = 0.0;
-    double w_y_i = 0.0;
+    double y_ik = 0.0;
     double diff_w = 0.0;
+    const double* y_i;
 
+    double* sum_l = sum_left.data();
+    double* sq_sum_l = sq_sum_left.data();
     int index = 0;
 
     for (int i = pos; i < new_pos; i++)
     {
-        index = samples.at(i);
+        index = samples[i];
 
-        if (sample_weight.total() != 0)
-            w  = sample_weight.at<double>(index);
+        if (!sample_weight.empty())
+            w  = sample_weight.at(index);
 
-        y_i = y.at<double>(index);
-        w_y_i = w * y_i;
-
-        sum_left += w_y_i;
-        sum_right -= w_y_i;
-
-        sq_sum_left += w_y_i * y_i;
-        sq_sum_right -= w_y_i * y_i;
+        y_i = &y.at(index, 0);
+        for (int k = 0; k < n_outputs; k++)
+        {
+            y_ik = y_i[k * y.col_stride];
+            sum_l[k] += w * y_ik;
+            sq_sum_l[k] += w * y_ik * y_ik;
+        }
 
         diff_w += w;
     }
     weighted_n_left += diff_w;
     weighted_n_right -= diff_w;
 
-    mean_left = sum_left / weighted_n_left;
-    mean_right = sum_right / weighted_n_right;
-    var_left = sq_sum_left / weighted_n_left -
-                mean_left * mean_left;
-    var_right = sq_sum_right / weighted_n_right -
-                 mean_right * mean_right;
+    // The right statistics follow from the total
+    for (int k = 0; k < n_outputs; k++)
+    {
+        sum_right[k] = sum_total[k] - sum_l[k];
+        sq_sum_right[k] = sq_sum_total[k] - sq_sum_l[k];
+    }
 
     pos = new_pos;
 }
 
 vector<double> RegressionCriterion::node_value()
 {
-    vector<double> vec;
-    vec.push_back(mean_total);
+    vector<double> vec(n_outputs);
+    for (int k = 0; k < n_outputs; k++)
+        vec[k] = sum_total[k] / weighted_n_node_samples;
     return vec;
 }
 
+int RegressionCriterion::init_stats(DataView<double> _y,
+                                    double _weight_n_samples,
+                                    int /*_n_classes*/)
+{
+    y = _y;
+    sample_weight = DataView<double>();
+    weighted_n_samples = _weight_n_samples;
+    samples = NULL;
+    start = 0;
+    end = 0;
+
+    n_outputs = y.cols;
+    sum_total = ArenaVector<double>(n_outputs, 0.0, ArenaAllocator<double>(arena));
+    sum_left = ArenaVector<double>(n_outputs, 0.0, ArenaAllocator<double>(arena));
+    sum_right = ArenaVector<double>(n_outputs, 0.0, ArenaAllocator<double>(arena));
+    sq_sum_total = ArenaVector<double>(n_outputs, 0.0, ArenaAllocator<double>(arena));
+    sq_sum_left = ArenaVector<double>(n_outputs, 0.0, ArenaAllocator<double>(arena));
+    sq_sum_right = ArenaVector<double>(n_outputs, 0.0, ArenaAllocator<double>(arena));
+    return 2 * n_outputs;
+}
+
+int RegressionCriterion::n_stats() const
+{
+    return 2 * n_outputs;
+}
+
+MemoryUsage RegressionCriterion::memory_usage() const
+{
+    MemoryUsage usage = Criterion::memory_usage();
+    usage.add("sums", vector_bytes(sum_total) + vector_bytes(sum_left) + vector_bytes(sum_right) +
+                      vector_bytes(sq_sum_total) + vector_bytes(sq_sum_left) + vector_bytes(sq_sum_right));
+    return usage;
+}
+
+void RegressionCriterion::add_stats(int i,
+                                    double w,
+                                    double* stats) const
+{
+    const double* y_i = &y.at(i, 0);
+    double y_ik;
+    for (int k = 0; k < n_outputs; k++)
+    {
+        y_ik = y_i[k * y.col_stride];
+        stats[k] += w * y_ik;
+        stats[n_outputs + k] += w * y_ik * y_ik;
+    }
+}
+
+void RegressionCriterion::reset_stats(const double* total,
+                                      double weighted_n)
+{
+    std::copy(total, total + n_outputs, sum_total.begin());
+    std::copy(total + n_outputs, total + 2 * n_outputs, sq_sum_total.begin());
+    weighted_n_node_samples = weighted_n;
+
+    reset();
+}
+
+void RegressionCriterion::update_stats(const double* left,
+                                       double _weighted_n_left)
+{
+    for (int k = 0; k < n_outputs; k++)
+    {
+        sum_left[k] = left[k];
+        sq_sum_left[k] = left[n_outputs + k];
+        sum_right[k] = sum_total[k] - sum_left[k];
+        sq_sum_right[k] = sq_sum_total[k] - sq_sum_left[k];
+    }
+    weighted_n_left = _weighted_n_left;
+    weighted_n_right = weighted_n_node_samples - _weighted_n_left;
+}
+
+double RegressionCriterion::variance(const double* sum,
+                                     const double* sq_sum,
+                                     double weighted_n) const
+{
+    double var = 0.0;
+    double mean;
+    for (int k = 0; k < n_outputs; k++)
+    {
+        mean = sum[k] / weighted_n;
+        var += sq_sum[k] / weighted_n - mean * mean;
+    }
+    return var / n_outputs;
+}
+
 MSE::MSE()
     : RegressionCriterion()
 {
@@ -394,13 +588,103 @@ MSE::~MSE()
 
 double MSE::node_impurity()
 {
-    return (sq_sum_total / weighted_n_node_samples -
-            mean_total * mean_total);
+    return variance(sum_total.data(), sq_sum_total.data(), weighted_n_node_samples);
 }
 
 pair<double, double> MSE::children_impurity()
 {
-    return make_pair(var_left, var_right);
+    return make_pair(variance(sum_left.data(), sq_sum_left.data(), weighted_n_left),
+                     variance(sum_right.data(), sq_sum_right.data(), weighted_n_right));
+}
+
+MemoryUsage MSE::memory_usage() const
+{
+    MemoryUsage usage = RegressionCriterion::memory_usage();
+    usage.add("bound_sum", vector_bytes(bound_sum));
+    return usage;
+}
+
+double MSE::improvement_upper_bound(const double* bin_weight,
+                                    const double* bin_sum,
+                                    const double* bin_y_min,
+                                    const double* bin_y_max,
+                                    int n_bins)
+{
+    const double W = weighted_n_node_samples;
+    const double* S = sum_total.data();
+
+    if (static_cast<int>(bound_sum.size()) != n_outputs)
+        bound_sum = ArenaVector<double>(n_outputs, 0.0, ArenaAllocator<double>(arena));
+    std::fill(bound_sum.begin(), bound_sum.end(), 0.0);
+
+    // g(S_L, W_L) of output k, an empty side counting for 0
+    auto g = [&](int k, double s, double w) {
+        double res = 0.0;
+        if (w > 0.0)
+            res += s * s / w;
+        if (W - w > 0.0)
+            res += (S[k] - s) * (S[k] - s) / (W - w);
+        return res;
+    };
+
+    double g_node = 0.0;
+    double scale = 0.0;
+    for (int k = 0; k < n_outputs; k++)
+    {
+        g_node += S[k] * S[k] / W;
+        scale += sq_sum_total[k];
+    }
+
+    double g_max = g_node;
+    double g_bin;
+    double g_k;
+    double w_b;
+    double s_b;
+    double y_min;
+    double y_max;
+    double w_top;
+    double w_bottom;
+    double w_left = 0.0;
+    double s;
+    for (int b = 0; b < n_bins; b++)
+    {
+        w_b = bin_weight[b];
+        if (w_b <= 0.0)
+            continue;
+
+        // Sum over the outputs of the max on the vertices
+        g_bin = 0.0;
+        for (int k = 0; k < n_outputs; k++)
+        {
+            s = bound_sum[k];
+            s_b = bin_sum[b * n_outputs + k];
+            y_min = bin_y_min[b * n_outputs + k];
+            y_max = bin_y_max[b * n_outputs + k];
+
+            // Whole bin boundaries
+            g_k = std::max(g(k, s, w_left), g(k, s + s_b, w_left + w_b));
+
+            // Weight w of the bin taken by the split: the largest sums are
+            // w * y_max up to w_top, then s_b - (w_b - w) * y_min, and the
+            // smallest ones symmetrically
+            if (y_max > y_min)
+            {
+                w_top = (s_b - w_b * y_min) / (y_max - y_min);
+                w_bottom = (w_b * y_max - s_b) / (y_max - y_min);
+                g_k = std::max(g_k, g(k, s + w_top * y_max, w_left + w_top));
+                g_k = std::max(g_k, g(k, s + w_bottom * y_min, w_left + w_bottom));
+            }
+            g_bin += g_k;
+
+            bound_sum[k] += s_b;
+        }
+        g_max = std::max(g_max, g_bin);
+        w_left += w_b;
+    }
+
+    // The improvements of the splits are rounded differently, the margin
+    // covers it relatively to the magnitude of the terms
+    return ((g_max - g_node) + 1e-10 * scale) / n_outputs / weighted_n_samples;
 }
 
 FriedmanMSE::FriedmanMSE()
@@ -420,35 +704,270 @@ double FriedmanMSE::impurity_improvement(double impurity)
     double total_sum_right = 0.0;
     double diff = 0.0;
 
-    total_sum_left += sum_left;
-    total_sum_right += sum_right;
-    diff = (total_sum_left / weighted_n_left) -
-           (total_sum_right / weighted_n_right);
+    for (int k = 0; k < n_outputs; k++)
+    {
+        total_sum_left += sum_left[k];
+        total_sum_right += sum_right[k];
+    }
+    diff = ((total_sum_left / weighted_n_left) -
+            (total_sum_right / weighted_n_right)) / n_outputs;
 
     return weighted_n_left * weighted_n_right * diff * diff /
             (weighted_n_left + weighted_n_right);
 }
 
+WeightedMedianCalculator::WeightedMedianCalculator(NodePool* pool)
+    : lower(std::less<pair<double, double> >(), PoolAllocator<pair<double, double> >(pool)),
+      upper(std::less<pair<double, double> >(), PoolAllocator<pair<double, double> >(pool)),
+      weight_lower(0.0),
+      weight_upper(0.0),
+      sum_lower(0.0),
+      sum_upper(0.0)
+{
 
+}
 
+void WeightedMedianCalculator::clear()
+{
+    lower.clear();
+    upper.clear();
+    weight_lower = 0.0;
+    weight_upper = 0.0;
+    sum_lower = 0.0;
+    sum_upper = 0.0;
+}
 
+void WeightedMedianCalculator::push(double value, double weight)
+{
+    if (lower.empty() || value <= lower.rbegin()->first)
+    {
+        lower.insert(make_pair(value, weight));
+        weight_lower += weight;
+        sum_lower += weight * value;
+    }
+    else
+    {
+        upper.insert(make_pair(value, weight));
+        weight_upper += weight;
+        sum_upper += weight * value;
+    }
+    rebalance();
+}
 
+void WeightedMedianCalculator::remove(double value, double weight)
+{
+    pair<double, double> sample = make_pair(value, weight);
+    SampleSet::iterator it = lower.find(sample);
+    if (it != lower.end())
+    {
+        lower.erase(it);
+        weight_lower -= weight;
+        sum_lower -= weight * value;
+    }
+    else
+    {
+        it = upper.find(sample);
+        if (it == upper.end())
+            return;
+        upper.erase(it);
+        weight_upper -= weight;
+        sum_upper -= weight * value;
+    }
 
+    if (lower.empty() && upper.empty())
+    {
+        // Drop the rounding errors of the sums
+        clear();
+        return;
+    }
+    rebalance();
+}
 
+void WeightedMedianCalculator::rebalance()
+{
+    SampleSet::iterator it;
+    double half = (weight_lower + weight_upper) / 2.0;
 
+    // Lower must hold at least half of the weight
+    while (weight_lower < half && !upper.empty())
+    {
+        it = upper.begin();
+        weight_upper -= it->second;
+        sum_upper -= it->second * it->first;
+        weight_lower += it->second;
+        sum_lower += it->second * it->first;
+        lower.insert(lower.end(), *it);
+        upper.erase(it);
+    }
 
+    // But not without its max
+    while (!lower.empty())
+    {
+        it = --lower.end();
+        if (weight_lower - it->second < half)
+            break;
+        weight_lower -= it->second;
+        sum_lower -= it->second * it->first;
+        weight_upper += it->second;
+        sum_upper += it->second * it->first;
+        upper.insert(upper.begin(), *it);
+        lower.erase(it);
+    }
+}
 
+double WeightedMedianCalculator::median() const
+{
+    if (lower.empty())
+        return 0.0;
 
+    double m = lower.rbegin()->first;
+    if (!upper.empty() && weight_lower == weight_upper)
+        m = (m + upper.begin()->first) / 2.0;
+    return m;
+}
 
+double WeightedMedianCalculator::abs_deviation() const
+{
+    // Every lower value is <= median <= every upper value
+    double m = median();
+    return (weight_lower * m - sum_lower) + (sum_upper - weight_upper * m);
+}
 
+MAE::MAE()
+    : RegressionCriterion()
+{
 
+}
 
+MAE::~MAE()
+{
+
+}
+
+void MAE::init(DataView<double> _y,
+               DataView<double> _sample_weight,
+               double _weight_n_samples,
+               const int* _samples,
+               int _start,
+               int _end)
+{
+    int index;
+    double w = 1.0;
+
+    // The nodes of the heaps are recycled from node to node
+    pool.arena = arena;
+    total.resize(_y.cols, WeightedMedianCalculator(&pool));
+    for (int k = 0; k < _y.cols; k++)
+        total[k].clear();
+
+    for (int i = _start; i < _end; i++)
+    {
+        index = _samples[i];
+
+        if (!_sample_weight.empty())
+            w = _sample_weight.at(index);
+
+        for (int k = 0; k < _y.cols; k++)
+            total[k].push(_y.at(index, k), w);
+    }
+
+    // Weighted counts, then reset() from the total
+    RegressionCriterion::init(_y,
+                              _sample_weight,
+                              _weight_n_samples,
+                              _samples,
+                              _start,
+                              _end);
+}
+
+void MAE::reset()
+{
+    RegressionCriterion::reset();
+
+    // Copied in place: the nodes of right are reused, those of left given
+    // back to the pool first
+    left.resize(n_outputs, WeightedMedianCalculator(&pool));
+    for (int k = 0; k < n_outputs; k++)
+        left[k].clear();
+    right = total;
+}
+
+void MAE::update(int new_pos)
+{
+    int index;
+    double w = 1.0;
+    double y_ik;
+
+    for (int i = pos; i < new_pos; i++)
+    {
+        index = samples[i];
 
+        if (!sample_weight.empty())
+            w = sample_weight.at(index);
 
+        for (int k = 0; k < n_outputs; k++)
+        {
+            y_ik = y.at(index, k);
+            right[k].remove(y_ik, w);
+            left[k].push(y_ik, w);
+        }
+    }
 
+    RegressionCriterion::update(new_pos);
+}
 
+double MAE::node_impurity()
+{
+    double impurity = 0.0;
+    for (int k = 0; k < n_outputs; k++)
+        impurity += total[k].abs_deviation();
+    return impurity / weighted_n_node_samples / n_outputs;
+}
 
+pair<double, double> MAE::children_impurity()
+{
+    double impurity_left = 0.0;
+    double impurity_right = 0.0;
 
+    for (int k = 0; k < n_outputs; k++)
+    {
+        impurity_left += left[k].abs_deviation();
+        impurity_right += right[k].abs_deviation();
+    }
 
+    if (weighted_n_left > 0.0)
+        impurity_left /= weighted_n_left * n_outputs;
+    if (weighted_n_right > 0.0)
+        impurity_right /= weighted_n_right * n_outputs;
+    return make_pair(impurity_left, impurity_right);
+}
 
+vector<double> MAE::node_value()
+{
+    vector<double> vec(n_outputs);
+    for (int k = 0; k < n_outputs; k++)
+        vec[k] = total[k].median();
+    return vec;
+}
+
+int MAE::init_stats(DataView<double> /*_y*/,
+                    double /*_weight_n_samples*/,
+                    int /*_n_classes*/)
+{
+    return 0;
+}
 
+int MAE::n_stats() const
+{
+    return 0;
+}
+
+MemoryUsage MAE::memory_usage() const
+{
+    // The nodes of the heaps, free or alive, and the calculators on the heap
+    MemoryUsage usage = RegressionCriterion::memory_usage();
+    usage.add("medians", pool.bytes_allocated());
+    usage.add("calculators", (total.capacity() + left.capacity() + right.capacity()) *
+                             sizeof(WeightedMedianCalculator));
+    return usage;
+}
@@ -8,13 +8,16 @@
 //========================================
 
 #include <cmath>
+#include <set>
 #include <utility>
 #include <vector>
-#include <opencv2/opencv.hpp>
+#include "dataview.h"
+#include "arena.h"
+#include "memoryusage.h"
 using std::pair;
 using std::make_pair;
 using std::vector;
-using cv::Mat;
+using std::multiset;
 
 class Criterion
 {
@@ -27,14 +30,14 @@ public:
      * @param y: y's value or label
      * @param sample_weight: weight of sample
      * @param weight_n_samples: sum(wi) for i in sample.size
-     * @param samples: sample index
+     * @param samples: sample index, read in place and not copied
      * @param start:
      * @param end:
      */
-    virtual void init(Mat y,
-                      Mat sample_weight,
+    virtual void init(DataView<double> y,
+                      DataView<double> sample_weight,
                       double weight_n_samples,
-                      vector<int>& samples,
+                      const int* samples,
                       int start,
                       int end)=0;
 
@@ -79,11 +82,87 @@ public:
      */
     double impurity_improvement(double impurity);
 
+    /**
+     * @brief Whether improvement_upper_bound is implemented
+     */
+    virtual bool has_improvement_upper_bound() const {
+        return false;
+    }
+
+    /**
+     * @brief Upper bound of impurity_improvement over all the splits of the
+     * node samples sorted along a feature, from a histogram of the feature
+     * in which every sample of bin b sorts before the samples of bin b+1.
+     * @param bin_weight Weight of each bin, shape [n_bins]
+     * @param bin_sum Weighted sum of y in each bin, shape [n_bins, n_outputs]
+     * @param bin_y_min Min of y in each bin, shape [n_bins, n_outputs]
+     * @param bin_y_max Max of y in each bin, shape [n_bins, n_outputs]
+     * @param n_bins
+     * @return The bound, INFINITY if the criterion has none
+     */
+    virtual double improvement_upper_bound(const double* bin_weight,
+                                           const double* bin_sum,
+                                           const double* bin_y_min,
+                                           const double* bin_y_max,
+                                           int n_bins);
+
+    /**
+     * @brief Prepare the criterion to be fed with summed statistics rather
+     * than with samples, e.g. histograms reduced over the row shards of a
+     * data-parallel fit. Statistics are additive over the samples.
+     * @param y Values of y of the local samples
+     * @param weight_n_samples Global sum(wi)
+     * @param n_classes Global number of classes, ignored by a regression
+     * @return Number of statistics per sample, 0 if the criterion is not additive
+     */
+    virtual int init_stats(DataView<double> y,
+                           double weight_n_samples,
+                           int n_classes);
+
+    /**
+     * @brief Number of statistics per sample of the criterion initialized
+     * by init or init_stats, 0 if the criterion is not additive
+     */
+    virtual int n_stats() const;
+
+    /**
+     * @brief Bytes of the statistics of the criterion, by part
+     */
+    virtual MemoryUsage memory_usage() const;
+
+    /**
+     * @brief Add the statistics of sample i with weight w to stats
+     * @param i Row of y
+     * @param w
+     * @param stats shape [n_stats]
+     */
+    virtual void add_stats(int i,
+                           double w,
+                           double* stats) const;
+
+    /**
+     * @brief Reset the criterion at a node given its total statistics, the
+     * whole node being in the right child
+     * @param total shape [n_stats]
+     * @param weighted_n Weight of the node
+     */
+    virtual void reset_stats(const double* total,
+                             double weighted_n);
+
+    /**
+     * @brief Set the left child to the given statistics, the right child
+     * being the rest of the node
+     * @param left shape [n_stats]
+     * @param weighted_n_left Weight of the left child
+     */
+    virtual void update_stats(const double* left,
+                              double weighted_n_left);
+
 public:
-    Mat y;                 // Values of y
-    Mat sample_weight;     // Sample weights
+    DataView<double> y;             // Values of y
+    DataView<double> sample_weight; // Sample weights, empty if samples are equally weighted
 
-    vector<int> samples;            // Sample indice in X, y
+    const int* samples;             // Sample indice in X, y, owned by the splitter
     int start;                      // samples[start:pos] are the samples in the left node
     int pos;                        // samples[pos:end] are the samples in the right node
     int end;
@@ -94,9 +173,11 @@ public:
     double weighted_n_left;         // Weighted number of samples in the left node
     double weighted_n_right;        // Weighted number of samples in the right node
 
-    vector<double> label_count_left;
-    vector<double> label_count_right;
-    vector<double> label_count_total;
+    ArenaVector<double> label_count_left;
+    ArenaVector<double> label_count_right;
+    ArenaVector<double> label_count_total;
+
+    Arena* arena;                   // Scratch memory of the fit, NULL for the heap
 };
 
 class ClassificationCriterion : public Criterion
@@ -113,14 +194,14 @@ public:
      * @param y: y's value or label
      * @param sample_weight: weight of sample
      * @param weight_n_samples: sum(wi) for i in sample.size
-     * @param samples: sample index
+     * @param samples: sample index, read in place and not copied
      * @param start:
      * @param end:
      */
-    virtual void init(Mat y,
-                      Mat sample_weight,
+    virtual void init(DataView<double> y,
+                      DataView<double> sample_weight,
                       double weight_n_samples,
-                      vector<int>& samples,
+                      const int* samples,
                       int start,
                       int end);
 
@@ -152,6 +233,25 @@ public:
      */
     virtual vector<double> node_value();
 
+    /**
+     * @brief The statistics of a sample are its weight in its class, shape [n_classes]
+     */
+    virtual int init_stats(DataView<double> y,
+                           double weight_n_samples,
+                           int n_classes);
+
+    virtual int n_stats() const;
+
+    virtual void add_stats(int i,
+                           double w,
+                           double* stats) const;
+
+    virtual void reset_stats(const double* total,
+                             double weighted_n);
+
+    virtual void update_stats(const double* left,
+                              double weighted_n_left);
+
 public:
     int n_classes;
 };
@@ -231,6 +331,10 @@ public:
      *
      *     var = \sum_i^n (y_i - y_bar) ** 2
      *         = (\sum_i^n y_i ** 2) - n_samples y_bar ** 2
+     *
+     * y has one column per output. The statistics are kept per output in
+     * contiguous arrays of size n_outputs, and the impurities are averaged
+     * over the outputs.
      */
     RegressionCriterion();
     virtual ~RegressionCriterion();
@@ -240,14 +344,14 @@ public:
      * @param y: y's value or label
      * @param sample_weight: weight of sample
      * @param weight_n_samples: sum(wi) for i in sample.size
-     * @param samples: sample index
+     * @param samples: sample index, read in place and not copied
      * @param start:
      * @param end:
      */
-    virtual void init(Mat y,
-                      Mat sample_weight,
+    virtual void init(DataView<double> y,
+                      DataView<double> sample_weight,
                       double weight_n_samples,
-                      vector<int>& samples,
+                      const int* samples,
                       int start,
                       int end);
 
@@ -279,25 +383,54 @@ public:
      */
     virtual vector<double> node_value();
 
+    /**
+     * @brief The statistics of a sample are its weighted y, then its
+     * weighted y ** 2, shape [2 * n_outputs]
+     */
+    virtual int init_stats(DataView<double> y,
+                           double weight_n_samples,
+                           int n_classes);
+
+    virtual int n_stats() const;
+
+    virtual MemoryUsage memory_usage() const;
+
+    virtual void add_stats(int i,
+                           double w,
+                           double* stats) const;
+
+    virtual void reset_stats(const double* total,
+                             double weighted_n);
+
+    virtual void update_stats(const double* left,
+                              double weighted_n_left);
+
+protected:
+    /**
+     * @brief Mean over the outputs of the variance of a node
+     * @param sum Weighted sums of y, shape [n_outputs]
+     * @param sq_sum Weighted sums of y ** 2, shape [n_outputs]
+     * @param weighted_n Weighted number of samples in the node
+     */
+    double variance(const double* sum,
+                    const double* sq_sum,
+                    double weighted_n) const;
+
 public:
-    double mean_left;
-    double mean_right;
-    double mean_total;
-    double sq_sum_left;
-    double sq_sum_right;
-    double sq_sum_total;
-    double var_left;
-    double var_right;
-    double sum_left;
-    double sum_right;
-    double sum_total;
+    int n_outputs;                      // y.cols
+    ArenaVector<double> sum_left;       // Weighted sums of y, per output
+    ArenaVector<double> sum_right;
+    ArenaVector<double> sum_total;
+    ArenaVector<double> sq_sum_left;    // Weighted sums of y ** 2, per output
+    ArenaVector<double> sq_sum_right;
+    ArenaVector<double> sq_sum_total;
 };
 
 class MSE : public RegressionCriterion
 {
 public:
     /** Mean squared error impurity criterion.
-     * MSE = var_left + vaar_right
+     * MSE = var_left + vaar_right, averaged over the outputs
      */
     MSE();
     virtual ~MSE();
@@ -312,6 +445,34 @@ public:
      * @return pair<impurity_left, impurity_right>
      */
     virtual pair<double, double> children_impurity();
+
+    virtual bool has_improvement_upper_bound() const {
+        return true;
+    }
+
+    /**
+     * @brief Upper bound of impurity_improvement from a histogram of a feature.
+     *
+     *     weighted_n_samples * improvement
+     *         = mean_k (S_L ** 2 / W_L + S_R ** 2 / W_R - S ** 2 / W)
+     *
+     * g(S_L, W_L) = S_L ** 2 / W_L + (S - S_L) ** 2 / (W - W_L) is convex.
+     * A split falling in bin b takes a weight w of the bin, whose sum s is
+     * within [w y_min, w y_max] and leaves s_b - s within
+     * [(w_b - w) y_min, (w_b - w) y_max]. (S_L, W_L) = (S_0 + s, W_0 + w),
+     * S_0 and W_0 summing the bins before b, is then in a parallelogram and g
+     * is at most its max on the 4 vertices.
+     */
+    virtual double improvement_upper_bound(const double* bin_weight,
+                                           const double* bin_sum,
+                                           const double* bin_y_min,
+                                           const double* bin_y_max,
+                                           int n_bins);
+
+    virtual MemoryUsage memory_usage() const;
+
+public:
+    ArenaVector<double> bound_sum;      // Weighted sum of y of the bins before b, per output
 };
 
 class FriedmanMSE : public MSE
@@ -327,6 +488,142 @@ public:
     virtual ~FriedmanMSE();
 
     virtual double impurity_improvement(double impurity);
+
+    /**
+     * @brief The Friedman improvement is not the variance reduction MSE bounds.
+     */
+    virtual bool has_improvement_upper_bound() const {
+        return false;
+    }
+};
+
+/**
+ * @brief Weighted median of a set of (value, weight) samples, kept under
+ * insertion and removal in O(log n).
+ *
+ * The samples are split into a lower and an upper half, every value of lower
+ * being <= every value of upper, with the weight of lower reaching half of the
+ * total weight. The median lies between the max of lower and the min of upper.
+ * The weight and weighted sum of each half give the sum of absolute
+ * deviations to the median in O(1).
+ */
+class WeightedMedianCalculator
+{
+public:
+    typedef multiset<pair<double, double>, std::less<pair<double, double> >,
+                     PoolAllocator<pair<double, double> > > SampleSet;
+
+    /**
+     * @param pool Pool of the nodes of the halves, NULL for the heap
+     */
+    WeightedMedianCalculator(NodePool* pool=NULL);
+
+    /**
+     * @brief Remove all the samples
+     */
+    void clear();
+
+    /**
+     * @brief Add a sample
+     * @param value
+     * @param weight
+     */
+    void push(double value, double weight);
+
+    /**
+     * @brief Remove a sample previously added with the same value and weight
+     * @param value
+     * @param weight
+     */
+    void remove(double value, double weight);
+
+    /**
+     * @brief Weighted median, the mean of the two middle values when the
+     * weight is split evenly between them
+     */
+    double median() const;
+
+    /**
+     * @brief sum_i w_i * |y_i - median|
+     */
+    double abs_deviation() const;
+
+    int size() const {
+        return static_cast<int>(lower.size() + upper.size());
+    }
+
+private:
+    /**
+     * @brief Move samples between the halves until the lower half is the
+     * smallest one holding at least half of the weight.
+     */
+    void rebalance();
+
+public:
+    SampleSet lower;                        // (value, weight) below the median
+    SampleSet upper;                        // (value, weight) above the median
+    double weight_lower;
+    double weight_upper;
+    double sum_lower;                       // sum of weight * value in lower
+    double sum_upper;                       // sum of weight * value in upper
+};
+
+class MAE : public RegressionCriterion
+{
+public:
+    /** Mean absolute error impurity criterion.
+     *
+     *     MAE = \sum_i w_i |y_i - median| / \sum_i w_i
+     *
+     * averaged over the outputs. The node value is the weighted median of
+     * each output. The medians of the children are maintained by
+     * WeightedMedianCalculator, samples moving from the right ones to the
+     * left ones in update, so each candidate split costs
+     * O(n_outputs * log n_node_samples).
+     */
+    MAE();
+    virtual ~MAE();
+
+    virtual void init(DataView<double> y,
+                      DataView<double> sample_weight,
+                      double weight_n_samples,
+                      const int* samples,
+                      int start,
+                      int end);
+
+    virtual void reset();
+
+    virtual void update(int new_pos);
+
+    virtual double node_impurity();
+
+    virtual pair<double, double> children_impurity();
+
+    /**
+     * @brief The weighted median of samples[start:end]
+     */
+    virtual vector<double> node_value();
+
+    /**
+     * @brief A median is not a sum over the samples
+     * @return 0
+     */
+    virtual int init_stats(DataView<double> y,
+                           double weight_n_samples,
+                           int n_classes);
+
+    virtual int n_stats() const;
+
+    /**
+     * @brief Bytes of the statistics, the median heaps included
+     */
+    virtual MemoryUsage memory_usage() const;
+
+public:
+    NodePool pool;                              // Nodes of the median heaps, in the arena
+    vector<WeightedMedianCalculator> total;     // One per output
+    vector<WeightedMedianCalculator> left;
+    vector<WeightedMedianCalculator> right;
 };
 
 #endif // CRITERION_H
@@ -0,0 +1,196 @@
+#include "crossvalidation.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "basetree.h"
+#include "binnedmatrix.h"
+#include "util.h"
+
+using std::vector;
+
+double prediction_score(const Mat& prediction,
+                        DataView<double> y,
+                        DataView<double> sample_weight,
+                        int start,
+                        int end,
+                        int is_classification)
+{
+    int n_outputs = y.cols;
+    double weight_sum = 0.0;
+
+    // Accuracy
+    if (is_classification == 0)
+    {
+        double correct = 0.0;
+        for (int i = start; i < end; i++)
+        {
+            double w = sample_weight.empty() ? 1.0 : sample_weight.at(i);
+            if (prediction.at<double>(i - start, 0) == y.at(i))
+                correct += w;
+            weight_sum += w;
+        }
+        return (weight_sum > 0.0) ? correct / weight_sum : 0.0;
+    }
+
+    // R^2 = 1 - SSE / SST, averaged over the outputs
+    vector<double> mean(n_outputs, 0.0);
+    for (int i = start; i < end; i++)
+    {
+        double w = sample_weight.empty() ? 1.0 : sample_weight.at(i);
+        for (int k = 0; k < n_outputs; k++)
+            mean[k] += w * y.at(i, k);
+        weight_sum += w;
+    }
+    double score = 0.0;
+    for (int k = 0; k < n_outputs; k++)
+    {
+        mean[k] /= weight_sum;
+        double sse = 0.0;
+        double sst = 0.0;
+        for (int i = start; i < end; i++)
+        {
+            double w = sample_weight.empty() ? 1.0 : sample_weight.at(i);
+            double error = y.at(i, k) - prediction.at<double>(i - start, k);
+            double deviation = y.at(i, k) - mean[k];
+            sse += w * error * error;
+            sst += w * deviation * deviation;
+        }
+        score += (sst > 0.0) ? 1.0 - sse / sst : (sse == 0.0 ? 1.0 : 0.0);
+    }
+    return score / n_outputs;
+}
+
+/**
+ * @brief Train the folds of cross_validate on X, a DataView<DTYPE> or the
+ * BinnedMatrix of features
+ */
+template <typename DTYPE, typename XTYPE>
+static int cross_validate_folds(const BaseDecisionTree& estimator,
+                                DataView<DTYPE> features,
+                                const XTYPE& X,
+                                DataView<double> y,
+                                DataView<double> sample_weight,
+                                int n_folds,
+                                Mat& test_scores,
+                                int n_threads)
+{
+    int n_samples = features.rows;
+    vector<int> errors(n_folds, 0);
+    test_scores = Mat::zeros(n_folds, 1, CV_64F);
+
+    parallel_for(n_folds, n_threads, [&](int begin, int end) {
+        for (int fold = begin; fold < end; fold++)
+        {
+            // Held-out rows [start, stop), training on the others
+            int start = static_cast<int>(static_cast<long long>(n_samples) * fold / n_folds);
+            int stop = static_cast<int>(static_cast<long long>(n_samples) * (fold + 1) / n_folds);
+            vector<int> train;
+            train.reserve(n_samples - (stop - start));
+            for (int i = 0; i < n_samples; i++)
+            {
+                if (i < start || i >= stop)
+                    train.push_back(i);
+            }
+
+            // A fresh tree with the estimator's parameters
+            BaseDecisionTree tree(estimator._criterion_name,
+                                  estimator._splitter_name,
+                                  estimator._max_depth,
+                                  estimator._min_samples_split,
+                                  estimator._min_samples_leaf,
+                                  estimator._min_weight_fraction_leaf,
+                                  estimator._max_features,
+                                  estimator._max_leaf_nodes,
+                                  estimator._random_state,
+                                  estimator._class_weight,
+                                  estimator._is_classification);
+            tree._max_bins = estimator._max_bins;
+            tree._max_conflict_rate = estimator._max_conflict_rate;
+            tree._ccp_alpha = estimator._ccp_alpha;
+            tree._bounded_search = estimator._bounded_search;
+            tree._numa_placement = estimator._numa_placement;
+            tree._sample_indices = DataView<int>(&train[0], static_cast<int>(train.size()), 1);
+
+            errors[fold] = tree.fit(X, y, sample_weight);
+            if (errors[fold] != 0)
+                continue;
+
+            // Predict the held-out block in place
+            DataView<DTYPE> held_out(&features.at(start, 0),
+                                     stop - start,
+                                     features.cols,
+                                     features.row_stride,
+                                     features.col_stride);
+            Mat prediction = tree.predict(held_out);
+            test_scores.at<double>(fold) = prediction_score(prediction, y, sample_weight,
+                                                            start, stop, estimator._is_classification);
+        }
+    }, estimator._numa_placement);
+
+    for (int fold = 0; fold < n_folds; fold++)
+    {
+        if (errors[fold] != 0)
+            return errors[fold];
+    }
+    return 0;
+}
+
+/**
+ * @brief cross_validate on the DTYPE features, binned once if the splitter needs it
+ */
+template <typename DTYPE>
+static int cross_validate_dense(const BaseDecisionTree& estimator,
+                                DataView<DTYPE> X,
+                                DataView<double> y,
+                                DataView<double> sample_weight,
+                                int n_folds,
+                                Mat& test_scores,
+                                int n_threads)
+{
+    if (strcmp(estimator._splitter_name, "Binned") == 0)
+    {
+        // Every fold scans all the columns: spread them over the nodes
+        NumaPlacement placement = (estimator._numa_placement == NUMA_NONE) ? NUMA_NONE
+                                                                            : NUMA_INTERLEAVED;
+        BinnedMatrix binned;
+        if (binned.fit(X, estimator._max_bins, n_threads, placement) != 0)
+            return 3;
+        if (estimator._max_conflict_rate >= 0.0 && binned.bundle(estimator._max_conflict_rate) != 0)
+            return 3;
+        return cross_validate_folds(estimator, X, binned, y, sample_weight,
+                                    n_folds, test_scores, n_threads);
+    }
+    return cross_validate_folds(estimator, X, X, y, sample_weight,
+                                n_folds, test_scores, n_threads);
+}
+
+int cross_validate(const BaseDecisionTree& estimator,
+                   Mat X,
+                   Mat y,
+                   Mat sample_weight,
+                   int n_folds,
+                   Mat& test_scores,
+                   int n_threads)
+{
+    // Validation
+    if (X.rows == 0 || X.cols == 0)
+        return 1;
+    if (n_folds < 2 || n_folds > X.rows)
+        return 3;
+
+    // Converted once for all the folds
+    if (X.depth() != CV_32F && X.depth() != CV_64F)
+        X.convertTo(X, CV_64F);
+    to_target(y);
+    to_target(sample_weight);
+    if (y.rows != X.rows)
+        return 2;
+    if (sample_weight.total() != 0 && sample_weight.rows != X.rows)
+        return 2;
+
+    if (X.depth() == CV_32F)
+        return cross_validate_dense(estimator, as_view<float>(X), as_view<double>(y),
+                                    as_view<double>(sample_weight), n_folds, test_scores, n_threads);
+    return cross_validate_dense(estimator, as_view<double>(X), as_view<double>(y),
+                                as_view<double>(sample_weight), n_folds, test_scores, n_threads);
+}
@@ -0,0 +1,58 @@
+#ifndef CROSSVALIDATION_H
+#define CROSSVALIDATION_H
+
+#include <opencv2/opencv.hpp>
+#include "tree.h"
+#include "dataview.h"
+
+using cv::Mat;
+
+/**
+ * @brief K-fold cross-validation of a decision tree.
+ * X is converted, and binned for the "Binned" splitter, once for all the
+ * folds. Each fold trains on its rows of the shared X through
+ * BaseDecisionTree::_sample_indices, the folds run concurrently, and each
+ * one scores its held-out rows, a contiguous block of X read in place.
+ * The bins are computed on the whole X, as they only depend on the features.
+ * With estimator._numa_placement, the fold threads are pinned to their node
+ * and the shared bins, scanned by every fold, are interleaved over the nodes.
+ * @param estimator Unfitted tree whose parameters are used by every fold
+ * @param X The input samples, shape = [n_samples, n_features]
+ * @param y The target values, shape = [n_samples], or [n_samples, n_outputs]
+ * for a multi-output regression
+ * @param sample_weight Sample weights. If total size equals to zero, then samples are equally weighted.
+ * @param n_folds Number of consecutive folds, without shuffling
+ * @param test_scores Weighted score of each fold on its held-out rows, the
+ * accuracy for a classification, the R^2 averaged over the outputs for a
+ * regression, shape = [n_folds, 1]
+ * @param n_threads Number of folds trained at the same time, 0 for all the cores
+ * @return error_code, the one of the first failed fold
+ */
+int cross_validate(const BaseDecisionTree& estimator,
+                   Mat X,
+                   Mat y,
+                   Mat sample_weight,
+                   int n_folds,
+                   Mat& test_scores,
+                   int n_threads=0);
+
+/**
+ * @brief Weighted score of the predictions of the rows [start, end) of y:
+ * the accuracy for a classification, the R^2 averaged over the outputs for
+ * a regression.
+ * @param prediction Predictions of the rows, shape = [end - start, n_outputs]
+ * @param y The target values, shape = [n_samples, n_outputs]
+ * @param sample_weight Sample weights. If empty, then samples are equally weighted.
+ * @param start
+ * @param end
+ * @param is_classification As BaseDecisionTree::_is_classification, 0 for a classification
+ * @return The score, 1 for perfect predictions
+ */
+double prediction_score(const Mat& prediction,
+                        DataView<double> y,
+                        DataView<double> sample_weight,
+                        int start,
+                        int end,
+                        int is_classification);
+
+#endif // CROSSVALIDATION_H
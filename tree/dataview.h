@@ -0,0 +1,103 @@
+#ifndef DATAVIEW_H
+#define DATAVIEW_H
+
+//========================================
+// DataView
+// Non-owning strided view over a 2-d buffer
+//========================================
+
+#include <cstddef>
+
+/**
+ * @brief A lightweight, non-owning view of a 2-d array.
+ *
+ * Element (i, j) lives at data[i * row_stride + j * col_stride], so row-major,
+ * column-major and sliced buffers can all be read without a copy. The view
+ * never frees `data`; the owner must keep the buffer alive while it is used.
+ * Vectors (y, sample_weight) are viewed as a single column, shape [n, 1].
+ */
+template <typename T>
+struct DataView
+{
+    const T* data;          // Address of element (0, 0), NULL for an empty view
+    int rows;               // Number of rows (samples)
+    int cols;               // Number of columns (features / outputs)
+    int row_stride;         // Elements between (i, j) and (i+1, j)
+    int col_stride;         // Elements between (i, j) and (i, j+1)
+
+    DataView()
+        : data(NULL),
+          rows(0),
+          cols(0),
+          row_stride(0),
+          col_stride(0)
+    {
+
+    }
+
+    /**
+     * @brief View a contiguous row-major buffer
+     * @param _data
+     * @param _rows
+     * @param _cols
+     */
+    DataView(const T* _data,
+             int _rows,
+             int _cols)
+        : data(_data),
+          rows(_rows),
+          cols(_cols),
+          row_stride(_cols),
+          col_stride(1)
+    {
+
+    }
+
+    /**
+     * @brief View an arbitrary strided buffer
+     * @param _data
+     * @param _rows
+     * @param _cols
+     * @param _row_stride
+     * @param _col_stride
+     */
+    DataView(const T* _data,
+             int _rows,
+             int _cols,
+             int _row_stride,
+             int _col_stride)
+        : data(_data),
+          rows(_rows),
+          cols(_cols),
+          row_stride(_row_stride),
+          col_stride(_col_stride)
+    {
+
+    }
+
+    inline const T& at(int i, int j) const
+    {
+        return data[static_cast<ptrdiff_t>(i) * row_stride +
+                    static_cast<ptrdiff_t>(j) * col_stride];
+    }
+
+    /**
+     * @brief Element i of a column vector, i.e. at(i, 0)
+     */
+    inline const T& at(int i) const
+    {
+        return data[static_cast<ptrdiff_t>(i) * row_stride];
+    }
+
+    inline int total() const
+    {
+        return rows * cols;
+    }
+
+    inline bool empty() const
+    {
+        return data == NULL || rows * cols == 0;
+    }
+};
+
+#endif // DATAVIEW_H
@@ -0,0 +1,416 @@
+#include "hoeffdingtree.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include "basetree.h"
+#include "criterion.h"
+#include "treebuilder.h"
+#include "util.h"
+
+HoeffdingTree::HoeffdingTree(char* criterion_name,
+                             int n_classes,
+                             int max_bins,
+                             int grace_period,
+                             double delta,
+                             double tie_threshold,
+                             int max_depth,
+                             int max_leaves,
+                             int window)
+    : _criterion_name(criterion_name),
+      _n_classes(n_classes),
+      _max_bins(max_bins),
+      _grace_period(grace_period),
+      _delta(delta),
+      _tie_threshold(tie_threshold),
+      _max_depth(max_depth),
+      _max_leaves(max_leaves),
+      _window(window),
+      _n_features(0),
+      _n_outputs(0),
+      _n_stats(0),
+      _bin_size(0),
+      _slot_size(0),
+      _n_leaves(0),
+      _n_events(0),
+      _criterion(NULL),
+      _tree(NULL)
+{
+    // Select a Criterion, MAE has no additive statistics and is refused at fit
+    if (strcmp(_criterion_name, "Gini") == 0)
+        _criterion = new Gini();
+    else if (strcmp(_criterion_name, "Entropy") == 0)
+        _criterion = new Entropy();
+    else if (strcmp(_criterion_name, "MSE") == 0)
+        _criterion = new MSE();
+    else if (strcmp(_criterion_name, "FriedmanMSE") == 0)
+        _criterion = new FriedmanMSE();
+    else if (strcmp(_criterion_name, "MAE") == 0)
+        _criterion = new MAE();
+    else
+        exit(1);
+}
+
+HoeffdingTree::~HoeffdingTree()
+{
+    delete _criterion;
+    delete _tree;
+}
+
+int HoeffdingTree::partial_fit(Mat X,
+                               Mat y,
+                               Mat sample_weight)
+{
+    if (X.empty())
+        return 1;
+
+    // Same conversions as BaseDecisionTree::fit, in double precision
+    if (X.depth() != CV_64F)
+        X.convertTo(X, CV_64F);
+    to_target(y);
+    to_target(sample_weight);
+
+    DataView<double> X_view = as_view<double>(X);
+    DataView<double> y_view = as_view<double>(y);
+    DataView<double> weight_view = as_view<double>(sample_weight);
+    if (y_view.rows != X_view.rows)
+        return 2;
+    if (!weight_view.empty() && weight_view.rows != X_view.rows)
+        return 2;
+
+    // Gini and Entropy classify, MSE and FriedmanMSE regress
+    bool is_classification = (strcmp(_criterion_name, "Gini") == 0 ||
+                              strcmp(_criterion_name, "Entropy") == 0);
+    if (is_classification)
+    {
+        if (_n_classes < 2 || y_view.cols != 1)
+            return (_n_classes < 2) ? 3 : 2;
+        for (int i = 0; i < y_view.rows; i++)
+        {
+            double label = y_view.at(i);
+            if (label < 0 || label >= _n_classes || label != std::floor(label))
+                return 2;
+        }
+    }
+    else if (_n_classes != 0)
+        return 3;
+
+    if (_tree == NULL)
+    {
+        if (_max_bins < 2 || _max_bins > 65536 || _grace_period < 1 ||
+            _delta <= 0.0 || _delta >= 1.0 || _window < 0 ||
+            _max_depth < 0 || _max_leaves < 0)
+            return 3;
+
+        // Bin edges from the first events, the codes are not kept
+        if (_bins.cols == 0)
+        {
+            int error = _bins.fit(X_view, _max_bins);
+            if (error != 0)
+                return error;
+            BinnedMatrix::Codes8().swap(_bins.codes8);
+            BinnedMatrix::Codes16().swap(_bins.codes16);
+        }
+        if (_bins.cols != X_view.cols)
+            return 2;
+
+        _n_features = X_view.cols;
+        _n_outputs = is_classification ? 1 : y_view.cols;
+        _n_stats = _criterion->init_stats(y_view, 1.0, _n_classes);
+        if (_n_stats == 0)
+            return 3;
+
+        // One histogram per feature, then the totals of the leaf
+        _bin_size = 2 + _n_stats;
+        _offsets.assign(_n_features + 1, 0);
+        for (int j = 0; j < _n_features; j++)
+            _offsets[j + 1] = _offsets[j] + _bins.n_bins(j) * _bin_size;
+        _slot_size = _offsets[_n_features] + _bin_size;
+
+        _codes.assign(_n_features, 0);
+        _stats.assign(_n_stats, 0.0);
+        _left.assign(_n_stats, 0.0);
+        if (_window > 0)
+        {
+            _window_codes.assign(static_cast<size_t>(_window) * _n_features, 0);
+            _window_stats.assign(static_cast<size_t>(_window) * _n_stats, 0.0);
+            _window_weight.assign(_window, 0.0);
+            _window_node.assign(_window, 0);
+        }
+
+        _tree = new Tree(_n_features, is_classification ? _n_classes : 1, _n_outputs);
+        _add_leaf(TREE_UNDEFINED, false, 0);
+    }
+    else
+    {
+        if (X_view.cols != _n_features || (!is_classification && y_view.cols != _n_outputs))
+            return 2;
+        // add_stats reads the labels of this batch
+        _criterion->init_stats(y_view, 1.0, _n_classes);
+    }
+
+    for (int i = 0; i < X_view.rows; i++)
+        _learn_one(X_view, weight_view, i);
+    return 0;
+}
+
+Mat HoeffdingTree::predict(Mat X)
+{
+    if (_tree == NULL)
+        return Mat();
+
+    if (X.depth() != CV_64F)
+        X.convertTo(X, CV_64F);
+
+    // The leaf values change with every event
+    _tree->normalize_leaves();
+    return _tree->predict(as_view<double>(X));
+}
+
+void HoeffdingTree::clear()
+{
+    delete _tree;
+    _tree = NULL;
+    _bins = BinnedMatrix();
+
+    _n_features = 0;
+    _n_outputs = 0;
+    _n_stats = 0;
+    _bin_size = 0;
+    _slot_size = 0;
+    _n_leaves = 0;
+    _n_events = 0;
+
+    _offsets.clear();
+    _slots.clear();
+    _free_slots.clear();
+    _node_slot.clear();
+    _node_depth.clear();
+    _pending_weight.clear();
+    _window_codes.clear();
+    _window_stats.clear();
+    _window_weight.clear();
+    _window_node.clear();
+}
+
+void HoeffdingTree::_learn_one(const DataView<double>& X,
+                               const DataView<double>& w,
+                               int i)
+{
+    double weight = w.empty() ? 1.0 : w.at(i);
+
+    // Down from the root, as Tree::predict
+    int node_id = 0;
+    while (_tree->_nodes[node_id].left_child != TREE_LEAF)
+    {
+        const Node& node = _tree->_nodes[node_id];
+        node_id = (X.at(i, node.feature) <= node.threshold) ? node.left_child : node.right_child;
+    }
+
+    for (int j = 0; j < _n_features; j++)
+        _codes[j] = static_cast<uint16_t>(_bins.bin_value(j, X.at(i, j)));
+    std::fill(_stats.begin(), _stats.end(), 0.0);
+    _criterion->add_stats(i, weight, &_stats[0]);
+
+    // Forget the oldest event of the window, if its leaf is still a leaf
+    if (_window > 0)
+    {
+        int position = static_cast<int>(_n_events % _window);
+        uint16_t* codes = &_window_codes[static_cast<size_t>(position) * _n_features];
+        double* stats = &_window_stats[static_cast<size_t>(position) * _n_stats];
+        if (_n_events >= _window)
+        {
+            int old_id = _window_node[position];
+            if (_node_slot[old_id] >= 0)
+            {
+                _update_leaf(old_id, codes, stats, _window_weight[position], -1.0);
+                _refresh_leaf(old_id);
+            }
+        }
+        std::copy(_codes.begin(), _codes.end(), codes);
+        std::copy(_stats.begin(), _stats.end(), stats);
+        _window_weight[position] = weight;
+        _window_node[position] = node_id;
+    }
+    _n_events += 1;
+
+    _update_leaf(node_id, &_codes[0], &_stats[0], weight, 1.0);
+    _refresh_leaf(node_id);
+
+    int slot = _node_slot[node_id];
+    _pending_weight[slot] += weight;
+    if (_pending_weight[slot] >= _grace_period)
+    {
+        _pending_weight[slot] = 0.0;
+        _attempt_split(node_id);
+    }
+}
+
+void HoeffdingTree::_update_leaf(int node_id,
+                                 const uint16_t* codes,
+                                 const double* stats,
+                                 double w,
+                                 double sign)
+{
+    double* slot = &_slots[static_cast<size_t>(_node_slot[node_id]) * _slot_size];
+
+    // The histogram of every feature, then the totals
+    for (int j = 0; j <= _n_features; j++)
+    {
+        double* bin = slot + _offsets[j];
+        if (j < _n_features)
+            bin += codes[j] * _bin_size;
+        bin[0] += sign;
+        bin[1] += sign * w;
+        for (int k = 0; k < _n_stats; k++)
+            bin[2 + k] += sign * stats[k];
+    }
+}
+
+void HoeffdingTree::_refresh_leaf(int node_id)
+{
+    const double* total = &_slots[static_cast<size_t>(_node_slot[node_id]) * _slot_size
+                                  + _offsets[_n_features]];
+    Node& node = _tree->_nodes[node_id];
+    node.n_node_samples = static_cast<int>(total[0] + 0.5);
+    node.weighted_n_node_samples = total[1];
+
+    // An empty leaf keeps its last value
+    if (node.n_node_samples == 0 || total[1] <= 0.0)
+        return;
+
+    _criterion->reset_stats(total + 2, total[1]);
+    node.impurity = _criterion->node_impurity();
+    _tree->_value[node_id] = _criterion->node_value();
+}
+
+void HoeffdingTree::_attempt_split(int node_id)
+{
+    int depth = _node_depth[node_id];
+    if (_max_depth > 0 && depth >= _max_depth)
+        return;
+    if (_max_leaves > 0 && _n_leaves >= _max_leaves)
+        return;
+
+    int slot_id = _node_slot[node_id];
+    const double* slot = &_slots[static_cast<size_t>(slot_id) * _slot_size];
+    const double* total = slot + _offsets[_n_features];
+    double weight = total[1];
+    if (weight <= 0.0)
+        return;
+
+    // Merits are relative to the leaf: improvement / impurity, in [0, 1]
+    _criterion->weighted_n_samples = weight;
+    _criterion->reset_stats(total + 2, weight);
+    double impurity = _criterion->node_impurity();
+    if (impurity <= MIN_IMPURITY_SPLIT)
+        return;
+
+    int best_feature = -1;
+    int best_bin = -1;
+    double best_merit = 0.0;
+    double second_merit = 0.0;
+    for (int j = 0; j < _n_features; j++)
+    {
+        const double* histogram = slot + _offsets[j];
+        int n_bins = _bins.n_bins(j);
+        std::fill(_left.begin(), _left.end(), 0.0);
+        double weight_left = 0.0;
+        double feature_merit = 0.0;
+        int feature_bin = -1;
+
+        // Split after bin b: bins [0, b] go left
+        for (int b = 0; b < n_bins - 1; b++)
+        {
+            const double* bin = histogram + b * _bin_size;
+            if (bin[0] == 0.0)
+                continue;
+            weight_left += bin[1];
+            for (int k = 0; k < _n_stats; k++)
+                _left[k] += bin[2 + k];
+            if (weight - weight_left <= 0.0)
+                break;
+
+            _criterion->update_stats(&_left[0], weight_left);
+            double merit = _criterion->impurity_improvement(impurity) / impurity;
+            if (merit > feature_merit)
+            {
+                feature_merit = merit;
+                feature_bin = b;
+            }
+        }
+
+        // The bound compares the two best features
+        if (feature_merit > best_merit)
+        {
+            second_merit = best_merit;
+            best_merit = feature_merit;
+            best_feature = j;
+            best_bin = feature_bin;
+        }
+        else if (feature_merit > second_merit)
+            second_merit = feature_merit;
+    }
+    if (best_feature < 0)
+        return;
+
+    double epsilon = std::sqrt(std::log(1.0 / _delta) / (2.0 * weight));
+    if (best_merit - second_merit <= epsilon && epsilon >= _tie_threshold)
+        return;
+
+    // The leaf becomes internal, its statistics go to the children
+    Node& node = _tree->_nodes[node_id];
+    node.feature = best_feature;
+    node.threshold = _bins.threshold(best_feature, best_bin);
+    _node_slot[node_id] = -1;
+    _free_slots.push_back(slot_id);
+    _n_leaves -= 1;
+
+    _add_leaf(node_id, true, depth + 1);
+    _add_leaf(node_id, false, depth + 1);
+    _tree->_max_depth = std::max(_tree->_max_depth, depth + 1);
+}
+
+int HoeffdingTree::_add_leaf(int parent,
+                             bool is_left,
+                             int depth)
+{
+    // A new leaf predicts as its parent until it receives events
+    vector<double> value;
+    double impurity = 0.0;
+    if (parent == TREE_UNDEFINED)
+        value.assign((_n_classes > 0) ? _n_classes : _n_outputs, 0.0);
+    else
+    {
+        value = _tree->_value[parent];
+        impurity = _tree->_nodes[parent].impurity;
+    }
+
+    int node_id = _tree->_add_node(parent, is_left, true, TREE_UNDEFINED, TREE_UNDEFINED,
+                                   impurity, 0, 0.0);
+    if (_tree->_value.size() < static_cast<size_t>(node_id) + 1)
+        _tree->_value.resize(node_id+1);
+    _tree->_value.at(node_id) = value;
+
+    // Reuse the slot of a split leaf, or grow
+    int slot_id;
+    if (!_free_slots.empty())
+    {
+        slot_id = _free_slots.back();
+        _free_slots.pop_back();
+        std::fill(_slots.begin() + static_cast<size_t>(slot_id) * _slot_size,
+                  _slots.begin() + static_cast<size_t>(slot_id + 1) * _slot_size, 0.0);
+        _pending_weight[slot_id] = 0.0;
+    }
+    else
+    {
+        slot_id = static_cast<int>(_pending_weight.size());
+        _slots.resize(static_cast<size_t>(slot_id + 1) * _slot_size, 0.0);
+        _pending_weight.push_back(0.0);
+    }
+
+    _node_slot.push_back(slot_id);
+    _node_depth.push_back(depth);
+    _n_leaves += 1;
+    return node_id;
+}
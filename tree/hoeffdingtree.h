@@ -0,0 +1,175 @@
+#ifndef HOEFFDINGTREE_H
+#define HOEFFDINGTREE_H
+
+//========================================
+// HoeffdingTree
+// Incremental decision tree for data streams (VFDT)
+//========================================
+
+#include <vector>
+#include <stdint.h>
+#include <opencv2/opencv.hpp>
+#include "dataview.h"
+#include "binnedmatrix.h"
+
+using std::vector;
+using cv::Mat;
+
+class Criterion;
+class Tree;
+
+class HoeffdingTree
+{
+public:
+    /**
+     * @brief A decision tree grown one event at a time.
+     *
+     * Every leaf keeps, for each feature, a histogram of the events it
+     * received: per bin the count, the weight and the statistics of the
+     * criterion (class weights, or weighted moments of y). An event is routed
+     * to its leaf and added to its histograms, in O(depth + n_features). After
+     * every grace_period of weight, a leaf evaluates the splits between its
+     * bins, and splits on the best feature when the Hoeffding bound
+     *
+     *     epsilon = sqrt(ln(1 / delta) / (2 * n))
+     *
+     * tells with confidence 1 - delta that it beats the second best feature,
+     * n being the weight of the leaf. Merits are the impurity improvements
+     * relative to the impurity of the leaf, in [0, 1]. Near ties are split
+     * when epsilon < tie_threshold. The children start empty, predicting the
+     * value of their parent until they receive events.
+     *
+     * Memory is bounded by max_leaves histograms. With a window, the events
+     * older than the last window ones are removed from the statistics of the
+     * leaf they reached, if it is still a leaf, so that the leaf values and
+     * the next splits follow the recent events after a drift.
+     *
+     * The model is a Tree, the same structure as a batch decision tree.
+     * @param criterion_name "Gini", "Entropy", "MSE" or "FriedmanMSE"
+     * @param n_classes Number of classes, labels in [0, n_classes). 0 for a regression.
+     * @param max_bins Maximal number of bins per feature
+     * @param grace_period Weight a leaf receives between two split attempts
+     * @param delta One minus the confidence of a split
+     * @param tie_threshold
+     * @param max_depth 0 for unlimited
+     * @param max_leaves 0 for unlimited
+     * @param window Number of recent events kept in the statistics, 0 for all
+     */
+    HoeffdingTree(char* criterion_name,
+                  int n_classes,
+                  int max_bins=64,
+                  int grace_period=200,
+                  double delta=1e-7,
+                  double tie_threshold=0.05,
+                  int max_depth=0,
+                  int max_leaves=0,
+                  int window=0);
+    ~HoeffdingTree();
+
+    /**
+     * @brief Learn the events (X, y) one by one, in row order.
+     * The first call fits the bin edges on X, unless _bins is already fitted.
+     * @param X The input samples, shape = [n_samples, n_features]
+     * @param y The target values, shape = [n_samples], or [n_samples, n_outputs]
+     * for a multi-output regression
+     * @param sample_weight Sample weights. If total size equals to zero, then samples are equally weighted.
+     * @return error_code, 2 if the shapes or the classes do not match the
+     * previous events, 3 for invalid parameters
+     */
+    int partial_fit(Mat X,
+                    Mat y,
+                    Mat sample_weight=Mat());
+
+    /**
+     * @brief Predict class or regression value of X.
+     * @param X The input samples, shape = [n_samples, n_features]
+     * @return shape = [n_samples, n_outputs], empty before the first event
+     */
+    Mat predict(Mat X);
+
+    /**
+     * @brief Forget the tree, the statistics and the bin edges.
+     */
+    void clear();
+
+private:
+    /**
+     * @brief Route event i to its leaf, and add it to the statistics.
+     */
+    void _learn_one(const DataView<double>& X,
+                    const DataView<double>& w,
+                    int i);
+
+    /**
+     * @brief Add (sign = 1) or remove (sign = -1) an event from the
+     * statistics of a leaf.
+     * @param codes Bin code of each feature, shape = [n_features]
+     * @param stats Criterion statistics of the event, weighted, shape = [n_stats]
+     */
+    void _update_leaf(int node_id,
+                      const uint16_t* codes,
+                      const double* stats,
+                      double w,
+                      double sign);
+
+    /**
+     * @brief Refresh the value, impurity and counts of a leaf from its totals.
+     */
+    void _refresh_leaf(int node_id);
+
+    /**
+     * @brief Split the leaf if the Hoeffding bound allows it.
+     */
+    void _attempt_split(int node_id);
+
+    /**
+     * @brief Add a leaf below parent, with a slot of statistics.
+     * @return node id, -1 if no slot is left
+     */
+    int _add_leaf(int parent,
+                  bool is_left,
+                  int depth);
+
+public:
+    char* _criterion_name;
+    int _n_classes;
+    int _max_bins;
+    int _grace_period;
+    double _delta;
+    double _tie_threshold;
+    int _max_depth;
+    int _max_leaves;
+    int _window;
+
+    int _n_features;
+    int _n_outputs;
+    int _n_stats;                       // Criterion statistics per event
+    int _bin_size;                      // Doubles per bin: count, weight, statistics
+    int _slot_size;                     // Doubles of the statistics of a leaf
+    int _n_leaves;
+    long long _n_events;                // Events learned so far
+
+    BinnedMatrix _bins;                 // Bin edges, only its edges are used
+    Criterion* _criterion;              // Evaluates the splits from the statistics
+    Tree* _tree;
+
+    vector<int> _offsets;               // Start of the histogram of each feature in a slot,
+                                        // the leaf totals being last
+    vector<double> _slots;              // Statistics of the leaves, _slot_size each
+    vector<int> _free_slots;
+    vector<int> _node_slot;             // Slot of each node, -1 for an internal node
+    vector<int> _node_depth;
+    vector<double> _pending_weight;     // Weight each slot received since its last split attempt
+
+    // Last _window events, in a ring
+    vector<uint16_t> _window_codes;     // shape = [window, n_features]
+    vector<double> _window_stats;       // shape = [window, n_stats]
+    vector<double> _window_weight;
+    vector<int> _window_node;           // Leaf each event was added to
+
+    vector<uint16_t> _codes;            // Codes of the current event
+    vector<double> _stats;              // Statistics of the current event
+    vector<double> _left;               // Left statistics of the split search
+};
+
+#endif // HOEFFDINGTREE_H
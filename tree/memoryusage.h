@@ -0,0 +1,85 @@
+#ifndef MEMORYUSAGE_H
+#define MEMORYUSAGE_H
+
+//========================================
+// MemoryUsage
+// Bytes held by the structures of a model or a fit, part by part
+//========================================
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+using std::vector;
+
+/**
+ * @brief Breakdown of the memory of a structure into named parts, e.g.
+ * "nodes" or "splitter.samples". Only the payload of the containers is
+ * counted, not their headers nor the allocator overhead.
+ */
+struct MemoryUsage
+{
+    vector<std::pair<std::string, size_t> > parts;     // (name, bytes)
+
+    /**
+     * @brief Add a part
+     * @param name
+     * @param bytes
+     */
+    void add(const std::string& name,
+             size_t bytes)
+    {
+        parts.push_back(std::make_pair(name, bytes));
+    }
+
+    /**
+     * @brief Add the parts of usage, their names prefixed by "prefix."
+     * @param prefix
+     * @param usage
+     */
+    void add(const std::string& prefix,
+             const MemoryUsage& usage)
+    {
+        for (size_t p = 0; p < usage.parts.size(); p++)
+            add(prefix + "." + usage.parts[p].first, usage.parts[p].second);
+    }
+
+    /**
+     * @brief Bytes of the part name, and of the parts under it
+     * @param name A part, or a prefix, e.g. "splitter"
+     */
+    size_t bytes(const std::string& name) const
+    {
+        size_t total = 0;
+        for (size_t p = 0; p < parts.size(); p++)
+        {
+            const std::string& part = parts[p].first;
+            if (part == name || (part.size() > name.size() && part.compare(0, name.size(), name) == 0 &&
+                                 part[name.size()] == '.'))
+                total += parts[p].second;
+        }
+        return total;
+    }
+
+    /**
+     * @brief Bytes of all the parts
+     */
+    size_t total() const
+    {
+        size_t total = 0;
+        for (size_t p = 0; p < parts.size(); p++)
+            total += parts[p].second;
+        return total;
+    }
+};
+
+/**
+ * @brief Bytes allocated by a vector, its capacity rather than its size
+ */
+template <typename VECTOR>
+inline size_t vector_bytes(const VECTOR& v)
+{
+    return v.capacity() * sizeof(typename VECTOR::value_type);
+}
+
+#endif // MEMORYUSAGE_H
@@ -0,0 +1,97 @@
+#include "numa.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <pthread.h>
+#include <sched.h>
+
+/**
+ * @brief Ids listed in a sysfs range list file, e.g. "0-3,8-11"
+ * @return The ids, empty if the file cannot be read
+ */
+static vector<int> read_range_list(const std::string& path)
+{
+    vector<int> ids;
+    std::ifstream file(path.c_str());
+    std::string range;
+    while (std::getline(file, range, ','))
+    {
+        int first = 0;
+        int last = 0;
+        char dash = 0;
+        std::istringstream parser(range);
+        if (!(parser >> first))
+            continue;
+        if (!(parser >> dash >> last) || dash != '-')
+            last = first;
+        for (int id = first; id <= last; id++)
+            ids.push_back(id);
+    }
+    return ids;
+}
+
+/**
+ * @brief CPUs of every node, read once from sysfs
+ */
+static const vector<vector<int> >& numa_topology()
+{
+    static const vector<vector<int> > topology = []() {
+        // The online node ids may have gaps, e.g. "0,2-3"
+        vector<vector<int> > nodes;
+        vector<int> online = read_range_list("/sys/devices/system/node/online");
+        for (size_t n = 0; n < online.size(); n++)
+        {
+            std::ostringstream path;
+            path << "/sys/devices/system/node/node" << online[n] << "/cpulist";
+            vector<int> cpus = read_range_list(path.str());
+
+            // Memory-only nodes take no worker
+            if (!cpus.empty())
+                nodes.push_back(cpus);
+        }
+        return nodes;
+    }();
+    return topology;
+}
+
+int numa_node_count()
+{
+    int n_nodes = static_cast<int>(numa_topology().size());
+    return (n_nodes > 0) ? n_nodes : 1;
+}
+
+vector<int> numa_node_cpus(int node)
+{
+    const vector<vector<int> >& topology = numa_topology();
+    if (node < 0 || node >= static_cast<int>(topology.size()))
+        return vector<int>();
+    return topology[node];
+}
+
+int numa_node_of(int worker,
+                 int n_workers,
+                 NumaPlacement placement)
+{
+    int n_nodes = numa_node_count();
+    if (placement == NUMA_INTERLEAVED)
+        return worker % n_nodes;
+    if (placement == NUMA_PARTITIONED)
+        return static_cast<int>((static_cast<long long>(worker) * n_nodes) / std::max(n_workers, 1));
+    return -1;
+}
+
+int pin_to_numa_node(int node)
+{
+    vector<int> cpus = numa_node_cpus(node);
+    if (cpus.empty())
+        return 1;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t c = 0; c < cpus.size(); c++)
+        CPU_SET(cpus[c], &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        return 2;
+    return 0;
+}
@@ -0,0 +1,90 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+//========================================
+// NUMA
+// Placement of the workers and of their data on the memory nodes of a host
+//========================================
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+using std::vector;
+
+/**
+ * @brief How the workers of a parallel run are spread over the NUMA nodes.
+ * Pages are placed by the first thread that writes them, so the data a
+ * pinned worker fills lands on its node.
+ */
+enum NumaPlacement
+{
+    NUMA_NONE=0,            // Workers are not pinned
+    NUMA_INTERLEAVED=1,     // Worker t on node t % n_nodes, for data shared by all the workers
+    NUMA_PARTITIONED=2,     // Consecutive workers share a node, for blocks scanned by one worker
+};
+
+/**
+ * @brief Number of NUMA nodes with CPUs, 1 if the topology is unknown
+ */
+int numa_node_count();
+
+/**
+ * @brief CPUs of a NUMA node
+ * @param node
+ * @return The CPU ids, empty if node does not exist
+ */
+vector<int> numa_node_cpus(int node);
+
+/**
+ * @brief Node of worker t of n_workers under placement
+ * @return The node, -1 for NUMA_NONE
+ */
+int numa_node_of(int worker,
+                 int n_workers,
+                 NumaPlacement placement);
+
+/**
+ * @brief Restrict the calling thread to the CPUs of a NUMA node. Its
+ * later allocations are then local to the node.
+ * @param node
+ * @return error_code, 1 if node does not exist, 2 if the affinity cannot be set
+ */
+int pin_to_numa_node(int node);
+
+/**
+ * @brief Allocator leaving new trivial elements uninitialized, so that the
+ * pages of a vector are first touched, hence placed, by the threads that
+ * fill it rather than by the one that resizes it.
+ */
+template <typename T>
+class FirstTouchAllocator : public std::allocator<T>
+{
+public:
+    template <typename U>
+    struct rebind
+    {
+        typedef FirstTouchAllocator<U> other;
+    };
+
+    FirstTouchAllocator() {}
+
+    template <typename U>
+    FirstTouchAllocator(const FirstTouchAllocator<U>&) {}
+
+    // Default-initialization, a no-op for the integer codes
+    template <typename U>
+    void construct(U* p)
+    {
+        ::new (static_cast<void*>(p)) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args)
+    {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+};
+
+#endif // NUMA_H
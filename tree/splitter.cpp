@@ -1,5 +1,6 @@
 #include "splitter.h"
 #include <algorithm>
+#include <numeric>
 
 void SplitRecord::init_split(int start_pos)
 {
@@ -25,7 +26,9 @@ Splitter::Splitter(Criterion* _criterion,
       n_features(0),
       weighted_n_samples(0.0),
       start(0),
-      end(0)
+      end(0),
+      arena(NULL),
+      bounded_search(false)
 {
 
 }
@@ -35,40 +38,83 @@ Splitter::~Splitter()
 
 }
 
-int Splitter::init(Mat _X,
-                   Mat _y,
-                   Mat _sample_weight)
+int Splitter::init(DataView<double> /*_X*/,
+                   DataView<double> /*_y*/,
+                   DataView<double> /*_sample_weight*/)
+{
+    // Feature type not handled by this splitter
+    return 5;
+}
+
+int Splitter::init(DataView<float> /*_X*/,
+                   DataView<double> /*_y*/,
+                   DataView<double> /*_sample_weight*/)
+{
+    // Feature type not handled by this splitter
+    return 5;
+}
+
+int Splitter::init(const BinnedMatrix& /*_X*/,
+                   DataView<double> /*_y*/,
+                   DataView<double> /*_sample_weight*/)
+{
+    // Feature type not handled by this splitter
+    return 5;
+}
+
+int Splitter::init_samples(int n_rows,
+                           int n_cols,
+                           DataView<double> _y,
+                           DataView<double> _sample_weight)
 {
     // Init some value
-    n_samples = _X.rows;
-    n_features = _X.cols;
+    n_samples = n_rows;
+    n_features = n_cols;
 
     weighted_n_samples = 0.0;
 
     // Validation
-    // _X.rows == _y.rows == _y.total
+    // _X.rows == _y.rows, _y.cols == n_outputs >= 1
     // _y.rows == _samples_weight.rows == _samples_weight.total
-    if (_X.rows != _y.rows)
+    if (n_rows != _y.rows)
         return 1;
-    if (_y.rows != _y.total())
+    if (_y.cols < 1)
         return 2;
-    if (_y.rows != _sample_weight.rows)
+    if (!_sample_weight.empty() && _y.rows != _sample_weight.rows)
         return 3;
     if (_sample_weight.rows != _sample_weight.total())
         return 4;
 
+    // Train on the selected rows, or on all of them
+    bool subset = !sample_indices.empty();
+    int n_candidates = subset ? sample_indices.rows : n_rows;
+
+    // Allocate the scratch vectors from the arena
+    samples = ArenaVector<int>(ArenaAllocator<int>(arena));
+    active_samples = ArenaVector<int>(ArenaAllocator<int>(arena));
+    features = ArenaVector<int>(ArenaAllocator<int>(arena));
+    constant_features = ArenaVector<int>(ArenaAllocator<int>(arena));
+    samples.reserve(n_candidates);
+    active_samples.reserve(n_candidates);
+    features.reserve(n_cols);
+
     // Calculate the weight sum
     int j = 0;
-    for (int i = 0; i < n_samples; i++)
+    for (int c = 0; c < n_candidates; c++)
     {
-        if (_sample_weight.total() != 0 || _sample_weight.at<double>(i) != 0.0)
+        int i = subset ? sample_indices.at(c) : c;
+        if (i < 0 || i >= n_rows)
+            return 6;
+
+        // Only work with positively weighted samples
+        if (_sample_weight.empty() || _sample_weight.at(i) != 0.0)
         {
             samples.push_back(i);
             j += 1;
         }
 
-        if (_sample_weight.total() != 0)
-            weighted_n_samples += _sample_weight.at<double>(i);
+        if (!_sample_weight.empty())
+            weighted_n_samples += _sample_weight.at(i);
         else
             weighted_n_samples += 1.0;
     }
@@ -81,13 +127,10 @@ int Splitter::init(Mat _X,
     // Store the constant feature index
     constant_features.resize(n_features);
 
-    // Init the size of feature_values
-    feature_values.resize(n_samples);
-
     // Store the data
-    X = _X;
     y = _y;
     sample_weight = _sample_weight;
+    return 0;
 }
 
 double Splitter::node_reset(int _start, int _end)
@@ -98,7 +141,7 @@ double Splitter::node_reset(int _start, int _end)
     criterion->init(y,
                     sample_weight,
                     weighted_n_samples,
-                    samples,
+                    samples.data(),
                     start,
                     end);
 
@@ -106,11 +149,20 @@ double Splitter::node_reset(int _start, int _end)
     return weighted_n_node_samples;
 }
 
-BaseDenseSplitter::BaseDenseSplitter(Criterion* criterion,
-                                     int max_feature,
-                                     int min_samples_leaf,
-                                     double min_weight_leaf,
-                                     int random_state)
+MemoryUsage Splitter::memory_usage() const
+{
+    MemoryUsage usage;
+    usage.add("samples", vector_bytes(samples) + vector_bytes(active_samples));
+    usage.add("features", vector_bytes(features) + vector_bytes(constant_features));
+    return usage;
+}
+
+template <typename DTYPE>
+BaseDenseSplitter<DTYPE>::BaseDenseSplitter(Criterion* criterion,
+                                            int max_feature,
+                                            int min_samples_leaf,
+                                            double min_weight_leaf,
+                                            int random_state)
     : Splitter(criterion,
                max_feature,
                min_samples_leaf,
@@ -120,47 +172,114 @@ BaseDenseSplitter::BaseDenseSplitter(Criterion* criterion,
 
 }
 
-BaseDenseSplitter::~BaseDenseSplitter()
+template <typename DTYPE>
+BaseDenseSplitter<DTYPE>::~BaseDenseSplitter()
 {
 
 }
 
-int BaseDenseSplitter::init(Mat _X,
-                            Mat _y,
-                            Mat _sample_weight)
+template <typename DTYPE>
+int BaseDenseSplitter<DTYPE>::init(DataView<DTYPE> _X,
+                                   DataView<double> _y,
+                                   DataView<double> _sample_weight)
 {
-    Splitter::init(_X, _y, _sample_weight);
+    int error = init_samples(_X.rows, _X.cols, _y, _sample_weight);
+    if (error != 0)
+        return error;
+
+    // Init the size of feature_values
+    feature_values = ArenaVector<DTYPE>(n_samples, DTYPE(), ArenaAllocator<DTYPE>(arena));
+    sort_buffer = ArenaVector<std::pair<DTYPE, int> >(
+                      n_samples, std::pair<DTYPE, int>(), ArenaAllocator<std::pair<DTYPE, int> >(arena));
+
+    // Store the data
+    X = _X;
+    return 0;
 }
 
-BestSplitter::BestSplitter(Criterion* criterion,
-                           int max_features,
-                           int min_samples_leaf,
-                           double min_weight_leaf,
-                           int random_state)
-    : BaseDenseSplitter(criterion,
-                        max_features,
-                        min_samples_leaf,
-                        min_weight_leaf,
-                        random_state)
+template <typename DTYPE>
+MemoryUsage BaseDenseSplitter<DTYPE>::memory_usage() const
+{
+    MemoryUsage usage = Splitter::memory_usage();
+    usage.add("feature_values", vector_bytes(feature_values) + vector_bytes(sort_buffer));
+    return usage;
+}
+
+template <typename DTYPE>
+BestSplitter<DTYPE>::BestSplitter(Criterion* criterion,
+                                  int max_features,
+                                  int min_samples_leaf,
+                                  double min_weight_leaf,
+                                  int random_state)
+    : BaseDenseSplitter<DTYPE>(criterion,
+                               max_features,
+                               min_samples_leaf,
+                               min_weight_leaf,
+                               random_state)
 {
 
 }
 
-BestSplitter::~BestSplitter()
+template <typename DTYPE>
+BestSplitter<DTYPE>::~BestSplitter()
 {
 
 }
 
-void BestSplitter::node_split(double impurity,
-                              SplitRecord *split,
-                              int* n_constant_features)
+template <typename DTYPE>
+int BestSplitter<DTYPE>::init(DataView<DTYPE> _X,
+                              DataView<double> _y,
+                              DataView<double> _sample_weight)
 {
-    int range = end - start;
-    split->init_split(end);
+    int error = BaseDenseSplitter<DTYPE>::init(_X, _y, _sample_weight);
+    if (error != 0)
+        return error;
 
-    std::pair<double, double> pdd;
+    // Histograms of the bounded search
+    if (this->bounded_search)
+    {
+        Arena* arena = this->arena;
+        int n_outputs = _y.cols;
+        bin_weight = ArenaVector<double>(N_BOUND_BINS, 0.0, ArenaAllocator<double>(arena));
+        bin_sum = ArenaVector<double>(N_BOUND_BINS * n_outputs, 0.0, ArenaAllocator<double>(arena));
+        bin_y_min = ArenaVector<double>(N_BOUND_BINS * n_outputs, 0.0, ArenaAllocator<double>(arena));
+        bin_y_max = ArenaVector<double>(N_BOUND_BINS * n_outputs, 0.0, ArenaAllocator<double>(arena));
+        candidates = ArenaVector<std::pair<double, int> >(ArenaAllocator<std::pair<double, int> >(arena));
+        candidates.reserve(this->n_features);
+    }
+    return 0;
+}
 
-    SplitRecord best, current;
+template <typename DTYPE>
+MemoryUsage BestSplitter<DTYPE>::memory_usage() const
+{
+    MemoryUsage usage = BaseDenseSplitter<DTYPE>::memory_usage();
+    usage.add("histograms", vector_bytes(bin_weight) + vector_bytes(bin_sum) +
+                            vector_bytes(bin_y_min) + vector_bytes(bin_y_max));
+    usage.add("candidates", vector_bytes(candidates));
+    return usage;
+}
+
+template <typename DTYPE>
+void BestSplitter<DTYPE>::node_split(double impurity,
+                                     SplitRecord *split,
+                                     int* n_constant_features)
+{
+    // Local references to the members of the (dependent) base classes
+    const DataView<DTYPE>& X = this->X;
+    ArenaVector<int>& samples = this->samples;
+    ArenaVector<int>& features = this->features;
+    ArenaVector<int>& constant_features = this->constant_features;
+    const int start = this->start;
+    const int end = this->end;
+    const int n_features = this->n_features;
+    const int max_features = this->max_features;
+    const int random_state = this->random_state;
+
+    split->init_split(end);
+
+    SplitRecord best;
+    best.pos = end - start;             // No split found yet
 
     int p;
     int tmp;
@@ -174,10 +293,18 @@ void BestSplitter::node_split(double impurity,
     // n_total_constants = n_known_constants + n_found_constants
     int n_total_constants = n_known_constants;
 
-    feature_values.resize(range);
-    active_samples = vector<int>(samples.begin()+start, samples.begin()+end);
-    vector<int> sorted_samples = active_samples;
-    std::sort(sorted_samples.begin(), sorted_samples.end());
+    this->active_samples.assign(samples.begin()+start, samples.begin()+end);
+
+    // Bounded search: the drawn non constant features, with their
+    // improvement upper bound, to evaluate after the draw
+    // Small nodes sort faster than they are summarized
+    bool bounded = (this->bounded_search &&
+                    end - start >= 4 * N_BOUND_BINS &&
+                    this->criterion->has_improvement_upper_bound());
+    ArenaVector<std::pair<double, int> >& candidates = this->candidates;
+    candidates.clear();
+    double bound;
+    bool is_constant;
 
     /**
       * Sample up to max_features without replacement using a
@@ -192,6 +319,7 @@ void BestSplitter::node_split(double impurity,
       */
     int f_i = n_features;
     int f_j = 0;
+    int current_feature;
     while (f_i > n_total_constants && // Stop early if remaining features
                                       // are constant
            (n_visited_features < max_features ||
@@ -233,33 +361,25 @@ void BestSplitter::node_split(double impurity,
             f_j += n_found_constants;
             // f_j in the interval [n_total_constants, f_i]
 
-            current.feature = features[f_j];
+            current_feature = features[f_j];
 
-            /**
-              * Sort sampels along that feature; first copy the feature
-              * values for the active samples into feature_values, s.t.
-              * feature_values[i] == X[sampels[i], j], so the sort uses the cache more
-              * effectively.
-              */
-            for (int i = 0; i < range; i++)
+            // The bounded search only summarizes the feature here, the
+            // exhaustive search sorts it right away
+            if (bounded)
             {
-                feature_values.at(i) = X.at<double>(active_samples.at(i), current.feature);
+                is_constant = feature_bound(current_feature, &bound);
+                if (!is_constant)
+                    candidates.push_back(std::make_pair(-bound, current_feature));
             }
+            else
+                is_constant = sort_feature(current_feature);
 
-            // sort feature_values and apply the squence to samples
-            // std::sort(feature_values.begin(), feature_values.end());
-            auto sequence = sort_permutation(feature_values,
-                                [](double const& a, double const &b){return a<b;});
-            feature_values = apply_permutation(feature_values, sequence);
-            active_samples = apply_permutation(active_samples, sequence);
-            criterion->samples = active_samples;
-
-            if (feature_values.back() <= feature_values.front() + FEATURE_THRESHOLD)
+            if (is_constant)
             {
                 // The feature is constant
                 // Move it to the features[n_total_constants]
                 features[f_j] = features[n_total_constants];
-                features[n_total_constants] = current.feature;
+                features[n_total_constants] = current_feature;
 
                 n_found_constants += 1;
                 n_total_constants += 1;
@@ -272,63 +392,38 @@ void BestSplitter::node_split(double impurity,
                 features[f_i] = features[f_j];
                 features[f_j] = tmp;
 
-                // Evaluate all splits
-                criterion->reset();
-                p = 0;
-
-                while (p < range)
-                {
-                    while (p + 1 < range &&
-                           feature_values.at(p+1) <= feature_values.at(p) + FEATURE_THRESHOLD)
-                        p += 1;
-                    p += 1;
-
-                    if (p < range)
-                    {
-                        current.pos = p;
-
-                        // Reject if min_samples_leaf is not guaranteed
-                        if (((current.pos) < min_samples_leaf) ||
-                            ((end - current.pos) < min_samples_leaf))
-                            continue;
-
-                        criterion->update(current.pos);
-
-                        // Reject if min_weight_leaf is not satisfied
-                        if ((criterion->weighted_n_left < min_weight_leaf) ||
-                             criterion->weighted_n_right < min_weight_leaf)
-                            continue;
-
-                        double a = impurity;
-                        current.improvement = criterion->impurity_improvement(impurity);
-
-                        if (current.improvement > best.improvement)
-                        {
-                            pdd = criterion->children_impurity();
-                            current.impurity_left = pdd.first;
-                            current.impurity_right = pdd.second;
-                            current.threshold = (feature_values.at(p-1) + feature_values.at(p)) / 2.0;
+                if (!bounded)
+                    scan_feature(current_feature, impurity, &best);
+            }
+        }
+    }
 
-                            if (current.threshold == feature_values.at(p))
-                                current.threshold = feature_values.at(p-1);
+    if (bounded)
+    {
+        // Evaluate the features by decreasing upper bound, until the bound
+        // falls below the best improvement found. Features of equal bound
+        // keep their draw order.
+        std::sort(candidates.begin(), candidates.end());
+        for (size_t c = 0; c < candidates.size(); c++)
+        {
+            if (-candidates[c].first < best.improvement)
+                break;
 
-                            best = current;
-                        }
-                    }
-                }
-            }
+            current_feature = candidates[c].second;
+            sort_feature(current_feature);
+            scan_feature(current_feature, impurity, &best);
         }
     }
 
     // Recoganize into samples[start:best.pos] + samples[best.pos:end]
-    if (best.pos < end)
+    if (best.pos < end - start)
     {
         partition_end = end;
         p = start;
 
         while (p < partition_end)
         {
-            if (X.at<double>(samples.at(p), best.feature) <= best.threshold)
+            if (X.at(samples.at(p), best.feature) <= best.threshold)
                 p += 1;
             else
             {
@@ -356,39 +451,222 @@ void BestSplitter::node_split(double impurity,
     n_constant_features[0] = n_total_constants;
 }
 
-RandomSplitter::RandomSplitter(Criterion* _criterion,
-                               int _max_features,
-                               int _min_samples_leaf,
-                               double _min_weight_leaf,
-                               int _random_state)
-    : BaseDenseSplitter(_criterion,
-                        _max_features,
-                        _min_samples_leaf,
-                        _min_weight_leaf,
-                        _random_state)
+template <typename DTYPE>
+bool BestSplitter<DTYPE>::sort_feature(int feature)
+{
+    const DataView<DTYPE>& X = this->X;
+    ArenaVector<int>& active_samples = this->active_samples;
+    ArenaVector<DTYPE>& feature_values = this->feature_values;
+    std::pair<DTYPE, int>* sort_buffer = this->sort_buffer.data();
+    const int range = this->end - this->start;
+
+    /**
+      * Sort sampels along that feature; first copy the feature
+      * values for the active samples into feature_values, s.t.
+      * feature_values[i] == X[sampels[i], j], so the sort uses the cache more
+      * effectively.
+      */
+    for (int i = 0; i < range; i++)
+    {
+        sort_buffer[i].first = X.at(active_samples[i], feature);
+        sort_buffer[i].second = active_samples[i];
+    }
+
+    // sort the (value, sample) pairs in place, and split them back
+    std::sort(sort_buffer, sort_buffer + range);
+    for (int i = 0; i < range; i++)
+    {
+        feature_values[i] = sort_buffer[i].first;
+        active_samples[i] = sort_buffer[i].second;
+    }
+    this->criterion->samples = active_samples.data();
+
+    return feature_values[range-1] <= feature_values[0] + FEATURE_THRESHOLD;
+}
+
+template <typename DTYPE>
+void BestSplitter<DTYPE>::scan_feature(int feature,
+                                       double impurity,
+                                       SplitRecord* best)
+{
+    Criterion* criterion = this->criterion;
+    ArenaVector<DTYPE>& feature_values = this->feature_values;
+    const int end = this->end;
+    const int range = end - this->start;
+    const int min_samples_leaf = this->min_samples_leaf;
+    const double min_weight_leaf = this->min_weight_leaf;
+
+    std::pair<double, double> pdd;
+    SplitRecord current;
+    current.feature = feature;
+
+    // Evaluate all splits
+    criterion->reset();
+    int p = 0;
+
+    while (p < range)
+    {
+        while (p + 1 < range &&
+               feature_values[p+1] <= feature_values[p] + FEATURE_THRESHOLD)
+            p += 1;
+        p += 1;
+
+        if (p < range)
+        {
+            current.pos = p;
+
+            // Reject if min_samples_leaf is not guaranteed
+            if ((current.pos < min_samples_leaf) ||
+                ((range - current.pos) < min_samples_leaf))
+                continue;
+
+            criterion->update(current.pos);
+
+            // Reject if min_weight_leaf is not satisfied
+            if ((criterion->weighted_n_left < min_weight_leaf) ||
+                 criterion->weighted_n_right < min_weight_leaf)
+                continue;
+
+            current.improvement = criterion->impurity_improvement(impurity);
+
+            // On a tie, the lower feature wins, whatever the order the
+            // features are evaluated in
+            if (current.improvement > best->improvement ||
+                (current.improvement == best->improvement && feature < best->feature))
+            {
+                pdd = criterion->children_impurity();
+                current.impurity_left = pdd.first;
+                current.impurity_right = pdd.second;
+                current.threshold = mid_threshold(feature_values[p-1],
+                                                  feature_values[p]);
+
+                *best = current;
+            }
+        }
+    }
+}
+
+template <typename DTYPE>
+bool BestSplitter<DTYPE>::feature_bound(int feature,
+                                        double* bound)
+{
+    const DataView<DTYPE>& X = this->X;
+    const DataView<double>& y = this->y;
+    const DataView<double>& sample_weight = this->sample_weight;
+    const ArenaVector<int>& samples = this->samples;
+    const int start = this->start;
+    const int end = this->end;
+    const int n_outputs = y.cols;
+
+    // Range of the feature in the node
+    double x;
+    double x_min = X.at(samples[start], feature);
+    double x_max = x_min;
+    for (int i = start + 1; i < end; i++)
+    {
+        x = X.at(samples[i], feature);
+        if (x < x_min)
+            x_min = x;
+        if (x > x_max)
+            x_max = x;
+    }
+    if (x_max <= x_min + FEATURE_THRESHOLD)
+        return true;
+
+    // Histogram of equal width bins: samples sorted along the feature are
+    // sorted by bin, so a split leaves whole bins and a part of one bin on
+    // its left
+    std::fill(bin_weight.begin(), bin_weight.end(), 0.0);
+    std::fill(bin_sum.begin(), bin_sum.end(), 0.0);
+    std::fill(bin_y_min.begin(), bin_y_min.end(), INFINITY);
+    std::fill(bin_y_max.begin(), bin_y_max.end(), -INFINITY);
+
+    double scale = N_BOUND_BINS / (x_max - x_min);
+    double w = 1.0;
+    double y_ik;
+    int index;
+    int b;
+    for (int i = start; i < end; i++)
+    {
+        index = samples[i];
+        b = static_cast<int>((X.at(index, feature) - x_min) * scale);
+        if (b >= N_BOUND_BINS)
+            b = N_BOUND_BINS - 1;
+
+        if (!sample_weight.empty())
+            w = sample_weight.at(index);
+        bin_weight[b] += w;
+
+        for (int k = 0; k < n_outputs; k++)
+        {
+            y_ik = y.at(index, k);
+            bin_sum[b * n_outputs + k] += w * y_ik;
+            if (y_ik < bin_y_min[b * n_outputs + k])
+                bin_y_min[b * n_outputs + k] = y_ik;
+            if (y_ik > bin_y_max[b * n_outputs + k])
+                bin_y_max[b * n_outputs + k] = y_ik;
+        }
+    }
+
+    *bound = this->criterion->improvement_upper_bound(bin_weight.data(),
+                                                      bin_sum.data(),
+                                                      bin_y_min.data(),
+                                                      bin_y_max.data(),
+                                                      N_BOUND_BINS);
+    return false;
+}
+
+template <typename DTYPE>
+RandomSplitter<DTYPE>::RandomSplitter(Criterion* _criterion,
+                                      int _max_features,
+                                      int _min_samples_leaf,
+                                      double _min_weight_leaf,
+                                      int _random_state)
+    : BaseDenseSplitter<DTYPE>(_criterion,
+                               _max_features,
+                               _min_samples_leaf,
+                               _min_weight_leaf,
+                               _random_state)
 {
 
 }
 
-RandomSplitter::~RandomSplitter()
+template <typename DTYPE>
+RandomSplitter<DTYPE>::~RandomSplitter()
 {
 
 }
 
-void RandomSplitter::node_split(double impurity,
-                                SplitRecord *split,
-                                int *n_constant_features)
+template <typename DTYPE>
+void RandomSplitter<DTYPE>::node_split(double impurity,
+                                       SplitRecord *split,
+                                       int *n_constant_features)
 {
+    // Local references to the members of the (dependent) base classes
+    const DataView<DTYPE>& X = this->X;
+    Criterion* criterion = this->criterion;
+    ArenaVector<int>& samples = this->samples;
+    ArenaVector<int>& features = this->features;
+    ArenaVector<int>& constant_features = this->constant_features;
+    ArenaVector<DTYPE>& feature_values = this->feature_values;
+    const int start = this->start;
+    const int end = this->end;
+    const int n_features = this->n_features;
+    const int max_features = this->max_features;
+    const int min_samples_leaf = this->min_samples_leaf;
+    const double min_weight_leaf = this->min_weight_leaf;
+    const int random_state = this->random_state;
+
     split->init_split(end);
 
-    feature_values.clear();
     std::pair<double, double> pdd;
 
     SplitRecord best, current;
+    best.pos = end - start;             // No split found yet
 
-    double min_feature_value;
-    double max_feature_value;
-    double current_feature_value;
+    DTYPE min_feature_value;
+    DTYPE max_feature_value;
+    DTYPE current_feature_value;
     int p;
     int tmp;
     int partition_end;
@@ -459,13 +737,13 @@ void RandomSplitter::node_split(double impurity,
 
             // Find min, max
             // This is faster than sort
-            min_feature_value = X.at<double>(samples[start], current.feature);
+            min_feature_value = X.at(samples[start], current.feature);
             max_feature_value = min_feature_value;
             feature_values.at(start) = min_feature_value;
 
             for (int i = start+1; i < end; i++)
             {
-                current_feature_value = X.at<double>(samples[i], current.feature);
+                current_feature_value = X.at(samples[i], current.feature);
                 feature_values.at(i) = current_feature_value;
 
                 if (current_feature_value < min_feature_value)
@@ -490,9 +768,9 @@ void RandomSplitter::node_split(double impurity,
                 features.at(f_i) = tmp;
 
                 // Draw a random threshold
-                current.threshold = rand_double(min_feature_value,
-                                                max_feature_value,
-                                                random_state);
+                current.threshold = static_cast<DTYPE>(rand_double(min_feature_value,
+                                                                   max_feature_value,
+                                                                   random_state));
 
                 if (current.threshold == max_feature_value)
                     current.threshold = min_feature_value;
@@ -517,14 +795,15 @@ void RandomSplitter::node_split(double impurity,
                         samples.at(p) = tmp;
                     }
                 }
-                current.pos = partition_end;
+                current.pos = partition_end - start;
 
                 // Reject if min_samples_leaf is not guaranteed
-                if (((current.pos - start) < min_samples_leaf) ||
-                        ((end - current.pos) < min_samples_leaf))
+                if ((current.pos < min_samples_leaf) ||
+                        ((end - start - current.pos) < min_samples_leaf))
                     continue;
 
-                // Evaluate split
+                // Evaluate split, positions are relative to the node start
+                criterion->samples = samples.data() + start;
                 criterion->reset();
                 criterion->update(current.pos);
 
@@ -547,14 +826,14 @@ void RandomSplitter::node_split(double impurity,
     }
 
     // Recoganize into samples[start:best.pos] + samples[best.pos:end]
-    if (best.pos < end)
+    if (best.pos < end - start)
     {
         partition_end = end;
         p = start;
 
         while (p < partition_end)
         {
-            if (X.at<double>(samples[p], best.feature) <= best.threshold)
+            if (X.at(samples[p], best.feature) <= best.threshold)
                 p += 1;
             else
             {
@@ -582,55 +861,91 @@ void RandomSplitter::node_split(double impurity,
     n_constant_features[0] = n_total_constants;
 }
 
-PresortBestSplitter::PresortBestSplitter(Criterion* _criterion,
-                                         int _max_features,
-                                         int _min_samples_leaf,
-                                         double _min_weight_leaf,
-                                         int _random_state)
-    : BaseDenseSplitter(_criterion,
-                        _max_features,
-                        _min_samples_leaf,
-                        _min_weight_leaf,
-                        _random_state)
+template <typename DTYPE>
+PresortBestSplitter<DTYPE>::PresortBestSplitter(Criterion* _criterion,
+                                                int _max_features,
+                                                int _min_samples_leaf,
+                                                double _min_weight_leaf,
+                                                int _random_state)
+    : BaseDenseSplitter<DTYPE>(_criterion,
+                               _max_features,
+                               _min_samples_leaf,
+                               _min_weight_leaf,
+                               _random_state)
 {
 
 }
 
-PresortBestSplitter::~PresortBestSplitter()
+template <typename DTYPE>
+PresortBestSplitter<DTYPE>::~PresortBestSplitter()
 {
 
 }
 
-int PresortBestSplitter::init(Mat _X,
-                              Mat _y,
-                              Mat _sample_weight)
+template <typename DTYPE>
+int PresortBestSplitter<DTYPE>::init(DataView<DTYPE> _X,
+                                     DataView<double> _y,
+                                     DataView<double> _sample_weight)
 {
     // Call parent initializer
-    BaseDenseSplitter::init(_X, _y, _sample_weight);
-
-    X = _X;
-
-    // Pre-sort X
-//    if (X_old == X)
-    if (true)
+    int error = BaseDenseSplitter<DTYPE>::init(_X, _y, _sample_weight);
+    if (error != 0)
+        return error;
+
+    const DataView<DTYPE>& X = this->X;
+    const int n_features = this->n_features;
+
+    // Pre-sort X, column by column
+    n_total_samples = X.rows;
+    X_argsorted = ArenaVector<int>(static_cast<size_t>(n_features) * n_total_samples, 0,
+                                   ArenaAllocator<int>(this->arena));
+    for (int f = 0; f < n_features; f++)
     {
-        X_old = X.clone();
-        n_total_samples = X.rows;
-        cv::sortIdx(_X, X_argsorted, CV_SORT_EVERY_COLUMN + CV_SORT_ASCENDING);
-        sample_mask.resize(n_total_samples);
+        ArenaVector<int>::iterator begin = X_argsorted.begin() +
+                                      static_cast<size_t>(f) * n_total_samples;
+        std::iota(begin, begin + n_total_samples, 0);
+        std::sort(begin, begin + n_total_samples,
+            [&](int a, int b){ return X.at(a, f) < X.at(b, f); });
     }
+    sample_mask = ArenaVector<uchar>(n_total_samples, 0, ArenaAllocator<uchar>(this->arena));
+    return 0;
 }
 
-void PresortBestSplitter::node_split(double impurity,
-                                     SplitRecord *split,
-                                     int *n_constant_features)
+template <typename DTYPE>
+MemoryUsage PresortBestSplitter<DTYPE>::memory_usage() const
+{
+    MemoryUsage usage = BaseDenseSplitter<DTYPE>::memory_usage();
+    usage.add("presort_indices", vector_bytes(X_argsorted));
+    usage.add("sample_mask", vector_bytes(sample_mask));
+    return usage;
+}
+
+template <typename DTYPE>
+void PresortBestSplitter<DTYPE>::node_split(double impurity,
+                                            SplitRecord *split,
+                                            int *n_constant_features)
 {
+    // Local references to the members of the (dependent) base classes
+    const DataView<DTYPE>& X = this->X;
+    Criterion* criterion = this->criterion;
+    ArenaVector<int>& samples = this->samples;
+    ArenaVector<int>& features = this->features;
+    ArenaVector<int>& constant_features = this->constant_features;
+    ArenaVector<DTYPE>& feature_values = this->feature_values;
+    const int start = this->start;
+    const int end = this->end;
+    const int n_features = this->n_features;
+    const int max_features = this->max_features;
+    const int min_samples_leaf = this->min_samples_leaf;
+    const double min_weight_leaf = this->min_weight_leaf;
+    const int random_state = this->random_state;
+
     split->init_split(end);
 
-    feature_values.clear();
     std::pair<double, double> pdd;
 
     SplitRecord best, current;
+    best.pos = end - start;             // No split found yet
 
     int partition_end = 0;
     int p = 0;
@@ -710,11 +1025,11 @@ void PresortBestSplitter::node_split(double impurity,
 
             for (int i = start, j = 0; i < n_total_samples; i++)
             {
-                j = X_argsorted.at<int>(current.feature, i);
+                j = X_argsorted.at(static_cast<size_t>(current.feature) * n_total_samples + i);
                 if (sample_mask[j] == 1)
                 {
                     samples[p] = j;
-                    feature_values.at(p) = X.at<double>(j, current.feature);
+                    feature_values.at(p) = X.at(j, current.feature);
                     p += 1;
                 }
             }
@@ -735,7 +1050,10 @@ void PresortBestSplitter::node_split(double impurity,
                 features[f_i] = features[f_j];
                 features[f_j] = tmp;
 
+                // Positions are relative to the node start
+                criterion->samples = samples.data() + start;
                 criterion->reset();
+                p = start;
 
                 while (p < end)
                 {
@@ -747,11 +1065,11 @@ void PresortBestSplitter::node_split(double impurity,
 
                     if (p < end)
                     {
-                        current.pos = p;
+                        current.pos = p - start;
 
                         // Reject if min_samples_leaf is not guaranteed
-                        if (((current.pos - start) < min_samples_leaf) ||
-                             ((end - current.pos) < min_samples_leaf))
+                        if ((current.pos < min_samples_leaf) ||
+                             ((end - p) < min_samples_leaf))
                             continue;
 
                         criterion->update(current.pos);
@@ -768,10 +1086,8 @@ void PresortBestSplitter::node_split(double impurity,
                             pdd = criterion->children_impurity();
                             current.impurity_left = pdd.first;
                             current.impurity_right = pdd.second;
-                            current.threshold = (feature_values.at(p-1) + feature_values.at(p)) / 2.0;
-
-                            if (current.threshold == feature_values.at(p))
-                                current.threshold = feature_values.at(p-1);
+                            current.threshold = mid_threshold(feature_values.at(p-1),
+                                                              feature_values.at(p));
 
                             best = current;
                         }
@@ -782,14 +1098,14 @@ void PresortBestSplitter::node_split(double impurity,
     }
 
     // Recoganize into samples[start:best.pos] + samples[best.pos:end]
-    if (best.pos < end)
+    if (best.pos < end - start)
     {
         partition_end = end;
         p = start;
 
         while (p < partition_end)
         {
-            if (X.at<double>(samples[p], best.feature) <= best.threshold)
+            if (X.at(samples[p], best.feature) <= best.threshold)
                 p += 1;
             else
             {
@@ -817,39 +1133,369 @@ void PresortBestSplitter::node_split(double impurity,
     n_constant_features[0] = n_total_constants;
 }
 
+BinnedSplitter::BinnedSplitter(Criterion* _criterion,
+                               int _max_features,
+                               int _min_samples_leaf,
+                               double _min_weight_leaf,
+                               int _random_state)
+    : Splitter(_criterion,
+               _max_features,
+               _min_samples_leaf,
+               _min_weight_leaf,
+               _random_state),
+      X(NULL),
+      bin_size(0),
+      node_stamp(0)
+{
 
+}
 
+BinnedSplitter::~BinnedSplitter()
+{
 
+}
 
+int BinnedSplitter::init(const BinnedMatrix& _X,
+                         DataView<double> _y,
+                         DataView<double> _sample_weight)
+{
+    int error = init_samples(_X.rows, _X.cols, _y, _sample_weight);
+    if (error != 0)
+        return error;
 
+    bin_count = ArenaVector<int>(_X.max_bins, 0, ArenaAllocator<int>(arena));
+    bin_offset = ArenaVector<int>(_X.max_bins, 0, ArenaAllocator<int>(arena));
 
+    // Every bundle holds its codes then the node totals, the statistics are
+    // sized at the first node once the criterion is initialized
+    if (_X.is_bundled())
+    {
+        int n_bundles = static_cast<int>(_X.bundles.size());
+        bundle_start = ArenaVector<int>(n_bundles + 1, 0, ArenaAllocator<int>(arena));
+        for (int k = 0; k < n_bundles; k++)
+            bundle_start[k + 1] = bundle_start[k] + _X.bundle_n_codes[k] + 1;
+        bundle_stamp = ArenaVector<int>(n_bundles, -1, ArenaAllocator<int>(arena));
+        bin_size = 0;
+        node_stamp = 0;
+    }
 
+    // Store the data
+    X = &_X;
+    return 0;
+}
 
+MemoryUsage BinnedSplitter::memory_usage() const
+{
+    MemoryUsage usage = Splitter::memory_usage();
+    usage.add("histograms", vector_bytes(bin_count) + vector_bytes(bin_offset) +
+                            vector_bytes(bundle_start) + vector_bytes(bundle_stamp) +
+                            vector_bytes(bundle_histograms) + vector_bytes(feature_hist) +
+                            vector_bytes(left_stats));
+    return usage;
+}
 
+bool BinnedSplitter::bundled_histogram(int j,
+                                       int n_bins)
+{
+    int k = X->feature_bundle[j];
+    if (bundle_stamp[k] != node_stamp)
+        fill_bundle_histogram(k);
+
+    // The default bin holds the node samples in no other bin of the feature
+    const double* histogram = &bundle_histograms[static_cast<size_t>(bundle_start[k]) * bin_size];
+    const double* total = histogram + static_cast<size_t>(X->bundle_n_codes[k]) * bin_size;
+    int default_bin = X->default_bin[j];
+    double* default_hist = &feature_hist[default_bin * bin_size];
+    std::copy(total, total + bin_size, default_hist);
+
+    int n_filled_bins = 0;
+    for (int b = 0; b < n_bins; b++)
+    {
+        if (b == default_bin)
+            continue;
+        const double* bin = histogram + static_cast<size_t>(X->bundle_code(j, b)) * bin_size;
+        std::copy(bin, bin + bin_size, &feature_hist[b * bin_size]);
+        for (int s = 0; s < bin_size; s++)
+            default_hist[s] -= bin[s];
+        if (bin[0] > 0.0)
+            n_filled_bins += 1;
+    }
+    if (default_hist[0] > 0.0)
+        n_filled_bins += 1;
+    return n_filled_bins > 1;
+}
 
+void BinnedSplitter::fill_bundle_histogram(int k)
+{
+    int n_codes = X->bundle_n_codes[k];
+    double* histogram = &bundle_histograms[static_cast<size_t>(bundle_start[k]) * bin_size];
+    std::fill(histogram, histogram + static_cast<size_t>(n_codes + 1) * bin_size, 0.0);
+
+    const uint16_t* column = X->bundle_column(k);
+    double w = 1.0;
+    int index;
+    for (int i = start; i < end; i++)
+    {
+        index = samples[i];
+        if (!sample_weight.empty())
+            w = sample_weight.at(index);
+
+        double* bin = histogram + static_cast<size_t>(column[index]) * bin_size;
+        bin[0] += 1.0;
+        bin[1] += w;
+        criterion->add_stats(index, w, bin + 2);
+    }
 
+    // Node totals after the codes
+    double* total = histogram + static_cast<size_t>(n_codes) * bin_size;
+    for (int c = 0; c < n_codes; c++)
+    {
+        for (int s = 0; s < bin_size; s++)
+            total[s] += histogram[static_cast<size_t>(c) * bin_size + s];
+    }
+    bundle_stamp[k] = node_stamp;
+}
 
+template <typename CTYPE>
+bool BinnedSplitter::sort_by_bin(const CTYPE* column,
+                                 int n_bins)
+{
+    int range = end - start;
+    int min_bin = n_bins;
+    int max_bin = -1;
+    int bin;
 
+    std::fill(bin_count.begin(), bin_count.begin() + n_bins, 0);
+    for (int i = start; i < end; i++)
+    {
+        bin = column[samples[i]];
+        bin_count[bin] += 1;
+        if (bin < min_bin)
+            min_bin = bin;
+        if (bin > max_bin)
+            max_bin = bin;
+    }
 
+    if (max_bin <= min_bin)
+        return false;
 
+    int offset = 0;
+    for (int b = 0; b < n_bins; b++)
+    {
+        bin_offset[b] = offset;
+        offset += bin_count[b];
+    }
 
+    active_samples.resize(range);
+    for (int i = start; i < end; i++)
+    {
+        bin = column[samples[i]];
+        active_samples[bin_offset[bin]] = samples[i];
+        bin_offset[bin] += 1;
+    }
+    return true;
+}
 
+void BinnedSplitter::node_split(double impurity,
+                                SplitRecord *split,
+                                int* n_constant_features)
+{
+    int range = end - start;
+    split->init_split(end);
 
+    std::pair<double, double> pdd;
 
+    SplitRecord best, current;
+    best.pos = range;           // No split found yet
+    int best_bin = 0;
 
+    int p;
+    int tmp;
+    int n_bins;
+    bool is_constant;
+    int partition_end;
+    int n_visited_features = 0;
+    // Num of features discovered to be constant during the split search
+    int n_found_constants = 0;
+    // Num of features known to be constant and drawn without replacement
+    int n_drawn_constants = 0;
+    int n_known_constants = *n_constant_features;
+    // n_total_constants = n_known_constants + n_found_constants
+    int n_total_constants = n_known_constants;
 
+    // A bundled X needs additive statistics, the bundle histograms of the
+    // previous node are stale
+    bool is_bundled = X->is_bundled();
+    double weight_left = 0.0;
+    if (is_bundled)
+    {
+        if (bin_size == 0)
+        {
+            bin_size = 2 + criterion->n_stats();
+            bundle_histograms = ArenaVector<double>(static_cast<size_t>(bundle_start.back()) * bin_size,
+                                                    0.0, ArenaAllocator<double>(arena));
+            feature_hist = ArenaVector<double>(static_cast<size_t>(X->max_bins) * bin_size,
+                                               0.0, ArenaAllocator<double>(arena));
+            left_stats = ArenaVector<double>(bin_size - 2, 0.0, ArenaAllocator<double>(arena));
+        }
+        node_stamp += 1;
+    }
 
+    /**
+      * Sample up to max_features without replacement using a
+      * Fisher-Yates-based algorithm, as BestSplitter does.
+      */
+    int f_i = n_features;
+    int f_j = 0;
+    while (f_i > n_total_constants && // Stop early if remaining features
+                                      // are constant
+           (n_visited_features < max_features ||
+            // At least one drawn features must be non constant
+            n_visited_features <= n_found_constants + n_drawn_constants))
+    {
+        n_visited_features += 1;
 
+        // Draw a feature at random
+        f_j = rand_int(n_drawn_constants, f_i - n_found_constants,
+                       random_state);
 
+        if (f_j < n_known_constants) // in the interval [n_drawn_constasn, n_known_constants]
+        {
+            tmp = features[f_j];
+            features[f_j] = features[n_drawn_constants];
+            features[n_drawn_constants] = tmp;
+
+            n_drawn_constants += 1;
+        }
+        else
+        {
+            f_j += n_found_constants;
+            current.feature = features[f_j];
 
+            // Order the node samples by bin, and find the constant features
+            n_bins = X->n_bins(current.feature);
+            if (is_bundled)
+                is_constant = (bin_size == 2) || !bundled_histogram(current.feature, n_bins);
+            else if (X->is_wide)
+                is_constant = !sort_by_bin(X->column16(current.feature), n_bins);
+            else
+                is_constant = !sort_by_bin(X->column8(current.feature), n_bins);
+
+            if (is_constant)
+            {
+                features[f_j] = features[n_total_constants];
+                features[n_total_constants] = current.feature;
+
+                n_found_constants += 1;
+                n_total_constants += 1;
+            }
+            else
+            {
+                f_i -= 1;
+                tmp = features[f_i];
+                features[f_i] = features[f_j];
+                features[f_j] = tmp;
 
+                // Evaluate the split after every non-empty bin
+                criterion->samples = active_samples.data();
+                criterion->reset();
+                p = 0;
+                weight_left = 0.0;
+                std::fill(left_stats.begin(), left_stats.end(), 0.0);
 
+                for (int b = 0; b < n_bins - 1; b++)
+                {
+                    int count = is_bundled ? static_cast<int>(feature_hist[b * bin_size]) : bin_count[b];
+                    if (count == 0)
+                        continue;
 
+                    p += count;
+                    if (is_bundled)
+                    {
+                        const double* bin = &feature_hist[b * bin_size];
+                        weight_left += bin[1];
+                        for (int s = 0; s < bin_size - 2; s++)
+                            left_stats[s] += bin[2 + s];
+                    }
+                    if (p >= range)
+                        break;
 
+                    current.pos = p;
 
+                    // Reject if min_samples_leaf is not guaranteed
+                    if ((current.pos < min_samples_leaf) ||
+                        ((range - current.pos) < min_samples_leaf))
+                        continue;
 
+                    if (is_bundled)
+                        criterion->update_stats(left_stats.data(), weight_left);
+                    else
+                        criterion->update(current.pos);
 
+                    // Reject if min_weight_leaf is not satisfied
+                    if ((criterion->weighted_n_left < min_weight_leaf) ||
+                         criterion->weighted_n_right < min_weight_leaf)
+                        continue;
 
+                    current.improvement = criterion->impurity_improvement(impurity);
 
+                    if (current.improvement > best.improvement)
+                    {
+                        pdd = criterion->children_impurity();
+                        current.impurity_left = pdd.first;
+                        current.impurity_right = pdd.second;
+                        current.threshold = X->threshold(current.feature, b);
 
+                        best = current;
+                        best_bin = b;
+                    }
+                }
+            }
+        }
+    }
+
+    // Recoganize into samples[start:best.pos] + samples[best.pos:end]
+    if (best.pos < range)
+    {
+        partition_end = end;
+        p = start;
+
+        while (p < partition_end)
+        {
+            if (X->code(samples[p], best.feature) <= best_bin)
+                p += 1;
+            else
+            {
+                partition_end -= 1;
+
+                tmp = samples[partition_end];
+                samples[partition_end] = samples[p];
+                samples[p] = tmp;
+            }
+        }
+    }
+
+    // Respect invariant for constant features: the original order of
+    // element in features[:n_known_constants] must be preserved for sibling
+    // and child nodes
+    for (int i = 0; i < n_known_constants; i++)
+        features.at(i) = constant_features.at(i);
+
+    // Copy newly found constant features
+    for (int i = n_known_constants; i < n_known_constants+n_found_constants; i++)
+        constant_features.at(i) = features.at(i);
+
+    // Return values
+    split[0] = best;
+    n_constant_features[0] = n_total_constants;
+}
 
+// Explicit instantiations for the supported feature types
+template class BaseDenseSplitter<float>;
+template class BaseDenseSplitter<double>;
+template class BestSplitter<float>;
+template class BestSplitter<double>;
+template class RandomSplitter<float>;
+template class RandomSplitter<double>;
+template class PresortBestSplitter<float>;
+template class PresortBestSplitter<double>;
@@ -4,14 +4,17 @@
 #include <vector>
 #include <utility>
 #include <cstdlib>
-#include <opencv2/opencv.hpp>
+#include <random>
 #include "criterion.h"
+#include "dataview.h"
+#include "binnedmatrix.h"
+#include "arena.h"
 #include "util.h"
 
 using std::vector;
-using cv::Mat;
 
 const double FEATURE_THRESHOLD = 1e-7;
+const int N_BOUND_BINS = 32;            // Histogram bins of the bounded split search
 
 /**
  * @brief Data to track sample split
@@ -20,9 +23,10 @@ struct SplitRecord
 {
     int feature;            // Which feature to split on
     double threshold;       // Threshold to split at.
-    int pos;                // Split samples array at the given position.
+    int pos;                // Split samples array at the given position,
+                            // relative to the node start.
                             // i.e. count of samples below threshold for feature
-                            // pos is >= end if the node is a leaf
+                            // pos is end - start if the node is a leaf
     double improvement;     // Impurity improvement given parent node.
     double impurity_left;   // Impurity of the left split.
     double impurity_right;  // Impurity of the right split.
@@ -46,8 +50,8 @@ struct SplitRecord
         pos = r.pos;
         threshold = r.threshold;
         improvement = r.improvement;
-        impurity_left = impurity_left;
-        impurity_right = impurity_right;
+        impurity_left = r.impurity_left;
+        impurity_right = r.impurity_right;
     }
 };
 
@@ -68,14 +72,50 @@ public:
     virtual ~Splitter();
 
     /**
-     * @brief Initialize the splitter.
+     * @brief Initialize the splitter on double features.
+     * @param X
+     * @param y
+     * @param sample_weight
+     * @return error_code, 5 if the splitter does not handle double features
+     */
+    virtual int init(DataView<double> X,
+                     DataView<double> y,
+                     DataView<double> sample_weight);
+
+    /**
+     * @brief Initialize the splitter on float features.
      * @param X
      * @param y
      * @param sample_weight
+     * @return error_code, 5 if the splitter does not handle float features
      */
-    virtual int init(Mat X,
-                     Mat y,
-                     Mat sample_weight);
+    virtual int init(DataView<float> X,
+                     DataView<double> y,
+                     DataView<double> sample_weight);
+
+    /**
+     * @brief Initialize the splitter on binned features.
+     * @param X
+     * @param y
+     * @param sample_weight
+     * @return error_code, 5 if the splitter does not handle binned features
+     */
+    virtual int init(const BinnedMatrix& X,
+                     DataView<double> y,
+                     DataView<double> sample_weight);
+
+    /**
+     * @brief Initialize the samples, features and weights shared by all splitters.
+     * @param n_rows X.shape[0]
+     * @param n_cols X.shape[1]
+     * @param y
+     * @param sample_weight
+     * @return error_code
+     */
+    int init_samples(int n_rows,
+                     int n_cols,
+                     DataView<double> y,
+                     DataView<double> sample_weight);
 
     /**
      * @brief Reset splitter on node samples[start:end].
@@ -96,6 +136,12 @@ public:
                             SplitRecord* split,
                             int* n_constant_features)=0;
 
+    /**
+     * @brief Bytes of the scratch vectors of the splitter, by part. The
+     * criterion reports its own.
+     */
+    virtual MemoryUsage memory_usage() const;
+
     /**
      * @brief return the value of node samples[start:end]
      * @return node_value
@@ -122,19 +168,29 @@ public:
 
     int n_samples;                      // X.shape[0]
     int n_features;                     // X.shape[1]
-    vector<int> samples;                // Sample indices in X, y
-    vector<int> active_samples;         // Sample indices in X, y
-    vector<int> features;               // Feature indices in x
-    vector<int> constant_features;      // Constant features indices
-    vector<double> feature_values;      // temp. array holding feature values
+    ArenaVector<int> samples;           // Sample indices in X, y
+    ArenaVector<int> active_samples;    // Sample indices in X, y
+    ArenaVector<int> features;          // Feature indices in x
+    ArenaVector<int> constant_features; // Constant features indices
     double weighted_n_samples;          // Weighted number of samples
 
     int start;                          // Start position for the current nodes
     int end;                            // End position for the current nodes
 
-    Mat X;
-    Mat y;
-    Mat sample_weight;
+    DataView<double> y;                 // Target values, shape [n_samples, n_outputs]
+    DataView<double> sample_weight;     // Sample weights, empty if equally weighted
+
+    Arena* arena;                       // Scratch memory of the fit, NULL for the heap.
+                                        // Set before init, the scratch vectors are
+                                        // allocated from it by init.
+
+    bool bounded_search;                // Skip the features that cannot beat the best
+                                        // split, when the criterion has an upper bound
+                                        // of its improvement. Set before init.
+
+    DataView<int> sample_indices;       // Rows of X, y to train on, e.g. the training rows
+                                        // of a cross-validation fold. All the rows if
+                                        // empty. Set before init.
 
 /**
  * The samples vector `samples` is maintained by the Splitter object such
@@ -155,6 +211,14 @@ public:
  */
 };
 
+/**
+ * @brief Base class for the splitters working on a dense X.
+ *
+ * DTYPE is the feature type (float or double). Only X, the feature values
+ * and the thresholds use it; y, the sample weights and all the criterion
+ * statistics stay in double.
+ */
+template <typename DTYPE>
 class BaseDenseSplitter : public Splitter
 {
 public:
@@ -165,31 +229,42 @@ public:
                       int random_state);
     virtual ~BaseDenseSplitter();
 
+    using Splitter::init;
+
     /**
      * @brief Initialize the splitter.
      * @param X
      * @param y
      * @param sample_weight
      */
-    virtual int init(Mat X,
-                     Mat y,
-                     Mat sample_weight);
+    virtual int init(DataView<DTYPE> X,
+                     DataView<double> y,
+                     DataView<double> sample_weight);
 
-    /**
-     * @brief Find a split on onde samples[start:end].
-     * @param impurity
-     * @param split
-     * @param n_constant_features
-     */
-//    virtual void node_split(double impurity,
-//                       SplitRecord *split,
-//                       int* n_constant_features);
+    virtual MemoryUsage memory_usage() const;
+
+public:
+    DataView<DTYPE> X;                  // Input samples, shape [n_samples, n_features]
+    ArenaVector<DTYPE> feature_values;  // temp. array holding feature values
+    ArenaVector<std::pair<DTYPE, int> > sort_buffer;
+                                        // temp. array of (feature value, sample) to sort
 };
 
 /**
  * @brief Splitter for finding the best split
+ *
+ * With bounded_search, the drawn features are first summarized by a
+ * histogram of N_BOUND_BINS equal width bins, from which the criterion
+ * bounds the improvement of any split on the feature. The features are then
+ * sorted and scanned by decreasing bound, and the search stops at the first
+ * bound below the best improvement found.
+ *
+ * Improvement ties go to the lowest feature index, whatever the draw order,
+ * so the bounded and the exhaustive search find the same split, and so does
+ * a FeatureParallelBuilder whatever the columns of its workers.
  */
-class BestSplitter : public BaseDenseSplitter
+template <typename DTYPE>
+class BestSplitter : public BaseDenseSplitter<DTYPE>
 {
 public:
     BestSplitter(Criterion* criterion,
@@ -199,6 +274,18 @@ public:
                  int random_state);
     virtual ~BestSplitter();
 
+    using Splitter::init;
+
+    /**
+     * @brief Initialize the splitter.
+     * @param X
+     * @param y
+     * @param sample_weight
+     */
+    virtual int init(DataView<DTYPE> X,
+                     DataView<double> y,
+                     DataView<double> sample_weight);
+
     /**
      * @brief Find a split on onde samples[start:end].
      * @param impurity
@@ -208,9 +295,44 @@ public:
     virtual void node_split(double impurity,
                             SplitRecord *split,
                             int* n_constant_features);
+
+    virtual MemoryUsage memory_usage() const;
+
+private:
+    /**
+     * @brief Sort active_samples and feature_values along feature.
+     * @return true if the feature is constant in the node
+     */
+    bool sort_feature(int feature);
+
+    /**
+     * @brief Evaluate the splits of the sorted feature, and keep the better
+     * ones in best. On a tie, the lower feature index wins.
+     */
+    void scan_feature(int feature,
+                      double impurity,
+                      SplitRecord* best);
+
+    /**
+     * @brief Upper bound of the improvement of the splits on feature.
+     * @param bound
+     * @return true if the feature is constant in the node, bound is unset
+     */
+    bool feature_bound(int feature,
+                       double* bound);
+
+public:
+    ArenaVector<double> bin_weight;     // Weight of each bin, shape [N_BOUND_BINS]
+    ArenaVector<double> bin_sum;        // Weighted sum of y, shape [N_BOUND_BINS, n_outputs]
+    ArenaVector<double> bin_y_min;      // Min of y, shape [N_BOUND_BINS, n_outputs]
+    ArenaVector<double> bin_y_max;      // Max of y, shape [N_BOUND_BINS, n_outputs]
+    ArenaVector<std::pair<double, int> > candidates;
+                                        // (-bound, feature) of the drawn features,
+                                        // capacity n_features
 };
 
-class RandomSplitter : public BaseDenseSplitter
+template <typename DTYPE>
+class RandomSplitter : public BaseDenseSplitter<DTYPE>
 {
 public:
     /**
@@ -239,7 +361,8 @@ public:
                             int* n_constant_features);
 };
 
-class PresortBestSplitter : public BaseDenseSplitter
+template <typename DTYPE>
+class PresortBestSplitter : public BaseDenseSplitter<DTYPE>
 {
 public:
     /**
@@ -257,24 +380,126 @@ public:
                         int _random_state);
     virtual ~PresortBestSplitter();
 
-    virtual int init(Mat X,
-                     Mat y,
-                     Mat sample_weight);
+    using Splitter::init;
+
+    virtual int init(DataView<DTYPE> X,
+                     DataView<double> y,
+                     DataView<double> sample_weight);
 
     virtual void node_split(double impurity,
                             SplitRecord *split,
                             int *n_constant_features);
 
-public:
-    vector<int> X_argsorted_ptr;
+    virtual MemoryUsage memory_usage() const;
 
-    Mat X_old;
-    Mat X_argsorted;
+public:
+    ArenaVector<int> X_argsorted;       // Sample indices sorted by each feature,
+                                        // X_argsorted[f * n_total_samples + i]
 
     int n_total_samples;
-    vector<uchar> sample_mask;
+    ArenaVector<uchar> sample_mask;
 };
 
+/**
+ * @brief Splitter for finding the best split on binned features.
+ *
+ * Samples of a node are ordered by a counting sort on their bin codes, in
+ * O(n_node_samples + n_bins), instead of a comparison sort, and only the
+ * bin boundaries are evaluated. The threshold of a split after bin b is
+ * the real bin edge X.threshold(feature, b).
+ */
+class BinnedSplitter : public Splitter
+{
+public:
+    BinnedSplitter(Criterion* criterion,
+                   int max_features,
+                   int min_samples_leaf,
+                   double min_weight_leaf,
+                   int random_state);
+    virtual ~BinnedSplitter();
+
+    using Splitter::init;
+
+    /**
+     * @brief Initialize the splitter.
+     * @param X
+     * @param y
+     * @param sample_weight
+     */
+    virtual int init(const BinnedMatrix& X,
+                     DataView<double> y,
+                     DataView<double> sample_weight);
+
+    /**
+     * @brief Find a split on onde samples[start:end].
+     * @param impurity
+     * @param split
+     * @param n_constant_features
+     */
+    virtual void node_split(double impurity,
+                            SplitRecord *split,
+                            int* n_constant_features);
+
+    virtual MemoryUsage memory_usage() const;
+
+private:
+    /**
+     * @brief Counting sort of samples[start:end] by their code in column,
+     * into active_samples, and count the samples of each bin.
+     * @return false if all the samples share one bin
+     */
+    template <typename CTYPE>
+    bool sort_by_bin(const CTYPE* column,
+                     int n_bins);
+
+    /**
+     * @brief Histogram of feature j over the node samples into feature_hist,
+     * from the histogram of its bundle, filled once per node.
+     * @return false if all the samples share one bin
+     */
+    bool bundled_histogram(int j,
+                           int n_bins);
+
+    /**
+     * @brief Count, weight and criterion statistics of every code of bundle
+     * k over samples[start:end], then of the whole node.
+     */
+    void fill_bundle_histogram(int k);
+
+public:
+    const BinnedMatrix* X;              // Binned input samples
+    ArenaVector<int> bin_count;         // Number of node samples in each bin
+    ArenaVector<int> bin_offset;        // Counting sort write positions
+
+    // A bundled X is scanned on histograms of statistics, one pass over the
+    // node samples per bundle rather than per feature
+    int bin_size;                       // Doubles per bin: count, weight, statistics
+    int node_stamp;                     // Number of the current node_split call
+    ArenaVector<int> bundle_start;      // First bin of every bundle in bundle_histograms
+    ArenaVector<int> bundle_stamp;      // node_stamp of the last fill of every bundle
+    ArenaVector<double> bundle_histograms;
+    ArenaVector<double> feature_hist;   // Histogram of the feature being scanned
+    ArenaVector<double> left_stats;     // Statistics of the left child
+};
+
+/**
+ * @brief Mid-point threshold between two consecutive sorted feature values.
+ * The threshold is rounded to DTYPE, and falls back to the lower value when
+ * rounding reaches the upper one, so that lower <= threshold < upper holds
+ * when comparing DTYPE features against it at prediction time.
+ * @param lower
+ * @param upper
+ * @return threshold
+ */
+template <typename DTYPE>
+inline double mid_threshold(DTYPE lower, DTYPE upper)
+{
+    DTYPE threshold = static_cast<DTYPE>((static_cast<double>(lower) + upper) / 2.0);
+    if (threshold == upper)
+        threshold = lower;
+    return threshold;
+}
+
 class BaseSparseSplitter : public Splitter
 {
 public:
@@ -296,17 +521,19 @@ public:
     virtual ~RandomSparseSplitter();
 };
 
+// A generator local to the call, so that concurrent fits draw the same
+// numbers as sequential ones
 inline int rand_int(int low, int high, int random_state)
 {
-    std::srand(random_state);
-    int random_variable = std::rand();
+    std::minstd_rand generator(random_state);
+    int random_variable = static_cast<int>(generator() % RAND_MAX);
     return low + random_variable % (high - low);
 }
 
 inline int rand_double(int low, int high, int random_state)
 {
-    std::srand(random_state);
-    int random_variable = std::rand();
+    std::minstd_rand generator(random_state);
+    int random_variable = static_cast<int>(generator() % RAND_MAX);
     return ((high - low) * (double)random_variable) / RAND_MAX + low;
 }
 
@@ -0,0 +1,205 @@
+#include "transport.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Transport::Transport()
+{
+
+}
+
+Transport::~Transport()
+{
+
+}
+
+SharedMemoryTransport::SharedMemoryTransport()
+    : _header(NULL),
+      _slots(NULL),
+      _length(0),
+      _rank(0),
+      _owner(0)
+{
+
+}
+
+SharedMemoryTransport::~SharedMemoryTransport()
+{
+    _close();
+}
+
+int SharedMemoryTransport::create(const string& name,
+                                  int n_workers,
+                                  int capacity)
+{
+    // Validation
+    if (n_workers < 1 || capacity < 1)
+        return 1;
+
+    _close();
+
+    size_t length = sizeof(Header) + sizeof(double) * static_cast<size_t>(n_workers) * capacity;
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+        return 2;
+    if (ftruncate(fd, length) != 0)
+    {
+        close(fd);
+        shm_unlink(name.c_str());
+        return 2;
+    }
+    void* address = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED)
+    {
+        shm_unlink(name.c_str());
+        return 2;
+    }
+
+    _header = static_cast<Header*>(address);
+    _slots = reinterpret_cast<double*>(_header + 1);
+    _length = length;
+    _rank = 0;
+    _name = name;
+    _owner = getpid();
+
+    // The barrier synchronizes processes, not only threads
+    pthread_barrierattr_t attr;
+    pthread_barrierattr_init(&attr);
+    pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_barrier_init(&_header->barrier, &attr, n_workers);
+    pthread_barrierattr_destroy(&attr);
+    _header->n_workers = n_workers;
+    _header->capacity = capacity;
+    return 0;
+}
+
+int SharedMemoryTransport::attach(const string& name,
+                                  int rank)
+{
+    _close();
+
+    int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0)
+        return 2;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header))
+    {
+        close(fd);
+        return 2;
+    }
+    size_t length = st.st_size;
+    void* address = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED)
+        return 2;
+
+    _header = static_cast<Header*>(address);
+    _slots = reinterpret_cast<double*>(_header + 1);
+    _length = length;
+    _name = name;
+    _owner = 0;
+
+    if (rank < 0 || rank >= _header->n_workers)
+    {
+        _close();
+        return 1;
+    }
+    _rank = rank;
+    return 0;
+}
+
+int SharedMemoryTransport::rank() const
+{
+    return _rank;
+}
+
+int SharedMemoryTransport::size() const
+{
+    return (_header != NULL) ? _header->n_workers : 0;
+}
+
+int SharedMemoryTransport::allreduce_sum(double* data,
+                                         int n)
+{
+    if (_header == NULL)
+        return 1;
+
+    int n_workers = _header->n_workers;
+    int capacity = _header->capacity;
+    double* slot = _slots + static_cast<size_t>(_rank) * capacity;
+
+    for (int offset = 0; offset < n; offset += capacity)
+    {
+        int length = std::min(capacity, n - offset);
+        double* chunk = data + offset;
+        std::memcpy(slot, chunk, sizeof(double) * length);
+
+        // Every contribution is written
+        pthread_barrier_wait(&_header->barrier);
+
+        // Same order on every worker, hence the same rounding
+        std::fill(chunk, chunk + length, 0.0);
+        for (int r = 0; r < n_workers; r++)
+        {
+            const double* other = _slots + static_cast<size_t>(r) * capacity;
+            for (int i = 0; i < length; i++)
+                chunk[i] += other[i];
+        }
+
+        // Every worker has read the slots
+        pthread_barrier_wait(&_header->barrier);
+    }
+    return 0;
+}
+
+int SharedMemoryTransport::broadcast(char* data,
+                                     int n_bytes,
+                                     int root)
+{
+    if (_header == NULL)
+        return 1;
+    if (root < 0 || root >= _header->n_workers)
+        return 1;
+
+    int capacity = static_cast<int>(sizeof(double)) * _header->capacity;
+    char* slot = reinterpret_cast<char*>(_slots + static_cast<size_t>(root) * _header->capacity);
+
+    for (int offset = 0; offset < n_bytes; offset += capacity)
+    {
+        int length = std::min(capacity, n_bytes - offset);
+        if (_rank == root)
+            std::memcpy(slot, data + offset, length);
+
+        // The chunk of the root is written
+        pthread_barrier_wait(&_header->barrier);
+
+        if (_rank != root)
+            std::memcpy(data + offset, slot, length);
+
+        // Every worker has read it
+        pthread_barrier_wait(&_header->barrier);
+    }
+    return 0;
+}
+
+void SharedMemoryTransport::_close()
+{
+    if (_header == NULL)
+        return;
+
+    bool is_owner = (_owner == getpid());
+    if (is_owner)
+        pthread_barrier_destroy(&_header->barrier);
+    munmap(_header, _length);
+    if (is_owner)
+        shm_unlink(_name.c_str());
+
+    _header = NULL;
+    _slots = NULL;
+    _length = 0;
+    _owner = 0;
+}
@@ -0,0 +1,135 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+//========================================
+// Transport
+// Collective operations between the workers of a distributed fit
+//========================================
+
+#include <pthread.h>
+#include <stddef.h>
+#include <string>
+using std::string;
+
+/**
+ * @brief Communication between n workers, each knowing its rank in [0, n).
+ *
+ * Every worker must call the collective operations in the same order with
+ * the same sizes. The reductions sum the contributions in rank order, so
+ * every worker gets the same bits whatever the timing.
+ */
+class Transport
+{
+public:
+    Transport();
+    virtual ~Transport();
+
+    /**
+     * @brief Rank of this worker, in [0, size())
+     */
+    virtual int rank() const=0;
+
+    /**
+     * @brief Number of workers
+     */
+    virtual int size() const=0;
+
+    /**
+     * @brief Sum data element-wise over all the workers, in place.
+     * @param data shape [n], replaced by the sum on every worker
+     * @param n
+     * @return error_code
+     */
+    virtual int allreduce_sum(double* data,
+                              int n)=0;
+
+    /**
+     * @brief Copy the data of worker root to all the workers.
+     * @param data shape [n_bytes], read on root, replaced on the others
+     * @param n_bytes
+     * @param root Rank of the sender
+     * @return error_code
+     */
+    virtual int broadcast(char* data,
+                          int n_bytes,
+                          int root)=0;
+};
+
+/**
+ * @brief Transport between the processes of one host, through a POSIX
+ * shared memory segment.
+ *
+ * The segment holds a process-shared barrier and one slot of capacity
+ * doubles per worker. An allreduce goes chunk by chunk: every worker copies
+ * its chunk into its slot, waits on the barrier, sums the slots of all the
+ * ranks in order, then waits again before the slots are reused. A
+ * broadcast goes the same way through the slot of the root only.
+ *
+ * The segment is created once, before the workers start, then every worker
+ * attaches to it with its rank. A worker forked after create may also use
+ * the creator's object as rank 0.
+ */
+class SharedMemoryTransport : public Transport
+{
+public:
+    SharedMemoryTransport();
+    virtual ~SharedMemoryTransport();
+
+    /**
+     * @brief Create the segment, and attach to it as rank 0.
+     * @param name Name of the segment, "/name"
+     * @param n_workers
+     * @param capacity Doubles exchanged per worker and per round, larger
+     * reductions go in several rounds
+     * @return error_code, 1 for invalid arguments, 2 if the segment cannot be created
+     */
+    int create(const string& name,
+               int n_workers,
+               int capacity);
+
+    /**
+     * @brief Attach to a segment made by create.
+     * @param name Name of the segment
+     * @param rank Rank of this worker
+     * @return error_code, 1 for an invalid rank, 2 if the segment cannot be opened
+     */
+    int attach(const string& name,
+               int rank);
+
+    virtual int rank() const;
+
+    virtual int size() const;
+
+    virtual int allreduce_sum(double* data,
+                              int n);
+
+    virtual int broadcast(char* data,
+                          int n_bytes,
+                          int root);
+
+private:
+    /**
+     * @brief Unmap the segment, and unlink it in the process that created it
+     */
+    void _close();
+
+private:
+    /**
+     * @brief Head of the segment, followed by the slots
+     */
+    struct Header
+    {
+        pthread_barrier_t barrier;
+        int n_workers;
+        int capacity;
+    };
+
+    Header* _header;
+    double* _slots;             // Slot of rank r at _slots + r * capacity
+    size_t _length;             // Bytes mapped
+    int _rank;
+    string _name;
+    int _owner;                 // Pid of the creating process, 0 if attached
+};
+
+#endif // TRANSPORT_H
@@ -1,12 +1,17 @@
 #include "tree.h"
 #include <stdlib.h>
 #include <algorithm>
+#include <cmath>
 using std::max;
 #include <set>
+#include <pthread.h>
 #include "criterion.h"
 #include "splitter.h"
 #include "basetree.h"
 #include "treebuilder.h"
+#include "binnedmatrix.h"
+#include "arena.h"
+#include "transport.h"
 #include "util.h"
 
 BaseDecisionTree::BaseDecisionTree(char* criterion_name,
@@ -29,18 +34,36 @@ BaseDecisionTree::BaseDecisionTree(char* criterion_name,
       _min_weight_fraction_leaf(min_weight_fraction_leaf),
       _max_features(max_features),
       _max_leaf_nodes(max_leaf_nodes),
+      _max_bins(256),
+      _max_conflict_rate(-1.0),
+      _ccp_alpha(0.0),
+      _bounded_search(false),
       _random_state(random_state),
       _class_weight(class_weight),
       _n_samples(0),
       _n_features(0),
-      _is_classification(is_classification)
+      _n_outputs(1),
+      _is_classification(is_classification),
+      _dtype(CV_64F),
+      _criterion(NULL),
+      _splitter(NULL),
+      _tree(NULL),
+      _tree_builder(NULL),
+      _arena(NULL),
+      _transport(NULL),
+      _numa_placement(NUMA_NONE),
+      _compressed(NULL)
 {
 
 }
 
 BaseDecisionTree::~BaseDecisionTree()
 {
-
+    delete _tree_builder;
+    delete _splitter;
+    delete _criterion;
+    delete _tree;
+    delete _compressed;
 }
 
 int BaseDecisionTree::fit(Mat X,
@@ -49,18 +72,383 @@ int BaseDecisionTree::fit(Mat X,
 {
     // Validation
     if (X.rows == 0 || X.cols == 0)
-        return 1;
+        return _agree_shards(1);
+
+    // The tree works on float or double buffers
+    if (X.depth() != CV_32F && X.depth() != CV_64F)
+        X.convertTo(X, CV_64F);
+
+    // Reshape a vector y to shape[n_samples, 1], a matrix y holds one
+    // column per output
+    to_target(y);
+    to_target(sample_weight);
+
+    if (X.depth() == CV_32F)
+        return fit(as_view<float>(X),
+                   as_view<double>(y),
+                   as_view<double>(sample_weight));
+    return fit(as_view<double>(X),
+               as_view<double>(y),
+               as_view<double>(sample_weight));
+}
+
+int BaseDecisionTree::fit(DataView<double> X,
+                          DataView<double> y,
+                          DataView<double> sample_weight)
+{
+    _dtype = CV_64F;
+    return _fit_dense(X, y, sample_weight);
+}
+
+int BaseDecisionTree::fit(DataView<float> X,
+                          DataView<double> y,
+                          DataView<double> sample_weight)
+{
+    _dtype = CV_32F;
+    return _fit_dense(X, y, sample_weight);
+}
+
+int BaseDecisionTree::fit(const BinnedMatrix& X,
+                          DataView<double> y,
+                          DataView<double> sample_weight)
+{
+    // Bin edges are plain doubles
+    _dtype = CV_64F;
+    cpu_set_t affinity;
+    bool pinned = _pin_worker(affinity);
+    int error = _fit(X, y, sample_weight);
+    _unpin_worker(pinned, affinity);
+    return error;
+}
+
+DataView<double> BaseDecisionTree::_apply_class_weight(DataView<double> y,
+                                                       DataView<double> sample_weight)
+{
+    if (_class_weight.total() == 0)
+        return sample_weight;
+
+    // The caller's buffer is read-only, so class weights are applied on a copy
+    int n_samples = y.rows;
+    _sample_weight.resize(n_samples);
+    for (int i = 0; i < n_samples; i++)
+    {
+        double w = sample_weight.empty() ? 1.0 : sample_weight.at(i);
+        int index = static_cast<int>(y.at(i));
+        _sample_weight.at(i) = w * _class_weight.at<double>(index, 0);
+    }
+    return DataView<double>(_sample_weight.data(), n_samples, 1);
+}
+
+template <typename DTYPE>
+int BaseDecisionTree::_fit_dense(DataView<DTYPE> X,
+                                 DataView<double> y,
+                                 DataView<double> sample_weight)
+{
+    // The row shards of a data-parallel fit must share their bin edges
+    if (_transport != NULL && _feature_indices.empty())
+        return _agree_shards(3);
+
+    // Before binning, so that the columns of the worker are local to its node
+    cpu_set_t affinity;
+    bool pinned = _pin_worker(affinity);
+
+    int error;
+    if (strcmp(_splitter_name, "Binned") == 0)
+    {
+        BinnedMatrix binned;
+        if (binned.fit(X, _max_bins) != 0 ||
+            (_max_conflict_rate >= 0.0 && binned.bundle(_max_conflict_rate) != 0))
+            error = _agree_shards(3);
+        else
+        {
+            error = _fit(binned, y, sample_weight);
+
+            // X is held next to the codes binned from it
+            _fit_memory.add("dataset.dense", static_cast<size_t>(X.rows) * X.cols * sizeof(DTYPE));
+        }
+    }
+    else
+        error = _fit(X, y, sample_weight);
+    _unpin_worker(pinned, affinity);
+    return error;
+}
+
+/**
+ * @brief Capacity of a vector grown by doubling to n elements
+ */
+static size_t pow2_ceil(size_t n)
+{
+    size_t capacity = 1;
+    while (capacity < n)
+        capacity *= 2;
+    return capacity;
+}
+
+/**
+ * @brief Bytes of the training set as the splitter reads it
+ */
+template <typename DTYPE>
+static MemoryUsage dataset_usage(const DataView<DTYPE>& X)
+{
+    MemoryUsage usage;
+    usage.add("dense", static_cast<size_t>(X.rows) * X.cols * sizeof(DTYPE));
+    return usage;
+}
+
+static MemoryUsage dataset_usage(const BinnedMatrix& X)
+{
+    return X.memory_usage();
+}
+
+template <typename XTYPE>
+void BaseDecisionTree::_record_fit_memory(const XTYPE& X,
+                                          const Arena& arena)
+{
+    MemoryUsage splitter_usage = _splitter->memory_usage();
+    MemoryUsage criterion_usage = _criterion->memory_usage();
+
+    // Besides the scratch vectors of the splitter and the criterion, the
+    // arena holds the stack or the frontier of the builder, with the buffers
+    // they outgrew, and the nodes of the median heaps of MAE. Only the
+    // calculators of MAE are on the heap.
+    size_t scratch = splitter_usage.total() + criterion_usage.total() - criterion_usage.bytes("calculators");
+    size_t peak = arena.high_water_mark();
+
+    _fit_memory = MemoryUsage();
+    _fit_memory.add("dataset", dataset_usage(X));
+    _fit_memory.add("splitter", splitter_usage);
+    _fit_memory.add("criterion", criterion_usage);
+    _fit_memory.add("builder", (peak > scratch) ? peak - scratch : 0);
+    _fit_memory.add("tree", _tree->memory_usage());
+    _fit_memory.add("sample_weight", vector_bytes(_sample_weight));
+}
+
+MemoryUsage BaseDecisionTree::memory_usage() const
+{
+    MemoryUsage usage;
+    if (_tree != NULL)
+        usage.add("tree", _tree->memory_usage());
+    if (_compressed != NULL)
+        usage.add("compressed", _compressed->memory_bytes());
+    usage.add("sample_weight", vector_bytes(_sample_weight));
+    return usage;
+}
+
+MemoryUsage BaseDecisionTree::estimate_fit_memory(int n_samples,
+                                                  int n_features,
+                                                  int n_outputs,
+                                                  int n_classes,
+                                                  int dtype) const
+{
+    size_t n = static_cast<size_t>(std::max(n_samples, 0));
+    size_t d = static_cast<size_t>(std::max(n_features, 0));
+    size_t value_size = (dtype == CV_32F) ? sizeof(float) : sizeof(double);
+    bool is_binned = (strcmp(_splitter_name, "Binned") == 0);
+    bool is_classifier = (strcmp(_criterion_name, "Gini") == 0 || strcmp(_criterion_name, "Entropy") == 0);
+    bool is_mae = (strcmp(_criterion_name, "MAE") == 0);
+    size_t n_values = is_classifier ? static_cast<size_t>(n_classes) : static_cast<size_t>(n_outputs);
+    MemoryUsage usage;
+
+    // Training set: X, and the codes binned from it
+    usage.add("dataset.dense", n * d * value_size);
+    if (is_binned)
+    {
+        // Edges are pushed back, at most max_bins - 1 of them
+        size_t n_edges = std::min(static_cast<size_t>(std::max(_max_bins - 1, 1)), n);
+        usage.add("dataset.bin_edges", d * (sizeof(vector<double>) + pow2_ceil(n_edges) * sizeof(double)));
+
+        // Bundling encodes the codes into as many as a bundle per feature
+        size_t codes = n * d * ((_max_bins > 256) ? sizeof(uint16_t) : sizeof(uint8_t));
+        if (_max_conflict_rate >= 0.0)
+        {
+            codes += n * d * sizeof(uint16_t);
+            usage.add("dataset.bundles", pow2_ceil(d) * (sizeof(vector<int>) + 4 * sizeof(int)) + 2 * d * sizeof(int));
+        }
+        usage.add("dataset.codes", codes);
+    }
+
+    // Splitter
+    usage.add("splitter.samples", 2 * n * sizeof(int));
+    usage.add("splitter.features", 2 * d * sizeof(int));
+    size_t n_stats = is_classifier ? n_values : (is_mae ? 0 : 2 * n_values);
+    if (is_binned)
+    {
+        size_t histograms = 2 * static_cast<size_t>(_max_bins) * sizeof(int);
+        if (_max_conflict_rate >= 0.0)
+        {
+            size_t bin_size = 2 + n_stats;
+            histograms += ((d + 1) * _max_bins + d) * bin_size * sizeof(double) + 2 * (d + 1) * sizeof(int);
+        }
+        usage.add("splitter.histograms", histograms);
+    }
+    else
+    {
+        usage.add("splitter.feature_values", n * (value_size + ((dtype == CV_32F) ? sizeof(std::pair<float, int>)
+                                                                              : sizeof(std::pair<double, int>))));
+        if (_bounded_search && strcmp(_splitter_name, "Best") == 0)
+        {
+            usage.add("splitter.histograms", (1 + 3 * n_values) * N_BOUND_BINS * sizeof(double));
+            usage.add("splitter.candidates", d * sizeof(std::pair<double, int>));
+            usage.add("criterion.bound_sum", n_values * sizeof(double));
+        }
+    }
+
+    // Criterion
+    if (is_classifier)
+        usage.add("criterion.label_counts", 3 * n_values * sizeof(double));
+    else
+    {
+        usage.add("criterion.sums", 6 * n_values * sizeof(double));
+        // The heaps of MAE hold each sample in total and in left or right,
+        // and a node more while a calculator rebalances
+        if (is_mae)
+            usage.add("criterion.medians", (2 * n + 1) * n_values * (sizeof(std::pair<double, double>) + 4 * sizeof(void*)) +
+                                           3 * n_values * sizeof(WeightedMedianCalculator));
+    }
+
+    // Tree: a leaf per min_samples_leaf samples at most, within the depth
+    // and leaf limits, in vectors grown by doubling
+    size_t n_leaves = std::max(n / static_cast<size_t>(std::max(_min_samples_leaf, 1)), static_cast<size_t>(1));
+    if (_max_depth > 0 && _max_depth < 62)
+        n_leaves = std::min(n_leaves, static_cast<size_t>(1) << _max_depth);
+    if (_max_leaf_nodes > 0)
+        n_leaves = std::min(n_leaves, static_cast<size_t>(_max_leaf_nodes));
+    size_t n_nodes = 2 * n_leaves - 1;
+    size_t capacity = pow2_ceil(n_nodes);
+    usage.add("tree.nodes", capacity * sizeof(Node));
+    usage.add("tree.values", capacity * sizeof(vector<double>) + n_nodes * n_values * sizeof(double));
+    usage.add("tree.leaf_tables", n_nodes * n_outputs * sizeof(double) +
+                                  (is_classifier ? n_nodes * sizeof(int) + 2 * n_leaves * n_values * sizeof(double) : 0));
+
+    // Builder: a frontier of at most a node per leaf, or a stack of at most
+    // a node per level, a level per leaf for a chain, in the arena with the
+    // buffers it outgrew
+    if (_max_leaf_nodes > 0)
+        usage.add("builder", 2 * pow2_ceil(n_leaves) * sizeof(P));
+    else
+    {
+        size_t n_levels = n_leaves;
+        if (_max_depth > 0)
+            n_levels = std::min(n_levels, static_cast<size_t>(_max_depth));
+        usage.add("builder", 2 * pow2_ceil(n_levels + 1) * sizeof(N));
+    }
+
+    if (_class_weight.total() != 0)
+        usage.add("sample_weight", n * sizeof(double));
+    return usage;
+}
+
+bool BaseDecisionTree::_pin_worker(cpu_set_t& affinity)
+{
+    if (_transport == NULL || _numa_placement == NUMA_NONE || _transport->size() < 1)
+        return false;
+    if (pthread_getaffinity_np(pthread_self(), sizeof(affinity), &affinity) != 0)
+        return false;
+    pin_to_numa_node(numa_node_of(_transport->rank(), _transport->size(), _numa_placement));
+    return true;
+}
+
+void BaseDecisionTree::_unpin_worker(bool pinned,
+                                     const cpu_set_t& affinity)
+{
+    if (pinned)
+        pthread_setaffinity_np(pthread_self(), sizeof(affinity), &affinity);
+}
+
+template <typename DTYPE>
+Splitter* BaseDecisionTree::_new_splitter(const DataView<DTYPE>& /*X*/,
+                                          int max_features,
+                                          int min_samples_leaf,
+                                          double min_weight_leaf)
+{
+    if (strcmp(_splitter_name, "Best") == 0)
+        return new BestSplitter<DTYPE>(_criterion,
+                                       max_features,
+                                       min_samples_leaf,
+                                       min_weight_leaf,
+                                       _random_state);
+    else if (strcmp(_splitter_name, "Random") == 0)
+        return new RandomSplitter<DTYPE>(_criterion,
+                                         max_features,
+                                         min_samples_leaf,
+                                         min_weight_leaf,
+                                         _random_state);
+    return NULL;
+}
+
+Splitter* BaseDecisionTree::_new_splitter(const BinnedMatrix& /*X*/,
+                                          int max_features,
+                                          int min_samples_leaf,
+                                          double min_weight_leaf)
+{
+    if (strcmp(_splitter_name, "Binned") == 0)
+        return new BinnedSplitter(_criterion,
+                                  max_features,
+                                  min_samples_leaf,
+                                  min_weight_leaf,
+                                  _random_state);
+    return NULL;
+}
+
+// Whether X is read through bundles of features, which need the histograms
+// of additive statistics of BinnedSplitter
+static bool is_bundled(const BinnedMatrix& X)
+{
+    return X.is_bundled();
+}
+
+template <typename DTYPE>
+static bool is_bundled(const DataView<DTYPE>& /*X*/)
+{
+    return false;
+}
+
+template <typename XTYPE>
+int BaseDecisionTree::_validate(const XTYPE& X,
+                                DataView<double> y,
+                                DataView<double> sample_weight)
+{
+    bool data_parallel = (_transport != NULL && _feature_indices.empty());
+    bool feature_parallel = (_transport != NULL && !_feature_indices.empty());
 
     // Determine output setting
     _n_samples = X.rows;
     _n_features = X.cols;
+    _n_outputs = y.cols;
 
-    // Reshape y to shape[n_samples, 1]
-    y = y.reshape(1, y.total());
+    // Validation
+    // The row shard of a worker of a data-parallel fit may be empty, it
+    // contributes empty histograms
+    bool empty_shard = (data_parallel && X.rows == 0 && y.rows == 0);
+    if (X.cols == 0 && !empty_shard)
+        return 1;
+    if (X.rows == 0 && !data_parallel)
+        return 1;
 
     // Validation
-    if (y.rows != _n_samples)
+    // Several outputs are only supported for regression
+    if (!empty_shard)
+    {
+        if (y.rows != _n_samples || y.cols < 1)
+            return 2;
+        if (_is_classification == 0 && y.cols != 1)
+            return 2;
+    }
+    if (!sample_weight.empty() &&
+        (sample_weight.rows != _n_samples || sample_weight.cols != 1))
+        return 2;
+    for (int r = 0; r < _sample_indices.rows; r++)
+    {
+        if (_sample_indices.at(r) < 0 || _sample_indices.at(r) >= _n_samples)
+            return 2;
+    }
+    if (feature_parallel && _feature_indices.rows != _n_features)
         return 2;
+    for (int c = 0; c < _feature_indices.rows; c++)
+    {
+        if (_feature_indices.at(c) < 0)
+            return 2;
+    }
 
     // Validation
     if (_max_depth < 0)
@@ -75,49 +463,139 @@ int BaseDecisionTree::fit(Mat X,
         return 3;
     if (_min_weight_fraction_leaf < 0. || _min_weight_fraction_leaf > 1.0)
         return 3;
+    // A distributed fit grows depth-first, on histograms of binned shards
+    // when data-parallel
+    if (_transport != NULL && (_max_leaf_nodes > 0 || _transport->size() < 1))
+        return 3;
+    if (data_parallel &&
+        (strcmp(_splitter_name, "Binned") != 0 ||
+         strcmp(_criterion_name, "MAE") == 0))
+        return 3;
+    if (is_bundled(X) && (data_parallel || strcmp(_criterion_name, "MAE") == 0))
+        return 3;
+    return 0;
+}
 
-    // Validation
-    if (_max_depth == 0)
-        _max_depth = static_cast<int>(pow(2, 31) - 1);      // max_depth is arbitrary
-    if (_max_features == 0)
-        _max_features = _n_features;                        // use all feature
-    else if (_max_features > 0.0 && _max_features < 1.0)
-        _max_features = static_cast<int>(_max_features * _n_features);  // use _max_features * _n_features
-    if (_min_samples_leaf < 1)
-        _min_samples_leaf = 1;
-    if (_min_samples_split < 2)
-        _min_samples_split = 2;
-    if (_max_leaf_nodes == 0)
-        _max_leaf_nodes = -1;                               // available when use best_build
+int BaseDecisionTree::_agree_shards(int error)
+{
+    if (_transport == NULL || _transport->size() < 1)
+        return error;
+
+    // Every worker posts its error code and its number of outputs, 0 for an
+    // empty shard, so that all the workers return together
+    int n_workers = _transport->size();
+    vector<double> shards(2 * n_workers, 0.0);
+    shards[_transport->rank()] = error;
+    shards[n_workers + _transport->rank()] = (_n_samples > 0) ? _n_outputs : 0;
+    _transport->allreduce_sum(&shards[0], shards.size());
+
+    error = static_cast<int>(*std::max_element(shards.begin(), shards.begin() + n_workers));
+    int n_outputs = static_cast<int>(*std::max_element(shards.begin() + n_workers, shards.end()));
+    if (error != 0)
+        return error;
+    if (n_outputs == 0)
+        return 1;                                           // every shard is empty
+    for (int r = 0; r < n_workers; r++)
+    {
+        if (shards[n_workers + r] != 0 && shards[n_workers + r] != n_outputs)
+            return 2;
+    }
+    _n_outputs = n_outputs;
+    return 0;
+}
+
+template <typename XTYPE>
+int BaseDecisionTree::_fit(const XTYPE& X,
+                           DataView<double> y,
+                           DataView<double> sample_weight)
+{
+    // Validation, agreed by all the workers of a distributed fit before
+    // their first collective
+    int error = _agree_shards(_validate(X, y, sample_weight));
+    if (error != 0)
+        return error;
+    bool data_parallel = (_transport != NULL && _feature_indices.empty());
+    bool feature_parallel = (_transport != NULL && !_feature_indices.empty());
+
+    // An empty shard has the outputs of the other shards
+    if (_n_samples == 0)
+        y = DataView<double>(NULL, 0, _n_outputs);
+
+    // The tree of a feature-parallel fit splits on the global feature indices
+    if (feature_parallel)
+    {
+        vector<double> shard_features(_transport->size(), 0.0);
+        for (int c = 0; c < _feature_indices.rows; c++)
+            shard_features[_transport->rank()] = max(shard_features[_transport->rank()],
+                                                     _feature_indices.at(c) + 1.0);
+        _transport->allreduce_sum(&shard_features[0], _transport->size());
+        _n_features = static_cast<int>(*std::max_element(shard_features.begin(), shard_features.end()));
+    }
+
+    // Resolve the parameters of this fit, the constructor arguments are
+    // kept for the next fit or a copy of the estimator
+    int max_depth = _max_depth;
+    if (max_depth == 0)
+        max_depth = static_cast<int>(pow(2, 31) - 1);       // max_depth is arbitrary
+    int max_features = _max_features;
+    if (max_features == 0)
+        max_features = _n_features;                         // use all feature
+    else if (max_features > 0.0 && max_features < 1.0)
+        max_features = static_cast<int>(max_features * _n_features);    // use max_features * _n_features
+    int min_samples_leaf = _min_samples_leaf;
+    if (min_samples_leaf < 1)
+        min_samples_leaf = 1;
+    int min_samples_split = _min_samples_split;
+    if (min_samples_split < 2)
+        min_samples_split = 2;
+    int max_leaf_nodes = _max_leaf_nodes;
+    if (max_leaf_nodes == 0)
+        max_leaf_nodes = -1;                                // available when use best_build
 
     // Get _n_classes
     std::set<double> s;
-    for (int i = 0; i < y.total(); i++)
+    for (int i = 0; i < _n_samples; i++)
     {
-        s.insert(y.at<double>(i));
+        s.insert(y.at(i));
     }
     int _n_classes = s.size();
 
-    // Calculate class_weight
-    Mat expended_class_weight = Mat::ones(_n_samples, 1, CV_64F);
-
-    // Get class_weight
-    if (_class_weight.total() != 0)
-        expended_class_weight = compute_sample_weight(_class_weight, y);
+    // Some classes may only be in the shards of other workers
+    if (data_parallel && _is_classification == 0)
+    {
+        vector<double> shard_classes(_transport->size(), 0.0);
+        shard_classes[_transport->rank()] = s.empty() ? 0.0 : *s.rbegin() + 1.0;
+        _transport->allreduce_sum(&shard_classes[0], _transport->size());
+        _n_classes = static_cast<int>(*std::max_element(shard_classes.begin(), shard_classes.end()));
+    }
 
     // Set samples' weight
-    for (int i = 0; i < sample_weight.total(); i++)
-        sample_weight.at<double>(i, 0) = sample_weight.at<double>(i, 0) * \
-                                         expended_class_weight.at<double>(i, 0);
+    sample_weight = _apply_class_weight(y, sample_weight);
 
-    // Set min_weight_fraction_leaf
+    // Set min_weight_leaf, a fraction of the weight of the trained rows
+    double min_weight_leaf = 0.;
     if (_min_weight_fraction_leaf != 0.)
-        _min_weight_fraction_leaf = _min_weight_fraction_leaf * cv::sum(sample_weight)[0];
-    else
-        _min_weight_fraction_leaf = 0.;
+    {
+        double weight_sum = 0.0;
+        int n_rows = _sample_indices.empty() ? _n_samples : _sample_indices.rows;
+        for (int r = 0; r < n_rows; r++)
+        {
+            int i = _sample_indices.empty() ? r : _sample_indices.at(r);
+            weight_sum += sample_weight.empty() ? 1.0 : sample_weight.at(i);
+        }
+        if (data_parallel)
+            _transport->allreduce_sum(&weight_sum, 1);
+        min_weight_leaf = _min_weight_fraction_leaf * weight_sum;
+    }
 
     // Set min_samples_split
-    _min_samples_split = max(_min_samples_split, 2 * _min_samples_leaf);
+    min_samples_split = max(min_samples_split, 2 * min_samples_leaf);
+
+    // Release the tree of a previous fit
+    delete _tree;
+    _tree = NULL;
+    delete _compressed;
+    _compressed = NULL;
 
     // Select a Criterion
     if (strcmp(_criterion_name, "Gini") == 0)
@@ -128,56 +606,359 @@ int BaseDecisionTree::fit(Mat X,
         _criterion = new MSE();
     else if (strcmp(_criterion_name, "FriedmanMSE") == 0)
         _criterion = new FriedmanMSE();
+    else if (strcmp(_criterion_name, "MAE") == 0)
+        _criterion = new MAE();
     else
         exit(1);
 
     // Select a Splitter
-    if (strcmp(_splitter_name, "Best") == 0)
-        _splitter = new BestSplitter(_criterion,
-                                     _max_features,
-                                     _min_samples_leaf,
-                                     _min_weight_fraction_leaf,
-                                     _random_state);
-    else if (strcmp(_splitter_name, "Random") == 0)
-        _splitter = new RandomSplitter(_criterion,
-                                       _max_features,
-                                       _min_samples_leaf,
-                                       _min_weight_fraction_leaf,
-                                       _random_state);
-    else
+    _splitter = _new_splitter(X, max_features, min_samples_leaf, min_weight_leaf);
+    if (_splitter == NULL)
         exit(1);
 
     // Select a Tree
-    _tree = new Tree(_n_features, _n_classes);
+    _tree = new Tree(_n_features, _n_classes, _n_outputs);
 
     // Select a Tree Builder
-    if (_max_leaf_nodes < 0)
+    if (feature_parallel)
+        _tree_builder = new FeatureParallelBuilder(_splitter,
+                                                   _transport,
+                                                   _feature_indices,
+                                                   min_samples_split,
+                                                   min_samples_leaf,
+                                                   min_weight_leaf,
+                                                   max_depth);
+    else if (data_parallel)
+        _tree_builder = new DataParallelBuilder(static_cast<BinnedSplitter*>(_splitter),
+                                                _transport,
+                                                (_is_classification == 0) ? _n_classes : 0,
+                                                min_samples_split,
+                                                min_samples_leaf,
+                                                min_weight_leaf,
+                                                max_depth);
+    else if (max_leaf_nodes < 0)
         _tree_builder = new DepthFirstBuilder(_splitter,
-                                              _min_samples_split,
-                                              _min_samples_leaf,
-                                              _min_weight_fraction_leaf,
-                                              _max_depth,
-                                              _max_leaf_nodes);
+                                              min_samples_split,
+                                              min_samples_leaf,
+                                              min_weight_leaf,
+                                              max_depth,
+                                              max_leaf_nodes);
     else
         _tree_builder = new BestFirstTreeBuilder(_splitter,
-                                                 _min_samples_split,
-                                                 _min_samples_leaf,
-                                                 _min_weight_fraction_leaf,
-                                                 _max_depth,
-                                                 _max_leaf_nodes);
+                                                 min_samples_split,
+                                                 min_samples_leaf,
+                                                 min_weight_leaf,
+                                                 max_depth,
+                                                 max_leaf_nodes);
+
+    // All the scratch memory of the fit comes from one arena
+    Arena local_arena;
+    Arena* arena = (_arena != NULL) ? _arena : &local_arena;
+    _criterion->arena = arena;
+    _splitter->arena = arena;
+    _splitter->bounded_search = _bounded_search;
+    _splitter->sample_indices = _sample_indices;
+    arena->reset_high_water_mark();
 
     // Build a tree
-    _tree_builder->build(_tree, X, y, sample_weight);
+    error = _tree_builder->build(_tree, X, y, sample_weight);
+    _tree->normalize_leaves();
+    _record_fit_memory(X, *arena);
+
+    // Only the tree outlives the fit
+    delete _tree_builder;
+    delete _splitter;
+    delete _criterion;
+    _tree_builder = NULL;
+    _splitter = NULL;
+    _criterion = NULL;
+    arena->reset();
+
+    if (error == 0 && _ccp_alpha > 0.0)
+        error = prune(_ccp_alpha);
+    return error;
 }
 
 Mat BaseDecisionTree::predict(Mat X)
 {
+    // Predict with the feature type the tree was trained on
+    if (X.depth() != _dtype)
+        X.convertTo(X, _dtype);
+
+    if (_dtype == CV_32F)
+        return predict(as_view<float>(X));
+    return predict(as_view<double>(X));
+}
+
+Mat BaseDecisionTree::predict(DataView<double> X)
+{
+    if (_tree == NULL && _compressed != NULL)
+        return _compressed->predict(X);
     return _tree->predict(X);
 }
 
+Mat BaseDecisionTree::predict(DataView<float> X)
+{
+    if (_tree == NULL && _compressed != NULL)
+        return _compressed->predict(X);
+    return _tree->predict(X);
+}
+
+Mat BaseDecisionTree::apply(Mat X,
+                            int n_threads)
+{
+    if (_tree == NULL)
+        return Mat();
+
+    if (X.depth() != _dtype)
+        X.convertTo(X, _dtype);
+    if (_dtype == CV_32F)
+        return _tree->apply(as_view<float>(X), n_threads);
+    return _tree->apply(as_view<double>(X), n_threads);
+}
+
+int BaseDecisionTree::compress(ThresholdCoding coding,
+                               CompressionReport& report,
+                               Mat X_check,
+                               bool release_tree)
+{
+    report = CompressionReport();
+    if (_tree == NULL)
+        return 1;
+
+    CompressedTree* compressed = new CompressedTree();
+    if (compressed->compress(*_tree, coding, report) != 0)
+    {
+        delete compressed;
+        return 2;
+    }
+    delete _compressed;
+    _compressed = compressed;
+
+    if (!X_check.empty())
+    {
+        if (X_check.depth() != _dtype)
+            X_check.convertTo(X_check, _dtype);
+        Mat original;
+        Mat result;
+        if (_dtype == CV_32F)
+        {
+            original = _tree->predict(as_view<float>(X_check));
+            result = _compressed->predict(as_view<float>(X_check));
+        }
+        else
+        {
+            original = _tree->predict(as_view<double>(X_check));
+            result = _compressed->predict(as_view<double>(X_check));
+        }
+        for (int i = 0; i < result.rows; i++)
+        {
+            for (int k = 0; k < result.cols; k++)
+                report.max_error = max(report.max_error,
+                                       fabs(result.at<double>(i, k) - original.at<double>(i, k)));
+        }
+        report.n_checked = X_check.rows;
+    }
+
+    if (release_tree)
+    {
+        delete _tree;
+        _tree = NULL;
+    }
+    return 0;
+}
+
+int BaseDecisionTree::bin_thresholds(const BinnedMatrix& quantizer)
+{
+    if (_tree == NULL)
+        return 1;
+    int error_code = _tree->bin_thresholds(quantizer);
+    if (error_code != 0)
+        return error_code + 1;
+    return 0;
+}
+
+Mat BaseDecisionTree::predict_binned(DataView<uint8_t> codes,
+                                     int n_threads)
+{
+    if (_tree == NULL)
+        return Mat();
+    return _tree->predict_binned(codes, n_threads);
+}
+
+Mat BaseDecisionTree::predict_binned(DataView<uint16_t> codes,
+                                     int n_threads)
+{
+    if (_tree == NULL)
+        return Mat();
+    return _tree->predict_binned(codes, n_threads);
+}
+
+CsrMatrix BaseDecisionTree::decision_path(Mat X,
+                                          int n_threads)
+{
+    if (_tree == NULL)
+    {
+        CsrMatrix path;
+        path.rows = X.rows;
+        path.cols = 0;
+        path.indptr.assign(X.rows + 1, 0);
+        return path;
+    }
+
+    if (X.depth() != _dtype)
+        X.convertTo(X, _dtype);
+    if (_dtype == CV_32F)
+        return _tree->decision_path(as_view<float>(X), n_threads);
+    return _tree->decision_path(as_view<double>(X), n_threads);
+}
+
+int BaseDecisionTree::refit_leaves(Mat X,
+                                   Mat y,
+                                   Mat sample_weight,
+                                   int n_threads)
+{
+    if (_tree == NULL)
+        return 1;
+
+    // Same conversions as fit, X takes the feature type of the tree
+    if (X.depth() != _dtype)
+        X.convertTo(X, _dtype);
+    to_target(y);
+    to_target(sample_weight);
+
+    // The leaves hold the node_value of the criterion
+    int statistic;
+    if (strcmp(_criterion_name, "Gini") == 0 || strcmp(_criterion_name, "Entropy") == 0)
+        statistic = LEAF_CLASS_COUNT;
+    else if (strcmp(_criterion_name, "MSE") == 0 || strcmp(_criterion_name, "FriedmanMSE") == 0)
+        statistic = LEAF_MEAN;
+    else if (strcmp(_criterion_name, "MAE") == 0)
+        statistic = LEAF_MEDIAN;
+    else
+        exit(1);
+
+    DataView<double> y_view = as_view<double>(y);
+    if (y_view.rows != X.rows)
+        return 2;
+    DataView<double> weight_view = _apply_class_weight(y_view, as_view<double>(sample_weight));
+    delete _compressed;
+    _compressed = NULL;
+
+    if (_dtype == CV_32F)
+        return _tree->refit_leaves(as_view<float>(X), y_view, weight_view, statistic, n_threads);
+    return _tree->refit_leaves(as_view<double>(X), y_view, weight_view, statistic, n_threads);
+}
+
+Mat BaseDecisionTree::shap_values(Mat X,
+                                  Mat background,
+                                  int output,
+                                  int n_threads)
+{
+    if (_tree == NULL)
+        return Mat();
+
+    if (X.depth() != _dtype)
+        X.convertTo(X, _dtype);
+    if (!background.empty() && background.depth() != _dtype)
+        background.convertTo(background, _dtype);
+
+    if (_dtype == CV_32F)
+    {
+        if (background.empty())
+            return _tree->shap_values(as_view<float>(X), output, n_threads);
+        return _tree->interventional_shap_values(as_view<float>(X), as_view<float>(background),
+                                                 output, n_threads);
+    }
+    if (background.empty())
+        return _tree->shap_values(as_view<double>(X), output, n_threads);
+    return _tree->interventional_shap_values(as_view<double>(X), as_view<double>(background),
+                                             output, n_threads);
+}
+
+Mat BaseDecisionTree::permutation_importance(Mat X,
+                                             Mat y,
+                                             Mat sample_weight,
+                                             int n_repeats,
+                                             int random_state,
+                                             int n_threads)
+{
+    if (_tree == NULL)
+        return Mat();
+
+    if (X.depth() != _dtype)
+        X.convertTo(X, _dtype);
+    to_target(y);
+    to_target(sample_weight);
+    int n_targets = (_is_classification == 0) ? 1 : _n_outputs;
+    if (X.cols != _n_features || y.rows != X.rows || y.cols != n_targets)
+        return Mat();
+    if (!sample_weight.empty() && sample_weight.rows != X.rows)
+        return Mat();
+
+    DataView<double> y_view = as_view<double>(y);
+    DataView<double> weight_view = as_view<double>(sample_weight);
+    if (_dtype == CV_32F)
+        return _tree->permutation_importance(as_view<float>(X), y_view, weight_view,
+                                             _is_classification, n_repeats, random_state, n_threads);
+    return _tree->permutation_importance(as_view<double>(X), y_view, weight_view,
+                                         _is_classification, n_repeats, random_state, n_threads);
+}
+
+Mat BaseDecisionTree::partial_dependence(const vector<int>& features,
+                                         Mat grid,
+                                         int n_threads)
+{
+    if (_tree == NULL)
+        return Mat();
+
+    // Validation
+    if (features.empty() || grid.cols != static_cast<int>(features.size()))
+        return Mat();
+    for (size_t c = 0; c < features.size(); c++)
+    {
+        if (features[c] < 0 || features[c] >= _n_features)
+            return Mat();
+    }
+
+    if (grid.depth() != CV_64F)
+        grid.convertTo(grid, CV_64F);
+    return _tree->partial_dependence(features, as_view<double>(grid), n_threads);
+}
+
+int BaseDecisionTree::cost_complexity_pruning_path(Mat& ccp_alphas,
+                                                   Mat& impurities)
+{
+    if (_tree == NULL)
+        return 1;
+
+    vector<double> alphas;
+    vector<double> leaf_impurities;
+    _tree->cost_complexity_pruning_path(alphas, leaf_impurities);
+
+    ccp_alphas = Mat(alphas, true);
+    impurities = Mat(leaf_impurities, true);
+    return 0;
+}
+
+int BaseDecisionTree::prune(double ccp_alpha)
+{
+    if (_tree == NULL)
+        return 1;
+
+    Tree* pruned = _tree->prune(ccp_alpha);
+    delete _tree;
+    _tree = pruned;
+    delete _compressed;
+    _compressed = NULL;
+    return 0;
+}
+
 Mat BaseDecisionTree::feature_importances()
 {
-    // TODO:
+    if (_tree == NULL)
+        return Mat();
+    return _tree->compute_feature_importances(true);
 }
 
 DecisionTreeClassifier::DecisionTreeClassifier(char* criterion_name,
@@ -212,12 +993,52 @@ DecisionTreeClassifier::~DecisionTreeClassifier()
 
 Mat DecisionTreeClassifier::predict_proba(Mat X)
 {
-    // TODO
+    Mat proba;
+    predict_proba(X, proba);
+    return proba;
 }
 
 Mat DecisionTreeClassifier::predict_log_proba(Mat X)
 {
-    // TODO
+    Mat log_proba;
+    predict_log_proba(X, log_proba);
+    return log_proba;
+}
+
+int DecisionTreeClassifier::predict_proba(Mat X,
+                                          Mat& proba,
+                                          int n_threads)
+{
+    return _predict_proba(X, proba, false, n_threads);
+}
+
+int DecisionTreeClassifier::predict_log_proba(Mat X,
+                                              Mat& log_proba,
+                                              int n_threads)
+{
+    return _predict_proba(X, log_proba, true, n_threads);
+}
+
+int DecisionTreeClassifier::_predict_proba(Mat X,
+                                           Mat& proba,
+                                           bool log,
+                                           int n_threads)
+{
+    if (_tree == NULL)
+        return 1;
+
+    if (X.depth() != _dtype)
+        X.convertTo(X, _dtype);
+
+    // Reuses the buffer of proba when it has the shape already
+    proba.create(X.rows, _tree->_n_values, CV_64F);
+    if (!proba.isContinuous())
+        return 2;
+    if (_dtype == CV_32F)
+        _tree->predict_proba(as_view<float>(X), proba.ptr<double>(0), log, n_threads);
+    else
+        _tree->predict_proba(as_view<double>(X), proba.ptr<double>(0), log, n_threads);
+    return 0;
 }
 
 DecisionTreeRegressor::DecisionTreeRegressor(char* criterion_name,
@@ -1,14 +1,25 @@
 #ifndef TREE_H
 #define TREE_H
 
+#include <vector>
+#include <sched.h>
 #include <opencv2/opencv.hpp>
+#include "dataview.h"
+#include "numa.h"
+#include "compressedtree.h"
+#include "memoryusage.h"
 
+using std::vector;
 using cv::Mat;
 
 class Criterion;
 class Splitter;
 class Tree;
 class TreeBuilder;
+class BinnedMatrix;
+class Arena;
+class Transport;
+struct CsrMatrix;
 
 class BaseDecisionTree
 {
@@ -42,8 +53,11 @@ public:
 
     /**
      * @brief Build a decision tree for the training set (X, y).
+     * A CV_32F X trains in single precision (float features and thresholds,
+     * double statistics), any other depth is converted to CV_64F.
      * @param X The training input samples, shape = [n_sampels, n_features]
-     * @param y The target values, shape = [n_samples]
+     * @param y The target values, shape = [n_samples], or [n_samples, n_outputs]
+     * for a multi-output regression
      * @param sample_weight Sample weights. If total size equals to zero, then samples are equally weighted.
      * @return error_code
      */
@@ -51,15 +65,232 @@ public:
             Mat y,
             Mat sample_weight);
 
+    /**
+     * @brief Build a decision tree for the training set (X, y) held in raw buffers.
+     * Nothing is copied, the buffers must stay alive during the call.
+     * @param X The training input samples, shape = [n_sampels, n_features]
+     * @param y The target values, shape = [n_samples, n_outputs], n_outputs = 1 for a classification
+     * @param sample_weight Sample weights. If empty, then samples are equally weighted.
+     * @return error_code
+     */
+    int fit(DataView<double> X,
+            DataView<double> y,
+            DataView<double> sample_weight);
+
+    /**
+     * @brief Build a decision tree for the training set (X, y) on float features.
+     * @param X The training input samples, shape = [n_sampels, n_features]
+     * @param y The target values, shape = [n_samples, n_outputs], n_outputs = 1 for a classification
+     * @param sample_weight Sample weights. If empty, then samples are equally weighted.
+     * @return error_code
+     */
+    int fit(DataView<float> X,
+            DataView<double> y,
+            DataView<double> sample_weight);
+
+    /**
+     * @brief Build a decision tree for an already binned training set (X, y).
+     * Requires the "Binned" splitter.
+     * @param X The binned training input samples, shape = [n_sampels, n_features]
+     * @param y The target values, shape = [n_samples, n_outputs], n_outputs = 1 for a classification
+     * @param sample_weight Sample weights. If empty, then samples are equally weighted.
+     * @return error_code
+     */
+    int fit(const BinnedMatrix& X,
+            DataView<double> y,
+            DataView<double> sample_weight);
+
     /**
      * @brief Predict class or regression value of X.
      * For a classification modle, the predicted class for each sample in X is returned.
      * For a regression model, the predicted value based on X is returned.
      * @param X The input samples, shape = [n_samples]
-     * @return The predicted classes, or the predict values
+     * @return The predicted classes, or the predict values, shape = [n_samples, n_outputs]
      */
     Mat predict(Mat X);
 
+    /**
+     * @brief Predict class or regression value of X held in a raw buffer.
+     * @param X The input samples, shape = [n_samples, n_features]
+     * @return The predicted classes, or the predict values
+     */
+    Mat predict(DataView<double> X);
+
+    /**
+     * @brief Predict class or regression value of float X held in a raw buffer.
+     * @param X The input samples, shape = [n_samples, n_features]
+     * @return The predicted classes, or the predict values
+     */
+    Mat predict(DataView<float> X);
+
+    /**
+     * @brief Leaf of every sample of X, e.g. as a feature of a downstream model.
+     * @param X The input samples, shape = [n_samples, n_features]
+     * @param n_threads Number of threads, 0 for all the cores
+     * @return Node id of the leaf of every sample, shape = [n_samples, 1], CV_32S.
+     * Empty if the tree is not fitted.
+     */
+    Mat apply(Mat X,
+              int n_threads=1);
+
+    /**
+     * @brief Nodes every sample of X goes through, as a sparse indicator matrix.
+     * @param X The input samples, shape = [n_samples, n_features]
+     * @param n_threads Number of threads, 0 for all the cores
+     * @return shape = [n_samples, n_nodes], no column if the tree is not fitted
+     */
+    CsrMatrix decision_path(Mat X,
+                            int n_threads=1);
+
+    /**
+     * @brief Compress the fitted tree for serving, see CompressedTree. With
+     * release_tree, the tree is freed and predict reads the compressed one;
+     * the other methods then see an unfitted tree. fit, prune and
+     * refit_leaves drop the compressed tree.
+     * @param coding THRESHOLD_FLOAT32 or THRESHOLD_INDEX
+     * @param report Sizes, threshold shift and error bound of the compression
+     * @param X_check Samples the errors are measured on, none if empty
+     * @param release_tree
+     * @return error_code, 1 if the tree is not fitted, 2 if it cannot be compressed
+     */
+    int compress(ThresholdCoding coding,
+                 CompressionReport& report,
+                 Mat X_check=Mat(),
+                 bool release_tree=false);
+
+    /**
+     * @brief Bytes held by the fitted model, by part
+     */
+    MemoryUsage memory_usage() const;
+
+    /**
+     * @brief Upper estimate of the memory of a fit with the current settings,
+     * with the parts of _fit_memory, e.g. to pack fits without exhausting
+     * the memory of a host.
+     * @param n_samples
+     * @param n_features
+     * @param n_outputs Number of regression outputs
+     * @param n_classes Number of classes of a classification
+     * @param dtype Feature type, CV_32F or CV_64F
+     */
+    MemoryUsage estimate_fit_memory(int n_samples,
+                                    int n_features,
+                                    int n_outputs=1,
+                                    int n_classes=2,
+                                    int dtype=CV_64F) const;
+
+    /**
+     * @brief Prepare predict_binned for the codes of quantizer, e.g. the
+     * BinnedMatrix the tree was fitted on with the binned splitter.
+     * @param quantizer Bin edges of every feature
+     * @return error_code, 1 if the tree is not fitted, 2 if quantizer has
+     * fewer features than the tree, 3 if a threshold is not one of its edges
+     */
+    int bin_thresholds(const BinnedMatrix& quantizer);
+
+    /**
+     * @brief Predict class or regression value of pre-binned X, with integer
+     * comparisons only. uint8_t codes hold at most 256 bins.
+     * @param codes Bin codes given by the quantizer of bin_thresholds,
+     * shape = [n_samples, n_features]
+     * @param n_threads Number of threads, 0 for all the cores
+     * @return The predicted classes, or the predict values. Empty before
+     * bin_thresholds.
+     */
+    Mat predict_binned(DataView<uint8_t> codes,
+                       int n_threads=1);
+
+    /**
+     * @brief Predict class or regression value of pre-binned X, up to 65536 bins.
+     */
+    Mat predict_binned(DataView<uint16_t> codes,
+                       int n_threads=1);
+
+    /**
+     * @brief Refresh the leaf values of the fitted tree on new labels,
+     * keeping its splits. Rows are routed once, without sorting.
+     * @param X The input samples, shape = [n_samples, n_features]
+     * @param y The target values, shape = [n_samples], or [n_samples, n_outputs]
+     * for a multi-output regression
+     * @param sample_weight Sample weights. If total size equals to zero, then samples are equally weighted.
+     * @param n_threads Number of threads, 0 for all the cores
+     * @return error_code, 1 if the tree is not fitted
+     */
+    int refit_leaves(Mat X,
+                     Mat y,
+                     Mat sample_weight,
+                     int n_threads=1);
+
+    /**
+     * @brief SHAP values of the predictions of X, computed by TreeSHAP.
+     * Without background, the absent features are integrated out following
+     * the training samples (path-dependent); with a background, they take the
+     * values of its rows (interventional).
+     * @param X The input samples, shape = [n_samples, n_features]
+     * @param background Reference samples, shape = [n_background, n_features], may be empty
+     * @param output Regression output, or class for a classification, explained
+     * @param n_threads Number of threads, 0 for all the cores
+     * @return shape = [n_samples, n_features + 1], the last column holds the expected value.
+     * Empty if the tree is not fitted.
+     */
+    Mat shap_values(Mat X,
+                    Mat background=Mat(),
+                    int output=0,
+                    int n_threads=1);
+
+    /**
+     * @brief Permutation importance of every feature on held-out data: the
+     * drop of the score, the accuracy or the R^2, when the feature is
+     * shuffled. Only the rows whose path tests the feature are re-scored.
+     * @param X The held-out samples, shape = [n_samples, n_features]
+     * @param y The target values, shape = [n_samples], or [n_samples, n_outputs]
+     * for a multi-output regression
+     * @param sample_weight Sample weights. If total size equals to zero, then samples are equally weighted.
+     * @param n_repeats Shuffles per feature
+     * @param random_state Seed of the shuffles
+     * @param n_threads Number of threads, 0 for all the cores
+     * @return shape = [n_features, n_repeats]. Empty if the tree is not
+     * fitted or the shapes do not match it.
+     */
+    Mat permutation_importance(Mat X,
+                               Mat y,
+                               Mat sample_weight=Mat(),
+                               int n_repeats=5,
+                               int random_state=0,
+                               int n_threads=1);
+
+    /**
+     * @brief Partial dependence of the predictions on the target features,
+     * by the weighted tree recursion, O(n_grid * n_nodes).
+     * @param features Target features, one or two for a plot
+     * @param grid Values of the target features, shape = [n_grid, n_target_features],
+     * see partial_dependence_grid
+     * @param n_threads Number of threads, 0 for all the cores
+     * @return Averaged prediction of every grid point, the fraction of each
+     * class for a classification, shape = [n_grid, n_values]. Empty if the
+     * tree is not fitted or the features do not match the grid.
+     */
+    Mat partial_dependence(const vector<int>& features,
+                           Mat grid,
+                           int n_threads=1);
+
+    /**
+     * @brief Minimal cost-complexity pruning path of the fitted tree.
+     * @param ccp_alphas Effective alphas of the pruning steps, increasing, shape = [n_steps, 1]
+     * @param impurities Sum of the leaf impurities after each step, shape = [n_steps, 1]
+     * @return error_code, 1 if the tree is not fitted
+     */
+    int cost_complexity_pruning_path(Mat& ccp_alphas,
+                                     Mat& impurities);
+
+    /**
+     * @brief Replace the fitted tree by its subtree of minimal cost-complexity
+     * for ccp_alpha, without retraining.
+     * @param ccp_alpha
+     * @return error_code, 1 if the tree is not fitted
+     */
+    int prune(double ccp_alpha);
+
    /**
     * @brief Return the feature importances.
     * The importance of a feature is computed as the normalized total
@@ -68,6 +299,97 @@ public:
     */
     Mat feature_importances();
 
+protected:
+    /**
+     * @brief Build a decision tree on X, a DataView<DTYPE> or a BinnedMatrix.
+     */
+    template <typename XTYPE>
+    int _fit(const XTYPE& X,
+             DataView<double> y,
+             DataView<double> sample_weight);
+
+    /**
+     * @brief Check the training set and the parameters of this worker, before
+     * any collective. Sets _n_samples, _n_features and _n_outputs.
+     * @return 0, or the error code of _fit
+     */
+    template <typename XTYPE>
+    int _validate(const XTYPE& X,
+                  DataView<double> y,
+                  DataView<double> sample_weight);
+
+    /**
+     * @brief Agree on the error code of all the workers of a distributed fit,
+     * the largest one, so that they all return together or all go on. Also
+     * agrees on _n_outputs, which an empty shard of a data-parallel fit takes
+     * from the others.
+     * @param error The error code of this worker
+     * @return The agreed error code, error when not distributed
+     */
+    int _agree_shards(int error);
+
+    /**
+     * @brief Bin X when the "Binned" splitter is selected, then build the tree.
+     */
+    template <typename DTYPE>
+    int _fit_dense(DataView<DTYPE> X,
+                   DataView<double> y,
+                   DataView<double> sample_weight);
+
+    /**
+     * @brief Apply _class_weight to the sample weights of y
+     * @return sample_weight, or a view of _sample_weight when class weights are set
+     */
+    DataView<double> _apply_class_weight(DataView<double> y,
+                                         DataView<double> sample_weight);
+
+    /**
+     * @brief Pin the calling thread, the worker of a distributed fit, to the
+     * NUMA node of its rank under _numa_placement, for the time of the fit.
+     * @param affinity The affinity of the thread before pinning
+     * @return Whether the thread was pinned, its affinity is then restored
+     * by _unpin_worker when the fit returns
+     */
+    bool _pin_worker(cpu_set_t& affinity);
+
+    /**
+     * @brief Restore the affinity the calling thread had before _pin_worker
+     */
+    void _unpin_worker(bool pinned,
+                       const cpu_set_t& affinity);
+
+    /**
+     * @brief Record the memory of the fit once the tree is built, into _fit_memory
+     * @param X The training set as the splitter reads it
+     * @param arena The arena of the fit, for its high-water mark
+     */
+    template <typename XTYPE>
+    void _record_fit_memory(const XTYPE& X,
+                            const Arena& arena);
+
+    /**
+     * @brief Create the splitter named _splitter_name for a dense X.
+     * @param X
+     * @param max_features The parameters resolved for the fit
+     * @param min_samples_leaf
+     * @param min_weight_leaf
+     * @return The splitter, NULL if the name is unknown
+     */
+    template <typename DTYPE>
+    Splitter* _new_splitter(const DataView<DTYPE>& X,
+                            int max_features,
+                            int min_samples_leaf,
+                            double min_weight_leaf);
+
+    /**
+     * @brief Create the splitter named _splitter_name for a binned X.
+     * @return The splitter, NULL if the name is unknown
+     */
+    Splitter* _new_splitter(const BinnedMatrix& X,
+                            int max_features,
+                            int min_samples_leaf,
+                            double min_weight_leaf);
+
 public:
     Criterion* _criterion;
     Splitter* _splitter;
@@ -78,17 +400,57 @@ public:
     int _max_features;
     int _random_state;
     int _max_leaf_nodes;
+    int _max_bins;                      // Number of bins per feature of the "Binned" splitter
+    double _max_conflict_rate;          // Exclusive feature bundling of the "Binned" splitter:
+                                        // fraction of the rows on which bundled features
+                                        // may conflict, negative not to bundle
+    double _ccp_alpha;                  // Cost-complexity pruning applied by fit, 0 for none
+    bool _bounded_search;               // Let the "Best" splitter skip the features whose
+                                        // improvement bound cannot beat the best split.
+                                        // Gives the same tree as the exhaustive search.
     Mat _class_weight;
+    vector<double> _sample_weight;      // sample_weight * class_weight, when class_weight is set
 
     char* _criterion_name;
     char* _splitter_name;
 
     int _n_samples;
     int _n_features;
+    int _n_outputs;                     // y.cols
     int _is_classification;
+    int _dtype;                         // Depth of the training features, CV_32F or CV_64F
 
     Tree* _tree;
     TreeBuilder* _tree_builder;
+
+    DataView<int> _sample_indices;      // Rows of X the fit trains on, all of them if empty.
+                                        // Lets the folds of a cross-validation share X.
+
+    Arena* _arena;                      // Scratch memory shared with other fits, e.g. the
+                                        // trees of an ensemble. NULL to use an arena local
+                                        // to each fit. It is reset at the end of fit.
+
+    Transport* _transport;              // Workers of a distributed fit, NULL to train
+                                        // in one process. Each worker fits its own
+                                        // shard and gets the same tree.
+                                        // Data-parallel: row shards, as BinnedMatrix
+                                        // binned by transform with common edges.
+
+    DataView<int> _feature_indices;     // Feature-parallel: global index of each column
+                                        // of X, the worker holding all the rows of its
+                                        // columns. Empty for a data-parallel fit.
+
+    NumaPlacement _numa_placement;      // NUMA nodes of the workers of a distributed fit,
+                                        // of the folds of cross_validate, NUMA_NONE not
+                                        // to pin them
+
+    CompressedTree* _compressed;        // Compressed copy of the tree for serving, NULL
+                                        // if not compressed, see compress
+
+    MemoryUsage _fit_memory;            // High-water mark of the last fit, by part: the
+                                        // training set, the scratch memory at its peak
+                                        // in the arena, the tree and the sample weights.
+                                        // _fit_memory.total() is the peak.
 };
 
 class DecisionTreeClassifier : public BaseDecisionTree
@@ -123,16 +485,49 @@ public:
      * @brief Predict class probabilities of the input samples X.
      * The predicted class probalility is the fraction of samples of the same class in a leaf.
      * @param X The input samples, shape = [n_samples]
-     * @return
+     * @return shape = [n_samples, n_classes], empty if the tree is not fitted
      */
     Mat predict_proba(Mat X);
 
     /**
      * @brief Predict class log-probabilities of the input samples X.
      * @param X The input samples, shape = [n_samples]
-     * @return
+     * @return shape = [n_samples, n_classes], empty if the tree is not fitted
      */
     Mat predict_log_proba(Mat X);
+
+    /**
+     * @brief Predict class probabilities of X into a caller-provided buffer.
+     * Each row is copied from the probabilities normalized once per leaf.
+     * @param X The input samples, shape = [n_samples, n_features]
+     * @param proba Output, shape = [n_samples, n_classes], CV_64F. Its buffer
+     * is reused, without allocation, when it has this shape already.
+     * @param n_threads Number of threads, 0 for all the cores
+     * @return error_code, 1 if the tree is not fitted, 2 if proba is not continuous
+     */
+    int predict_proba(Mat X,
+                      Mat& proba,
+                      int n_threads=1);
+
+    /**
+     * @brief Predict class log-probabilities of X into a caller-provided buffer.
+     * @param X The input samples, shape = [n_samples, n_features]
+     * @param log_proba Output, shape = [n_samples, n_classes], CV_64F, reused as in predict_proba
+     * @param n_threads Number of threads, 0 for all the cores
+     * @return error_code, 1 if the tree is not fitted, 2 if log_proba is not continuous
+     */
+    int predict_log_proba(Mat X,
+                          Mat& log_proba,
+                          int n_threads=1);
+
+private:
+    /**
+     * @brief predict_proba, or predict_log_proba when log is set
+     */
+    int _predict_proba(Mat X,
+                       Mat& proba,
+                       bool log,
+                       int n_threads);
 };
 
 class DecisionTreeRegressor : public BaseDecisionTree
@@ -12,16 +12,41 @@ SOURCES += criterion.cpp \
     main.cpp \
     basetree.cpp \
     tree.cpp \
-    util.cpp
+    util.cpp \
+    binnedmatrix.cpp \
+    arena.cpp \
+    crossvalidation.cpp \
+    transport.cpp \
+    hoeffdingtree.cpp \
+    numa.cpp \
+    compressedtree.cpp \
+    treedag.cpp
 
 HEADERS += criterion.h \
     splitter.h \
     treebuilder.h \
     basetree.h \
     tree.h \
-    util.h
+    util.h \
+    dataview.h \
+    binnedmatrix.h \
+    arena.h \
+    crossvalidation.h \
+    transport.h \
+    hoeffdingtree.h \
+    numa.h \
+    compressedtree.h \
+    treedag.h \
+    memoryusage.h
 
 LIBS += -L/usr/local/lib
 LIBS += -lopencv_core
 
+# parallel_for runs on std::thread
+QMAKE_CXXFLAGS += -pthread
+LIBS += -pthread
+
+# shm_open of SharedMemoryTransport
+LIBS += -lrt
+
 TARGET = tree
@@ -3,6 +3,7 @@
 #include "splitter.h"
 #include "basetree.h"
 #include "tree.h"
+#include "transport.h"
 #include <stack>
 #include <queue>
 using std::stack;
@@ -51,16 +52,8 @@ DepthFirstBuilder::~DepthFirstBuilder()
 
 }
 
-void DepthFirstBuilder::build(Tree* _tree,
-                              Mat _X,
-                              Mat _y,
-                              Mat _sample_weight)
+void DepthFirstBuilder::_build(Tree* _tree)
 {
-    if (_sample_weight.total() != 0)
-        sample_weight = _sample_weight;
-
-    splitter->init(_X, _y, _sample_weight);
-
     int n_node_samples = splitter->n_samples;
     double weighted_n_node_samples = splitter->weighted_n_samples;
     bool is_leaf;
@@ -78,7 +71,8 @@ void DepthFirstBuilder::build(Tree* _tree,
 
     bool first = true;
 
-    stack<N> stk;
+    // Stack of nodes to split, in the scratch memory of the fit
+    stack<N, ArenaVector<N> > stk((ArenaVector<N>(ArenaAllocator<N>(splitter->arena))));
     // Push root node onto stack
     stk.push(N(0, n_node_samples, 0, TREE_UNDEFINED, 0, INFINITY, 0));
 
@@ -113,21 +107,19 @@ void DepthFirstBuilder::build(Tree* _tree,
         if (!is_leaf)
         {
             splitter->node_split(impurity, &split, &n_constant_features);
-            is_leaf = is_leaf || (split.pos >= end);
+            is_leaf = is_leaf || (split.pos + start >= end);
         }
 
         node_id = _tree->_add_node(parent, is_left, is_leaf, split.feature,
                                   split.threshold, impurity, n_node_samples,
                                   weighted_n_node_samples);
 
-        if (is_leaf)
-        {
-            // Don't store value for internal nodes
-            if (_tree->_value.size() < node_id+1)
-                _tree->_value.resize(node_id+1);
-            _tree->_value.at(node_id) = splitter->node_value();
-        }
-        else
+        // Internal nodes keep their value too, for the leaves of a pruned tree
+        if (_tree->_value.size() < static_cast<size_t>(node_id) + 1)
+            _tree->_value.resize(node_id+1);
+        _tree->_value.at(node_id) = splitter->node_value();
+
+        if (!is_leaf)
         {
             // Push right child on stack
             stk.push(N(split.pos+start, end, depth+1, node_id, 0,
@@ -161,34 +153,17 @@ BestFirstTreeBuilder::~BestFirstTreeBuilder()
 
 }
 
-void BestFirstTreeBuilder::build(Tree* _tree,
-                                 Mat _X,
-                                 Mat _y,
-                                 Mat _sample_weight)
+void BestFirstTreeBuilder::_build(Tree* _tree)
 {
-    if (_sample_weight.total() != 0)
-        sample_weight = _sample_weight;
-
-    splitter->init(_X, _y, _sample_weight);
-
     int n_node_samples = splitter->n_samples;
-    double weighted_n_node_samples = splitter->weighted_n_samples;
-    bool is_leaf;
-    SplitRecord split;
-    int node_id;
+    int max_split_nodes = max_leaf_nodes - 1;
     int max_depth_seen = -1;
+    bool is_leaf;
+    Node* node;
 
-    int start;
-    int end;
-    int depth;
-    int parent;
-    bool is_left;
-    double impurity;
-    int n_constant_features;
-
-    bool first = true;
-
-    priority_queue<P> pq;
+    // Frontier of the nodes to expand, in the scratch memory of the fit
+    priority_queue<P, ArenaVector<P> > pq(std::less<P>(),
+                                          ArenaVector<P>(ArenaAllocator<P>(splitter->arena)));
     P record, split_node_left, split_node_right;
     // Push root to frontier
     _add_split_node(splitter,
@@ -202,14 +177,62 @@ void BestFirstTreeBuilder::build(Tree* _tree,
                     0,
                     &split_node_left);
 
-    _add_to_frontier(&split_node_left, pq);
+    _add_to_frontier(split_node_left, pq);
 
     while (!pq.empty())
     {
-        record = pq.pop();
+        record = pq.top();
+        pq.pop();
+
+        node = &(_tree->_nodes.at(record._node_id));
+        is_leaf = (record._is_leaf || max_split_nodes <= 0);
+
+        if (is_leaf)
+        {
+            // Node is not expandable, set node as leaf
+            node->left_child = TREE_LEAF;
+            node->right_child = TREE_LEAF;
+            node->feature = TREE_UNDEFINED;
+            node->threshold = TREE_UNDEFINED;
+        }
+        else
+        {
+            // Node is expandable
+            max_split_nodes -= 1;
+
+            // Compute left split node
+            _add_split_node(splitter,
+                            _tree,
+                            record._start,
+                            record._pos,
+                            record._impurity_left,
+                            0,
+                            1,
+                            record._node_id,
+                            record._depth + 1,
+                            &split_node_left);
+
+            // Compute right split node
+            _add_split_node(splitter,
+                            _tree,
+                            record._pos,
+                            record._end,
+                            record._impurity_right,
+                            0,
+                            0,
+                            record._node_id,
+                            record._depth + 1,
+                            &split_node_right);
+
+            // Add nodes to queue
+            _add_to_frontier(split_node_left, pq);
+            _add_to_frontier(split_node_right, pq);
+        }
 
-        node =
+        if (record._depth > max_depth_seen)
+            max_depth_seen = record._depth;
     }
+    _tree->_max_depth = max_depth_seen;
 }
 
 int BestFirstTreeBuilder::_add_split_node(Splitter* _splitter,
@@ -227,20 +250,22 @@ int BestFirstTreeBuilder::_add_split_node(Splitter* _splitter,
     int n_constant_features = 0;
     int node_id = 0;
     bool is_leaf = false;
+    int n_node_samples = _end - _start;
     double weighted_n_node_samples = _splitter->node_reset(_start, _end);
 
     if (_is_first)
         _impurity = _splitter->node_impurity();
 
-    is_leaf = ((_depth > max_depth) ||
+    is_leaf = ((_depth >= max_depth) ||
                (n_node_samples < min_samples_split) ||
                (n_node_samples < 2 * min_samples_leaf) ||
-               (impurity <= MIN_IMPURITY_SPLIT));
+               (weighted_n_node_samples < min_weight_leaf) ||
+               (_impurity <= MIN_IMPURITY_SPLIT));
 
     if (!is_leaf)
     {
-        _splitter->node_split(_impurity, split, &n_constant_features);
-        is_leaf = is_leaf || (split.pos >= end);
+        _splitter->node_split(_impurity, &split, &n_constant_features);
+        is_leaf = is_leaf || (split.pos + _start >= _end);
     }
 
     if (_parent == -1)
@@ -254,13 +279,15 @@ int BestFirstTreeBuilder::_add_split_node(Splitter* _splitter,
                                n_node_samples,
                                weighted_n_node_samples);
 
+    if (_tree->_value.size() < static_cast<size_t>(node_id) + 1)
+        _tree->_value.resize(node_id+1);
     _tree->_value.at(node_id) = splitter->node_value();
 
     res->_node_id = node_id;
     res->_start = _start;
-    res->_end;
-    res->_depth;
-    res->_impurity;
+    res->_end = _end;
+    res->_depth = _depth;
+    res->_impurity = _impurity;
 
     if (!is_leaf)
     {
@@ -280,3 +307,627 @@ int BestFirstTreeBuilder::_add_split_node(Splitter* _splitter,
     }
     return 0;
 }
+
+/**
+ * @brief Node of the stack of DataParallelBuilder: the local samples
+ * samples[start:end], and the global count and weight given by the split
+ * of the parent
+ */
+struct ShardNode
+{
+    int start;
+    int end;
+    int depth;
+    int parent;
+    bool is_left;
+    double impurity;
+    int n_constant_features;
+    int n_node_samples;
+    double weighted_n_node_samples;
+
+    ShardNode(int _start,
+              int _end,
+              int _depth,
+              int _parent,
+              bool _is_left,
+              double _impurity,
+              int _n_constant_features,
+              int _n_node_samples,
+              double _weighted_n_node_samples)
+        : start(_start),
+          end(_end),
+          depth(_depth),
+          parent(_parent),
+          is_left(_is_left),
+          impurity(_impurity),
+          n_constant_features(_n_constant_features),
+          n_node_samples(_n_node_samples),
+          weighted_n_node_samples(_weighted_n_node_samples){
+    }
+};
+
+DataParallelBuilder::DataParallelBuilder(BinnedSplitter* _splitter,
+                                         Transport* _transport,
+                                         int _n_classes,
+                                         int _min_samples_split,
+                                         int _min_samples_leaf,
+                                         double _min_weight_leaf,
+                                         int _max_depth)
+    : TreeBuilder(_splitter,
+                  _min_samples_split,
+                  _min_samples_leaf,
+                  _min_weight_leaf,
+                  _max_depth,
+                  -1),
+      binned_splitter(_splitter),
+      transport(_transport),
+      n_classes(_n_classes),
+      _n_stats(0),
+      _bin_size(0),
+      _n_node_samples(0),
+      _weighted_n_node_samples(0.0)
+{
+
+}
+
+DataParallelBuilder::~DataParallelBuilder()
+{
+
+}
+
+void DataParallelBuilder::_build(Tree* _tree)
+{
+    Criterion* criterion = splitter->criterion;
+    const BinnedMatrix* X = binned_splitter->X;
+    Arena* arena = splitter->arena;
+
+    // Global number and weight of the samples
+    double root[2] = {static_cast<double>(splitter->n_samples), splitter->weighted_n_samples};
+    transport->allreduce_sum(root, 2);
+
+    _n_stats = criterion->init_stats(splitter->y, root[1], n_classes);
+    _bin_size = 2 + _n_stats;
+
+    // One histogram per feature, followed by the node totals
+    _offsets = ArenaVector<int>(splitter->n_features, 0, ArenaAllocator<int>(arena));
+    int size = 0;
+    for (int f = 0; f < splitter->n_features; f++)
+    {
+        _offsets[f] = size;
+        size += X->n_bins(f) * _bin_size;
+    }
+    _histograms = ArenaVector<double>(size + _bin_size, 0.0, ArenaAllocator<double>(arena));
+    _left = ArenaVector<double>(_n_stats, 0.0, ArenaAllocator<double>(arena));
+    double* totals = &_histograms[size];
+
+    bool is_leaf;
+    SplitRecord split;
+    int best_bin = 0;
+    double weighted_n_left = 0.0;
+    int node_id;
+    int p;
+    int partition_end;
+    int tmp;
+    bool first = true;
+
+    // Stack of nodes to split, in the scratch memory of the fit
+    stack<ShardNode, ArenaVector<ShardNode> > stk((ArenaVector<ShardNode>(ArenaAllocator<ShardNode>(arena))));
+    stk.push(ShardNode(0, splitter->n_samples, 0, TREE_UNDEFINED, 0, INFINITY, 0,
+                       static_cast<int>(root[0]), root[1]));
+
+    while (!stk.empty())
+    {
+        ShardNode n = stk.top();
+        stk.pop();
+        _n_node_samples = n.n_node_samples;
+        _weighted_n_node_samples = n.weighted_n_node_samples;
+
+        // Every worker takes the same decisions on the global figures
+        is_leaf = ((n.depth >= max_depth) ||
+                   (_n_node_samples < min_samples_split) ||
+                   (_n_node_samples < 2 * min_samples_leaf) ||
+                   (_weighted_n_node_samples < min_weight_leaf) ||
+                   (!first && n.impurity <= MIN_IMPURITY_SPLIT));
+
+        if (is_leaf)
+            _reduce_totals(n.start, n.end);
+        else
+            _reduce_histograms(n.start, n.end, n.n_constant_features);
+        criterion->reset_stats(totals + 2, _weighted_n_node_samples);
+
+        if (first)
+        {
+            n.impurity = criterion->node_impurity();
+            is_leaf = is_leaf || (n.impurity <= MIN_IMPURITY_SPLIT);
+            first = false;
+        }
+
+        if (!is_leaf)
+        {
+            _node_split(n.impurity, &split, &best_bin, &weighted_n_left, &n.n_constant_features);
+            is_leaf = (split.pos >= _n_node_samples);
+        }
+
+        node_id = _tree->_add_node(n.parent, n.is_left, is_leaf, split.feature,
+                                   split.threshold, n.impurity, _n_node_samples,
+                                   _weighted_n_node_samples);
+
+        // The values of the reduced totals, the same on every worker
+        if (_tree->_value.size() < static_cast<size_t>(node_id) + 1)
+            _tree->_value.resize(node_id+1);
+        _tree->_value.at(node_id) = criterion->node_value();
+
+        if (!is_leaf)
+        {
+            // Partition the local samples on the global split
+            ArenaVector<int>& samples = splitter->samples;
+            partition_end = n.end;
+            p = n.start;
+            while (p < partition_end)
+            {
+                if (X->code(samples[p], split.feature) <= best_bin)
+                    p += 1;
+                else
+                {
+                    partition_end -= 1;
+
+                    tmp = samples[partition_end];
+                    samples[partition_end] = samples[p];
+                    samples[p] = tmp;
+                }
+            }
+
+            // Push right child on stack
+            stk.push(ShardNode(p, n.end, n.depth+1, node_id, 0,
+                               split.impurity_right, n.n_constant_features,
+                               _n_node_samples - split.pos,
+                               _weighted_n_node_samples - weighted_n_left));
+            stk.push(ShardNode(n.start, p, n.depth+1, node_id, 1,
+                               split.impurity_left, n.n_constant_features,
+                               split.pos, weighted_n_left));
+        }
+    }
+}
+
+void DataParallelBuilder::_reduce_histograms(int start,
+                                             int end,
+                                             int n_known_constants)
+{
+    const BinnedMatrix* X = binned_splitter->X;
+    std::fill(_histograms.begin(), _histograms.end(), 0.0);
+
+    // The features known to be constant are never drawn for their split
+    int f;
+    for (int f_i = n_known_constants; f_i < splitter->n_features; f_i++)
+    {
+        f = splitter->features[f_i];
+        if (X->is_wide)
+            _fill_histogram(X->column16(f), &_histograms[_offsets[f]], start, end);
+        else
+            _fill_histogram(X->column8(f), &_histograms[_offsets[f]], start, end);
+    }
+
+    // Node totals, in the last bin
+    double* totals = &_histograms[_histograms.size() - _bin_size];
+    double w = 1.0;
+    int i;
+    for (int k = start; k < end; k++)
+    {
+        i = splitter->samples[k];
+        if (!splitter->sample_weight.empty())
+            w = splitter->sample_weight.at(i);
+        totals[0] += 1.0;
+        totals[1] += w;
+        splitter->criterion->add_stats(i, w, totals + 2);
+    }
+
+    transport->allreduce_sum(_histograms.data(), static_cast<int>(_histograms.size()));
+}
+
+void DataParallelBuilder::_reduce_totals(int start,
+                                         int end)
+{
+    double* totals = &_histograms[_histograms.size() - _bin_size];
+    std::fill(totals, totals + _bin_size, 0.0);
+
+    double w = 1.0;
+    int i;
+    for (int k = start; k < end; k++)
+    {
+        i = splitter->samples[k];
+        if (!splitter->sample_weight.empty())
+            w = splitter->sample_weight.at(i);
+        totals[0] += 1.0;
+        totals[1] += w;
+        splitter->criterion->add_stats(i, w, totals + 2);
+    }
+
+    transport->allreduce_sum(totals, _bin_size);
+}
+
+template <typename CTYPE>
+void DataParallelBuilder::_fill_histogram(const CTYPE* column,
+                                          double* histogram,
+                                          int start,
+                                          int end)
+{
+    double w = 1.0;
+    double* bin;
+    int i;
+    for (int k = start; k < end; k++)
+    {
+        i = splitter->samples[k];
+        if (!splitter->sample_weight.empty())
+            w = splitter->sample_weight.at(i);
+
+        bin = histogram + column[i] * _bin_size;
+        bin[0] += 1.0;
+        bin[1] += w;
+        splitter->criterion->add_stats(i, w, bin + 2);
+    }
+}
+
+void DataParallelBuilder::_node_split(double impurity,
+                                      SplitRecord* split,
+                                      int* best_bin,
+                                      double* weighted_n_left,
+                                      int* n_constant_features)
+{
+    Criterion* criterion = splitter->criterion;
+    const BinnedMatrix* X = binned_splitter->X;
+    ArenaVector<int>& features = splitter->features;
+    ArenaVector<int>& constant_features = splitter->constant_features;
+    int range = _n_node_samples;
+
+    SplitRecord best, current;
+    best.pos = range;           // No split found yet
+    *best_bin = 0;
+    *weighted_n_left = 0.0;
+
+    std::pair<double, double> pdd;
+    const double* histogram;
+    const double* bin;
+    double w_left;
+    int p;
+    int tmp;
+    int n_bins;
+    int n_filled_bins;
+    int n_visited_features = 0;
+    int n_found_constants = 0;
+    int n_drawn_constants = 0;
+    int n_known_constants = *n_constant_features;
+    int n_total_constants = n_known_constants;
+
+    // The draws of BinnedSplitter::node_split, on the global histograms
+    int f_i = splitter->n_features;
+    int f_j = 0;
+    while (f_i > n_total_constants &&
+           (n_visited_features < splitter->max_features ||
+            n_visited_features <= n_found_constants + n_drawn_constants))
+    {
+        n_visited_features += 1;
+
+        f_j = rand_int(n_drawn_constants, f_i - n_found_constants,
+                       splitter->random_state);
+
+        if (f_j < n_known_constants)
+        {
+            tmp = features[f_j];
+            features[f_j] = features[n_drawn_constants];
+            features[n_drawn_constants] = tmp;
+
+            n_drawn_constants += 1;
+            continue;
+        }
+
+        f_j += n_found_constants;
+        current.feature = features[f_j];
+        n_bins = X->n_bins(current.feature);
+        histogram = &_histograms[_offsets[current.feature]];
+
+        // Constant if all the node samples share one bin
+        n_filled_bins = 0;
+        for (int b = 0; b < n_bins && n_filled_bins < 2; b++)
+        {
+            if (histogram[b * _bin_size] > 0.0)
+                n_filled_bins += 1;
+        }
+
+        if (n_filled_bins < 2)
+        {
+            features[f_j] = features[n_total_constants];
+            features[n_total_constants] = current.feature;
+
+            n_found_constants += 1;
+            n_total_constants += 1;
+            continue;
+        }
+
+        f_i -= 1;
+        tmp = features[f_i];
+        features[f_i] = features[f_j];
+        features[f_j] = tmp;
+
+        // Evaluate the split after every non-empty bin
+        criterion->reset();
+        std::fill(_left.begin(), _left.end(), 0.0);
+        w_left = 0.0;
+        p = 0;
+
+        for (int b = 0; b < n_bins - 1; b++)
+        {
+            bin = histogram + b * _bin_size;
+            if (bin[0] == 0.0)
+                continue;
+
+            p += static_cast<int>(bin[0]);
+            w_left += bin[1];
+            for (int s = 0; s < _n_stats; s++)
+                _left[s] += bin[2 + s];
+            if (p >= range)
+                break;
+
+            current.pos = p;
+
+            // Reject if min_samples_leaf is not guaranteed
+            if ((current.pos < splitter->min_samples_leaf) ||
+                ((range - current.pos) < splitter->min_samples_leaf))
+                continue;
+
+            criterion->update_stats(_left.data(), w_left);
+
+            // Reject if min_weight_leaf is not satisfied
+            if ((criterion->weighted_n_left < splitter->min_weight_leaf) ||
+                 criterion->weighted_n_right < splitter->min_weight_leaf)
+                continue;
+
+            current.improvement = criterion->impurity_improvement(impurity);
+
+            if (current.improvement > best.improvement)
+            {
+                pdd = criterion->children_impurity();
+                current.impurity_left = pdd.first;
+                current.impurity_right = pdd.second;
+                current.threshold = X->threshold(current.feature, b);
+
+                best = current;
+                *best_bin = b;
+                *weighted_n_left = w_left;
+            }
+        }
+    }
+
+    // Respect invariant for constant features, as BinnedSplitter does
+    for (int i = 0; i < n_known_constants; i++)
+        features.at(i) = constant_features.at(i);
+    for (int i = n_known_constants; i < n_known_constants+n_found_constants; i++)
+        constant_features.at(i) = features.at(i);
+
+    split[0] = best;
+    n_constant_features[0] = n_total_constants;
+}
+
+// A SplitRecord in the exchange of FeatureParallelBuilder: found, improvement,
+// feature, threshold, pos, impurity_left, impurity_right
+const int SPLIT_RECORD_SIZE = 7;
+
+FeatureParallelBuilder::FeatureParallelBuilder(Splitter* _splitter,
+                                               Transport* _transport,
+                                               DataView<int> _feature_indices,
+                                               int _min_samples_split,
+                                               int _min_samples_leaf,
+                                               double _min_weight_leaf,
+                                               int _max_depth)
+    : TreeBuilder(_splitter,
+                  _min_samples_split,
+                  _min_samples_leaf,
+                  _min_weight_leaf,
+                  _max_depth,
+                  -1),
+      transport(_transport),
+      feature_indices(_feature_indices)
+{
+
+}
+
+FeatureParallelBuilder::~FeatureParallelBuilder()
+{
+
+}
+
+void FeatureParallelBuilder::_build(Tree* _tree)
+{
+    Arena* arena = splitter->arena;
+    int n_node_samples = splitter->n_samples;
+    double weighted_n_node_samples;
+    bool is_leaf;
+    SplitRecord split;
+    int node_id;
+    int owner;
+
+    int start;
+    int end;
+    int depth;
+    int parent;
+    bool is_left;
+    double impurity;
+    int n_constant_features;
+
+    bool first = true;
+
+    _node_samples = ArenaVector<int>(n_node_samples, 0, ArenaAllocator<int>(arena));
+    _is_left = ArenaVector<char>(splitter->y.rows, 0, ArenaAllocator<char>(arena));
+    _bitmap = ArenaVector<char>((n_node_samples + 7) / 8, 0, ArenaAllocator<char>(arena));
+    _records = ArenaVector<double>(SPLIT_RECORD_SIZE * transport->size(), 0.0,
+                                   ArenaAllocator<double>(arena));
+
+    // Stack of nodes to split, in the scratch memory of the fit
+    stack<N, ArenaVector<N> > stk((ArenaVector<N>(ArenaAllocator<N>(arena))));
+    stk.push(N(0, n_node_samples, 0, TREE_UNDEFINED, 0, INFINITY, 0));
+
+    while (!stk.empty())
+    {
+        N n = stk.top();
+        stk.pop();
+        start = n.start;
+        end = n.end;
+        depth = n.depth;
+        parent = n.parent;
+        is_left = n.is_left;
+        impurity = n.impurity;
+        n_constant_features = n.n_constant_features;
+
+        // Same samples in the same order on every worker, so the same sums
+        n_node_samples = end - start;
+        weighted_n_node_samples = splitter->node_reset(start, end);
+
+        is_leaf = ((depth >= max_depth) ||
+                   (n_node_samples < min_samples_split) ||
+                   (n_node_samples < 2 * min_samples_leaf) ||
+                   (weighted_n_node_samples < min_weight_leaf));
+
+        if (first)
+        {
+            impurity = splitter->node_impurity();
+            first = false;
+        }
+
+        is_leaf = is_leaf || (impurity <= MIN_IMPURITY_SPLIT);
+
+        if (!is_leaf)
+        {
+            std::copy(splitter->samples.begin() + start,
+                      splitter->samples.begin() + end,
+                      _node_samples.begin());
+
+            // Best split of the local columns, then of all of them
+            splitter->node_split(impurity, &split, &n_constant_features);
+            owner = _exchange_split(&split, n_node_samples);
+            is_leaf = (owner < 0);
+            if (!is_leaf)
+                _apply_partition(owner, start, end, split.pos);
+        }
+
+        node_id = _tree->_add_node(parent, is_left, is_leaf, split.feature,
+                                   split.threshold, impurity, n_node_samples,
+                                   weighted_n_node_samples);
+
+        if (_tree->_value.size() < static_cast<size_t>(node_id) + 1)
+            _tree->_value.resize(node_id+1);
+        _tree->_value.at(node_id) = splitter->node_value();
+
+        if (!is_leaf)
+        {
+            // Push right child on stack
+            stk.push(N(split.pos+start, end, depth+1, node_id, 0,
+                       split.impurity_right, n_constant_features));
+            stk.push(N(start, split.pos+start, depth+1, node_id, 1,
+                       split.impurity_left, n_constant_features));
+        }
+    }
+}
+
+int FeatureParallelBuilder::_exchange_split(SplitRecord* split,
+                                            int n_node_samples)
+{
+    int n_workers = transport->size();
+    int rank = transport->rank();
+
+    // Every worker fills its own record, the sum gathers them
+    std::fill(_records.begin(), _records.end(), 0.0);
+    double* record = &_records[SPLIT_RECORD_SIZE * rank];
+    if (split->pos < n_node_samples)
+    {
+        record[0] = 1.0;
+        record[1] = split->improvement;
+        record[2] = feature_indices.at(split->feature);
+        record[3] = split->threshold;
+        record[4] = split->pos;
+        record[5] = split->impurity_left;
+        record[6] = split->impurity_right;
+    }
+    transport->allreduce_sum(_records.data(), static_cast<int>(_records.size()));
+
+    // On a tie, the lower global feature wins, as in BestSplitter
+    int owner = -1;
+    for (int r = 0; r < n_workers; r++)
+    {
+        record = &_records[SPLIT_RECORD_SIZE * r];
+        if (record[0] == 0.0)
+            continue;
+        if (owner >= 0)
+        {
+            const double* best = &_records[SPLIT_RECORD_SIZE * owner];
+            if (record[1] < best[1] || (record[1] == best[1] && record[2] > best[2]))
+                continue;
+        }
+        owner = r;
+    }
+    if (owner < 0)
+        return -1;
+
+    record = &_records[SPLIT_RECORD_SIZE * owner];
+    split->improvement = record[1];
+    split->feature = static_cast<int>(record[2]);
+    split->threshold = record[3];
+    split->pos = static_cast<int>(record[4]);
+    split->impurity_left = record[5];
+    split->impurity_right = record[6];
+    return owner;
+}
+
+void FeatureParallelBuilder::_apply_partition(int owner,
+                                              int start,
+                                              int end,
+                                              int pos)
+{
+    ArenaVector<int>& samples = splitter->samples;
+    int n_node_samples = end - start;
+    int n_bytes = (n_node_samples + 7) / 8;
+
+    // The owner's split left samples[start:start+pos], as a bitmap of the
+    // samples in their order before the search
+    if (transport->rank() == owner)
+    {
+        for (int k = start; k < start + pos; k++)
+            _is_left[samples[k]] = 1;
+        std::fill(_bitmap.begin(), _bitmap.begin() + n_bytes, 0);
+        for (int k = 0; k < n_node_samples; k++)
+        {
+            if (_is_left[_node_samples[k]])
+                _bitmap[k >> 3] |= static_cast<char>(1 << (k & 7));
+        }
+        for (int k = start; k < start + pos; k++)
+            _is_left[samples[k]] = 0;
+    }
+    transport->broadcast(_bitmap.data(), n_bytes, owner);
+
+    // Replay the partition of the splitters from the order before the
+    // search: the same swaps give every worker the order the owner has, that
+    // of a single worker
+    for (int k = 0; k < n_node_samples; k++)
+    {
+        samples[start + k] = _node_samples[k];
+        _is_left[_node_samples[k]] = (_bitmap[k >> 3] >> (k & 7)) & 1;
+    }
+
+    int p = start;
+    int partition_end = end;
+    int tmp;
+    while (p < partition_end)
+    {
+        if (_is_left[samples[p]])
+            p += 1;
+        else
+        {
+            partition_end -= 1;
+
+            tmp = samples[partition_end];
+            samples[partition_end] = samples[p];
+            samples[p] = tmp;
+        }
+    }
+
+    for (int k = start; k < end; k++)
+        _is_left[samples[k]] = 0;
+}
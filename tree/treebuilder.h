@@ -1,15 +1,15 @@
 #ifndef TREEBUILDER_H
 #define TREEBUILDER_H
 
-#include <opencv2/opencv.hpp>
 #include <queue>
-using cv::Mat;
+#include "dataview.h"
+#include "splitter.h"
 using std::priority_queue;
 
 class Criterion;
-class Splitter;
 class Node;
 class Tree;
+class Transport;
 
 const double MIN_IMPURITY_SPLIT = 1e-7;
 
@@ -53,6 +53,19 @@ struct P
     double _impurity_right;
     double _improvement;
 
+    P()
+        : _node_id(0),
+          _start(0),
+          _end(0),
+          _pos(0),
+          _depth(0),
+          _is_leaf(true),
+          _impurity(0.),
+          _impurity_left(0.),
+          _impurity_right(0.),
+          _improvement(0.){
+    }
+
     P(int node_id,
       int start,
       int end,
@@ -94,15 +107,35 @@ public:
 
     /**
      * @brief Build a decision tree from the training set (X, y)
+     * XTYPE is the representation of X the splitter is initialized with:
+     * DataView<float>, DataView<double> or BinnedMatrix.
      * @param tree
      * @param X
      * @param y
      * @param sample_weight
+     * @return error_code of the splitter initialization
+     */
+    template <typename XTYPE>
+    int build(Tree* tree,
+              const XTYPE& X,
+              DataView<double> y,
+              DataView<double> sample_weight)
+    {
+        this->sample_weight = sample_weight;
+
+        int error = splitter->init(X, y, sample_weight);
+        if (error != 0)
+            return error;
+
+        _build(tree);
+        return 0;
+    }
+
+    /**
+     * @brief Grow the tree on the samples the splitter has been initialized with
+     * @param tree
      */
-    virtual void build(Tree* tree,
-                       Mat X,
-                       Mat y,
-                       Mat sample_weight)=0;
+    virtual void _build(Tree* tree)=0;
 public:
     Splitter* splitter;
     int min_samples_split;
@@ -111,7 +144,7 @@ public:
     int max_depth;
     int max_leaf_nodes;
 
-    Mat sample_weight;
+    DataView<double> sample_weight;
 };
 
 class DepthFirstBuilder : public TreeBuilder
@@ -135,19 +168,10 @@ public:
     virtual ~DepthFirstBuilder();
 
     /**
-     * @brief Build a decision tree from the training set (X, y)
+     * @brief Grow the tree on the samples the splitter has been initialized with
      * @param tree
-     * @param X
-     * @param y
-     * @param sample_weight
      */
-    virtual void build(Tree* tree,
-                       Mat X,
-                       Mat y,
-                       Mat sample_weight);
-
-public:
-    Mat sample_weight;
+    virtual void _build(Tree* tree);
 };
 
 class BestFirstTreeBuilder : public TreeBuilder
@@ -174,16 +198,10 @@ public:
     virtual ~BestFirstTreeBuilder();
 
     /**
-     * @brief Build a decision tree from the training set (X, y)
+     * @brief Grow the tree on the samples the splitter has been initialized with
      * @param tree
-     * @param X
-     * @param y
-     * @param sample_weight
      */
-    virtual void build(Tree* tree,
-                       Mat X,
-                       Mat y,
-                       Mat sample_weight);
+    virtual void _build(Tree* tree);
 
     /**
      * @brief Adds node w/ partition [start, end) to the frontier
@@ -210,7 +228,7 @@ public:
                         int depth,
                         P* res);
 
-    inline void _add_to_frontier(const P& p, priority_queue<P> pq)
+    inline void _add_to_frontier(const P& p, priority_queue<P, ArenaVector<P> >& pq)
     {
         pq.push(P(p._node_id,
                   p._start,
@@ -223,9 +241,175 @@ public:
                   p._impurity_right,
                   p._improvement));
     }
+};
 
+class DataParallelBuilder : public TreeBuilder
+{
 public:
-    int max_leaf_nodes;
+    /**
+     * @brief Build a decision tree in depth-first fashion over the row shards
+     * of several workers, each worker running its own builder on its own rows.
+     *
+     * At every node to split, each worker fills for all the features a
+     * histogram of its node samples: per bin the count, the weight and the
+     * criterion statistics. One allreduce of the transport sums them, then
+     * every worker runs the same split search on the sums, finds the same
+     * split and partitions its own samples. The children inherit their global
+     * count and weight from the split, so a leaf only reduces its statistics.
+     * The workers grow identical trees, the tree of a BinnedSplitter on the
+     * union of the shards.
+     *
+     * The shards must be binned with the same bin edges, and the criterion
+     * must support the statistics mode (not MAE).
+     * @param splitter Holds the local samples, and draws the features
+     * @param transport
+     * @param n_classes Number of classes over all the shards, 0 for a regression
+     * @param min_samples_split
+     * @param min_samples_leaf
+     * @param min_weight_leaf
+     * @param max_depth
+     */
+    DataParallelBuilder(BinnedSplitter* splitter,
+                        Transport* transport,
+                        int n_classes,
+                        int min_samples_split,
+                        int min_samples_leaf,
+                        double min_weight_leaf,
+                        int max_depth);
+    virtual ~DataParallelBuilder();
+
+    /**
+     * @brief Grow the tree on the samples the splitter has been initialized with
+     * @param tree
+     */
+    virtual void _build(Tree* tree);
+
+private:
+    /**
+     * @brief Fill the histograms of the local samples[start:end] for the
+     * features not known to be constant, and the node totals, then sum them
+     * over the workers.
+     */
+    void _reduce_histograms(int start,
+                            int end,
+                            int n_known_constants);
+
+    /**
+     * @brief Sum the statistics of the local samples[start:end] over the
+     * workers, into the node totals.
+     */
+    void _reduce_totals(int start,
+                        int end);
+
+    template <typename CTYPE>
+    void _fill_histogram(const CTYPE* column,
+                         double* histogram,
+                         int start,
+                         int end);
+
+    /**
+     * @brief Search the best split of the node on the summed histograms,
+     * drawing the features as BinnedSplitter::node_split does.
+     * @param impurity
+     * @param split pos is the global number of samples on the left, pos >= the
+     * number of node samples if no split is found
+     * @param best_bin The split sends the bins <= best_bin to the left
+     * @param weighted_n_left Global weight of the left child
+     * @param n_constant_features
+     */
+    void _node_split(double impurity,
+                     SplitRecord* split,
+                     int* best_bin,
+                     double* weighted_n_left,
+                     int* n_constant_features);
+
+public:
+    BinnedSplitter* binned_splitter;
+    Transport* transport;
+    int n_classes;
+
+private:
+    int _n_stats;                       // Criterion statistics per sample
+    int _bin_size;                      // Doubles per bin: count, weight, statistics
+    int _n_node_samples;                // Global samples of the node
+    double _weighted_n_node_samples;    // Global weight of the node
+    ArenaVector<int> _offsets;          // Start of the histogram of each feature
+    ArenaVector<double> _histograms;    // Histograms of all the features, then the node totals
+    ArenaVector<double> _left;          // Left statistics of the split search
+};
+
+class FeatureParallelBuilder : public TreeBuilder
+{
+public:
+    /**
+     * @brief Build a decision tree in depth-first fashion over the column
+     * subsets of several workers, each worker holding all the rows but only
+     * its own columns, and running its own builder.
+     *
+     * At every node each worker runs its splitter on its columns. The
+     * workers exchange their best SplitRecord only, and all take the best
+     * one, the lowest rank winning a tie. The owner of the winning feature
+     * sends the partition of the node samples as a bitmap, one bit per
+     * sample, and every worker rebuilds samples[start:end] from it. The
+     * node samples are kept in the same order on every worker, so that
+     * the criterion sums them in the same order and all the workers get
+     * the same tree.
+     * @param splitter Splitter of the local columns, any of them
+     * @param transport
+     * @param feature_indices Global index of each local column, shape [n_local_features]
+     * @param min_samples_split
+     * @param min_samples_leaf
+     * @param min_weight_leaf
+     * @param max_depth
+     */
+    FeatureParallelBuilder(Splitter* splitter,
+                           Transport* transport,
+                           DataView<int> feature_indices,
+                           int min_samples_split,
+                           int min_samples_leaf,
+                           double min_weight_leaf,
+                           int max_depth);
+    virtual ~FeatureParallelBuilder();
+
+    /**
+     * @brief Grow the tree on the samples the splitter has been initialized with
+     * @param tree
+     */
+    virtual void _build(Tree* tree);
+
+private:
+    /**
+     * @brief Agree with the other workers on the best of their splits.
+     * @param split The local split in, the global one out, with a global feature index
+     * @param n_node_samples
+     * @return Rank of the owner of the split, -1 if no worker found one
+     */
+    int _exchange_split(SplitRecord* split,
+                        int n_node_samples);
+
+    /**
+     * @brief Reorder samples[start:end] into the left then the right samples
+     * of the split of owner, by the swaps of the splitters from the order of
+     * _node_samples, so that every worker ends in the order of the owner.
+     * @param owner
+     * @param start
+     * @param end
+     * @param pos Number of left samples
+     */
+    void _apply_partition(int owner,
+                          int start,
+                          int end,
+                          int pos);
+
+public:
+    Transport* transport;
+    DataView<int> feature_indices;
+
+private:
+    ArenaVector<int> _node_samples;     // samples[start:end] before the split search
+    ArenaVector<char> _is_left;         // Per row of X, set for the left samples of the owner
+    ArenaVector<char> _bitmap;          // Partition of the node samples, a bit per sample
+    ArenaVector<double> _records;       // SplitRecords of all the workers
 };
 
 #endif // TREEBUILDER_H
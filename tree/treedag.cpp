@@ -0,0 +1,227 @@
+#include "treedag.h"
+#include "basetree.h"
+#include "util.h"
+#include <cstring>
+#include <unordered_map>
+
+/**
+ * @brief Hash of a double, equal for 0.0 and -0.0 as == is
+ */
+static size_t hash_double(double value)
+{
+    if (value == 0.0)
+        value = 0.0;
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return std::hash<uint64_t>()(bits);
+}
+
+static void hash_combine(size_t& seed,
+                         size_t value)
+{
+    seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+
+/**
+ * @brief A split is identified by its test and by its (already shared) children
+ */
+struct SplitKey
+{
+    int feature;
+    double threshold;
+    int left_child;
+    int right_child;
+
+    bool operator== (const SplitKey& a) const
+    {
+        return feature == a.feature && threshold == a.threshold &&
+               left_child == a.left_child && right_child == a.right_child;
+    }
+};
+
+struct SplitKeyHash
+{
+    size_t operator() (const SplitKey& key) const
+    {
+        size_t seed = hash_double(key.threshold);
+        hash_combine(seed, std::hash<int>()(key.feature));
+        hash_combine(seed, std::hash<int>()(key.left_child));
+        hash_combine(seed, std::hash<int>()(key.right_child));
+        return seed;
+    }
+};
+
+struct LeafKeyHash
+{
+    size_t operator() (const vector<double>& key) const
+    {
+        size_t seed = 0;
+        for (size_t k = 0; k < key.size(); k++)
+            hash_combine(seed, hash_double(key[k]));
+        return seed;
+    }
+};
+
+TreeDag::TreeDag()
+    : _n_outputs(0),
+      _n_tree_nodes(0)
+{
+
+}
+
+int TreeDag::add_trees(const vector<const Tree*>& trees)
+{
+    // Validation
+    int n_outputs = _n_outputs;
+    for (size_t t = 0; t < trees.size(); t++)
+    {
+        if (trees[t]->_node_count == 0)
+            return 1;
+        if (n_outputs == 0)
+            n_outputs = trees[t]->_n_outputs;
+        if (trees[t]->_n_outputs != n_outputs)
+            return 2;
+    }
+    _n_outputs = n_outputs;
+
+    // Index of the nodes already shared
+    std::unordered_map<SplitKey, int, SplitKeyHash> splits;
+    std::unordered_map<vector<double>, int, LeafKeyHash> leaves;
+    for (size_t n = 0; n < _nodes.size(); n++)
+    {
+        const DagNode& node = _nodes[n];
+        if (node.left_child < 0)
+        {
+            const double* value = &_leaf_values[static_cast<size_t>(~node.left_child) * _n_outputs];
+            leaves[vector<double>(value, value + _n_outputs)] = static_cast<int>(n);
+        }
+        else
+        {
+            SplitKey key = {node.feature, node.threshold, node.left_child, node.right_child};
+            splits[key] = static_cast<int>(n);
+        }
+    }
+
+    vector<double> prediction(_n_outputs);
+    for (size_t t = 0; t < trees.size(); t++)
+    {
+        const Tree& tree = *trees[t];
+        bool has_tables = (tree._leaf_prediction.size() == static_cast<size_t>(tree._node_count) * _n_outputs);
+
+        // Children have larger ids than their parent: bottom-up from the last node
+        vector<int> dag_id(tree._node_count);
+        for (int n = tree._node_count - 1; n >= 0; n--)
+        {
+            const Node& node = tree._nodes[n];
+            if (node.left_child == TREE_LEAF)
+            {
+                if (has_tables)
+                    std::copy(&tree._leaf_prediction[static_cast<size_t>(n) * _n_outputs],
+                              &tree._leaf_prediction[static_cast<size_t>(n + 1) * _n_outputs],
+                              prediction.begin());
+                else
+                    tree._node_prediction(n, &prediction[0]);
+
+                std::unordered_map<vector<double>, int, LeafKeyHash>::iterator leaf = leaves.find(prediction);
+                if (leaf != leaves.end())
+                {
+                    dag_id[n] = leaf->second;
+                    continue;
+                }
+                DagNode dag_node;
+                dag_node.threshold = 0.0;
+                dag_node.left_child = ~static_cast<int32_t>(_leaf_values.size() / _n_outputs);
+                dag_node.right_child = dag_node.left_child;
+                dag_node.feature = 0;
+                _leaf_values.insert(_leaf_values.end(), prediction.begin(), prediction.end());
+                dag_id[n] = static_cast<int>(_nodes.size());
+                leaves[prediction] = dag_id[n];
+                _nodes.push_back(dag_node);
+                continue;
+            }
+
+            // A split between two identical subtrees decides nothing
+            if (dag_id[node.left_child] == dag_id[node.right_child])
+            {
+                dag_id[n] = dag_id[node.left_child];
+                continue;
+            }
+
+            SplitKey key = {node.feature, node.threshold, dag_id[node.left_child], dag_id[node.right_child]};
+            std::unordered_map<SplitKey, int, SplitKeyHash>::iterator split = splits.find(key);
+            if (split != splits.end())
+            {
+                dag_id[n] = split->second;
+                continue;
+            }
+            DagNode dag_node;
+            dag_node.threshold = node.threshold;
+            dag_node.left_child = key.left_child;
+            dag_node.right_child = key.right_child;
+            dag_node.feature = node.feature;
+            dag_id[n] = static_cast<int>(_nodes.size());
+            splits[key] = dag_id[n];
+            _nodes.push_back(dag_node);
+        }
+        _roots.push_back(dag_id[0]);
+        _n_tree_nodes += tree._node_count;
+    }
+    return 0;
+}
+
+template <typename DTYPE>
+Mat TreeDag::predict(DataView<DTYPE> X,
+                     int n_threads) const
+{
+    int n_trees = static_cast<int>(_roots.size());
+    Mat_<double> result(X.rows, n_trees * _n_outputs);
+    size_t row_size = sizeof(double) * _n_outputs;
+    parallel_for(X.rows, n_threads, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+        {
+            double* row = result.ptr<double>(i);
+            for (int t = 0; t < n_trees; t++)
+                std::memcpy(row + t * _n_outputs,
+                            &_leaf_values[static_cast<size_t>(_find_leaf(X, i, _roots[t])) * _n_outputs],
+                            row_size);
+        }
+    });
+    return result;
+}
+
+template <typename DTYPE>
+Mat TreeDag::predict_sum(DataView<DTYPE> X,
+                         double bias,
+                         double weight,
+                         int n_threads) const
+{
+    int n_outputs = std::max(_n_outputs, 1);
+    Mat_<double> result(X.rows, n_outputs);
+    parallel_for(X.rows, n_threads, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+        {
+            double* row = result.ptr<double>(i);
+            for (int k = 0; k < n_outputs; k++)
+                row[k] = bias;
+            for (size_t t = 0; t < _roots.size(); t++)
+            {
+                const double* value = &_leaf_values[static_cast<size_t>(_find_leaf(X, i, _roots[t])) * n_outputs];
+                for (int k = 0; k < n_outputs; k++)
+                    row[k] += weight * value[k];
+            }
+        }
+    });
+    return result;
+}
+
+size_t TreeDag::memory_bytes() const
+{
+    return _nodes.size() * sizeof(DagNode) +
+           _leaf_values.size() * sizeof(double) +
+           _roots.size() * sizeof(int);
+}
+
+template Mat TreeDag::predict<float>(DataView<float> X, int n_threads) const;
+template Mat TreeDag::predict<double>(DataView<double> X, int n_threads) const;
+template Mat TreeDag::predict_sum<float>(DataView<float> X, double bias, double weight, int n_threads) const;
+template Mat TreeDag::predict_sum<double>(DataView<double> X, double bias, double weight, int n_threads) const;
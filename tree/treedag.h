@@ -0,0 +1,107 @@
+#ifndef TREEDAG_H
+#define TREEDAG_H
+
+//========================================
+// TreeDag
+// Trees sharing their identical subtrees
+//========================================
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+#include <opencv2/opencv.hpp>
+#include "dataview.h"
+
+using std::vector;
+using cv::Mat;
+
+class Tree;
+
+/**
+ * @brief Node of a TreeDag, shared by every subtree it roots
+ */
+struct DagNode
+{
+    double threshold;       // Threshold value at the node
+    int32_t left_child;     // Id of the left child, or ~leaf for a leaf
+    int32_t right_child;    // Id of the right child
+    int32_t feature;        // Feature used for splitting the node
+};
+
+class TreeDag
+{
+public:
+    /**
+     * @brief Nodes of one or several trees hash-consed into a directed
+     * acyclic graph: a leaf is stored once per distinct prediction, a split
+     * once per distinct (feature, threshold, left subtree, right subtree),
+     * and a split between two identical subtrees is replaced by them.
+     * Structurally identical subtrees, within a tree or across the trees of
+     * an ensemble, are then a single one, read by every tree reaching it.
+     * Predictions walk the DAG directly and equal those of the trees.
+     */
+    TreeDag();
+
+    /**
+     * @brief Add trees to the DAG, their subtrees being shared with those
+     * already added.
+     * @param trees Fitted trees with the same number of outputs
+     * @return error_code, 1 if a tree has no node, 2 if the outputs differ
+     */
+    int add_trees(const vector<const Tree*>& trees);
+
+    /**
+     * @brief Predict target for X with every tree.
+     * @param X shape = [n_samples, n_features]
+     * @param n_threads Rows are split among the threads, 0 for all the cores
+     * @return shape [n_samples, n_trees * n_outputs], the outputs of tree t
+     * from column t * n_outputs
+     */
+    template <typename DTYPE>
+    Mat predict(DataView<DTYPE> X,
+                int n_threads=1) const;
+
+    /**
+     * @brief bias + weight * the sum of the predictions of the trees, e.g.
+     * the raw prediction of a boosted ensemble.
+     * @param X shape = [n_samples, n_features]
+     * @param bias
+     * @param weight
+     * @param n_threads Rows are split among the threads, 0 for all the cores
+     * @return shape [n_samples, n_outputs]
+     */
+    template <typename DTYPE>
+    Mat predict_sum(DataView<DTYPE> X,
+                    double bias,
+                    double weight,
+                    int n_threads=1) const;
+
+    /**
+     * @brief Leaf reached by sample i of X from a root
+     * @return The leaf index
+     */
+    template <typename DTYPE>
+    inline int _find_leaf(const DataView<DTYPE>& X,
+                          int i,
+                          int root) const
+    {
+        const DagNode* node = &_nodes[root];
+        while (node->left_child >= 0)
+            node = &_nodes[(X.at(i, node->feature) <= node->threshold) ? node->left_child
+                                                                        : node->right_child];
+        return ~node->left_child;
+    }
+
+    /**
+     * @brief Bytes held by the nodes and the leaf values
+     */
+    size_t memory_bytes() const;
+
+    int _n_outputs;                 // Size of a leaf value
+    vector<DagNode> _nodes;         // Children before their parents
+    vector<double> _leaf_values;    // Distinct leaf predictions, shape [n_leaves, n_outputs]
+    vector<int> _roots;             // Root node of every tree
+    long long _n_tree_nodes;        // Number of nodes of the trees added, before sharing
+};
+
+#endif // TREEDAG_H
@@ -1,4 +1,7 @@
 #include "util.h"
+#include <thread>
+#include <pthread.h>
+#include <sched.h>
 
 Mat_<double> compute_sample_weight(Mat_<double> class_weight,
                                    Mat_<double> y)
@@ -37,3 +40,111 @@ vector<double> unique(const Mat &input, bool sort)
 
     return out;
 }
+
+void to_target(Mat& input)
+{
+    if (input.total() == 0)
+        return;
+    if (input.depth() != CV_64F)
+        input.convertTo(input, CV_64F);
+    if (!input.isContinuous())
+        input = input.clone();
+    if (input.rows == 1 || input.cols == 1)
+        input = input.reshape(1, input.total());
+}
+
+Mat partial_dependence_grid(Mat X,
+                            const vector<int>& features,
+                            int grid_resolution)
+{
+    if (X.depth() != CV_64F)
+        X.convertTo(X, CV_64F);
+
+    vector<vector<double> > axes(features.size());
+    int n_grid = 1;
+    for (size_t c = 0; c < features.size(); c++)
+    {
+        vector<double> values(X.rows);
+        for (int i = 0; i < X.rows; i++)
+            values[i] = X.at<double>(i, features[c]);
+        std::sort(values.begin(), values.end());
+
+        vector<double> distinct;
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            if (distinct.empty() || values[i] != distinct.back())
+                distinct.push_back(values[i]);
+        }
+        if (static_cast<int>(distinct.size()) <= grid_resolution || grid_resolution < 2)
+            axes[c] = distinct;
+        else
+        {
+            double low = values[static_cast<size_t>(0.05 * (values.size() - 1))];
+            double high = values[static_cast<size_t>(0.95 * (values.size() - 1))];
+            for (int r = 0; r < grid_resolution; r++)
+                axes[c].push_back(low + (high - low) * r / (grid_resolution - 1));
+        }
+        n_grid *= static_cast<int>(axes[c].size());
+    }
+
+    Mat grid(n_grid, static_cast<int>(features.size()), CV_64F);
+    for (int g = 0; g < n_grid; g++)
+    {
+        int index = g;
+        for (int c = static_cast<int>(features.size()) - 1; c >= 0; c--)
+        {
+            int n_values = static_cast<int>(axes[c].size());
+            grid.at<double>(g, c) = axes[c][index % n_values];
+            index /= n_values;
+        }
+    }
+    return grid;
+}
+
+void parallel_for(int n,
+                  int n_threads,
+                  const std::function<void(int, int)>& body,
+                  NumaPlacement placement)
+{
+    if (n <= 0)
+        return;
+    if (n_threads <= 0)
+        n_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    n_threads = std::min(n_threads, n);
+    if (n_threads <= 1 && placement == NUMA_NONE)
+    {
+        body(0, n);
+        return;
+    }
+
+    // A chunk pins its thread before touching its data
+    int chunk = (n + n_threads - 1) / n_threads;
+    int n_chunks = (n + chunk - 1) / chunk;
+    auto pinned_body = [&](int t, int begin, int end) {
+        if (placement != NUMA_NONE)
+            pin_to_numa_node(numa_node_of(t, n_chunks, placement));
+        body(begin, end);
+    };
+
+    // The calling thread runs the last chunk
+    vector<std::thread> threads;
+    int begin = 0;
+    for (int t = 0; t < n_chunks - 1; t++)
+    {
+        int end = std::min(n, begin + chunk);
+        threads.push_back(std::thread(pinned_body, t, begin, end));
+        begin = end;
+    }
+    if (begin < n)
+    {
+        cpu_set_t affinity;
+        bool restore = (placement != NUMA_NONE &&
+                        pthread_getaffinity_np(pthread_self(), sizeof(affinity), &affinity) == 0);
+        pinned_body(n_chunks - 1, begin, n);
+        if (restore)
+            pthread_setaffinity_np(pthread_self(), sizeof(affinity), &affinity);
+    }
+
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+}
@@ -2,8 +2,11 @@
 #define UTIL_H
 
 #include <algorithm>
+#include <functional>
 #include <vector>
 #include <opencv2/opencv.hpp>
+#include "dataview.h"
+#include "numa.h"
 
 using std::vector;
 using cv::Mat;
@@ -25,6 +28,62 @@ Mat_<double> compute_sample_weight(Mat_<double> class_weight,
  */
 vector<double> unique(const Mat& input, bool sort=false);
 
+/**
+ * @brief Convert targets or sample weights in place to the layout the trees
+ * read: a continuous CV_64F Mat, a vector being reshaped to shape = [n, 1].
+ * @param input y or sample_weight, may be empty
+ */
+void to_target(Mat& input);
+
+/**
+ * @brief Grid of partial dependence: the cartesian product of the values of
+ * every target feature, the last feature varying fastest. A feature takes
+ * its distinct values when they are at most grid_resolution, else
+ * grid_resolution values evenly spaced between its 5th and 95th percentiles.
+ * @param X The input samples, shape = [n_samples, n_features]
+ * @param features Target features
+ * @param grid_resolution
+ * @return shape = [n_grid, n_target_features], CV_64F
+ */
+Mat partial_dependence_grid(Mat X,
+                            const vector<int>& features,
+                            int grid_resolution=100);
+
+/**
+ * @brief Wrap a single channel Mat as a DataView, without copying.
+ * The Mat must outlive the view.
+ * @param input Mat whose depth matches T
+ * @return The view, empty if input is empty
+ */
+template <typename T>
+DataView<T> as_view(const Mat& input)
+{
+    if (input.total() == 0)
+        return DataView<T>();
+
+    CV_Assert(input.depth() == cv::DataType<T>::depth && input.channels() == 1);
+    return DataView<T>(input.ptr<T>(0),
+                       input.rows,
+                       input.cols,
+                       static_cast<int>(input.step[0] / sizeof(T)),
+                       1);
+}
+
+/**
+ * @brief Run body(begin, end) over [0, n) split in contiguous chunks, one
+ * chunk per thread. Returns when every chunk is done.
+ * @param n Number of items
+ * @param n_threads Number of threads, 0 for the number of cores. 1 runs
+ * body(0, n) in the calling thread.
+ * @param body Must be safe to run concurrently on disjoint chunks
+ * @param placement Pin the thread of chunk t to numa_node_of(t, n_chunks).
+ * The calling thread gets its affinity back.
+ */
+void parallel_for(int n,
+                  int n_threads,
+                  const std::function<void(int, int)>& body,
+                  NumaPlacement placement=NUMA_NONE);
+
 template <typename T, typename Compare>
 std::vector<int> sort_permutation(
     std::vector<T> const& vec,